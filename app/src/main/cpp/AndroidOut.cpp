@@ -1,4 +1,24 @@
 #include "AndroidOut.h"
 
-AndroidOut androidOut("AO");
-std::ostream aout(&androidOut);
\ No newline at end of file
+#ifdef __ANDROID__
+#include <android/log.h>
+#else
+#include <cstdio>
+#endif
+
+thread_local AndroidOut androidOut("AO");
+thread_local std::ostream aout(&androidOut);
+
+void setLogTag(const char* logTag) {
+    androidOut.setLogTag(logTag);
+}
+
+int AndroidOut::sync() {
+#ifdef __ANDROID__
+    __android_log_print(ANDROID_LOG_DEBUG, logTag_, "%s", str().c_str());
+#else
+    fprintf(stderr, "%s: %s", logTag_, str().c_str());
+#endif
+    str("");
+    return 0;
+}
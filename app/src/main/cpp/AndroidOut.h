@@ -1,7 +1,6 @@
 #ifndef ANDROIDGLINVESTIGATIONS_ANDROIDOUT_H
 #define ANDROIDGLINVESTIGATIONS_ANDROIDOUT_H
 
-#include <android/log.h>
 #include <sstream>
 
 /*!
@@ -9,12 +8,21 @@
  *
  * ex:
  *  aout << "Hello World" << std::endl;
+ *
+ * Every thread has its own stream, lines logged by the workers and the upload thread are committed
+ * whole and never interleave.
  */
-extern std::ostream aout;
+extern thread_local std::ostream aout;
 
 /*!
- * Use this class to create an output stream that writes to logcat. By default, a global one is
- * defined as @a aout
+ * Tags the lines the calling thread logs through @a aout from now on, so the output of a helper
+ * thread can be told apart. @a logTag has to outlive the thread.
+ */
+void setLogTag(const char* logTag);
+
+/*!
+ * Use this class to create an output stream that writes to logcat. By default, one is defined per
+ * thread as @a aout
  */
 class AndroidOut: public std::stringbuf {
 public:
@@ -24,15 +32,14 @@ public:
      */
     inline AndroidOut(const char* kLogTag) : logTag_(kLogTag){}
 
+    inline void setLogTag(const char* logTag) { logTag_ = logTag; }
+
 protected:
-    virtual int sync() override {
-        __android_log_print(ANDROID_LOG_DEBUG, logTag_, "%s", str().c_str());
-        str("");
-        return 0;
-    }
+    // one log call per committed line, off Android the line goes to stderr
+    int sync() override;
 
 private:
     const char* logTag_;
 };
 
-#endif //ANDROIDGLINVESTIGATIONS_ANDROIDOUT_H
\ No newline at end of file
+#endif //ANDROIDGLINVESTIGATIONS_ANDROIDOUT_H
@@ -2,6 +2,7 @@
 
 #include <game-activity/native_app_glue/android_native_app_glue.h>
 #include <GLES3/gl3.h>
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <android/imagedecoder.h>
@@ -20,6 +21,8 @@
 #include "mesh/primitives/Sphere.h"
 #include "light/PointLight.h"
 #include "light/SpotLight.h"
+#include "gpu/GpuResourceRegistry.h"
+#include "mesh/Material.h"
 
 //! executes glGetString and outputs the result to logcat
 #define PRINT_GL_STRING(s) {aout << #s": "<< glGetString(s) << std::endl;}
@@ -53,6 +56,19 @@ aout << std::endl;\
 
 
 Renderer::~Renderer() {
+    // GL objects have to go while the context is still current, anything left in the registry
+    // afterwards was leaked
+    uploadThread_.reset();
+    if (scene_) {
+        scene_->onDestroy();
+        scene_.reset();
+    }
+    geometryArena_.reset();
+    samplerCache_.reset();
+    shaderLoader_.reset();
+    jobSystem_.reset();
+    GpuResourceRegistry::instance().reportLeaks();
+
     if (display_ != EGL_NO_DISPLAY) {
         eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
         if (context_ != EGL_NO_CONTEXT) {
@@ -63,10 +79,13 @@ Renderer::~Renderer() {
             eglDestroySurface(display_, surface_);
             surface_ = EGL_NO_SURFACE;
         }
+        if (pbufferSurface_ != EGL_NO_SURFACE) {
+            eglDestroySurface(display_, pbufferSurface_);
+            pbufferSurface_ = EGL_NO_SURFACE;
+        }
         eglTerminate(display_);
         display_ = EGL_NO_DISPLAY;
     }
-    scene_->onDestroy();
 
 }
 
@@ -76,26 +95,33 @@ void Renderer::render() {
     // changed.
     updateRenderArea();
 
-    // Clear the screen and depth buffer
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // hand finished uploads over to the render thread
+    if (uploadThread_) {
+        uploadThread_->poll();
+    }
 
+    // draws the last update and starts the next one, it runs while this frame is swapped. The
+    // scene clears the window itself, after its offscreen passes.
     scene_->render();
 
     GLenum err;
     CHECK_GL_ERROR();
 
-    scene_->update();
-
     auto swapResult = eglSwapBuffers(display_, surface_);
-    assert(swapResult == EGL_TRUE);
+    if (swapResult != EGL_TRUE && eglGetError() == EGL_CONTEXT_LOST) {
+        recreateContext();
+    }
+
+    GpuResourceRegistry::instance().nextFrame();
 }
 
 void Renderer::initRenderer() {
 
-    // Choose your render attributes
+    // Choose your render attributes, the pbuffer bit lets the context stay current while there is
+    // no window
     constexpr EGLint attribs[] = {
             EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
-            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            EGL_SURFACE_TYPE, EGL_WINDOW_BIT | EGL_PBUFFER_BIT,
             EGL_BLUE_SIZE, 8,
             EGL_GREEN_SIZE, 8,
             EGL_RED_SIZE, 8,
@@ -138,28 +164,11 @@ void Renderer::initRenderer() {
     aout << "Found " << numConfigs << " configs" << std::endl;
     aout << "Chose " << config << std::endl;
 
-    // create the proper window surface
-    EGLint format;
-    eglGetConfigAttrib(display, config, EGL_NATIVE_VISUAL_ID, &format);
-    EGLSurface surface = eglCreateWindowSurface(display, config, app_->window, nullptr);
-
-
-    // Create a GLES 3 context
-    EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
-    EGLContext context = eglCreateContext(display, config, nullptr, contextAttribs);
-    auto versionDetails = glGetString(GL_SHADING_LANGUAGE_VERSION);
-    // aout << "VERSION " << *versionDetails << std::endl;
-    // get some window metrics
-    auto madeCurrent = eglMakeCurrent(display, surface, surface, context);
-    assert(madeCurrent);
-
     display_ = display;
-    surface_ = surface;
-    context_ = context;
+    config_ = config;
 
-    // make width and height invalid so it gets updated the first frame in @a updateRenderArea()
-    width_ = -1;
-    height_ = -1;
+    createContext();
+    onSurfaceCreated();
 
     PRINT_GL_STRING(GL_VENDOR);
     PRINT_GL_STRING(GL_RENDERER);
@@ -167,6 +176,36 @@ void Renderer::initRenderer() {
     PRINT_GL_STRING(GL_SHADING_LANGUAGE_VERSION);
     PRINT_GL_STRING_AS_LIST(GL_EXTENSIONS);
 
+    // import, decode and transform work is spread over the other cores
+    jobSystem_ = std::make_shared<JobSystem>();
+    shaderLoader_ = std::make_shared<ShaderLoader>();
+    samplerCache_ = std::make_shared<SamplerCache>();
+    geometryArena_ = std::make_shared<GeometryArena>();
+    meshCache_ = std::make_shared<MeshCache>(
+            std::string(app_->activity->internalDataPath) + "/mesh_cache");
+}
+
+void Renderer::createContext() {
+    // Create a GLES 3 context
+    EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    context_ = eglCreateContext(display_, config_, nullptr, contextAttribs);
+
+    // a tiny offscreen surface keeps the context current between windows
+    EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    pbufferSurface_ = eglCreatePbufferSurface(display_, config_, pbufferAttribs);
+    auto madeCurrent = eglMakeCurrent(display_, pbufferSurface_, pbufferSurface_, context_);
+    assert(madeCurrent);
+
+    initGlState();
+
+    // big buffer and texture uploads go through a second context sharing this one
+    uploadThread_ = std::make_shared<UploadThread>(display_, config_, context_);
+    if (!uploadThread_->isValid()) {
+        uploadThread_.reset();
+    }
+}
+
+void Renderer::initGlState() {
     glEnable(GL_CULL_FACE);
     glCullFace(GL_FRONT);
     glEnable(GL_DEPTH_TEST);
@@ -174,13 +213,70 @@ void Renderer::initRenderer() {
     // setup any other gl related global states
     glClearColor(DARK_GRAY);
 
-    // enable alpha globally for now, you probably don't want to do this in a game
-    glEnable(GL_BLEND);
+    // blending is only enabled for the blended queue, opaque meshes write their color as is
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
 
+void Renderer::onSurfaceCreated() {
+    // create the proper window surface
+    surface_ = eglCreateWindowSurface(display_, config_, app_->window, nullptr);
+    if (eglMakeCurrent(display_, surface_, surface_, context_) != EGL_TRUE) {
+        if (eglGetError() != EGL_CONTEXT_LOST) {
+            aout << "Unable to make the window surface current" << std::endl;
+            return;
+        }
+        recreateContext();
+        eglMakeCurrent(display_, surface_, surface_, context_);
+    }
 
+    // make width and height invalid so it gets updated the first frame in @a updateRenderArea()
+    width_ = -1;
+    height_ = -1;
+}
 
-    shaderLoader_ = std::make_shared<ShaderLoader>();
+void Renderer::onSurfaceDestroyed() {
+    // the context and everything in it survives, only the window goes away
+    eglMakeCurrent(display_, pbufferSurface_, pbufferSurface_, context_);
+    if (surface_ != EGL_NO_SURFACE) {
+        eglDestroySurface(display_, surface_);
+        surface_ = EGL_NO_SURFACE;
+    }
+}
+
+void Renderer::recreateContext() {
+    auto start = std::chrono::steady_clock::now();
+    aout << "GL context lost, rebuilding GPU objects" << std::endl;
+
+    // pending uploads went down with the old context, the restore below uploads everything again
+    uploadThread_.reset();
+    GpuResourceRegistry::instance().contextLost();
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroySurface(display_, pbufferSurface_);
+    eglDestroyContext(display_, context_);
+    createContext();
+    if (surface_ != EGL_NO_SURFACE) {
+        eglMakeCurrent(display_, surface_, surface_, context_);
+    }
+
+    // only GL objects are rebuilt, scene data comes from memory, the assets and the mesh cache
+    Shader::resetBindings();
+    if (shaderLoader_) {
+        shaderLoader_->restore();
+    }
+    if (samplerCache_) {
+        samplerCache_->restore();
+    }
+    if (geometryArena_) {
+        geometryArena_->restore();
+    }
+    Material::resetBindings();
+    if (scene_) {
+        scene_->onContextRestored();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+    aout << "GL context restored in " << elapsed.count() << " ms" << std::endl;
 }
 
 void Renderer::updateRenderArea() {
@@ -217,7 +313,10 @@ void Renderer::createModels() {
 
     importer->SetIOHandler(ioSystem);
 
-    std::shared_ptr<ModelImporter> modelImporter = std::make_shared<ModelImporter>(assetManager, shaderLoader_.get());
+    std::shared_ptr<ModelImporter> modelImporter = std::make_shared<ModelImporter>(
+            assetManager, shaderLoader_.get(), samplerCache_.get());
+    // geometry lives in GL buffers, the CPU copy can be read back from the mesh cache
+    modelImporter->setMeshResidency(MeshResidency::DISCARD, meshCache_.get());
     //Load one model
     std::shared_ptr<MeshRenderer> environment = modelImporter->import(importer,
                                                                       "megatron__transformers_dotm/scene.gltf");
@@ -228,6 +327,10 @@ void Renderer::createModels() {
 
     scene_->addObject(environment);
 
+    // the lights' flat ambient stays until an environment.hdr is added to the assets
+    scene_->loadEnvironment(assetManager, "environment.hdr",
+                            std::string(app_->activity->internalDataPath) + "/environment_cache");
+
     std::shared_ptr<DirectionalLight> light = std::make_shared<DirectionalLight>();
     light->ambientIntensity = 0.8f;
     light->direction  = { 4, 2, 6};
@@ -235,22 +338,23 @@ void Renderer::createModels() {
     light->color = {1, 1, 1, 1};
 
    /* std::shared_ptr<PointLight> light = std::make_shared<PointLight>();
-    light->transform->position = { 2, 0, 12};
+    light->transform->setPosition(2, 0, 12);
     light->color = {0.8, 0.2, 0.2, 1.0};
     light->attenuation.constant = 0.9;
     light->attenuation.linear = 0.01;
     light->attenuation.exp = 0.0;
    // light->cutOff = 20.0;
-    //light->transform->position = {0.0, 0.0, 0.0};
-    //light->direction = {0.0, 2.0, 0.0};
-    shaderLoader_->setNumOfLights(1);*/
+    //light->transform->setPosition(0.0, 0.0, 0.0);
+    //light->direction = {0.0, 2.0, 0.0};*/
 
     scene_->addObject(light);
 
     scene_->getMainCamera()->setPosition(0, 4, 0);
-    glm::vec3 target = environment->transform->position;
+    glm::vec3 target = environment->transform->getPosition();
     target.y = 3;
     scene_->getMainCamera()->setTarget(target);
+
+    GpuResourceRegistry::instance().dump();
 }
 
 void Renderer::handleInput() {
@@ -260,6 +364,10 @@ void Renderer::handleInput() {
         // no inputs yet.
         return;
     }
+    // the camera is read by the update running on a worker
+    if (scene_) {
+        scene_->waitForUpdate();
+    }
 
     // handle motion events (motionEventsCounts can be 0).
     for (auto i = 0; i < inputBuffer->motionEventsCount; i++) {
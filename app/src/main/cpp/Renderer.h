@@ -10,6 +10,11 @@
 #include "camera/Camera.h"
 #include "shader/Shader.h"
 #include "core/Scene.h"
+#include "texture/SamplerCache.h"
+#include "mesh/MeshCache.h"
+#include "mesh/GeometryArena.h"
+#include "gpu/UploadThread.h"
+#include "core/JobSystem.h"
 
 struct android_app;
 
@@ -23,7 +28,9 @@ public:
             app_(pApp),
             display_(EGL_NO_DISPLAY),
             surface_(EGL_NO_SURFACE),
+            pbufferSurface_(EGL_NO_SURFACE),
             context_(EGL_NO_CONTEXT),
+            config_(nullptr),
             width_(0),
             height_(0),
             scene_(),
@@ -47,6 +54,22 @@ public:
     void render();
     void initScene();
 
+    /*!
+     * Attaches the renderer to the new window of the android_app. The GL context and the scene are
+     * kept from before, if the context was lost meanwhile only the GL objects are rebuilt.
+     */
+    void onSurfaceCreated();
+
+    /*!
+     * Detaches from the window that is about to be destroyed, the context stays alive
+     */
+    void onSurfaceDestroyed();
+
+    /*!
+     * @return true while there is a window to render into
+     */
+    bool hasSurface() const { return surface_ != EGL_NO_SURFACE; }
+
 private:
     /*!
      * Performs necessary OpenGL initialization. Customize this if you want to change your EGL
@@ -54,6 +77,23 @@ private:
      */
     void initRenderer();
 
+    /*!
+     * Creates the GL context and the offscreen surface it is current on without a window, plus the
+     * upload thread sharing it
+     */
+    void createContext();
+
+    /*!
+     * Sets the global GL state, needed again for every new context
+     */
+    void initGlState();
+
+    /*!
+     * Replaces a lost context and rebuilds every GL object from the data kept on the CPU side or
+     * in the caches, without running the importer again
+     */
+    void recreateContext();
+
     /*!
      * @brief we have to check every frame to see if the framebuffer has changed in size. If it has,
      * update the viewport accordingly
@@ -69,7 +109,9 @@ private:
     android_app *app_;
     EGLDisplay display_;
     EGLSurface surface_;
+    EGLSurface pbufferSurface_;
     EGLContext context_;
+    EGLConfig config_;
     EGLint width_;
     EGLint height_;
     float rotation = 0;
@@ -86,6 +128,11 @@ private:
 
     std::shared_ptr<Scene> scene_;
     std::shared_ptr<ShaderLoader> shaderLoader_;
+    std::shared_ptr<SamplerCache> samplerCache_;
+    std::shared_ptr<MeshCache> meshCache_;
+    std::shared_ptr<GeometryArena> geometryArena_;
+    std::shared_ptr<UploadThread> uploadThread_;
+    std::shared_ptr<JobSystem> jobSystem_;
 
 };
 
@@ -2,23 +2,294 @@
 #include "TextureAsset.h"
 #include "AndroidOut.h"
 #include "Utility.h"
+#include "gpu/UploadThread.h"
+#include <algorithm>
+#include <cmath>
+
+TextureSource TextureSource::fromAsset(const std::string &assetPath) {
+    TextureSource source;
+    source.name = assetPath;
+    return source;
+}
+
+TextureSource TextureSource::fromMemory(const std::string &name, const void *data, size_t size) {
+    TextureSource source;
+    source.name = name;
+    source.data = data;
+    source.size = size;
+    return source;
+}
+
+TextureSource TextureSource::fromRawTexels(const std::string &name, const void *texels,
+                                           int32_t width, int32_t height) {
+    TextureSource source;
+    source.name = name;
+    source.data = texels;
+    source.size = (size_t) width * height * 4;
+    source.rawWidth = width;
+    source.rawHeight = height;
+    return source;
+}
+
+TextureSource TextureSource::retain() const {
+    if (!isEmbedded() || ownedData) {
+        return *this;
+    }
+    TextureSource retained = *this;
+    auto bytes = static_cast<const uint8_t *>(data);
+    retained.ownedData = std::make_shared<const std::vector<uint8_t>>(bytes, bytes + size);
+    retained.data = retained.ownedData->data();
+    return retained;
+}
+
+std::shared_ptr<TextureAsset>
+TextureAsset::loadAsset(AAssetManager *assetManager, const TextureSource &source,
+                        TextureSemantic semantic) {
+    aout << "LoadAsset :" << source.name << std::endl;
+
+    TextureImage image;
+    if (!decode(assetManager, source, image, channelCount(semantic))) {
+        // a missing file or a format the decoder can't read, the material goes without it
+        aout << "Unable to decode texture " << source.name << std::endl;
+        return nullptr;
+    }
+
+    auto texture = upload(std::move(image));
+    texture->setRestore([assetManager, retained = source.retain(), semantic]() {
+        return loadAsset(assetManager, retained, semantic);
+    });
+    return texture;
+}
 
 std::shared_ptr<TextureAsset>
-TextureAsset::loadAsset(AAssetManager *assetManager, const std::string &assetPath,  GLint format = GL_RGBA) {
-    aout << "LoadAsset :" << assetPath << std::endl;
-    // Get the image from asset manager
-    auto pAndroidRobotPng = AAssetManager_open(
+TextureAsset::loadOcclusionRoughnessMetallic(AAssetManager *assetManager,
+                                             const TextureSource &occlusion,
+                                             const TextureSource &roughnessMetallic) {
+    auto texture = packOcclusionRoughnessMetallic(assetManager, occlusion, roughnessMetallic);
+    if (texture) {
+        texture->setRestore([assetManager, retainedOcclusion = occlusion.retain(),
+                                    retainedRoughnessMetallic = roughnessMetallic.retain()]() {
+            return packOcclusionRoughnessMetallic(assetManager, retainedOcclusion,
+                                                  retainedRoughnessMetallic);
+        });
+    }
+    return texture;
+}
+
+std::shared_ptr<TextureAsset>
+TextureAsset::packOcclusionRoughnessMetallic(AAssetManager *assetManager,
+                                             const TextureSource &occlusion,
+                                             const TextureSource &roughnessMetallic) {
+    aout << "LoadAsset ORM :" << occlusion.name << " + " << roughnessMetallic.name << std::endl;
+
+    // glTF already stores roughness in green and metallic in blue, so when occlusion lives in the
+    // same file (the common "ORM" export) a single RGB decode is all we need
+    TextureImage image;
+    if (roughnessMetallic.isValid() && decode(assetManager, roughnessMetallic, image, 3)) {
+        if (occlusion.name != roughnessMetallic.name) {
+            TextureImage occlusionImage;
+            bool hasOcclusion = occlusion.isValid()
+                                && decode(assetManager, occlusion, occlusionImage, 1)
+                                && occlusionImage.width == image.width
+                                && occlusionImage.height == image.height;
+            size_t pixelCount = (size_t) image.width * image.height;
+            for (size_t i = 0; i < pixelCount; ++i) {
+                image.pixels[i * 3] = hasOcclusion ? occlusionImage.pixels[i] : 255;
+            }
+        }
+        return upload(std::move(image));
+    }
+
+    TextureImage occlusionImage;
+    if (!occlusion.isValid() || !decode(assetManager, occlusion, occlusionImage, 1)) {
+        return nullptr;
+    }
+    size_t pixelCount = (size_t) occlusionImage.width * occlusionImage.height;
+    image.width = occlusionImage.width;
+    image.height = occlusionImage.height;
+    image.channels = 3;
+    image.pixels.assign(pixelCount * 3, 255);
+    for (size_t i = 0; i < pixelCount; ++i) {
+        image.pixels[i * 3] = occlusionImage.pixels[i];
+    }
+    return upload(std::move(image));
+}
+
+std::shared_ptr<TextureAsset> TextureAsset::upload(TextureImage image) {
+    GLenum internalFormat = GL_RGBA8;
+    GLenum format = GL_RGBA;
+    switch (image.channels) {
+        case 1:
+            internalFormat = GL_R8;
+            format = GL_RED;
+            break;
+        case 2:
+            internalFormat = GL_RG8;
+            format = GL_RG;
+            break;
+        case 3:
+            internalFormat = GL_RGB8;
+            format = GL_RGB;
+            break;
+        default:
+            break;
+    }
+    auto levels = (GLsizei) std::floor(std::log2((float) std::max(image.width, image.height))) + 1;
+
+    // Get an opengl texture, the name is shared with the upload context
+    GLuint textureId;
+    glGenTextures(1, &textureId);
+
+    // Create a shared pointer so it can be cleaned up easily/automatically
+    auto texture = wrap(textureId, GL_TEXTURE_2D,
+                        storageSize(image.width, image.height, image.channels));
+
+    UploadThread::submit([textureId, internalFormat, format, levels, image = std::move(image)]() {
+        glBindTexture(GL_TEXTURE_2D, textureId);
+
+        // Wrap and filter modes are not set here, they come from the sampler bound by the material
+
+        // Rows of 1 to 3 channel images are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // Load the texture into VRAM, immutable storage lets the driver skip completeness checks
+        glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, image.width, image.height);
+        glTexSubImage2D(
+                GL_TEXTURE_2D, // target
+                0, // mip level
+                0, 0, // offset
+                image.width, // width of the texture
+                image.height, // height of the texture
+                format, // format, matches the decoded channel layout
+                GL_UNSIGNED_BYTE, // type
+                image.pixels.data() // Data to upload
+        );
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // generate mip levels. Not really needed for 2D, but good to do
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }, texture->beginUpload());
+    return texture;
+}
+
+std::function<void()> TextureAsset::beginUpload() {
+    *ready_ = false;
+    return [ready = ready_]() { *ready = true; };
+}
+
+int32_t TextureAsset::channelCount(TextureSemantic semantic) {
+    switch (semantic) {
+        case TextureSemantic::NORMAL:
+            return 2;
+        case TextureSemantic::MASK:
+            return 1;
+        case TextureSemantic::OCCLUSION_ROUGHNESS_METALLIC:
+            return 3;
+        case TextureSemantic::COLOR:
+        default:
+            return 4;
+    }
+}
+
+bool TextureAsset::readSize(AAssetManager *assetManager, const TextureSource &source,
+                            int32_t &width, int32_t &height) {
+    if (source.rawWidth > 0) {
+        width = source.rawWidth;
+        height = source.rawHeight;
+        return true;
+    }
+
+    AAsset *pAsset = nullptr;
+    AImageDecoder *pAndroidDecoder = nullptr;
+    int result;
+    if (source.isEmbedded()) {
+        result = AImageDecoder_createFromBuffer(source.data, source.size, &pAndroidDecoder);
+    } else {
+        pAsset = AAssetManager_open(assetManager, source.name.c_str(), AASSET_MODE_STREAMING);
+        if (!pAsset) {
+            return false;
+        }
+        result = AImageDecoder_createFromAAsset(pAsset, &pAndroidDecoder);
+    }
+
+    if (result == ANDROID_IMAGE_DECODER_SUCCESS) {
+        const AImageDecoderHeaderInfo *pAndroidHeader = AImageDecoder_getHeaderInfo(pAndroidDecoder);
+        width = AImageDecoderHeaderInfo_getWidth(pAndroidHeader);
+        height = AImageDecoderHeaderInfo_getHeight(pAndroidHeader);
+        AImageDecoder_delete(pAndroidDecoder);
+    }
+    if (pAsset) {
+        AAsset_close(pAsset);
+    }
+    return result == ANDROID_IMAGE_DECODER_SUCCESS;
+}
+
+bool TextureAsset::decode(AAssetManager *assetManager, const TextureSource &source,
+                          TextureImage &outImage, int32_t channels) {
+    if (source.rawWidth > 0) {
+        copyRawTexels(source, outImage, channels);
+        return true;
+    }
+
+    if (source.isEmbedded()) {
+        // Compressed images embedded in the model are decoded right out of the importer's buffer
+        AImageDecoder *pAndroidDecoder = nullptr;
+        auto result = AImageDecoder_createFromBuffer(source.data, source.size, &pAndroidDecoder);
+        if (result != ANDROID_IMAGE_DECODER_SUCCESS) {
+            aout << "Unable to create a decoder for " << source.name << std::endl;
+            return false;
+        }
+        auto decoded = decodeWithDecoder(pAndroidDecoder, outImage, channels);
+        AImageDecoder_delete(pAndroidDecoder);
+        if (!decoded) {
+            aout << "Unable to decode " << source.name << std::endl;
+        }
+        return decoded;
+    }
+
+    // Get the image from asset manager, buffer mode maps uncompressed assets instead of copying
+    auto pAsset = AAssetManager_open(
             assetManager,
-            assetPath.c_str(),
+            source.name.c_str(),
             AASSET_MODE_BUFFER);
+    if (!pAsset) {
+        aout << "Texture asset not found : " << source.name << std::endl;
+        return false;
+    }
 
     // Make a decoder to turn it into a texture
     AImageDecoder *pAndroidDecoder = nullptr;
-    auto result = AImageDecoder_createFromAAsset(pAndroidRobotPng, &pAndroidDecoder);
-    assert(result == ANDROID_IMAGE_DECODER_SUCCESS);
+    auto result = AImageDecoder_createFromAAsset(pAsset, &pAndroidDecoder);
+    if (result != ANDROID_IMAGE_DECODER_SUCCESS) {
+        aout << "Unable to create a decoder for " << source.name << std::endl;
+        AAsset_close(pAsset);
+        return false;
+    }
+
+    auto decoded = decodeWithDecoder(pAndroidDecoder, outImage, channels);
+
+    // cleanup helpers
+    AImageDecoder_delete(pAndroidDecoder);
+    AAsset_close(pAsset);
 
-    // make sure we get 8 bits per channel out. RGBA order.
-    AImageDecoder_setAndroidBitmapFormat(pAndroidDecoder, ANDROID_BITMAP_FORMAT_RGBA_8888);
+    if (!decoded) {
+        aout << "Unable to decode " << source.name << std::endl;
+    }
+    return decoded;
+}
+
+bool TextureAsset::decodeWithDecoder(AImageDecoder *pAndroidDecoder, TextureImage &outImage,
+                                     int32_t channels) {
+    // grayscale sources decode straight to one byte per pixel, everything else gets 8 bits per
+    // channel in RGBA order and is compacted below
+    bool decodesToAlpha8 = channels == 1
+                           && AImageDecoder_setAndroidBitmapFormat(pAndroidDecoder,
+                                                                   ANDROID_BITMAP_FORMAT_A_8)
+                              == ANDROID_IMAGE_DECODER_SUCCESS;
+    if (!decodesToAlpha8) {
+        AImageDecoder_setAndroidBitmapFormat(pAndroidDecoder, ANDROID_BITMAP_FORMAT_RGBA_8888);
+    }
 
     // Get the image header, to help set everything up
     const AImageDecoderHeaderInfo *pAndroidHeader = nullptr;
@@ -30,54 +301,113 @@ TextureAsset::loadAsset(AAssetManager *assetManager, const std::string &assetPat
     auto stride = AImageDecoder_getMinimumStride(pAndroidDecoder);
 
     // Get the bitmap data of the image
-    auto upAndroidImageData = std::make_unique<std::vector<uint8_t>>(height * stride);
+    std::vector<uint8_t> pixels(height * stride);
     auto decodeResult = AImageDecoder_decodeImage(
             pAndroidDecoder,
-            upAndroidImageData->data(),
+            pixels.data(),
             stride,
-            upAndroidImageData->size());
-    assert(decodeResult == ANDROID_IMAGE_DECODER_SUCCESS);
+            pixels.size());
+    if (decodeResult != ANDROID_IMAGE_DECODER_SUCCESS) {
+        return false;
+    }
 
-    // Get an opengl texture
-    GLuint textureId;
-    glGenTextures(1, &textureId);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-
-    // Clamp to the edge, you'll get odd results alpha blending if you don't
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // Load the texture into VRAM
-    glTexImage2D(
-            GL_TEXTURE_2D, // target
-            0, // mip level
-            format, // internal format, often advisable to use BGR
-            width, // width of the texture
-            height, // height of the texture
-            0, // border (always 0)
-            format, // format
-            GL_UNSIGNED_BYTE, // type
-            upAndroidImageData->data() // Data to upload
-    );
-
-    // generate mip levels. Not really needed for 2D, but good to do
-    glGenerateMipmap(GL_TEXTURE_2D);
+    auto decodedChannels = decodesToAlpha8 ? 1 : 4;
+    auto rowBytes = (size_t) width * decodedChannels;
+    if (decodedChannels != channels || stride != rowBytes) {
+        // keep the first channels of every pixel, writing never overtakes reading so this is safe
+        // to do in place
+        size_t out = 0;
+        for (int32_t y = 0; y < height; ++y) {
+            const uint8_t *row = pixels.data() + y * stride;
+            for (int32_t x = 0; x < width; ++x) {
+                for (int32_t c = 0; c < channels; ++c) {
+                    pixels[out++] = row[x * decodedChannels + c];
+                }
+            }
+        }
+        pixels.resize(out);
+        pixels.shrink_to_fit();
+    }
 
-    // cleanup helpers
-    AImageDecoder_delete(pAndroidDecoder);
-    AAsset_close(pAndroidRobotPng);
+    outImage.width = width;
+    outImage.height = height;
+    outImage.channels = channels;
+    outImage.pixels = std::move(pixels);
+    return true;
+}
 
-    // Create a shared pointer so it can be cleaned up easily/automatically
-    return std::shared_ptr<TextureAsset>(new TextureAsset(textureId));
+void TextureAsset::copyRawTexels(const TextureSource &source, TextureImage &outImage,
+                                 int32_t channels) {
+    // Assimp stores uncompressed embedded textures as BGRA texels
+    static constexpr int kRgbaFromBgra[4] = {2, 1, 0, 3};
+    auto texels = static_cast<const uint8_t *>(source.data);
+    size_t pixelCount = (size_t) source.rawWidth * source.rawHeight;
+
+    outImage.width = source.rawWidth;
+    outImage.height = source.rawHeight;
+    outImage.channels = channels;
+    outImage.pixels.resize(pixelCount * channels);
+    for (size_t i = 0; i < pixelCount; ++i) {
+        for (int32_t c = 0; c < channels; ++c) {
+            outImage.pixels[i * channels + c] = texels[i * 4 + kRgbaFromBgra[c]];
+        }
+    }
+}
+
+std::shared_ptr<TextureAsset>
+TextureAsset::wrap(GLuint textureId, GLenum target, size_t bytes) {
+    auto texture = std::shared_ptr<TextureAsset>(new TextureAsset(textureId, target));
+    texture->storage_ = GpuResource(GpuResourceType::TEXTURE, textureId, bytes);
+    return texture;
+}
+
+size_t TextureAsset::storageSize(int32_t width, int32_t height, int32_t channels, int32_t layers) {
+    // the mip chain adds a third on top of the base level
+    return (size_t) width * height * channels * layers * 4 / 3;
+}
+
+std::shared_ptr<TextureAsset>
+TextureAsset::createLayer(const std::shared_ptr<TextureAsset> &textureArray, GLint layer) {
+    return std::shared_ptr<TextureAsset>(
+            new TextureAsset(textureArray->getTextureID(), GL_TEXTURE_2D_ARRAY, layer,
+                             textureArray));
+}
+
+void TextureAsset::setRestore(std::function<std::shared_ptr<TextureAsset>()> recreate) {
+    recreate_ = std::move(recreate);
+}
+
+bool TextureAsset::restore() {
+    if (owner_) {
+        return owner_->restore();
+    }
+    if (storage_.isCurrent()) {
+        return true;
+    }
+    auto fresh = recreate_ ? recreate_() : nullptr;
+    if (!fresh) {
+        aout << "Texture " << textureID_ << " can't be restored" << std::endl;
+        return false;
+    }
+    // take over the new GL texture, the fresh asset is left empty
+    textureID_ = fresh->textureID_;
+    storage_ = std::move(fresh->storage_);
+    ready_ = fresh->ready_;
+    return true;
+}
+
+void TextureAsset::markUsed() const {
+    if (owner_) {
+        owner_->markUsed();
+    } else {
+        storage_.markUsed();
+    }
 }
 
 TextureAsset::~TextureAsset() {
-    // return texture resources
-    glDeleteTextures(1, &textureID_);
+    // texture resources are returned by storage_, layer views leave that to the array they point
+    // into
     textureID_ = 0;
 
     aout << "Texture is destroying";
-}
\ No newline at end of file
+}
@@ -1,35 +1,228 @@
 #ifndef ANDROIDGLINVESTIGATIONS_TEXTUREASSET_H
 #define ANDROIDGLINVESTIGATIONS_TEXTUREASSET_H
 
+#include <functional>
 #include <memory>
 #include <android/asset_manager.h>
 #include <GLES3/gl3.h>
 #include <string>
 #include <vector>
+#include "gpu/GpuResourceRegistry.h"
+
+struct AImageDecoder;
+
+/*!
+ * What a texture is sampled for. Decides how many channels are decoded and the GL format the
+ * texture is stored in.
+ */
+enum class TextureSemantic {
+    // base color / diffuse, RGBA8
+    COLOR,
+    // tangent space normal map, only x and y are stored (RG8), z is rebuilt in the shader
+    NORMAL,
+    // single channel maps like the specular exponent, R8
+    MASK,
+    // occlusion in red, roughness in green and metallic in blue, RGB8
+    OCCLUSION_ROUGHNESS_METALLIC
+};
+
+/*!
+ * CPU side copy of a decoded image, tightly packed rows of @a channels bytes per pixel.
+ */
+struct TextureImage {
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t channels = 4;
+    std::vector<uint8_t> pixels;
+};
+
+/*!
+ * Where the encoded image of a texture lives. Either a file in the assets/ directory or a blob
+ * embedded in the model file (GLB, data uris). Embedded data is not owned or copied, it is decoded
+ * straight from the importer's buffer, so it has to stay alive until decoding finished.
+ */
+struct TextureSource {
+    // asset path, or a unique name for embedded textures, used as the cache key
+    std::string name;
+    // encoded (png, jpeg, webp) bytes, or raw BGRA8888 texels when rawWidth is set
+    const void *data = nullptr;
+    size_t size = 0;
+    int32_t rawWidth = 0;
+    int32_t rawHeight = 0;
+
+    static TextureSource fromAsset(const std::string &assetPath);
+
+    static TextureSource fromMemory(const std::string &name, const void *data, size_t size);
+
+    static TextureSource
+    fromRawTexels(const std::string &name, const void *texels, int32_t width, int32_t height);
+
+    // keeps embedded data alive for sources returned by retain()
+    std::shared_ptr<const std::vector<uint8_t>> ownedData;
+
+    bool isValid() const { return !name.empty(); }
+
+    bool isEmbedded() const { return data != nullptr; }
+
+    /*!
+     * @return a copy of this source that owns its embedded data, so it can be decoded again after
+     * the importer released the model
+     */
+    TextureSource retain() const;
+};
 
 class TextureAsset {
 public:
     /*!
-     * Loads a texture asset from the assets/ directory
+     * Loads a texture from the assets/ directory or from memory embedded in a model
      * @param assetManager Asset manager to use
-     * @param assetPath The path to the asset
-     * @return a shared pointer to a texture asset, resources will be reclaimed when it's cleaned up
+     * @param source The asset path or embedded image to load
+     * @param semantic what the texture is used for, selects the channel layout
+     * @return a shared pointer to a texture asset, resources will be reclaimed when it's cleaned up.
+     * nullptr if the image could not be decoded.
+     */
+    static std::shared_ptr<TextureAsset>
+    loadAsset(AAssetManager *assetManager, const TextureSource &source,
+              TextureSemantic semantic = TextureSemantic::COLOR);
+
+    /*!
+     * Packs the glTF occlusion map and metallic-roughness map into one RGB texture. Either source
+     * may be invalid, missing channels are filled with 1 so the material factors apply unchanged.
+     * @return nullptr if neither map could be decoded
+     */
+    static std::shared_ptr<TextureAsset>
+    loadOcclusionRoughnessMetallic(AAssetManager *assetManager, const TextureSource &occlusion,
+                                   const TextureSource &roughnessMetallic);
+
+    /*!
+     * Uploads a decoded image with a sized format matching its channel count and builds the mip
+     * chain. The upload runs on the UploadThread when there is one, the texture reports isReady()
+     * once the GPU has it.
+     */
+    static std::shared_ptr<TextureAsset> upload(TextureImage image);
+
+    /*!
+     * @return number of channels stored for @a semantic
+     */
+    static int32_t channelCount(TextureSemantic semantic);
+
+    /*!
+     * Reads only the image header of a texture, without decoding any pixels
+     * @return true if the image could be opened and its size was read
+     */
+    static bool
+    readSize(AAssetManager *assetManager, const TextureSource &source, int32_t &width,
+             int32_t &height);
+
+    /*!
+     * Decodes a texture straight into @a channels bytes per pixel. Single channel images are
+     * decoded as A_8 when the source is grayscale, everything else is decoded as RGBA8888 and
+     * compacted in place, so no second buffer is allocated.
+     * @return true on success, @a outImage is left untouched on failure
+     */
+    static bool
+    decode(AAssetManager *assetManager, const TextureSource &source, TextureImage &outImage,
+           int32_t channels = 4);
+
+    /*!
+     * Wraps an already created GL texture. The texture is deleted when the asset is destroyed.
+     * @param bytes estimated size of the texture storage, reported to the GpuResourceRegistry
+     */
+    static std::shared_ptr<TextureAsset> wrap(GLuint textureId, GLenum target, size_t bytes);
+
+    /*!
+     * Sets how the texture is rebuilt after the GL context was lost, @a recreate has to produce a
+     * new texture with the same content
+     */
+    void setRestore(std::function<std::shared_ptr<TextureAsset>()> recreate);
+
+    /*!
+     * Uploads the texture again if its GL object belongs to a lost context. Layer views restore the
+     * array they point into.
+     * @return true if the texture is usable
+     */
+    bool restore();
+
+    /*!
+     * @return estimated device memory of a texture with a full mip chain
+     */
+    static size_t
+    storageSize(int32_t width, int32_t height, int32_t channels, int32_t layers = 1);
+
+    /*!
+     * Creates a view on a single layer of a GL_TEXTURE_2D_ARRAY texture. The view keeps the array
+     * alive but never deletes it itself.
      */
     static std::shared_ptr<TextureAsset>
-    loadAsset(AAssetManager *assetManager, const std::string &assetPath, GLint format);
+    createLayer(const std::shared_ptr<TextureAsset> &textureArray, GLint layer);
 
     ~TextureAsset();
 
     /*!
      * @return the texture id for use with OpenGL
      */
-    constexpr GLuint getTextureID() const { return textureID_; }
+    GLuint getTextureID() const { return owner_ ? owner_->textureID_ : textureID_; }
+
+    /*!
+     * @return the target the texture has to be bound to, GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+     */
+    constexpr GLenum getTarget() const { return target_; }
+
+    /*!
+     * @return the layer inside the array texture, 0 for plain 2D textures
+     */
+    constexpr GLint getLayer() const { return layer_; }
+
+    constexpr bool isArrayLayer() const { return target_ == GL_TEXTURE_2D_ARRAY; }
+
+    /*!
+     * Stamps the texture as used in the current frame
+     */
+    void markUsed() const;
+
+    /*!
+     * @return true once the texture data is on the GPU, textures that are still uploading must not
+     * be sampled
+     */
+    bool isReady() const { return owner_ ? owner_->isReady() : *ready_; }
+
+    /*!
+     * Marks the texture as uploading
+     * @return callback that marks it ready again, pass it as the ready callback of the upload
+     */
+    std::function<void()> beginUpload();
 
 private:
-    inline TextureAsset(GLuint textureId) : textureID_(textureId) {}
+    inline TextureAsset(GLuint textureId, GLenum target = GL_TEXTURE_2D, GLint layer = 0,
+                        std::shared_ptr<TextureAsset> owner = nullptr)
+            : textureID_(textureId), target_(target), layer_(layer), owner_(std::move(owner)) {}
+
+    static std::shared_ptr<TextureAsset>
+    packOcclusionRoughnessMetallic(AAssetManager *assetManager, const TextureSource &occlusion,
+                                   const TextureSource &roughnessMetallic);
+
+    static bool decodeWithDecoder(AImageDecoder *pAndroidDecoder, TextureImage &outImage,
+                                  int32_t channels);
+
+    static void copyRawTexels(const TextureSource &source, TextureImage &outImage,
+                              int32_t channels);
 
     GLuint textureID_;
+    GLenum target_;
+    GLint layer_;
+
+    // set for layer views, the array texture is released by its owner
+    std::shared_ptr<TextureAsset> owner_;
+
+    // the texture storage, empty for layer views
+    GpuResource storage_;
+
+    // rebuilds the texture after context loss
+    std::function<std::shared_ptr<TextureAsset>()> recreate_;
+
+    // shared with the ready callback of a pending upload
+    std::shared_ptr<bool> ready_ = std::make_shared<bool>(true);
 
 };
 
-#endif //ANDROIDGLINVESTIGATIONS_TEXTUREASSET_H
\ No newline at end of file
+#endif //ANDROIDGLINVESTIGATIONS_TEXTUREASSET_H
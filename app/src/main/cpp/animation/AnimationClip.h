@@ -0,0 +1,77 @@
+//
+// Created by Dark Matter on 6/27/24.
+//
+
+#ifndef LEARNOPENGL_ANIMATIONCLIP_H
+#define LEARNOPENGL_ANIMATIONCLIP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "glm/vec3.hpp"
+#include "math/quaternion.h"
+
+/*!
+ * Keyframes of one imported animation. Channels are stored as structure of arrays: the keys of all
+ * channels share flat time and value arrays, a channel only knows where its keys start. Sampling
+ * walks the times of one track front to back, which stays in cache.
+ */
+struct AnimationClip {
+    std::string name;
+    // seconds
+    float duration = 0.0f;
+
+    // hierarchy node every channel moves
+    std::vector<int> nodes;
+    // the keys of channel i are [start[i], start[i + 1])
+    std::vector<uint32_t> positionStart{0};
+    std::vector<uint32_t> rotationStart{0};
+    std::vector<uint32_t> scaleStart{0};
+
+    std::vector<float> positionTimes;
+    std::vector<glm::vec3> positions;
+    std::vector<float> rotationTimes;
+    std::vector<Quaternion> rotations;
+    std::vector<float> scaleTimes;
+    std::vector<glm::vec3> scales;
+
+    // morph weight channels, the keys of channel i are [morphStart[i], morphStart[i + 1]) and
+    // every key holds morphCounts[i] weights starting at morphWeightStart[i]
+    std::vector<int> morphNodes;
+    std::vector<uint32_t> morphStart{0};
+    std::vector<uint32_t> morphCounts;
+    std::vector<uint32_t> morphWeightStart;
+    std::vector<float> morphTimes;
+    std::vector<float> morphWeights;
+
+    size_t getChannelCount() const { return nodes.size(); }
+
+    size_t getMorphChannelCount() const { return morphNodes.size(); }
+
+    /*!
+     * Closes a channel of @a node, its keys are the ones appended since the last channel
+     */
+    void endChannel(int node) {
+        nodes.push_back(node);
+        positionStart.push_back((uint32_t) positionTimes.size());
+        rotationStart.push_back((uint32_t) rotationTimes.size());
+        scaleStart.push_back((uint32_t) scaleTimes.size());
+    }
+
+    /*!
+     * Starts a morph channel of @a node whose keys hold @a count weights each, append its times
+     * and weights afterwards
+     */
+    void beginMorphChannel(int node, uint32_t count) {
+        morphNodes.push_back(node);
+        morphCounts.push_back(count);
+        morphWeightStart.push_back((uint32_t) morphWeights.size());
+    }
+
+    void endMorphChannel() {
+        morphStart.push_back((uint32_t) morphTimes.size());
+    }
+};
+
+
+#endif //LEARNOPENGL_ANIMATIONCLIP_H
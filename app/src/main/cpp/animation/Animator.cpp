@@ -0,0 +1,246 @@
+//
+// Created by Dark Matter on 6/27/24.
+//
+
+#include "Animator.h"
+#include <algorithm>
+#include <cmath>
+#include "glm/common.hpp"
+
+int Skin::addJoint(int node, const Mat4f &inverseBindMatrix) {
+    for (size_t joint = 0; joint < jointNodes.size(); ++joint) {
+        if (jointNodes[joint] != node) {
+            continue;
+        }
+        bool same = true;
+        for (int row = 0; row < 3 && same; ++row) {
+            for (int column = 0; column < 4 && same; ++column) {
+                same = std::abs(inverseBindMatrices[joint].m[row][column]
+                                - inverseBindMatrix.m[row][column]) < 1e-4f;
+            }
+        }
+        if (same) {
+            return (int) joint;
+        }
+    }
+    if (jointNodes.size() == kMaxSkinJoints) {
+        return -1;
+    }
+    jointNodes.push_back(node);
+    inverseBindMatrices.push_back(inverseBindMatrix);
+    return (int) jointNodes.size() - 1;
+}
+
+/*!
+ * Splits an affine matrix into translation, rotation and scale, a mirroring matrix gets a negative
+ * x scale
+ */
+static void decompose(const Mat4f &matrix, glm::vec3 &translation, Quaternion &rotation,
+                      glm::vec3 &scale) {
+    const float (*m)[4] = matrix.m;
+    translation = glm::vec3(m[0][3], m[1][3], m[2][3]);
+    scale = glm::vec3(sqrtf(m[0][0] * m[0][0] + m[1][0] * m[1][0] + m[2][0] * m[2][0]),
+                      sqrtf(m[0][1] * m[0][1] + m[1][1] * m[1][1] + m[2][1] * m[2][1]),
+                      sqrtf(m[0][2] * m[0][2] + m[1][2] * m[1][2] + m[2][2] * m[2][2]));
+    float determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                        - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                        + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (determinant < 0.0f) {
+        scale.x = -scale.x;
+    }
+
+    float r[3][3];
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 3; ++column) {
+            r[row][column] = scale[column] != 0.0f ? m[row][column] / scale[column] : 0.0f;
+        }
+    }
+    // the largest of w, x, y and z is computed first so nothing is divided by a tiny number
+    float trace = r[0][0] + r[1][1] + r[2][2];
+    if (trace > 0.0f) {
+        float s = sqrtf(trace + 1.0f) * 2.0f;
+        rotation = Quaternion((r[2][1] - r[1][2]) / s, (r[0][2] - r[2][0]) / s,
+                              (r[1][0] - r[0][1]) / s, 0.25f * s);
+    } else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+        float s = sqrtf(1.0f + r[0][0] - r[1][1] - r[2][2]) * 2.0f;
+        rotation = Quaternion(0.25f * s, (r[0][1] + r[1][0]) / s, (r[0][2] + r[2][0]) / s,
+                              (r[2][1] - r[1][2]) / s);
+    } else if (r[1][1] > r[2][2]) {
+        float s = sqrtf(1.0f + r[1][1] - r[0][0] - r[2][2]) * 2.0f;
+        rotation = Quaternion((r[0][1] + r[1][0]) / s, 0.25f * s, (r[1][2] + r[2][1]) / s,
+                              (r[0][2] - r[2][0]) / s);
+    } else {
+        float s = sqrtf(1.0f + r[2][2] - r[0][0] - r[1][1]) * 2.0f;
+        rotation = Quaternion((r[0][2] + r[2][0]) / s, (r[1][2] + r[2][1]) / s, 0.25f * s,
+                              (r[1][0] - r[0][1]) / s);
+    }
+    rotation.Normalize();
+}
+
+Animator::Animator(const TransformHierarchy &hierarchy, Skin skin, MorphWeights morphWeights,
+                   std::vector<std::shared_ptr<const AnimationClip>> clips)
+        : skin_(std::move(skin)), morphWeights_(std::move(morphWeights)),
+          clips_(std::move(clips)) {
+    size_t nodeCount = hierarchy.size();
+    parents_.reserve(nodeCount);
+    Quaternion identity(0.0f, 0.0f, 0.0f, 1.0f);
+    restTranslations_.resize(nodeCount);
+    restRotations_.resize(nodeCount, identity);
+    restScales_.resize(nodeCount);
+    for (size_t node = 0; node < nodeCount; ++node) {
+        parents_.push_back(hierarchy.getParent((int) node));
+        decompose(hierarchy.getLocalMatrix((int) node), restTranslations_[node],
+                  restRotations_[node], restScales_[node]);
+    }
+    translations_ = restTranslations_;
+    rotations_ = restRotations_;
+    scales_ = restScales_;
+    worldMatrices_.resize(nodeCount);
+    weights_ = morphWeights_.defaults;
+    morphGroups_.assign(nodeCount, -1);
+    for (size_t group = 0; group < morphWeights_.nodes.size(); ++group) {
+        morphGroups_[morphWeights_.nodes[group]] = (int) group;
+    }
+}
+
+void Animator::play(size_t clip, bool loop) {
+    if (clip >= clips_.size()) {
+        return;
+    }
+    clip_ = (int) clip;
+    loop_ = loop;
+    time_ = 0.0f;
+    translations_ = restTranslations_;
+    rotations_ = restRotations_;
+    scales_ = restScales_;
+    weights_ = morphWeights_.defaults;
+    size_t channelCount = clips_[clip]->getChannelCount();
+    positionKeys_.assign(channelCount, 0);
+    rotationKeys_.assign(channelCount, 0);
+    scaleKeys_.assign(channelCount, 0);
+    morphKeys_.assign(clips_[clip]->getMorphChannelCount(), 0);
+}
+
+/*!
+ * Moves @a key to the last key of [first, end) at or before @a time. It starts from the key of the
+ * previous sample and only goes back to the first one when the time jumped back.
+ * @return weight of the key after @a key
+ */
+static inline float seekKey(const float *times, uint32_t first, uint32_t end, float time,
+                            uint32_t &key) {
+    if (key < first || key >= end || times[key] > time) {
+        key = first;
+    }
+    while (key + 1 < end && times[key + 1] <= time) {
+        key++;
+    }
+    if (key + 1 >= end) {
+        return 0.0f;
+    }
+    float span = times[key + 1] - times[key];
+    return span > 0.0f ? std::clamp((time - times[key]) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+/*!
+ * Normalized linear interpolation, takes the short way around
+ */
+static inline Quaternion nlerp(const Quaternion &a, const Quaternion &b, float t) {
+    float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    float tb = dot < 0.0f ? -t : t;
+    float ta = 1.0f - t;
+    Quaternion result(a.x * ta + b.x * tb, a.y * ta + b.y * tb, a.z * ta + b.z * tb,
+                      a.w * ta + b.w * tb);
+    result.Normalize();
+    return result;
+}
+
+void Animator::sample(const AnimationClip &clip, float time) {
+    for (size_t channel = 0; channel < clip.getChannelCount(); ++channel) {
+        int node = clip.nodes[channel];
+        if (node < 0) {
+            continue;
+        }
+        uint32_t first = clip.positionStart[channel];
+        uint32_t end = clip.positionStart[channel + 1];
+        if (first < end) {
+            uint32_t &key = positionKeys_[channel];
+            float t = seekKey(clip.positionTimes.data(), first, end, time, key);
+            translations_[node] = t > 0.0f
+                                  ? glm::mix(clip.positions[key], clip.positions[key + 1], t)
+                                  : clip.positions[key];
+        }
+        first = clip.rotationStart[channel];
+        end = clip.rotationStart[channel + 1];
+        if (first < end) {
+            uint32_t &key = rotationKeys_[channel];
+            float t = seekKey(clip.rotationTimes.data(), first, end, time, key);
+            rotations_[node] = t > 0.0f ? nlerp(clip.rotations[key], clip.rotations[key + 1], t)
+                                        : clip.rotations[key];
+        }
+        first = clip.scaleStart[channel];
+        end = clip.scaleStart[channel + 1];
+        if (first < end) {
+            uint32_t &key = scaleKeys_[channel];
+            float t = seekKey(clip.scaleTimes.data(), first, end, time, key);
+            scales_[node] = t > 0.0f ? glm::mix(clip.scales[key], clip.scales[key + 1], t)
+                                     : clip.scales[key];
+        }
+    }
+
+    for (size_t channel = 0; channel < clip.getMorphChannelCount(); ++channel) {
+        int group = morphGroups_[clip.morphNodes[channel]];
+        uint32_t first = clip.morphStart[channel];
+        uint32_t end = clip.morphStart[channel + 1];
+        if (group < 0 || first == end) {
+            continue;
+        }
+        uint32_t &key = morphKeys_[channel];
+        float t = seekKey(clip.morphTimes.data(), first, end, time, key);
+        uint32_t count = clip.morphCounts[channel];
+        const float *from = &clip.morphWeights[clip.morphWeightStart[channel]
+                                               + (key - first) * count];
+        const float *to = t > 0.0f ? from + count : from;
+        float *weights = &weights_[morphWeights_.firstWeights[group]];
+        uint32_t targets = std::min(count, morphWeights_.counts[group]);
+        for (uint32_t target = 0; target < targets; ++target) {
+            weights[target] = from[target] + (to[target] - from[target]) * t;
+        }
+    }
+}
+
+void Animator::update(float deltaTime, SkinData &skinData, MorphData &morphData) {
+    if (clip_ >= 0) {
+        const AnimationClip &clip = *clips_[clip_];
+        time_ += deltaTime * speed_;
+        if (loop_ && clip.duration > 0.0f) {
+            time_ = fmodf(time_, clip.duration);
+            if (time_ < 0.0f) {
+                time_ += clip.duration;
+            }
+        } else {
+            time_ = std::clamp(time_, 0.0f, clip.duration);
+        }
+        sample(clip, time_);
+    }
+
+    for (size_t node = 0; node < parents_.size(); ++node) {
+        Mat4f local;
+        local.initTransform(translations_[node], rotations_[node], scales_[node]);
+        int parent = parents_[node];
+        worldMatrices_[node] = parent == TransformHierarchy::kNoParent
+                               ? local : worldMatrices_[parent] * local;
+    }
+
+    for (size_t joint = 0; joint < skin_.size(); ++joint) {
+        Mat4f matrix = worldMatrices_[skin_.jointNodes[joint]] * skin_.inverseBindMatrices[joint];
+        SkinMatrix &skinMatrix = skinData.joints[joint];
+        for (int row = 0; row < 3; ++row) {
+            skinMatrix.rows[row] = glm::vec4(matrix.m[row][0], matrix.m[row][1], matrix.m[row][2],
+                                             matrix.m[row][3]);
+        }
+    }
+
+    for (size_t weight = 0; weight < weights_.size(); ++weight) {
+        morphData.weights[weight / 4][(int) (weight % 4)] = weights_[weight];
+    }
+}
@@ -0,0 +1,136 @@
+//
+// Created by Dark Matter on 6/27/24.
+//
+
+#ifndef LEARNOPENGL_ANIMATOR_H
+#define LEARNOPENGL_ANIMATOR_H
+
+#include <memory>
+#include <vector>
+#include "vec4.hpp"
+#include "math/mat4f.h"
+#include "AnimationClip.h"
+#include "MorphTargets.h"
+#include "transform/TransformHierarchy.h"
+
+/*!
+ * Joints a skinned draw can reference, has to match MAX_SKIN_JOINTS in vert.vert and depth.vert.
+ * Vertices store joint indices as bytes, so it can't go beyond 256.
+ */
+static constexpr int kMaxSkinJoints = 128;
+
+/*!
+ * Joint matrix as the top three rows of a row major 4x4 matrix
+ */
+struct SkinMatrix {
+    glm::vec4 rows[3];
+};
+
+/*!
+ * std140 layout of the SkinData uniform block
+ */
+struct SkinData {
+    SkinMatrix joints[kMaxSkinJoints];
+};
+
+/*!
+ * Joints of all skinned meshes of a model. Meshes with bones and meshes hanging below animated
+ * nodes share one list, so the whole model is drawn with a single SkinData block.
+ */
+struct Skin {
+    // hierarchy node every joint follows
+    std::vector<int> jointNodes;
+    // from the baked model space of the vertices to the space of the joint in its rest pose
+    std::vector<Mat4f> inverseBindMatrices;
+
+    /*!
+     * @return index of the joint, a joint with the same node and matrix is reused. -1 when the
+     * skin is full.
+     */
+    int addJoint(int node, const Mat4f &inverseBindMatrix);
+
+    size_t size() const { return jointNodes.size(); }
+};
+
+/*!
+ * Plays the animation clips of a model. Every update samples the playing clip, builds the world
+ * matrices of all nodes and writes joint matrices for GPU skinning and the morph target weights.
+ *
+ * The animator evaluates its own copy of the node graph and never writes the model's
+ * TransformHierarchy, so the render thread can draw the last pose while the next one is evaluated
+ * and animators of different models update in parallel.
+ *
+ * Every track remembers the key it sampled last. Playing forward only ever moves it by a key or
+ * two, so sampling costs O(1) per track instead of a search through all keys.
+ */
+class Animator {
+public:
+    /*!
+     * @param hierarchy node graph of the model, copied in its current state
+     */
+    Animator(const TransformHierarchy &hierarchy, Skin skin, MorphWeights morphWeights,
+             std::vector<std::shared_ptr<const AnimationClip>> clips);
+
+    /*!
+     * Starts @a clip from the beginning, the other nodes go back to their rest pose
+     */
+    void play(size_t clip, bool loop = true);
+
+    /*!
+     * Playback rate, 1 is the authored speed
+     */
+    void setSpeed(float speed) { speed_ = speed; }
+
+    size_t getClipCount() const { return clips_.size(); }
+
+    const AnimationClip &getClip(size_t clip) const { return *clips_[clip]; }
+
+    float getTime() const { return time_; }
+
+    const Skin &getSkin() const { return skin_; }
+
+    const MorphWeights &getMorphWeights() const { return morphWeights_; }
+
+    /*!
+     * Advances the clip by @a deltaTime seconds and writes the joint matrices of the new pose to
+     * @a skinData and its morph target weights to @a morphData. Only touches the animator itself.
+     */
+    void update(float deltaTime, SkinData &skinData, MorphData &morphData);
+
+private:
+    /*!
+     * Writes the translation, rotation and scale of every node @a clip moves at @a time
+     */
+    void sample(const AnimationClip &clip, float time);
+
+    Skin skin_;
+    MorphWeights morphWeights_;
+    std::vector<std::shared_ptr<const AnimationClip>> clips_;
+    int clip_ = -1;
+    float time_ = 0.0f;
+    float speed_ = 1.0f;
+    bool loop_ = true;
+
+    // node graph in hierarchy order, parents come before their children
+    std::vector<int> parents_;
+    std::vector<glm::vec3> restTranslations_;
+    std::vector<Quaternion> restRotations_;
+    std::vector<glm::vec3> restScales_;
+    // local transform of the current pose
+    std::vector<glm::vec3> translations_;
+    std::vector<Quaternion> rotations_;
+    std::vector<glm::vec3> scales_;
+    std::vector<Mat4f> worldMatrices_;
+    // morph target weights of the current pose, and the weight group of every node or -1
+    std::vector<float> weights_;
+    std::vector<int> morphGroups_;
+
+    // keyframe cache, the key every track of the current clip sampled last
+    std::vector<uint32_t> positionKeys_;
+    std::vector<uint32_t> rotationKeys_;
+    std::vector<uint32_t> scaleKeys_;
+    std::vector<uint32_t> morphKeys_;
+};
+
+
+#endif //LEARNOPENGL_ANIMATOR_H
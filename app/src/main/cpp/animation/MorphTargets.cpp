@@ -0,0 +1,121 @@
+//
+// Created by Dark Matter on 6/28/24.
+//
+
+#include "MorphTargets.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
+
+uint32_t MorphWeights::addNode(int node, const float *nodeDefaults, uint32_t count) {
+    for (size_t group = 0; group < nodes.size(); ++group) {
+        if (nodes[group] == node && counts[group] == count) {
+            return firstWeights[group];
+        }
+    }
+    if (defaults.size() + count > kMaxMorphWeights) {
+        return UINT32_MAX;
+    }
+    auto first = (uint32_t) defaults.size();
+    nodes.push_back(node);
+    firstWeights.push_back(first);
+    counts.push_back(count);
+    defaults.insert(defaults.end(), nodeDefaults, nodeDefaults + count);
+    return first;
+}
+
+size_t MorphTargets::maxDeltasFor(GLint maxTextureSize) {
+    size_t rows = std::max(maxTextureSize, 0);
+    return std::min(rows * kMorphTextureWidth / 2, (size_t) kMaxMorphDeltas);
+}
+
+size_t MorphTargets::detectMaxDeltas() {
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    return maxDeltasFor(maxTextureSize);
+}
+
+bool MorphTargets::addMesh(const std::vector<MorphDelta> &deltas, std::vector<Vertex> &vertices) {
+    if (deltaCount_ + deltas.size() > maxDeltas_) {
+        aout << "Morph target texture is full, " << deltas.size() << " deltas are dropped"
+             << std::endl;
+        for (auto &vertex: vertices) {
+            vertex.morph = 0;
+        }
+        return false;
+    }
+    for (auto &vertex: vertices) {
+        if (vertex.morph != 0) {
+            vertex.morph += (uint32_t) deltaCount_;
+        }
+    }
+    texels_.reserve(texels_.size() + deltas.size() * 8);
+    for (const auto &delta: deltas) {
+        texels_.push_back(toHalf(delta.position.x));
+        texels_.push_back(toHalf(delta.position.y));
+        texels_.push_back(toHalf(delta.position.z));
+        texels_.push_back(toHalf((float) delta.weight));
+        texels_.push_back(toHalf(delta.normal.x));
+        texels_.push_back(toHalf(delta.normal.y));
+        texels_.push_back(toHalf(delta.normal.z));
+        texels_.push_back(0);
+    }
+    deltaCount_ += deltas.size();
+    // the texture is uploaded again with the new deltas
+    texture_.reset();
+    return true;
+}
+
+void MorphTargets::bind() {
+    if (!texture_.isValid() && deltaCount_ > 0) {
+        size_t texelCount = deltaCount_ * 2;
+        auto rows = (GLsizei) ((texelCount + kMorphTextureWidth - 1) / kMorphTextureWidth);
+        // the last row is filled up, glTexSubImage2D can't upload part of a row
+        texels_.resize((size_t) rows * kMorphTextureWidth * 4, 0);
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, kMorphTextureWidth, rows);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kMorphTextureWidth, rows, GL_RGBA, GL_HALF_FLOAT,
+                        texels_.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        texels_.resize(texelCount * 4);
+        texture_ = GpuResource(GpuResourceType::TEXTURE, texture,
+                               (size_t) rows * kMorphTextureWidth * 4 * sizeof(uint16_t));
+        CHECK_GL_ERROR();
+    }
+    glActiveTexture(MORPH_TARGET_UNIT);
+    glBindTexture(GL_TEXTURE_2D, texture_.getId());
+    texture_.markUsed();
+}
+
+uint16_t MorphTargets::toHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    auto sign = (uint16_t) ((bits >> 16) & 0x8000);
+    int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent >= 31) {
+        // too big for a half, NaNs are never stored
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+        // denormal, the implicit one becomes part of the mantissa
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        // round to nearest
+        half += (mantissa >> (shift - 1)) & 1;
+        return sign | (uint16_t) half;
+    }
+    // a mantissa that rounds up carries into the exponent, which is still the right number
+    uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> 13);
+    half += (mantissa >> 12) & 1;
+    return sign | (uint16_t) half;
+}
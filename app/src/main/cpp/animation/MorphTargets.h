@@ -0,0 +1,132 @@
+//
+// Created by Dark Matter on 6/28/24.
+//
+
+#ifndef LEARNOPENGL_MORPHTARGETS_H
+#define LEARNOPENGL_MORPHTARGETS_H
+
+#include <GLES3/gl3.h>
+#include <cstdint>
+#include <vector>
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "math/math.h"
+#include "gpu/GpuResourceRegistry.h"
+
+/*!
+ * Morph target weights one model can animate, has to match MAX_MORPH_WEIGHTS in vert.vert and
+ * depth.vert. Deltas store their weight index in a half float, so it can't go beyond 2048.
+ */
+static constexpr int kMaxMorphWeights = 256;
+
+/*!
+ * Texels per row of the morph target texture, a power of two so the shaders can split the index
+ * with a mask and a shift
+ */
+static constexpr int kMorphTextureWidth = 1024;
+
+/*!
+ * Vertex::morph holds the first delta in its low bits and the delta count in the top 8 bits. The
+ * texture usually runs out of rows first, see MorphTargets::maxDeltasFor().
+ */
+static constexpr uint32_t kMorphStartBits = 24;
+static constexpr uint32_t kMaxMorphDeltas = 1u << kMorphStartBits;
+
+/*!
+ * std140 layout of the MorphData uniform block, four weights per vector
+ */
+struct MorphData {
+    glm::vec4 weights[kMaxMorphWeights / 4];
+};
+
+/*!
+ * Difference one morph target makes to one vertex
+ */
+struct MorphDelta {
+    glm::vec3 position;
+    glm::vec3 normal;
+    // index of the target's weight in MorphData
+    uint32_t weight;
+};
+
+/*!
+ * Weights of the morph targets of a model. Like in glTF, all meshes of a node share the weights
+ * of the node.
+ */
+struct MorphWeights {
+    // node every group of weights belongs to, with its first weight and the number of weights
+    std::vector<int> nodes;
+    std::vector<uint32_t> firstWeights;
+    std::vector<uint32_t> counts;
+    // weights while no clip animates them
+    std::vector<float> defaults;
+
+    /*!
+     * @param defaults @a count weights the node starts with
+     * @return first weight of @a node, an existing group is reused. UINT32_MAX when the weights
+     * are used up.
+     */
+    uint32_t addNode(int node, const float *defaults, uint32_t count);
+
+    size_t size() const { return defaults.size(); }
+};
+
+/*!
+ * Sparse morph target deltas of all meshes of a model. Only vertices a target moves get a delta,
+ * stored as two half float texels: position and weight index, then the normal. The vertex shader
+ * reads the deltas of its vertex with texelFetch and adds them times the weights of the frame, so
+ * an animated face only uploads its weights every frame.
+ */
+class MorphTargets {
+public:
+    /*!
+     * @param maxDeltas deltas the texture can hold, from maxDeltasFor() or detectMaxDeltas()
+     */
+    explicit MorphTargets(size_t maxDeltas) : maxDeltas_(maxDeltas) {}
+
+    /*!
+     * @return deltas a texture of at most @a maxTextureSize rows holds, two texels each
+     */
+    static size_t maxDeltasFor(GLint maxTextureSize);
+
+    /*!
+     * @return maxDeltasFor() the GL_MAX_TEXTURE_SIZE of the current context, ES 3.0 guarantees
+     * 2048 rows
+     */
+    static size_t detectMaxDeltas();
+
+    /*!
+     * Appends the deltas of one mesh
+     * @param deltas grouped by vertex, the morph field of @a vertices points into them
+     * @param vertices get the morph field moved to where the deltas ended up
+     * @return false if the texture is full, the morph fields are cleared then
+     */
+    bool addMesh(const std::vector<MorphDelta> &deltas, std::vector<Vertex> &vertices);
+
+    size_t getDeltaCount() const { return deltaCount_; }
+
+    /*!
+     * Binds the texture to MORPH_TARGET_UNIT, it is created on the first call
+     */
+    void bind();
+
+    /*!
+     * Forgets the texture after the GL context was lost, the next bind() uploads it again
+     */
+    void restore() { texture_.reset(); }
+
+    /*!
+     * @return @a value rounded to the nearest half float
+     */
+    static uint16_t toHalf(float value);
+
+private:
+    // RGBA half floats, two texels per delta
+    std::vector<uint16_t> texels_;
+    size_t deltaCount_ = 0;
+    size_t maxDeltas_;
+    GpuResource texture_;
+};
+
+
+#endif //LEARNOPENGL_MORPHTARGETS_H
@@ -7,9 +7,7 @@
 #include "trigonometric.hpp"
 
 void Camera::setPosition(float x, float y, float z) {
-    transform->position.x = x;
-    transform->position.y = y;
-    transform->position.z = z;
+    transform->setPosition(x, y, z);
 }
 
 void Camera::onUp() {
@@ -40,11 +38,11 @@ void Camera::onRight() {
 }
 
 void Camera::panUp() {
-    transform->position.y += speed_;
+    transform->translate(glm::vec3(0, speed_, 0));
 }
 
 void Camera::panDown() {
-    transform->position.y -= speed_;
+    transform->translate(glm::vec3(0, -speed_, 0));
 }
 
 void Camera::onMove() {
@@ -61,7 +59,7 @@ void Camera::onZoomOut() {
 
 Mat4f Camera::matrix() {
     Mat4f cameraMat;
-    cameraMat.lookAt(target_, transform->position, up_);
+    cameraMat.lookAt(target_, transform->getPosition(), up_);
     return cameraMat;
 }
 
@@ -89,7 +87,7 @@ void Camera::init() {
 }
 
 void Camera::onMove(float deltaX, float deltaY) {
-    float radius = glm::length(transform->position - target_);
+    float radius = glm::length(transform->getPosition() - target_);
 
     angleX += deltaX;
     angleY += deltaY;
@@ -100,21 +98,21 @@ void Camera::onMove(float deltaX, float deltaY) {
     float radAngleX = glm::radians(angleX) * speed_;
     float radAngleY = glm::radians(angleY) * speed_;
 
-    transform->position.x = target_.x + radius * cosf(radAngleX) * cosf(radAngleY);
-    transform->position.y = target_.y + radius * cosf(radAngleX) * sinf(radAngleY);
-    transform->position.z = target_.z + radius * sinf(radAngleX);
+    transform->setPosition(target_.x + radius * cosf(radAngleX) * cosf(radAngleY),
+                           target_.y + radius * cosf(radAngleX) * sinf(radAngleY),
+                           target_.z + radius * sinf(radAngleX));
 
 
 }
 
 void Camera::moveForward(float distance) {
-    transform->position.z += distance * speed_;
+    transform->translate(glm::vec3(0, 0, distance * speed_));
 }
 void Camera::moveLeft(float distance) {
-    transform->position.x += distance * speed_;
+    transform->translate(glm::vec3(distance * speed_, 0, 0));
 }
 void Camera::moveUp(float distance) {
-    transform->position.y += distance * speed_;
+    transform->translate(glm::vec3(0, distance * speed_, 0));
 }
 
 void Camera::update() {
@@ -170,8 +168,8 @@ glm::vec3 Camera::getTarget() {
     return target_;
 }
 
-glm::vec3 &Camera::getPos() {
-    return transform->position;
+const glm::vec3 &Camera::getPos() const {
+    return transform->getPosition();
 }
 
 void Camera::setTarget(const glm::vec3& target) {
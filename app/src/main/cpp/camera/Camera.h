@@ -37,7 +37,7 @@ public:
 
     static void rotate(float Angle, const glm::vec3& V, glm::vec3& target);
 
-    glm::vec3& getPos();
+    const glm::vec3& getPos() const;
 
     glm::vec3 getTarget();
 
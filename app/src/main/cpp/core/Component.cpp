@@ -29,6 +29,18 @@ void Component::onDestroy() {
     //DO NOTHING
 }
 
+void Component::onContextRestored() {
+    //DO NOTHING
+}
+
+void Component::writeComponents(EntityRegistry &registry, Entity entity) {
+    //DO NOTHING
+}
+
+void Component::refreshComponents(EntityRegistry &registry, Entity entity) {
+    //DO NOTHING
+}
+
 Component::~Component() {
     aout << "Component is destroyed : " << this << std::endl;
 }
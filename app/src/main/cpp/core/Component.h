@@ -6,6 +6,15 @@
 #define LEARNOPENGL_COMPONENT_H
 
 #include "../transform/Transform.h"
+#include "EntityRegistry.h"
+
+/*!
+ * Copy of a component's transform taken after its update, with both matrices built. The scene
+ * systems read it instead of following the component to its transform.
+ */
+struct WorldTransform {
+    Transform transform;
+};
 
 class Component {
 
@@ -18,6 +27,22 @@ public:
     virtual void onDestroy();
     virtual void onAttach();
     virtual void onCreate();
+    /*!
+     * Called after the GL context was lost and recreated, GL objects have to be built again
+     */
+    virtual void onContextRestored();
+
+    /*!
+     * Adds the packed data the scene systems read to the pools of @a registry, once when the
+     * component is added. Components no system reads add nothing.
+     */
+    virtual void writeComponents(EntityRegistry &registry, Entity entity);
+
+    /*!
+     * Overwrites the packed data writeComponents() added after every update. Goes through
+     * EntityRegistry::get(), so no pool changes its layout while the scene walks them.
+     */
+    virtual void refreshComponents(EntityRegistry &registry, Entity entity);
 
 };
 
@@ -0,0 +1,230 @@
+//
+// Created by Dark Matter on 6/22/24.
+//
+
+#ifndef LEARNOPENGL_ENTITYREGISTRY_H
+#define LEARNOPENGL_ENTITYREGISTRY_H
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/*!
+ * Handle of an entity. The generation tells a recycled index apart from the entity that used it
+ * before, handles of destroyed entities never match a live one.
+ */
+struct Entity {
+    static constexpr uint32_t kInvalidIndex = UINT32_MAX;
+
+    uint32_t index = kInvalidIndex;
+    uint32_t generation = 0;
+
+    constexpr bool isValid() const { return index != kInvalidIndex; }
+
+    constexpr bool operator==(const Entity &other) const {
+        return index == other.index && generation == other.generation;
+    }
+
+    constexpr bool operator!=(const Entity &other) const { return !(*this == other); }
+};
+
+class ComponentPoolBase {
+public:
+    virtual ~ComponentPoolBase() = default;
+
+    virtual void remove(Entity entity) = 0;
+};
+
+/*!
+ * All components of one type, packed densely so systems iterate them without pointer chasing.
+ * A sparse array maps entity indices into the dense one, removal moves the last component into
+ * the gap.
+ */
+template<typename T>
+class ComponentPool : public ComponentPoolBase {
+public:
+    T &add(Entity entity, T component) {
+        if (entity.index >= sparse_.size()) {
+            sparse_.resize(entity.index + 1, kNotPresent);
+        }
+        if (sparse_[entity.index] != kNotPresent) {
+            auto dense = sparse_[entity.index];
+            entities_[dense] = entity;
+            components_[dense] = std::move(component);
+            return components_[dense];
+        }
+        sparse_[entity.index] = (uint32_t) components_.size();
+        entities_.push_back(entity);
+        components_.push_back(std::move(component));
+        return components_.back();
+    }
+
+    T *get(Entity entity) {
+        if (entity.index >= sparse_.size() || sparse_[entity.index] == kNotPresent) {
+            return nullptr;
+        }
+        auto dense = sparse_[entity.index];
+        return entities_[dense] == entity ? &components_[dense] : nullptr;
+    }
+
+    void remove(Entity entity) override {
+        if (!get(entity)) {
+            return;
+        }
+        auto dense = sparse_[entity.index];
+        auto last = (uint32_t) components_.size() - 1;
+        if (dense != last) {
+            components_[dense] = std::move(components_[last]);
+            entities_[dense] = entities_[last];
+            sparse_[entities_[dense].index] = dense;
+        }
+        components_.pop_back();
+        entities_.pop_back();
+        sparse_[entity.index] = kNotPresent;
+    }
+
+    size_t size() const { return components_.size(); }
+
+    T &componentAt(size_t dense) { return components_[dense]; }
+
+    Entity entityAt(size_t dense) const { return entities_[dense]; }
+
+private:
+    static constexpr uint32_t kNotPresent = UINT32_MAX;
+
+    std::vector<T> components_;
+    std::vector<Entity> entities_;
+    std::vector<uint32_t> sparse_;
+};
+
+/*!
+ * Entity/component store. Every component type lives in its own dense ComponentPool, queries walk
+ * the pool of the first requested type and look the others up by entity, no RTTI involved.
+ */
+class EntityRegistry {
+public:
+    Entity create() {
+        Entity entity;
+        if (!freeIndices_.empty()) {
+            entity.index = freeIndices_.back();
+            freeIndices_.pop_back();
+        } else {
+            entity.index = (uint32_t) generations_.size();
+            generations_.push_back(0);
+        }
+        entity.generation = generations_[entity.index];
+        alive_++;
+        return entity;
+    }
+
+    /*!
+     * Removes the entity and all its components, its handle becomes invalid
+     */
+    void destroy(Entity entity) {
+        if (!isAlive(entity)) {
+            return;
+        }
+        for (const auto &pool: pools_) {
+            if (pool) {
+                pool->remove(entity);
+            }
+        }
+        generations_[entity.index]++;
+        freeIndices_.push_back(entity.index);
+        alive_--;
+    }
+
+    bool isAlive(Entity entity) const {
+        return entity.index < generations_.size()
+               && generations_[entity.index] == entity.generation;
+    }
+
+    size_t getEntityCount() const { return alive_; }
+
+    template<typename T>
+    T &add(Entity entity, T component) {
+        assert(isAlive(entity));
+        return pool<T>().add(entity, std::move(component));
+    }
+
+    /*!
+     * @return the component, or nullptr if the entity doesn't have one
+     */
+    template<typename T>
+    T *get(Entity entity) {
+        return pool<T>().get(entity);
+    }
+
+    template<typename T>
+    void remove(Entity entity) {
+        pool<T>().remove(entity);
+    }
+
+    template<typename T>
+    ComponentPool<T> &pool() {
+        size_t id = typeId<T>();
+        if (id >= pools_.size()) {
+            pools_.resize(id + 1);
+        }
+        if (!pools_[id]) {
+            pools_[id] = std::make_unique<ComponentPool<T>>();
+        }
+        return *static_cast<ComponentPool<T> *>(pools_[id].get());
+    }
+
+    /*!
+     * Calls @a fn(entity, first, rest...) for every entity that has all the requested components,
+     * in the dense order of @a First. Put the rarest component first. Components must not be added
+     * or removed from inside @a fn, existing ones of any pool may be changed through get().
+     */
+    template<typename First, typename... Rest, typename Fn>
+    void each(Fn &&fn) {
+        auto &firstPool = pool<First>();
+        // looked up once, not for every entity
+        std::tuple<ComponentPool<Rest> &...> otherPools(pool<Rest>()...);
+        for (size_t i = 0; i < firstPool.size(); ++i) {
+            Entity entity = firstPool.entityAt(i);
+            auto others = std::apply([entity](auto &...pools) {
+                return std::make_tuple(pools.get(entity)...);
+            }, otherPools);
+            if (!allPresent(others, std::index_sequence_for<Rest...>())) {
+                continue;
+            }
+            callWith(fn, entity, firstPool.componentAt(i), others,
+                     std::index_sequence_for<Rest...>());
+        }
+    }
+
+private:
+    std::vector<uint32_t> generations_;
+    std::vector<uint32_t> freeIndices_;
+    std::vector<std::unique_ptr<ComponentPoolBase>> pools_;
+    size_t alive_ = 0;
+
+    // shared by every registry, scenes may be set up from different threads
+    static inline std::atomic<size_t> nextTypeId_{0};
+
+    template<typename T>
+    static size_t typeId() {
+        static const size_t id = nextTypeId_.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    template<typename Tuple, size_t... I>
+    static bool allPresent(const Tuple &components, std::index_sequence<I...>) {
+        return ((std::get<I>(components) != nullptr) && ...);
+    }
+
+    template<typename Fn, typename T, typename Tuple, size_t... I>
+    static void callWith(Fn &fn, Entity entity, T &first, const Tuple &others,
+                         std::index_sequence<I...>) {
+        fn(entity, first, *std::get<I>(others)...);
+    }
+};
+
+
+#endif //LEARNOPENGL_ENTITYREGISTRY_H
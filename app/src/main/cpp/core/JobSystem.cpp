@@ -0,0 +1,301 @@
+//
+// Created by Dark Matter on 6/23/24.
+//
+
+#include "JobSystem.h"
+#include "AndroidOut.h"
+#include <algorithm>
+#include <cstdio>
+#include <sched.h>
+#include <utility>
+
+JobSystem *JobSystem::instance_ = nullptr;
+
+// the job system and worker the current thread belongs to, render and loader threads have none
+static thread_local JobSystem *tJobSystem = nullptr;
+static thread_local int tWorkerIndex = -1;
+
+void JobCounter::add() {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    if (parent_) {
+        parent_->add();
+    }
+}
+
+void JobCounter::finish() {
+    // whoever waits on this counter may destroy it as soon as it hits zero
+    JobCounter *parent = parent_;
+    pending_.fetch_sub(1, std::memory_order_acq_rel);
+    if (parent) {
+        parent->finish();
+    }
+}
+
+JobSystem::JobSystem(int workerCount) {
+    int coreCount = std::max(1, (int) std::thread::hardware_concurrency());
+    if (workerCount <= 0) {
+        workerCount = std::max(1, coreCount - 1);
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+
+    // the render thread usually sits on a big core, leave one of them to it
+    std::vector<int> bigCores;
+    std::vector<int> littleCores;
+    int bigWorkers = 0;
+    if (readCoreClasses(bigCores, littleCores)) {
+        bigWorkers = std::min(workerCount, std::max(1, (int) bigCores.size() - 1));
+        for (int i = 0; i < workerCount; ++i) {
+            Worker &worker = *workers_[i];
+            bool big = i < bigWorkers;
+            worker.coreClass = big ? JobAffinity::BIG : JobAffinity::LITTLE;
+            worker.cores = big ? bigCores : littleCores;
+        }
+    }
+
+    for (int i = 0; i < workerCount; ++i) {
+        workers_[i]->thread = std::thread(&JobSystem::run, this, i);
+    }
+    instance_ = this;
+    aout << "Job system with " << workerCount << " workers, " << bigWorkers << " on big cores"
+         << std::endl;
+}
+
+JobSystem::~JobSystem() {
+    if (instance_ == this) {
+        instance_ = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        running_ = false;
+    }
+    wakeUp_.notify_all();
+    for (auto &worker: workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+JobSystem *JobSystem::get() {
+    return instance_;
+}
+
+void JobSystem::enqueue(std::function<void()> job, JobCounter *counter, JobAffinity affinity) {
+    if (counter) {
+        counter->add();
+    }
+    Worker &worker = *workers_[pickWorker(affinity)];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.jobs.push_back({std::move(job), counter, affinity});
+    }
+    queued_.fetch_add(1, std::memory_order_release);
+    {
+        // pairs with the predicate check of sleeping workers, so the wake up can't be missed
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wakeUp_.notify_one();
+}
+
+void JobSystem::help(const JobCounter &counter) {
+    int workerIndex = tJobSystem == this ? tWorkerIndex : -1;
+    while (!counter.isDone()) {
+        Job job;
+        if (takeJob(workerIndex, job)) {
+            execute(job);
+        } else {
+            // the remaining jobs are running on other threads
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::submit(std::function<void()> job, JobCounter *counter, JobAffinity affinity) {
+    if (instance_) {
+        instance_->enqueue(std::move(job), counter, affinity);
+        return;
+    }
+    job();
+}
+
+void JobSystem::wait(const JobCounter &counter) {
+    if (instance_) {
+        instance_->help(counter);
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain,
+                            const std::function<void(size_t, size_t)> &body,
+                            JobAffinity affinity) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max(grain, (size_t) 1);
+    if (!instance_ || count <= grain) {
+        body(0, count);
+        return;
+    }
+
+    // one range per thread is enough, stealing evens out ranges that take longer
+    size_t ranges = std::min((count + grain - 1) / grain,
+                             (size_t) instance_->getWorkerCount() + 1);
+    size_t rangeSize = (count + ranges - 1) / ranges;
+    JobCounter counter;
+    for (size_t begin = rangeSize; begin < count; begin += rangeSize) {
+        size_t end = std::min(begin + rangeSize, count);
+        instance_->enqueue([&body, begin, end]() { body(begin, end); }, &counter, affinity);
+    }
+    body(0, rangeSize);
+    instance_->help(counter);
+}
+
+void JobSystem::run(int workerIndex) {
+    tJobSystem = this;
+    tWorkerIndex = workerIndex;
+    pinToCores(workers_[workerIndex]->cores);
+
+    while (true) {
+        Job job;
+        if (takeJob(workerIndex, job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wakeUp_.wait(lock, [this]() {
+            return !running_ || queued_.load(std::memory_order_acquire) > 0;
+        });
+        if (!running_) {
+            return;
+        }
+    }
+}
+
+bool JobSystem::takeJob(int workerIndex, Job &outJob) {
+    if (queued_.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    if (workerIndex >= 0) {
+        Worker &own = *workers_[workerIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            outJob = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // steal jobs meant for this core class first, anything else only when there is nothing left
+    JobAffinity coreClass = workerIndex >= 0 ? workers_[workerIndex]->coreClass : JobAffinity::ANY;
+    auto count = (int) workers_.size();
+    int first = workerIndex >= 0 ? workerIndex + 1 : 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < count; ++i) {
+            int victimIndex = (first + i) % count;
+            if (victimIndex == workerIndex) {
+                continue;
+            }
+            Worker &victim = *workers_[victimIndex];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.jobs.empty()) {
+                continue;
+            }
+            JobAffinity affinity = victim.jobs.front().affinity;
+            // background jobs may run for long, the render thread leaves them to the workers
+            if (workerIndex < 0 && affinity == JobAffinity::LITTLE) {
+                continue;
+            }
+            if (pass == 0 && affinity != JobAffinity::ANY && coreClass != JobAffinity::ANY
+                && affinity != coreClass) {
+                continue;
+            }
+            outJob = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Job &job) {
+    job.run();
+    if (job.counter) {
+        job.counter->finish();
+    }
+}
+
+int JobSystem::pickWorker(JobAffinity affinity) {
+    // jobs spawned by a worker stay on it, they are likely to touch the same data
+    if (tJobSystem == this && tWorkerIndex >= 0) {
+        JobAffinity coreClass = workers_[tWorkerIndex]->coreClass;
+        if (affinity == JobAffinity::ANY || coreClass == JobAffinity::ANY
+            || coreClass == affinity) {
+            return tWorkerIndex;
+        }
+    }
+    auto count = (int) workers_.size();
+    auto first = (int) (nextWorker_.fetch_add(1, std::memory_order_relaxed) % count);
+    for (int i = 0; i < count; ++i) {
+        int workerIndex = (first + i) % count;
+        JobAffinity coreClass = workers_[workerIndex]->coreClass;
+        if (affinity == JobAffinity::ANY || coreClass == JobAffinity::ANY
+            || coreClass == affinity) {
+            return workerIndex;
+        }
+    }
+    return first;
+}
+
+bool JobSystem::readCoreClasses(std::vector<int> &bigCores, std::vector<int> &littleCores) {
+    auto coreCount = (int) std::thread::hardware_concurrency();
+    std::vector<long> frequencies;
+    for (int core = 0; core < coreCount; ++core) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
+                 core);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            return false;
+        }
+        long frequency = 0;
+        bool read = fscanf(file, "%ld", &frequency) == 1;
+        fclose(file);
+        if (!read) {
+            return false;
+        }
+        frequencies.push_back(frequency);
+    }
+    return splitCoreClasses(frequencies, bigCores, littleCores);
+}
+
+bool JobSystem::splitCoreClasses(const std::vector<long> &frequencies, std::vector<int> &bigCores,
+                                 std::vector<int> &littleCores) {
+    bigCores.clear();
+    littleCores.clear();
+    if (frequencies.empty()) {
+        return false;
+    }
+    // a prime core clocks above the rest of the big cluster, only the slowest cores are little
+    long minFrequency = *std::min_element(frequencies.begin(), frequencies.end());
+    for (int core = 0; core < (int) frequencies.size(); ++core) {
+        (frequencies[core] > minFrequency ? bigCores : littleCores).push_back(core);
+    }
+    return !bigCores.empty() && !littleCores.empty();
+}
+
+void JobSystem::pinToCores(const std::vector<int> &cores) {
+    if (cores.empty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core: cores) {
+        CPU_SET(core, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        aout << "Unable to pin job worker to " << cores.size() << " cores" << std::endl;
+    }
+}
@@ -0,0 +1,176 @@
+//
+// Created by Dark Matter on 6/23/24.
+//
+
+#ifndef LEARNOPENGL_JOBSYSTEM_H
+#define LEARNOPENGL_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * Which cores a job prefers. Only a hint: the job is queued on a worker of that class, but idle
+ * workers of the other class still steal it so nothing waits on a busy cluster.
+ */
+enum class JobAffinity {
+    ANY,
+    // long CPU heavy work like decoding and vertex baking
+    BIG,
+    // background work that isn't latency sensitive, threads outside the pool never run it while
+    // they wait
+    LITTLE
+};
+
+/*!
+ * Counts the jobs that still have to finish. A counter with a parent keeps the parent pending
+ * as well, so waiting on the parent waits for everything spawned below it.
+ */
+class JobCounter {
+public:
+    explicit JobCounter(JobCounter *parent = nullptr) : parent_(parent) {}
+
+    JobCounter(const JobCounter &) = delete;
+
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool isDone() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    void add();
+
+    void finish();
+
+    std::atomic<int> pending_{0};
+    JobCounter *parent_;
+};
+
+/*!
+ * Runs CPU work on a pool of worker threads. Every worker owns a deque, it pushes and pops its own
+ * jobs at the back and steals from the front of the others when it runs dry. Threads that wait on
+ * a counter run queued jobs in the meantime, so jobs may wait on the jobs they spawned.
+ *
+ * On big.LITTLE devices the workers are pinned to the big or the little cluster, read from the
+ * maximum frequency of every core. Devices with a prime core count it as big as well.
+ *
+ * Jobs must not touch GL, the render context only lives on the render thread.
+ */
+class JobSystem {
+public:
+    /*!
+     * @param workerCount number of worker threads, 0 uses one per core besides the render thread
+     */
+    explicit JobSystem(int workerCount = 0);
+
+    /*!
+     * Stops the workers, queued jobs that didn't run yet are dropped
+     */
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    /*!
+     * @return the running job system, or nullptr when jobs run inline
+     */
+    static JobSystem *get();
+
+    int getWorkerCount() const { return (int) workers_.size(); }
+
+    /*!
+     * Queues @a job, @a counter is pending until it finished
+     */
+    void enqueue(std::function<void()> job, JobCounter *counter = nullptr,
+                 JobAffinity affinity = JobAffinity::ANY);
+
+    /*!
+     * Runs queued jobs on the calling thread until @a counter is done
+     */
+    void help(const JobCounter &counter);
+
+    /*!
+     * Queues @a job on the running job system, or runs it right away when there is none
+     */
+    static void submit(std::function<void()> job, JobCounter *counter = nullptr,
+                       JobAffinity affinity = JobAffinity::ANY);
+
+    /*!
+     * Blocks until @a counter is done, running queued jobs while waiting
+     */
+    static void wait(const JobCounter &counter);
+
+    /*!
+     * Splits [0, count) into ranges of at least @a grain items and runs @a body on them in
+     * parallel, the calling thread takes its share. Returns once every range finished.
+     */
+    static void parallelFor(size_t count, size_t grain,
+                            const std::function<void(size_t begin, size_t end)> &body,
+                            JobAffinity affinity = JobAffinity::ANY);
+
+    /*!
+     * Splits cores by their maximum frequency, everything faster than the slowest cluster is big
+     * @return false when every core runs at the same frequency
+     */
+    static bool splitCoreClasses(const std::vector<long> &frequencies, std::vector<int> &bigCores,
+                                 std::vector<int> &littleCores);
+
+private:
+    struct Job {
+        std::function<void()> run;
+        JobCounter *counter;
+        JobAffinity affinity;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        JobAffinity coreClass = JobAffinity::ANY;
+        // cores the worker is pinned to, empty when it may run anywhere
+        std::vector<int> cores;
+        std::thread thread;
+    };
+
+    void run(int workerIndex);
+
+    /*!
+     * Pops the newest job of @a workerIndex, or steals the oldest one of another worker
+     * @param workerIndex -1 for threads that aren't workers, they only steal
+     */
+    bool takeJob(int workerIndex, Job &outJob);
+
+    void execute(Job &job);
+
+    /*!
+     * @return the worker a job submitted from the current thread is queued on
+     */
+    int pickWorker(JobAffinity affinity);
+
+    /*!
+     * Splits the cores into the big and little cluster
+     * @return false on homogeneous devices, or when the frequencies can't be read
+     */
+    static bool readCoreClasses(std::vector<int> &bigCores, std::vector<int> &littleCores);
+
+    static void pinToCores(const std::vector<int> &cores);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<int> queued_{0};
+    std::atomic<unsigned int> nextWorker_{0};
+
+    std::mutex sleepMutex_;
+    std::condition_variable wakeUp_;
+    bool running_ = true;
+
+    static JobSystem *instance_;
+};
+
+
+#endif //LEARNOPENGL_JOBSYSTEM_H
@@ -6,11 +6,12 @@
 #include "../unused/ShaderBase.h"
 #include "../Model.h"
 #include "Utility.h"
+#include "utils.h"
 #include "AndroidOut.h"
 #include "mesh/MeshRenderer.h"
 #include "Behaviour.h"
 #include "light/Light.h"
-#include "light/PointLight.h"
+#include <algorithm>
 
 /*!
  * Half the height of the projection matrix. This gives you a renderable area of height 4 ranging
@@ -31,8 +32,43 @@ static constexpr float kProjectionNearPlane = 0.01;
  */
 static constexpr float kProjectionFarPlane = 100.f;
 
+/*!
+ * Initial size of one frame of the draw data ring, it grows when a frame needs more
+ */
+static constexpr size_t kDrawDataFrameSize = 64 * 1024;
+
+/*!
+ * Initial size of one frame of the pose data ring, room for a few animated models
+ */
+static constexpr size_t kPoseDataFrameSize = 8 * (sizeof(SkinData) + sizeof(MorphData));
+
+/*!
+ * Longest step an animation advances in one update, so a stall doesn't make it jump
+ */
+static constexpr float kMaxAnimationStep = 0.1f;
+
+/*!
+ * Fragments per pixel the overdraw view can count, matches OVERDRAW_LAYERS in frag.frag
+ */
+static constexpr float kOverdrawLayers = 32.0f;
+
+/*!
+ * Frames between two overdraw read backs
+ */
+static constexpr int kOverdrawLogInterval = 60;
+
+/*!
+ * Frames the occlusion statistics are summed over before they are logged
+ */
+static constexpr int kOcclusionLogInterval = 120;
+
 void Scene::addObject(const std::shared_ptr<Component> &gameObject) {
-    this->components_.push_back(gameObject);
+    waitForUpdate();
+    Entity entity = registry_.create();
+    registry_.add(entity, SceneObject{gameObject});
+    // the component picks the pools it lives in
+    gameObject->writeComponents(registry_, entity);
+    entities_[gameObject.get()] = entity;
     gameObject->onAttach();
 }
 
@@ -41,74 +77,300 @@ Camera *Scene::getMainCamera() const {
 }
 
 void Scene::render() {
-    mainCamera_->onRender();
-    CHECK_GL_ERROR();
-    Mat4f View = mainCamera_->matrix();
-    std::vector<MeshRenderer *> meshRenderers;
-    std::vector<Light *> lights;
-    for (const auto &component: components_) {
-        auto *pMeshRenderer = dynamic_cast<MeshRenderer *>(component.get());
-        auto *light = dynamic_cast<Light *>(component.get());
-        if (pMeshRenderer != nullptr) {
-            if (component->transform) {
-                meshRenderers.push_back(pMeshRenderer);
-            } else {
-                aout << "Render::Component transform is gone " << component->transform << std::endl;
+    waitForUpdate();
+    if (!hasSnapshot_) {
+        // nothing to draw before the first update
+        update();
+        renderSnapshot_ = 1 - renderSnapshot_;
+    }
+    const FrameSnapshot &snapshot = snapshots_[renderSnapshot_];
+    // batches own GL ranges, they are regrouped here before the next update reads them
+    for (const auto &item: snapshot.items) {
+        item.renderer->prepareBatches(renderSnapshot_, item.projection, item.shadowProjection);
+    }
+    hasSnapshot_ = false;
+    updating_ = true;
+    JobSystem::submit([this]() { update(); }, &updateCounter_, JobAffinity::BIG);
+
+    drawData_->beginFrame();
+    // every pose is pushed before the first draw, a ring growing later would lose the ranges
+    poseData_->beginFrame();
+    size_t alignment = poseData_->getAlignment();
+    size_t skinSize = (sizeof(SkinData) + alignment - 1) / alignment * alignment;
+    size_t morphSize = (sizeof(MorphData) + alignment - 1) / alignment * alignment;
+    size_t skinCount = 1, morphCount = 1;
+    for (const auto &item: snapshot.items) {
+        skinCount += item.skin != nullptr;
+        morphCount += item.morph != nullptr;
+    }
+    poseData_->reserve(skinCount * skinSize + morphCount * morphSize);
+    GLuint poseBuffer = poseData_->getBuffer();
+    for (const auto &item: snapshot.items) {
+        if (item.skin || item.morph) {
+            size_t skinOffset = item.skin ? poseData_->push(item.skin, sizeof(SkinData)) : SIZE_MAX;
+            size_t morphOffset = item.morph ? poseData_->push(item.morph, sizeof(MorphData))
+                                            : SIZE_MAX;
+            item.renderer->bindPose(poseBuffer, skinOffset, morphOffset);
+        }
+    }
+    // static meshes never read them, but the blocks of the programs need a buffer behind them
+    static const SkinData kNoSkin = {};
+    static const MorphData kNoMorph = {};
+    size_t noSkinOffset = poseData_->push(&kNoSkin, sizeof(kNoSkin));
+    size_t noMorphOffset = poseData_->push(&kNoMorph, sizeof(kNoMorph));
+    glBindBufferRange(GL_UNIFORM_BUFFER, SKIN_DATA_UNIFORM_BINDING, poseBuffer,
+                      (GLintptr) noSkinOffset, sizeof(SkinData));
+    glBindBufferRange(GL_UNIFORM_BUFFER, MORPH_DATA_UNIFORM_BINDING, poseBuffer,
+                      (GLintptr) noMorphOffset, sizeof(MorphData));
+    // the shadow maps are drawn before the window is touched, tilers don't have to store and
+    // reload it in between
+    if (snapshot.shadows.cascadeCount > 0 && depthShader_->isValid()) {
+        depthShader_->bind();
+        for (int cascade = 0; cascade < snapshot.shadows.cascadeCount; ++cascade) {
+            shadowCascades_->beginCascade(cascade);
+            for (const auto &item: snapshot.items) {
+                item.renderer->renderDepth(snapshot.shadows.viewProjections[cascade],
+                                           item.transform, drawData_.get(), true,
+                                           renderSnapshot_);
             }
-        } else if (light != nullptr) {
-            lights.push_back(light);
         }
+        shadowCascades_->endCascades((GLsizei) width_, (GLsizei) height_);
+    }
+    if (overdrawView_) {
+        // the count starts at zero
+        GLfloat clearColor[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    } else {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     }
-    for (const auto &pLight: lights) {
-        if(  pLight->transform->position.y > 10 || pLight->transform->position.y < -10){
-            deltaY = -deltaY;
+
+    // opaque depth first, the shading pass then only runs for the fragments that stay visible
+    if (depthPrepass_ && depthShader_->isValid()) {
+        depthShader_->bind();
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (const auto &item: snapshot.items) {
+            item.renderer->renderDepth(snapshot.viewProjection, item.transform, drawData_.get(),
+                                       false, renderSnapshot_);
         }
-       // pLight->transform->setYPosition(pLight->transform->position.y + deltaY);
-        for (const auto &component: meshRenderers) {
-            component->transform->rotate(0, rotation_, 0);
-            Mat4f model = component->transform->matrix();
-            Mat4f finalProjectionMatrix = (*projectionMatrix_) * View * model;
-            component->render(&finalProjectionMatrix, getMainCamera(), pLight);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    lightClusters_->beginFrame(snapshot.clusters);
+    shadowCascades_->beginFrame(snapshot.shadows);
+    brdfLut_->bind();
+    imageBasedLight_->bind();
+    // without a pass light the clustered lights still need one pass
+    size_t passCount = std::max(snapshot.lights.size(), (size_t) 1);
+    for (size_t pass = 0; pass < passCount; ++pass) {
+        const PassLight *pLight = pass < snapshot.lights.size() ? &snapshot.lights[pass] : nullptr;
+        for (const auto &item: snapshot.items) {
+            item.renderer->render(item.projection, item.transform, snapshot.cameraPosition, pLight,
+                                  drawData_.get(), RenderQueue::OPAQUE, renderSnapshot_);
+        }
+    }
+
+    // blended meshes are tested against the opaque depth but don't hide each other
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    for (size_t pass = 0; pass < passCount; ++pass) {
+        const PassLight *pLight = pass < snapshot.lights.size() ? &snapshot.lights[pass] : nullptr;
+        for (auto item = snapshot.items.rbegin(); item != snapshot.items.rend(); ++item) {
+            item->renderer->render(item->projection, item->transform, snapshot.cameraPosition,
+                                   pLight, drawData_.get(), RenderQueue::BLENDED,
+                                   renderSnapshot_);
         }
     }
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    if (overdrawView_) {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        logOverdraw();
+    }
+    drawData_->endFrame();
+    poseData_->endFrame();
+    lightClusters_->endFrame();
+    shadowCascades_->endFrame();
 }
 
 
 void Scene::update() {
-    for (const auto &component: components_) {
-        if (component && component->transform) {
+    auto now = std::chrono::steady_clock::now();
+    float deltaTime = hasUpdated_ ? std::chrono::duration<float>(now - lastUpdate_).count() : 0.0f;
+    deltaTime = std::min(deltaTime, kMaxAnimationStep);
+    lastUpdate_ = now;
+    hasUpdated_ = true;
+
+    // spins the models before their transforms are copied into the pool
+    registry_.each<Renderable>([this](Entity, Renderable &renderable) {
+        renderable.renderer->transform->rotate(0, rotation_, 0);
+    });
+    // the packed copies are refreshed in place, no pool changes its layout while this walks
+    registry_.each<SceneObject>([this](Entity entity, SceneObject &object) {
+        object.component->update();
+        object.component->refreshComponents(registry_, entity);
+    });
+
+    mainCamera_->onRender();
+    Mat4f view = mainCamera_->matrix();
+    Mat4f viewProjection = (*projectionMatrix_) * view;
+    int updateSnapshot = 1 - renderSnapshot_;
+    FrameSnapshot &snapshot = snapshots_[updateSnapshot];
+    snapshot.cameraPosition = mainCamera_->transform->getPosition();
+    snapshot.viewProjection = viewProjection;
+    glm::vec3 cameraForward(view.m[2][0], view.m[2][1], view.m[2][2]);
+
+    std::vector<ClusteredLight> clusteredLights;
+    registry_.each<ClusteredLight>([&](Entity, ClusteredLight &light) {
+        clusteredLights.push_back(light);
+    });
+    lightClusters_->build(view, snapshot.cameraPosition, clusteredLights, snapshot.clusters);
+
+    snapshot.lights.clear();
+    glm::vec3 shadowDirection(0.0f);
+    registry_.each<LightSource>([&](Entity, LightSource &lightSource) {
+        if (shadowDirection == glm::vec3(0.0f)) {
+            shadowDirection = lightSource.shadowDirection;
+        }
+        snapshot.lights.push_back(lightSource.pass);
+    });
+    shadowCascades_->build(view, snapshot.cameraPosition, shadowDirection, snapshot.shadows);
+    // every cascade looks along the light, the first one orders the casters for all of them
+    const Mat4f &shadowViewProjection = snapshot.shadows.cascadeCount > 0
+                                        ? snapshot.shadows.viewProjections[0] : viewProjection;
 
-            component->update();
-        } else {
-            aout << "update::Component transform is gone " << component << std::endl;
+    snapshot.items.clear();
+    // reads the packed transforms and bounds, the renderer itself only for its pose
+    registry_.each<Renderable, WorldTransform, RenderBounds>(
+            [&](Entity, Renderable &renderable, WorldTransform &world, RenderBounds &bounds) {
+        MeshRenderer *component = renderable.renderer;
+        const Mat4f &model = world.transform.matrix();
+        glm::vec3 center(model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+        snapshot.items.push_back({component, world.transform, viewProjection * model,
+                                  shadowViewProjection * model,
+                                  glm::dot(center - snapshot.cameraPosition, cameraForward),
+                                  bounds, component->getSkin(updateSnapshot),
+                                  component->getMorph(updateSnapshot)});
+    });
+    std::sort(snapshot.items.begin(), snapshot.items.end(),
+              [](const RenderItem &a, const RenderItem &b) { return a.depth < b.depth; });
+    // the occluders are rasterized on a worker while the models animate
+    OcclusionCuller *culler = nullptr;
+    if (occlusionCulling_) {
+        occluders_.clear();
+        for (const auto &item: snapshot.items) {
+            item.renderer->collectOccluders(item.projection, occluders_);
         }
+        JobSystem::submit([this]() { occlusionCuller_->rasterize(occluders_); },
+                          &occlusionCounter_, JobAffinity::BIG);
+        culler = occlusionCuller_.get();
     }
+    // the poses and draw lists go to this snapshot, the render pass reads the other ones
+    JobSystem::parallelFor(snapshot.items.size(), 4, [&](size_t begin, size_t end) {
+        for (size_t item = begin; item < end; ++item) {
+            snapshot.items[item].renderer->animate(deltaTime, updateSnapshot);
+        }
+    });
+    if (culler) {
+        JobSystem::wait(occlusionCounter_);
+        logOcclusion();
+    }
+    JobSystem::parallelFor(snapshot.items.size(), 4, [&](size_t begin, size_t end) {
+        for (size_t index = begin; index < end; ++index) {
+            const RenderItem &item = snapshot.items[index];
+            // a renderer hidden as a whole skips the tests of its batches
+            bool hidden = culler && item.bounds.valid
+                          && !culler->isVisible(item.projection, item.bounds.min,
+                                                item.bounds.max);
+            item.renderer->buildDrawList(updateSnapshot, culler, item.projection,
+                                         item.shadowProjection, hidden);
+        }
+    });
+    hasSnapshot_ = true;
 }
 
-void Scene::removeObject(Component *gameObject) {
+void Scene::waitForUpdate() {
+    if (!updating_) {
+        return;
+    }
+    JobSystem::wait(updateCounter_);
+    updating_ = false;
+    renderSnapshot_ = 1 - renderSnapshot_;
+}
 
+void Scene::removeObject(Component *gameObject) {
+    waitForUpdate();
+    // the snapshots must not point at it once it is gone
+    for (auto &snapshot: snapshots_) {
+        snapshot.items.erase(std::remove_if(snapshot.items.begin(), snapshot.items.end(),
+                                            [gameObject](const RenderItem &item) {
+                                                return item.renderer == gameObject;
+                                            }), snapshot.items.end());
+    }
+    auto entity = entities_.find(gameObject);
+    if (entity == entities_.end()) {
+        return;
+    }
+    // keeps the component alive until the registry let go of it
+    auto component = registry_.get<SceneObject>(entity->second)->component;
+    registry_.destroy(entity->second);
+    entities_.erase(entity);
+    component->onDestroy();
 }
 
 void Scene::onDestroy() {
-    for (const auto &component: components_) {
-        if (component && component->transform) {
-            component->onDestroy();
-        } else {
-            aout << "update::Component transform is gone " << component << std::endl;
-        }
-    }
+    waitForUpdate();
+    registry_.each<SceneObject>([](Entity, SceneObject &object) {
+        object.component->onDestroy();
+    });
+}
+
+void Scene::onContextRestored() {
+    waitForUpdate();
+    drawData_->restore();
+    poseData_->restore();
+    lightClusters_->restore();
+    shadowCascades_->restore();
+    brdfLut_->restore();
+    imageBasedLight_->restore();
+    depthShader_->restore();
+    registry_.each<SceneObject>([](Entity, SceneObject &object) {
+        object.component->onContextRestored();
+    });
 }
 
 Scene::Scene(float width, float height) {
+    lightClusters_ = std::make_unique<LightClusters>();
+    shadowCascades_ = std::make_unique<ShadowCascades>(ShadowCascades::detectQuality());
+    brdfLut_ = std::make_unique<BrdfLut>();
+    imageBasedLight_ = std::make_unique<ImageBasedLight>();
+    depthShader_ = std::make_unique<DepthShader>();
+    occlusionCuller_ = std::make_unique<OcclusionCuller>();
     setSize(width, height);
     glm::vec3 CameraPos(0.0f, 0.0f, -1.0f);
     glm::vec3 CameraTarget(0.0f, 0.0f, 1.0f);
     glm::vec3 CameraUp(0.0f, 1.0f, 0.0f);
 
     mainCamera_ = std::make_shared<Camera>(CameraPos, CameraTarget, CameraUp);
+    drawData_ = StreamingBuffer::createUniformRing(kDrawDataFrameSize);
+    poseData_ = StreamingBuffer::createUniformRing(kPoseDataFrameSize);
+}
+
+Scene::~Scene() {
+    waitForUpdate();
 }
 
 void Scene::setSize(float width, float height) {
+    waitForUpdate();
+    width_ = width;
+    height_ = height;
     projectionMatrix_ = std::make_shared<Mat4f>();
     Utility::buildPerspectiveMat(
             projectionMatrix_.get(),
@@ -116,11 +378,61 @@ void Scene::setSize(float width, float height) {
             float(width) / height,
             kProjectionNearPlane,
             kProjectionFarPlane);
+    lightClusters_->setProjection(*projectionMatrix_, kProjectionNearPlane, kProjectionFarPlane,
+                                  width, height);
+    shadowCascades_->setProjection(*projectionMatrix_, kProjectionNearPlane);
 
 }
 
+void Scene::setShadowQuality(ShadowQuality quality) {
+    waitForUpdate();
+    shadowCascades_->setQuality(quality);
+}
 
+void Scene::loadEnvironment(AAssetManager *assetManager, const std::string &assetPath,
+                            const std::string &cacheDirectory) {
+    imageBasedLight_->load(assetManager, assetPath, cacheDirectory);
+}
 
+void Scene::setOverdrawView(bool overdrawView) {
+    overdrawView_ = overdrawView;
+    overdrawFrame_ = 0;
+    Shader::setOverdrawView(overdrawView);
+}
 
+void Scene::logOverdraw() {
+    if (++overdrawFrame_ < kOverdrawLogInterval) {
+        return;
+    }
+    overdrawFrame_ = 0;
+    auto width = (GLsizei) width_;
+    auto height = (GLsizei) height_;
+    size_t pixelCount = (size_t) width * (size_t) height;
+    if (pixelCount == 0) {
+        return;
+    }
+    overdrawPixels_.resize(pixelCount * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, overdrawPixels_.data());
+    uint64_t sum = 0;
+    for (size_t pixel = 0; pixel < pixelCount; ++pixel) {
+        sum += overdrawPixels_[pixel * 4];
+    }
+    float fragments = (float) sum * kOverdrawLayers / (255.0f * (float) pixelCount);
+    aout << "Average overdraw " << fragments << " fragments per pixel" << std::endl;
+}
 
 
+void Scene::logOcclusion() {
+    const OcclusionStats &stats = occlusionCuller_->getStats();
+    if (stats.frames < kOcclusionLogInterval) {
+        return;
+    }
+    float frames = (float) stats.frames;
+    float tested = (float) std::max(stats.tested, 1u);
+    aout << "Occlusion culling: " << stats.tested / stats.frames << " batches per frame, "
+         << 100.0f * (float) stats.culled / tested << "% occluded, "
+         << 100.0f * (float) stats.outside / tested << "% off screen, "
+         << (float) stats.occluderTriangles / frames << " occluder triangles in "
+         << stats.rasterizeMs / frames << " ms" << std::endl;
+    occlusionCuller_->resetStats();
+}
\ No newline at end of file
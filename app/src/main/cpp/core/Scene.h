@@ -10,32 +10,188 @@
 #include "../Model.h"
 #include "camera/Camera.h"
 #include "mesh/MeshRenderer.h"
+#include "gpu/StreamingBuffer.h"
+#include "EntityRegistry.h"
+#include "light/Light.h"
+#include "light/LightClusters.h"
+#include "light/ShadowCascades.h"
+#include "light/BrdfLut.h"
+#include "light/ImageBasedLight.h"
+#include "shader/DepthShader.h"
+#include "culling/OcclusionCuller.h"
+#include "JobSystem.h"
+#include <chrono>
+#include <unordered_map>
+
+
+/*!
+ * Owns the component an entity was created for, every scene object has one
+ */
+struct SceneObject {
+    std::shared_ptr<Component> component;
+};
+
+/*!
+ * What the render pass needs of one MeshRenderer, copied when the update finished so the next
+ * update can move the renderer while this frame is drawn
+ */
+struct RenderItem {
+    MeshRenderer *renderer;
+    Transform transform;
+    // projection * view * model
+    Mat4f projection;
+    // light projection * model, orders the shadow casters
+    Mat4f shadowProjection;
+    // view depth of the center of the bounds, items are sorted by it
+    float depth;
+    RenderBounds bounds;
+    // joint matrices of the pose of this frame, nullptr for renderers without skinned meshes
+    const SkinData *skin;
+    // morph target weights of the pose of this frame, nullptr for renderers without morph targets
+    const MorphData *morph;
+};
 
+/*!
+ * Render state of one frame, written by the update and read by the render pass
+ */
+struct FrameSnapshot {
+    glm::vec3 cameraPosition;
+    // projection * view
+    Mat4f viewProjection;
+    // front to back
+    std::vector<RenderItem> items;
+    // the lights drawn as a pass each, copied so the render thread never reads the components
+    std::vector<PassLight> lights;
+    ClusterFrame clusters;
+    ShadowFrame shadows;
+};
 
+/*!
+ * Updates and draws are pipelined: render() draws the snapshot of the last update and starts the
+ * update of the next frame on the job system, so it runs while this frame is submitted and
+ * swapped. The update also culls and sorts the draw lists, the render thread only submits them.
+ * Everything that touches scene objects outside of update() has to waitForUpdate() first.
+ */
 class Scene {
 public:
     Scene(float width, float height);
 
+    ~Scene();
+
     void setSize(float width, float height);
 
+    /*!
+     * Overrides the shadow tier detected for the device
+     */
+    void setShadowQuality(ShadowQuality quality);
+
+    /*!
+     * Lights the PBR materials with the equirectangular .hdr asset at @a assetPath instead of the
+     * flat ambient intensity of the lights. It is loaded on a job, the flat ambient stays until
+     * it finished, or for good if the asset couldn't be loaded. The prefiltered maps are cached in
+     * @a cacheDirectory.
+     */
+    void loadEnvironment(AAssetManager *assetManager, const std::string &assetPath,
+                         const std::string &cacheDirectory);
+
+    /*!
+     * Lays down the depth of the opaque meshes with a position only program first, so the
+     * lighting shader runs once per pixel. On by default.
+     */
+    void setDepthPrepass(bool depthPrepass) { depthPrepass_ = depthPrepass; }
+
+    /*!
+     * Shows how many fragments were shaded per pixel instead of the lit scene, brighter is more
+     * overdraw. The average is logged every few frames.
+     */
+    void setOverdrawView(bool overdrawView);
+
+    /*!
+     * Skips meshes hidden behind the occluders of the scene, the culling rate is logged every few
+     * frames. On by default.
+     */
+    void setOcclusionCulling(bool occlusionCulling) { occlusionCulling_ = occlusionCulling; }
+
     void addObject(const std::shared_ptr<Component> &gameObject);
 
     void removeObject(Component *gameObject);
 
+    /*!
+     * Draws the snapshot of the last update, then starts the next update
+     */
     void render();
 
+    /*!
+     * Updates all components and records the next snapshot, runs on a worker
+     */
     void update();
 
+    /*!
+     * Blocks until the running update finished, scene objects can be changed afterwards
+     */
+    void waitForUpdate();
+
     void onDestroy();
 
+    /*!
+     * Lets every component rebuild its GL objects after the context was recreated
+     */
+    void onContextRestored();
+
     Camera *getMainCamera() const;
 
 private:
-    std::vector<std::shared_ptr<Component>> components_;
+    /*!
+     * Reads the overdraw view back and logs the average number of fragments per pixel, only every
+     * kOverdrawLogInterval frames since it stalls the pipeline
+     */
+    void logOverdraw();
+
+    /*!
+     * Logs the culling rate and the rasterizer time every kOcclusionLogInterval frames, from the
+     * update
+     */
+    void logOcclusion();
+
+    // every component writes the packed data of the systems into typed pools
+    EntityRegistry registry_;
+    std::unordered_map<Component *, Entity> entities_;
     std::shared_ptr<Camera> mainCamera_;
     std::shared_ptr<Mat4f> projectionMatrix_;
+    // per draw data written every frame
+    std::shared_ptr<StreamingBuffer> drawData_;
+    // joint matrices and morph target weights of every animated renderer, all pushed at the
+    // start of the frame
+    std::shared_ptr<StreamingBuffer> poseData_;
+    std::unique_ptr<LightClusters> lightClusters_;
+    // the first directional light casts shadows into these
+    std::unique_ptr<ShadowCascades> shadowCascades_;
+    // environment BRDF of the PBR materials
+    std::unique_ptr<BrdfLut> brdfLut_;
+    // ambient light of the PBR materials, the lights keep their flat ambient without one
+    std::unique_ptr<ImageBasedLight> imageBasedLight_;
+    std::unique_ptr<DepthShader> depthShader_;
+    // filled by the update while it animates, the draw lists are culled against it
+    std::unique_ptr<OcclusionCuller> occlusionCuller_;
+    std::vector<OccluderDraw> occluders_;
+    JobCounter occlusionCounter_;
+    bool occlusionCulling_ = true;
+    float width_ = 0;
+    float height_ = 0;
+    bool depthPrepass_ = true;
+    bool overdrawView_ = false;
+    int overdrawFrame_ = 0;
+    std::vector<uint8_t> overdrawPixels_;
+    // one snapshot is drawn while the update writes the other
+    FrameSnapshot snapshots_[2];
+    int renderSnapshot_ = 0;
+    JobCounter updateCounter_;
+    bool updating_ = false;
+    bool hasSnapshot_ = false;
+    // animations advance by the time between two updates
+    std::chrono::steady_clock::time_point lastUpdate_;
+    bool hasUpdated_ = false;
     float rotation_ = 0.2;
-    float deltaY = 0.2;
 
 };
 
@@ -0,0 +1,276 @@
+//
+// Created by Dark Matter on 6/26/24.
+//
+
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/*!
+ * Occluder triangles are clipped at this w, in front of the camera's near plane is enough
+ */
+static constexpr float kOcclusionNearW = 0.01f;
+
+/*!
+ * A box is tested against the pyramid level where it covers at most this many texels per side
+ */
+static constexpr int kOcclusionTestTexels = 4;
+
+OcclusionCuller::OcclusionCuller() {
+    int width = kOcclusionWidth;
+    int height = kOcclusionHeight;
+    while (true) {
+        levels_.push_back({width, height, std::vector<float>((size_t) width * height, 0.0f)});
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = std::max(1, (width + 1) / 2);
+        height = std::max(1, (height + 1) / 2);
+    }
+}
+
+void OcclusionCuller::rasterize(const std::vector<OccluderDraw> &occluders) {
+    auto start = std::chrono::steady_clock::now();
+    std::fill(levels_[0].depth.begin(), levels_[0].depth.end(), 0.0f);
+    hasOccluders_ = !occluders.empty();
+
+    for (const auto &occluder: occluders) {
+        const OccluderGeometry &geometry = *occluder.geometry;
+        clipPositions_.resize(geometry.positions.size());
+        for (size_t i = 0; i < geometry.positions.size(); ++i) {
+            clipPositions_[i] = occluder.projection * glm::vec4(geometry.positions[i], 1.0f);
+        }
+        for (size_t i = 0; i + 2 < geometry.indices.size(); i += 3) {
+            drawTriangle(clipPositions_[geometry.indices[i]],
+                         clipPositions_[geometry.indices[i + 1]],
+                         clipPositions_[geometry.indices[i + 2]]);
+        }
+        stats_.occluderTriangles += (uint32_t) (geometry.indices.size() / 3);
+    }
+    buildPyramid();
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stats_.rasterizeMs += elapsed.count();
+    stats_.frames++;
+}
+
+/*!
+ * @return x and y of @a clip in pixels of the depth buffer, 1 / w in z
+ */
+static inline glm::vec3 toScreen(const glm::vec4 &clip) {
+    float inverseW = 1.0f / clip.w;
+    return {(clip.x * inverseW * 0.5f + 0.5f) * (float) kOcclusionWidth,
+            (clip.y * inverseW * 0.5f + 0.5f) * (float) kOcclusionHeight,
+            inverseW};
+}
+
+void OcclusionCuller::drawTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c) {
+    const glm::vec4 *vertices[3] = {&a, &b, &c};
+    int behind = (a.w < kOcclusionNearW) + (b.w < kOcclusionNearW) + (c.w < kOcclusionNearW);
+    if (behind == 3) {
+        return;
+    }
+    if (behind == 0) {
+        rasterizeTriangle(toScreen(a), toScreen(b), toScreen(c));
+        return;
+    }
+
+    // cut off the part behind the near plane, what is left is a triangle or a quad
+    glm::vec3 polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec4 &from = *vertices[i];
+        const glm::vec4 &to = *vertices[(i + 1) % 3];
+        bool fromInside = from.w >= kOcclusionNearW;
+        bool toInside = to.w >= kOcclusionNearW;
+        if (fromInside) {
+            polygon[count++] = toScreen(from);
+        }
+        if (fromInside != toInside) {
+            float t = (kOcclusionNearW - from.w) / (to.w - from.w);
+            polygon[count++] = toScreen(from + (to - from) * t);
+        }
+    }
+    for (int i = 2; i < count; ++i) {
+        rasterizeTriangle(polygon[0], polygon[i - 1], polygon[i]);
+    }
+}
+
+void OcclusionCuller::rasterizeTriangle(const glm::vec3 &a, const glm::vec3 &b,
+                                        const glm::vec3 &c) {
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (std::abs(area) < 1e-6f) {
+        return;
+    }
+    // both faces occlude, counter clockwise keeps the inside of every edge positive
+    const glm::vec3 &v0 = a;
+    const glm::vec3 &v1 = area > 0.0f ? b : c;
+    const glm::vec3 &v2 = area > 0.0f ? c : b;
+    area = std::abs(area);
+
+    // pixels whose center is covered
+    int minX = std::max((int) ceilf(std::min({v0.x, v1.x, v2.x}) - 0.5f), 0);
+    int maxX = std::min((int) floorf(std::max({v0.x, v1.x, v2.x}) - 0.5f), kOcclusionWidth - 1);
+    int minY = std::max((int) ceilf(std::min({v0.y, v1.y, v2.y}) - 0.5f), 0);
+    int maxY = std::min((int) floorf(std::max({v0.y, v1.y, v2.y}) - 0.5f), kOcclusionHeight - 1);
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    // edge i is opposite of vertex i, e = ex * x + ey * y + e0
+    const glm::vec3 *edgeFrom[3] = {&v1, &v2, &v0};
+    const glm::vec3 *edgeTo[3] = {&v2, &v0, &v1};
+    float ex[3], ey[3], e0[3];
+    for (int i = 0; i < 3; ++i) {
+        ex[i] = edgeFrom[i]->y - edgeTo[i]->y;
+        ey[i] = edgeTo[i]->x - edgeFrom[i]->x;
+        e0[i] = -(ex[i] * edgeFrom[i]->x + ey[i] * edgeFrom[i]->y);
+    }
+    // 1 / w is a plane over the screen, built from the barycentric weights
+    float zx = (ex[0] * v0.z + ex[1] * v1.z + ex[2] * v2.z) / area;
+    float zy = (ey[0] * v0.z + ey[1] * v1.z + ey[2] * v2.z) / area;
+    float z0 = (e0[0] * v0.z + e0[1] * v1.z + e0[2] * v2.z) / area;
+
+    std::vector<float> &depth = levels_[0].depth;
+    int startX = minX & ~3;
+    for (int y = minY; y <= maxY; ++y) {
+        float py = (float) y + 0.5f;
+        float *row = depth.data() + (size_t) y * kOcclusionWidth;
+        float rowE[3] = {ey[0] * py + e0[0], ey[1] * py + e0[1], ey[2] * py + e0[2]};
+        float rowZ = zy * py + z0;
+#if defined(__ARM_NEON)
+        static const float kOffsets[4] = {0.5f, 1.5f, 2.5f, 3.5f};
+        float32x4_t offsets = vld1q_f32(kOffsets);
+        float32x4_t zero = vdupq_n_f32(0.0f);
+        for (int x = startX; x <= maxX; x += 4) {
+            float32x4_t px = vaddq_f32(vdupq_n_f32((float) x), offsets);
+            float32x4_t edge0 = vmlaq_f32(vdupq_n_f32(rowE[0]), vdupq_n_f32(ex[0]), px);
+            float32x4_t edge1 = vmlaq_f32(vdupq_n_f32(rowE[1]), vdupq_n_f32(ex[1]), px);
+            float32x4_t edge2 = vmlaq_f32(vdupq_n_f32(rowE[2]), vdupq_n_f32(ex[2]), px);
+            uint32x4_t inside = vandq_u32(vandq_u32(vcgeq_f32(edge0, zero),
+                                                    vcgeq_f32(edge1, zero)),
+                                          vcgeq_f32(edge2, zero));
+            float32x4_t z = vmlaq_f32(vdupq_n_f32(rowZ), vdupq_n_f32(zx), px);
+            float32x4_t stored = vld1q_f32(row + x);
+            vst1q_f32(row + x, vbslq_f32(inside, vmaxq_f32(stored, z), stored));
+        }
+#elif defined(__SSE__)
+        __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        __m128 zero = _mm_setzero_ps();
+        for (int x = startX; x <= maxX; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float) x), offsets);
+            __m128 edge0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ex[0]), px), _mm_set1_ps(rowE[0]));
+            __m128 edge1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ex[1]), px), _mm_set1_ps(rowE[1]));
+            __m128 edge2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ex[2]), px), _mm_set1_ps(rowE[2]));
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero),
+                                                  _mm_cmpge_ps(edge1, zero)),
+                                       _mm_cmpge_ps(edge2, zero));
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zx), px), _mm_set1_ps(rowZ));
+            __m128 stored = _mm_loadu_ps(row + x);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_max_ps(stored, z)),
+                                             _mm_andnot_ps(inside, stored)));
+        }
+#else
+        for (int x = startX; x <= maxX; ++x) {
+            float px = (float) x + 0.5f;
+            if (ex[0] * px + rowE[0] >= 0.0f && ex[1] * px + rowE[1] >= 0.0f
+                && ex[2] * px + rowE[2] >= 0.0f) {
+                row[x] = std::max(row[x], zx * px + rowZ);
+            }
+        }
+#endif
+    }
+}
+
+void OcclusionCuller::buildPyramid() {
+    for (size_t level = 1; level < levels_.size(); ++level) {
+        const Level &source = levels_[level - 1];
+        Level &target = levels_[level];
+        for (int y = 0; y < target.height; ++y) {
+            int y0 = std::min(y * 2, source.height - 1);
+            int y1 = std::min(y * 2 + 1, source.height - 1);
+            for (int x = 0; x < target.width; ++x) {
+                int x0 = std::min(x * 2, source.width - 1);
+                int x1 = std::min(x * 2 + 1, source.width - 1);
+                // the farthest depth, anything behind it is hidden in the whole texel
+                target.depth[x + y * target.width] = std::min(
+                        std::min(source.depth[x0 + y0 * source.width],
+                                 source.depth[x1 + y0 * source.width]),
+                        std::min(source.depth[x0 + y1 * source.width],
+                                 source.depth[x1 + y1 * source.width]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(const Mat4f &projection, const glm::vec3 &boundsMin,
+                                const glm::vec3 &boundsMax) {
+    stats_.tested++;
+    float minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY;
+    float minW = INFINITY;
+    int behind = 0;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec4 position((corner & 1) ? boundsMax.x : boundsMin.x,
+                           (corner & 2) ? boundsMax.y : boundsMin.y,
+                           (corner & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+        glm::vec4 clip = projection * position;
+        if (clip.w < kOcclusionNearW) {
+            behind++;
+            continue;
+        }
+        glm::vec3 screen = toScreen(clip);
+        minX = std::min(minX, screen.x);
+        maxX = std::max(maxX, screen.x);
+        minY = std::min(minY, screen.y);
+        maxY = std::max(maxY, screen.y);
+        minW = std::min(minW, clip.w);
+    }
+    if (behind == 8) {
+        stats_.outside++;
+        return false;
+    }
+    // the camera is inside or right in front of the box
+    if (behind > 0) {
+        return true;
+    }
+    if (maxX < 0.0f || minX > (float) kOcclusionWidth
+        || maxY < 0.0f || minY > (float) kOcclusionHeight) {
+        stats_.outside++;
+        return false;
+    }
+    if (!hasOccluders_) {
+        return true;
+    }
+
+    // one pixel more to every side, occluder pixels are covered at their center only
+    int x0 = std::max((int) floorf(minX) - 1, 0);
+    int x1 = std::min((int) floorf(maxX) + 1, kOcclusionWidth - 1);
+    int y0 = std::max((int) floorf(minY) - 1, 0);
+    int y1 = std::min((int) floorf(maxY) + 1, kOcclusionHeight - 1);
+    int level = 0;
+    while (level + 1 < (int) levels_.size()
+           && std::max((x1 >> level) - (x0 >> level), (y1 >> level) - (y0 >> level))
+              >= kOcclusionTestTexels) {
+        level++;
+    }
+
+    float farthest = INFINITY;
+    for (int y = y0 >> level; y <= y1 >> level; ++y) {
+        for (int x = x0 >> level; x <= x1 >> level; ++x) {
+            farthest = std::min(farthest, getDepth(level, x, y));
+        }
+    }
+    // the nearest point of the box is still behind every occluder it overlaps
+    if (1.0f / minW < farthest) {
+        stats_.culled++;
+        return false;
+    }
+    return true;
+}
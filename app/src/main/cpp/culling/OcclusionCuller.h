@@ -0,0 +1,133 @@
+//
+// Created by Dark Matter on 6/26/24.
+//
+
+#ifndef LEARNOPENGL_OCCLUSIONCULLER_H
+#define LEARNOPENGL_OCCLUSIONCULLER_H
+
+#include <cstdint>
+#include <vector>
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "math/mat4f.h"
+
+/*!
+ * Size of the occlusion depth buffer, the width has to be a multiple of 4 so rows are rasterized
+ * four pixels at a time
+ */
+static constexpr int kOcclusionWidth = 256;
+static constexpr int kOcclusionHeight = 128;
+
+static_assert(kOcclusionWidth % 4 == 0, "rows are rasterized in groups of four pixels");
+
+/*!
+ * Position only copy of a mesh that hides what is behind it, kept in model space like the mesh
+ */
+struct OccluderGeometry {
+    std::vector<glm::vec3> positions;
+    // triangle list, the same 16 bit indices as the mesh
+    std::vector<uint16_t> indices;
+};
+
+/*!
+ * One occluder to rasterize this frame
+ */
+struct OccluderDraw {
+    const OccluderGeometry *geometry;
+    // projection * view * model
+    Mat4f projection;
+};
+
+/*!
+ * Counters since the last resetStats()
+ */
+struct OcclusionStats {
+    uint32_t frames = 0;
+    uint32_t occluderTriangles = 0;
+    uint32_t tested = 0;
+    // outside the screen or behind the camera
+    uint32_t outside = 0;
+    // behind the occluders
+    uint32_t culled = 0;
+    // time spent rasterizing and building the pyramid
+    float rasterizeMs = 0.0f;
+};
+
+/*!
+ * Software occlusion culling. A few big occluders are rasterized into a small depth buffer on the
+ * CPU, four pixels per SIMD instruction, then a hierarchical-Z pyramid is built where every texel
+ * holds the farthest depth below it. Bounding boxes are projected to the screen and tested against
+ * the pyramid level where they cover at most a few texels, a box behind all of them is hidden.
+ *
+ * Depths are stored as 1 / w of the perspective projection, which interpolates linearly across the
+ * screen. 0 is infinitely far away, so the cleared buffer hides nothing.
+ *
+ * Independent of GL, it only needs the occluder geometry and the matrices of the frame.
+ */
+class OcclusionCuller {
+public:
+    OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller &) = delete;
+
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    /*!
+     * Clears the depth, draws @a occluders and builds the pyramid, safe to call from a worker
+     * thread as long as nothing tests at the same time
+     */
+    void rasterize(const std::vector<OccluderDraw> &occluders);
+
+    /*!
+     * @param projection projection * view * model of the box
+     * @return false if the box is outside the screen or behind the occluders
+     */
+    bool isVisible(const Mat4f &projection, const glm::vec3 &boundsMin,
+                   const glm::vec3 &boundsMax);
+
+    const OcclusionStats &getStats() const { return stats_; }
+
+    void resetStats() { stats_ = OcclusionStats(); }
+
+    int getLevelCount() const { return (int) levels_.size(); }
+
+    int getLevelWidth(int level) const { return levels_[level].width; }
+
+    int getLevelHeight(int level) const { return levels_[level].height; }
+
+    /*!
+     * @return 1 / w of the farthest occluder in the texel, 0 where there is none
+     */
+    float getDepth(int level, int x, int y) const {
+        return levels_[level].depth[x + y * levels_[level].width];
+    }
+
+private:
+    struct Level {
+        int width;
+        int height;
+        std::vector<float> depth;
+    };
+
+    /*!
+     * Clips the triangle against the near plane and rasterizes what is left
+     */
+    void drawTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+
+    /*!
+     * @param a, b, c screen x and y, 1 / w in z
+     */
+    void rasterizeTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+
+    void buildPyramid();
+
+    // clip positions of the occluder being drawn
+    std::vector<glm::vec4> clipPositions_;
+    // level 0 is the full resolution buffer
+    std::vector<Level> levels_;
+    OcclusionStats stats_;
+    bool hasOccluders_ = false;
+};
+
+
+#endif //LEARNOPENGL_OCCLUSIONCULLER_H
@@ -0,0 +1,196 @@
+//
+// Created by Dark Matter on 6/13/24.
+//
+
+#include "GpuResourceRegistry.h"
+#include "AndroidOut.h"
+#include <map>
+#include <utility>
+
+GpuResourceRegistry &GpuResourceRegistry::instance() {
+    static GpuResourceRegistry registry;
+    return registry;
+}
+
+GpuResourceRegistry::OwnerScope::OwnerScope(std::string owner)
+        : previous_(std::move(instance().owner_)) {
+    instance().owner_ = std::move(owner);
+}
+
+GpuResourceRegistry::OwnerScope::~OwnerScope() {
+    instance().owner_ = std::move(previous_);
+}
+
+GpuResourceInfo *GpuResourceRegistry::track(GpuResourceType type, GLuint id, size_t bytes) {
+    auto &info = resources_[key(type, id)];
+    info = {type, id, bytes, owner_, frame_, frame_};
+    return &info;
+}
+
+void GpuResourceRegistry::untrack(GpuResourceType type, GLuint id) {
+    resources_.erase(key(type, id));
+}
+
+size_t GpuResourceRegistry::getTotalBytes() const {
+    size_t total = 0;
+    for (const auto &resource: resources_) {
+        total += resource.second.bytes;
+    }
+    return total;
+}
+
+size_t GpuResourceRegistry::getTotalBytes(GpuResourceType type) const {
+    size_t total = 0;
+    for (const auto &resource: resources_) {
+        if (resource.second.type == type) {
+            total += resource.second.bytes;
+        }
+    }
+    return total;
+}
+
+void GpuResourceRegistry::dump() const {
+    struct Totals {
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+    // ordered so the log reads the same every time
+    std::map<std::string, Totals> owners;
+    std::map<GpuResourceType, Totals> types;
+    for (const auto &resource: resources_) {
+        auto &owner = owners[resource.second.owner];
+        owner.count++;
+        owner.bytes += resource.second.bytes;
+        auto &type = types[resource.second.type];
+        type.count++;
+        type.bytes += resource.second.bytes;
+    }
+
+    aout << "GPU memory at frame " << frame_ << ": " << getTotalBytes() / 1024 << " KiB in "
+         << resources_.size() << " objects" << std::endl;
+    for (const auto &type: types) {
+        aout << "  " << typeName(type.first) << ": " << type.second.count << " objects, "
+             << type.second.bytes / 1024 << " KiB" << std::endl;
+    }
+    for (const auto &owner: owners) {
+        aout << "  " << owner.first << ": " << owner.second.count << " objects, "
+             << owner.second.bytes / 1024 << " KiB" << std::endl;
+    }
+}
+
+size_t GpuResourceRegistry::reportLeaks() const {
+    if (resources_.empty()) {
+        aout << "No GPU resources leaked" << std::endl;
+        return 0;
+    }
+    for (const auto &resource: resources_) {
+        const auto &info = resource.second;
+        aout << "Leaked " << typeName(info.type) << " " << info.id << " (" << info.bytes
+             << " bytes) owned by " << info.owner << ", created at frame " << info.createdFrame
+             << ", last used at frame " << info.lastUsedFrame << std::endl;
+    }
+    return resources_.size();
+}
+
+void GpuResourceRegistry::contextLost() {
+    aout << "GL context lost, dropping " << resources_.size() << " resource records" << std::endl;
+    resources_.clear();
+    generation_++;
+}
+
+const char *GpuResourceRegistry::typeName(GpuResourceType type) {
+    switch (type) {
+        case GpuResourceType::BUFFER:
+            return "buffer";
+        case GpuResourceType::TEXTURE:
+            return "texture";
+        case GpuResourceType::VERTEX_ARRAY:
+            return "vertex array";
+        case GpuResourceType::SAMPLER:
+            return "sampler";
+        case GpuResourceType::PROGRAM:
+            return "program";
+        case GpuResourceType::FRAMEBUFFER:
+            return "framebuffer";
+    }
+    return "unknown";
+}
+
+GpuResource::GpuResource(GpuResourceType type, GLuint id, size_t bytes)
+        : type_(type), id_(id), generation_(GpuResourceRegistry::instance().getGeneration()),
+          info_(id ? GpuResourceRegistry::instance().track(type, id, bytes) : nullptr) {}
+
+GpuResource::~GpuResource() {
+    reset();
+}
+
+GpuResource::GpuResource(GpuResource &&other) noexcept
+        : type_(other.type_), id_(other.id_), generation_(other.generation_),
+          info_(other.info_) {
+    other.id_ = 0;
+    other.info_ = nullptr;
+}
+
+GpuResource &GpuResource::operator=(GpuResource &&other) noexcept {
+    if (this != &other) {
+        reset();
+        type_ = other.type_;
+        id_ = other.id_;
+        generation_ = other.generation_;
+        info_ = other.info_;
+        other.id_ = 0;
+        other.info_ = nullptr;
+    }
+    return *this;
+}
+
+void GpuResource::reset() {
+    if (id_ == 0) {
+        return;
+    }
+    if (!isCurrent()) {
+        // the name belonged to a lost context, it may already be reused by a new object
+        id_ = 0;
+        info_ = nullptr;
+        return;
+    }
+    switch (type_) {
+        case GpuResourceType::BUFFER:
+            glDeleteBuffers(1, &id_);
+            break;
+        case GpuResourceType::TEXTURE:
+            glDeleteTextures(1, &id_);
+            break;
+        case GpuResourceType::VERTEX_ARRAY:
+            glDeleteVertexArrays(1, &id_);
+            break;
+        case GpuResourceType::SAMPLER:
+            glDeleteSamplers(1, &id_);
+            break;
+        case GpuResourceType::PROGRAM:
+            glDeleteProgram(id_);
+            break;
+        case GpuResourceType::FRAMEBUFFER:
+            glDeleteFramebuffers(1, &id_);
+            break;
+    }
+    GpuResourceRegistry::instance().untrack(type_, id_);
+    id_ = 0;
+    info_ = nullptr;
+}
+
+bool GpuResource::isCurrent() const {
+    return id_ != 0 && generation_ == GpuResourceRegistry::instance().getGeneration();
+}
+
+void GpuResource::markUsed() const {
+    if (info_ && isCurrent()) {
+        info_->lastUsedFrame = GpuResourceRegistry::instance().getFrame();
+    }
+}
+
+void GpuResource::setBytes(size_t bytes) {
+    if (info_ && isCurrent()) {
+        info_->bytes = bytes;
+    }
+}
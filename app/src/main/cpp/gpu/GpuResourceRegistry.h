@@ -0,0 +1,173 @@
+//
+// Created by Dark Matter on 6/13/24.
+//
+
+#ifndef LEARNOPENGL_GPURESOURCEREGISTRY_H
+#define LEARNOPENGL_GPURESOURCEREGISTRY_H
+
+#include <GLES3/gl3.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+enum class GpuResourceType {
+    BUFFER,
+    TEXTURE,
+    VERTEX_ARRAY,
+    SAMPLER,
+    PROGRAM,
+    FRAMEBUFFER
+};
+
+/*!
+ * What the registry knows about a single GL object.
+ */
+struct GpuResourceInfo {
+    GpuResourceType type;
+    GLuint id;
+    // estimated device memory, including the mip chain for textures
+    size_t bytes;
+    // the model or system the object was created for
+    std::string owner;
+    uint64_t createdFrame;
+    uint64_t lastUsedFrame;
+};
+
+/*!
+ * Keeps a record of every GL buffer, texture, vertex array, sampler, program and framebuffer
+ * that is alive, so memory budgets can be checked and leaks found. Objects are registered through
+ * GpuResource handles, which also delete them again.
+ */
+class GpuResourceRegistry {
+public:
+    static GpuResourceRegistry &instance();
+
+    /*!
+     * Attributes every resource created while it is alive to @a owner. Scopes nest, the previous
+     * owner is restored when the scope ends.
+     */
+    class OwnerScope {
+    public:
+        explicit OwnerScope(std::string owner);
+
+        ~OwnerScope();
+
+        OwnerScope(const OwnerScope &) = delete;
+
+        OwnerScope &operator=(const OwnerScope &) = delete;
+
+    private:
+        std::string previous_;
+    };
+
+    GpuResourceInfo *track(GpuResourceType type, GLuint id, size_t bytes);
+
+    void untrack(GpuResourceType type, GLuint id);
+
+    /*!
+     * Advances the frame counter used for last-use stamps, call once per rendered frame
+     */
+    void nextFrame() { frame_++; }
+
+    constexpr uint64_t getFrame() const { return frame_; }
+
+    size_t getTotalBytes() const;
+
+    size_t getTotalBytes(GpuResourceType type) const;
+
+    size_t getResourceCount() const { return resources_.size(); }
+
+    /*!
+     * Logs totals per type and per owner
+     */
+    void dump() const;
+
+    /*!
+     * Logs every resource that is still registered, call after everything should have been
+     * released
+     * @return number of leaked resources
+     */
+    size_t reportLeaks() const;
+
+    static const char *typeName(GpuResourceType type);
+
+    /*!
+     * Forgets every registered object after the GL context was lost. Handles created before are
+     * stale from then on, they neither delete their old name nor touch the registry again.
+     */
+    void contextLost();
+
+    constexpr uint32_t getGeneration() const { return generation_; }
+
+private:
+    GpuResourceRegistry() = default;
+
+    static uint64_t key(GpuResourceType type, GLuint id) {
+        return ((uint64_t) type << 32) | id;
+    }
+
+    // node based, so pointers handed out by track() stay valid until untrack()
+    std::unordered_map<uint64_t, GpuResourceInfo> resources_;
+    std::string owner_ = "unowned";
+    uint64_t frame_ = 0;
+    // bumped on context loss, GL names from older generations are meaningless
+    uint32_t generation_ = 0;
+};
+
+/*!
+ * Owning handle to a GL object. Registers the object on creation and deletes it (and its record)
+ * when the handle is destroyed or reset. Move only.
+ */
+class GpuResource {
+public:
+    GpuResource() = default;
+
+    /*!
+     * Takes ownership of the already created GL object @a id
+     */
+    GpuResource(GpuResourceType type, GLuint id, size_t bytes);
+
+    ~GpuResource();
+
+    GpuResource(GpuResource &&other) noexcept;
+
+    GpuResource &operator=(GpuResource &&other) noexcept;
+
+    GpuResource(const GpuResource &) = delete;
+
+    GpuResource &operator=(const GpuResource &) = delete;
+
+    /*!
+     * Deletes the GL object now
+     */
+    void reset();
+
+    /*!
+     * Stamps the current frame as the last use of the object
+     */
+    void markUsed() const;
+
+    /*!
+     * Updates the recorded size after the storage of the object was specified again, e.g. when a
+     * buffer is orphaned with a new size
+     */
+    void setBytes(size_t bytes);
+
+    constexpr GLuint getId() const { return id_; }
+
+    constexpr bool isValid() const { return id_ != 0; }
+
+    /*!
+     * @return true if the object was created in the current GL context
+     */
+    bool isCurrent() const;
+
+private:
+    GpuResourceType type_ = GpuResourceType::BUFFER;
+    GLuint id_ = 0;
+    uint32_t generation_ = 0;
+    GpuResourceInfo *info_ = nullptr;
+};
+
+
+#endif //LEARNOPENGL_GPURESOURCEREGISTRY_H
@@ -0,0 +1,69 @@
+//
+// Created by Dark Matter on 6/19/24.
+//
+
+#include "RangeAllocator.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+RangeAllocator::RangeAllocator(size_t capacity) : capacity_(capacity), free_(capacity) {
+    if (capacity > 0) {
+        freeRanges_[0] = capacity;
+    }
+}
+
+bool RangeAllocator::allocate(size_t size, size_t &offset) {
+    if (size == 0 || size > free_) {
+        return false;
+    }
+    for (auto it = freeRanges_.begin(); it != freeRanges_.end(); ++it) {
+        if (it->second < size) {
+            continue;
+        }
+        offset = it->first;
+        size_t remaining = it->second - size;
+        freeRanges_.erase(it);
+        if (remaining > 0) {
+            freeRanges_[offset + size] = remaining;
+        }
+        free_ -= size;
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::free(size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    assert(offset + size <= capacity_);
+    free_ += size;
+    auto next = freeRanges_.lower_bound(offset);
+    assert(next == freeRanges_.end() || next->first >= offset + size);
+
+    // merge with the range in front
+    if (next != freeRanges_.begin()) {
+        auto previous = std::prev(next);
+        assert(previous->first + previous->second <= offset);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            freeRanges_.erase(previous);
+        }
+    }
+    // and with the one behind
+    if (next != freeRanges_.end() && next->first == offset + size) {
+        size += next->second;
+        freeRanges_.erase(next);
+    }
+    freeRanges_[offset] = size;
+}
+
+size_t RangeAllocator::getLargestFreeRange() const {
+    size_t largest = 0;
+    for (const auto &range: freeRanges_) {
+        largest = std::max(largest, range.second);
+    }
+    return largest;
+}
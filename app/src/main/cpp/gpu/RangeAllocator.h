@@ -0,0 +1,47 @@
+//
+// Created by Dark Matter on 6/19/24.
+//
+
+#ifndef LEARNOPENGL_RANGEALLOCATOR_H
+#define LEARNOPENGL_RANGEALLOCATOR_H
+
+#include <cstddef>
+#include <map>
+
+/*!
+ * Free list allocator for ranges of a fixed capacity, e.g. vertices of a shared buffer. Allocation
+ * is first fit, freed ranges are merged with their free neighbours so the space doesn't fragment
+ * when meshes are unloaded and loaded again. Sizes and offsets are in elements, not bytes.
+ */
+class RangeAllocator {
+public:
+    explicit RangeAllocator(size_t capacity);
+
+    /*!
+     * @return true if @a size elements were found, their start is written to @a offset
+     */
+    bool allocate(size_t size, size_t &offset);
+
+    /*!
+     * Returns a range handed out by allocate()
+     */
+    void free(size_t offset, size_t size);
+
+    constexpr size_t getCapacity() const { return capacity_; }
+
+    constexpr size_t getFree() const { return free_; }
+
+    /*!
+     * @return size of the biggest range that can be allocated right now
+     */
+    size_t getLargestFreeRange() const;
+
+private:
+    size_t capacity_;
+    size_t free_;
+    // start -> size of every free range, ordered so neighbours are found for merging
+    std::map<size_t, size_t> freeRanges_;
+};
+
+
+#endif //LEARNOPENGL_RANGEALLOCATOR_H
@@ -0,0 +1,178 @@
+//
+// Created by Dark Matter on 6/18/24.
+//
+
+#include "StreamingBuffer.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+/*!
+ * How long beginFrame() waits for a region before giving up and logging, in nanoseconds
+ */
+static constexpr GLuint64 kFenceTimeout = 1000000000;
+
+GlStreamingBufferBackend::~GlStreamingBufferBackend() {
+    clearFences();
+}
+
+void GlStreamingBufferBackend::allocate(size_t capacity) {
+    if (!buffer_.isCurrent()) {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        buffer_ = GpuResource(GpuResourceType::BUFFER, buffer, capacity);
+    } else {
+        // orphan in place, draws still in flight keep reading the old storage. The handle stays,
+        // a new one for the same name would delete the buffer when the old handle goes.
+        buffer_.setBytes(capacity);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_.getId());
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) capacity, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    capacity_ = capacity;
+}
+
+void GlStreamingBufferBackend::write(size_t offset, const void *data, size_t size) {
+    assert(offset + size <= capacity_);
+    // the copy write target leaves the uniform buffer bindings of the draws alone
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_.getId());
+    void *mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr) offset, (GLsizeiptr) size,
+                                    GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+                                    | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (mapped) {
+        memcpy(mapped, data, size);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    } else {
+        CHECK_GL_ERROR();
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GlStreamingBufferBackend::insertFence(int region) {
+    if (fences_[region]) {
+        glDeleteSync(fences_[region]);
+    }
+    fences_[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void GlStreamingBufferBackend::waitFence(int region) {
+    if (!fences_[region]) {
+        return;
+    }
+    auto status = glClientWaitSync(fences_[region], GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+        aout << "Streaming buffer region " << region << " is still in use" << std::endl;
+    }
+    glDeleteSync(fences_[region]);
+    fences_[region] = nullptr;
+}
+
+void GlStreamingBufferBackend::clearFences() {
+    // fences of a lost context are gone with it
+    bool current = buffer_.isCurrent();
+    for (auto &fence: fences_) {
+        if (fence && current) {
+            glDeleteSync(fence);
+        }
+        fence = nullptr;
+    }
+}
+
+void HostStreamingBufferBackend::allocate(size_t capacity) {
+    storage_.assign(capacity, 0);
+}
+
+void HostStreamingBufferBackend::write(size_t offset, const void *data, size_t size) {
+    assert(offset + size <= storage_.size());
+    memcpy(storage_.data() + offset, data, size);
+}
+
+void HostStreamingBufferBackend::insertFence(int region) {
+    fenced_[region] = true;
+    fenceInserts_++;
+}
+
+void HostStreamingBufferBackend::waitFence(int region) {
+    if (fenced_[region]) {
+        fenced_[region] = false;
+        fenceWaits_++;
+    }
+}
+
+void HostStreamingBufferBackend::clearFences() {
+    for (auto &fenced: fenced_) {
+        fenced = false;
+    }
+}
+
+StreamingBuffer::StreamingBuffer(std::unique_ptr<StreamingBufferBackend> backend,
+                                 size_t frameCapacity, size_t alignment)
+        : backend_(std::move(backend)), alignment_(alignment > 0 ? alignment : 1) {
+    // regions start aligned too, and never empty, growing doubles the capacity
+    frameCapacity_ = (std::max(frameCapacity, alignment_) + alignment_ - 1) / alignment_
+                     * alignment_;
+    backend_->allocate(frameCapacity_ * kStreamingFrames);
+}
+
+std::shared_ptr<StreamingBuffer> StreamingBuffer::createUniformRing(size_t frameCapacity) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return std::make_shared<StreamingBuffer>(std::make_unique<GlStreamingBufferBackend>(),
+                                             frameCapacity, (size_t) alignment);
+}
+
+void StreamingBuffer::beginFrame() {
+    assert(!inFrame_);
+    region_ = (region_ + 1) % kStreamingFrames;
+    backend_->waitFence(region_);
+    offset_ = 0;
+    inFrame_ = true;
+}
+
+void StreamingBuffer::endFrame() {
+    assert(inFrame_);
+    backend_->insertFence(region_);
+    inFrame_ = false;
+}
+
+size_t StreamingBuffer::push(const void *data, size_t size) {
+    assert(inFrame_);
+    size_t start = (offset_ + alignment_ - 1) / alignment_ * alignment_;
+    if (start + size > frameCapacity_) {
+        grow(start + size);
+        start = 0;
+    }
+    size_t offset = region_ * frameCapacity_ + start;
+    backend_->write(offset, data, size);
+    offset_ = start + size;
+    return offset;
+}
+
+void StreamingBuffer::reserve(size_t size) {
+    assert(inFrame_ && offset_ == 0);
+    if (size > frameCapacity_) {
+        grow(size);
+    }
+}
+
+void StreamingBuffer::grow(size_t required) {
+    size_t capacity = frameCapacity_;
+    while (capacity < required) {
+        capacity *= 2;
+    }
+    aout << "Streaming buffer grows to " << capacity << " bytes per frame" << std::endl;
+    frameCapacity_ = (capacity + alignment_ - 1) / alignment_ * alignment_;
+    // the new storage is not used by the GPU at all, no region needs waiting for
+    backend_->clearFences();
+    backend_->allocate(frameCapacity_ * kStreamingFrames);
+    offset_ = 0;
+}
+
+void StreamingBuffer::restore() {
+    backend_->clearFences();
+    backend_->allocate(frameCapacity_ * kStreamingFrames);
+    offset_ = 0;
+}
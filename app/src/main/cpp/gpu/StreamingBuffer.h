@@ -0,0 +1,187 @@
+//
+// Created by Dark Matter on 6/18/24.
+//
+
+#ifndef LEARNOPENGL_STREAMINGBUFFER_H
+#define LEARNOPENGL_STREAMINGBUFFER_H
+
+#include <GLES3/gl3.h>
+#include <memory>
+#include <vector>
+#include "GpuResourceRegistry.h"
+
+/*!
+ * Number of frames the ring is split into, the GPU may still read two of them while the CPU writes
+ * the third.
+ */
+static constexpr int kStreamingFrames = 3;
+
+/*!
+ * Storage behind a StreamingBuffer. The GL backend writes through unsynchronized mappings and
+ * guards every frame region with a fence, the host backend keeps everything in plain memory so the
+ * ring logic can be exercised without a GL context.
+ */
+class StreamingBufferBackend {
+public:
+    virtual ~StreamingBufferBackend() = default;
+
+    /*!
+     * Replaces the storage with @a capacity bytes, earlier contents are gone. Memory that is still
+     * read by the GPU stays valid for those reads (orphaning).
+     */
+    virtual void allocate(size_t capacity) = 0;
+
+    /*!
+     * Copies @a size bytes to @a offset, the range is known not to be in use by the GPU
+     */
+    virtual void write(size_t offset, const void *data, size_t size) = 0;
+
+    /*!
+     * Marks the end of the GPU commands that read frame @a region
+     */
+    virtual void insertFence(int region) = 0;
+
+    /*!
+     * Blocks until the GPU finished reading frame @a region
+     */
+    virtual void waitFence(int region) = 0;
+
+    /*!
+     * Drops all fences, after allocate() or when the context was lost
+     */
+    virtual void clearFences() = 0;
+
+    /*!
+     * @return the GL buffer to bind, 0 for backends without one
+     */
+    virtual GLuint getBuffer() const = 0;
+};
+
+/*!
+ * GL_UNIFORM_BUFFER backed ring, every write maps just the written range with
+ * GL_MAP_UNSYNCHRONIZED_BIT so the driver never waits for the GPU, the fences make that safe.
+ */
+class GlStreamingBufferBackend : public StreamingBufferBackend {
+public:
+    ~GlStreamingBufferBackend() override;
+
+    void allocate(size_t capacity) override;
+
+    void write(size_t offset, const void *data, size_t size) override;
+
+    void insertFence(int region) override;
+
+    void waitFence(int region) override;
+
+    void clearFences() override;
+
+    GLuint getBuffer() const override { return buffer_.getId(); }
+
+private:
+    GpuResource buffer_;
+    size_t capacity_ = 0;
+    GLsync fences_[kStreamingFrames] = {};
+};
+
+/*!
+ * Plain memory backend without GL calls, fences only count how often they were used.
+ */
+class HostStreamingBufferBackend : public StreamingBufferBackend {
+public:
+    void allocate(size_t capacity) override;
+
+    void write(size_t offset, const void *data, size_t size) override;
+
+    void insertFence(int region) override;
+
+    void waitFence(int region) override;
+
+    void clearFences() override;
+
+    GLuint getBuffer() const override { return 0; }
+
+    const std::vector<uint8_t> &getStorage() const { return storage_; }
+
+    int getFenceInserts() const { return fenceInserts_; }
+
+    int getFenceWaits() const { return fenceWaits_; }
+
+private:
+    std::vector<uint8_t> storage_;
+    bool fenced_[kStreamingFrames] = {};
+    int fenceInserts_ = 0;
+    int fenceWaits_ = 0;
+};
+
+/*!
+ * Ring buffer for data that changes every frame (per draw matrices now, instance, skinning or
+ * particle data later). The buffer is split into kStreamingFrames regions, one per frame in flight.
+ * Allocations are bump allocated from the current frame's region, beginFrame() waits until the GPU
+ * is done with the region it is about to reuse.
+ *
+ * Usage per frame: beginFrame(), push() and bind the returned range for every draw, endFrame().
+ */
+class StreamingBuffer {
+public:
+    /*!
+     * @param frameCapacity bytes available per frame, the ring grows when a frame needs more. At
+     * least one alignment unit is reserved.
+     * @param alignment every allocation starts at a multiple of this, e.g. the uniform buffer offset
+     * alignment
+     */
+    StreamingBuffer(std::unique_ptr<StreamingBufferBackend> backend, size_t frameCapacity,
+                    size_t alignment);
+
+    /*!
+     * Creates a uniform buffer ring using the driver's uniform buffer offset alignment
+     */
+    static std::shared_ptr<StreamingBuffer> createUniformRing(size_t frameCapacity);
+
+    void beginFrame();
+
+    void endFrame();
+
+    /*!
+     * Copies @a size bytes into the current frame.
+     * @return offset of the data in the buffer. If the frame is out of space the ring is reallocated
+     * bigger, ranges handed out before in the same frame must have been consumed by then.
+     */
+    size_t push(const void *data, size_t size);
+
+    /*!
+     * Makes sure the current frame holds @a size bytes, so the pushes that follow never grow the
+     * ring. Call right after beginFrame() when ranges have to stay valid for the whole frame.
+     */
+    void reserve(size_t size);
+
+    GLuint getBuffer() const { return backend_->getBuffer(); }
+
+    constexpr size_t getFrameCapacity() const { return frameCapacity_; }
+
+    constexpr size_t getAlignment() const { return alignment_; }
+
+    constexpr int getRegion() const { return region_; }
+
+    /*!
+     * @return bytes used in the current frame
+     */
+    constexpr size_t getUsed() const { return offset_; }
+
+    /*!
+     * Rebuilds the storage after the GL context was lost
+     */
+    void restore();
+
+private:
+    std::unique_ptr<StreamingBufferBackend> backend_;
+    size_t frameCapacity_;
+    size_t alignment_;
+    int region_ = 0;
+    size_t offset_ = 0;
+    bool inFrame_ = false;
+
+    void grow(size_t required);
+};
+
+
+#endif //LEARNOPENGL_STREAMINGBUFFER_H
@@ -0,0 +1,148 @@
+//
+// Created by Dark Matter on 6/16/24.
+//
+
+#include "UploadThread.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include <utility>
+
+UploadThread *UploadThread::instance_ = nullptr;
+
+UploadThread::UploadThread(EGLDisplay display, EGLConfig config, EGLContext shareContext)
+        : display_(display), context_(EGL_NO_CONTEXT), surface_(EGL_NO_SURFACE) {
+    EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    context_ = eglCreateContext(display_, config, shareContext, contextAttribs);
+    if (context_ == EGL_NO_CONTEXT) {
+        aout << "Unable to create the upload context, uploading on the render thread" << std::endl;
+        return;
+    }
+    EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    surface_ = eglCreatePbufferSurface(display_, config, pbufferAttribs);
+
+    running_ = true;
+    thread_ = std::thread(&UploadThread::run, this);
+    instance_ = this;
+}
+
+UploadThread::~UploadThread() {
+    if (instance_ == this) {
+        instance_ = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        jobs_.clear();
+    }
+    condition_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    // fences belong to the share group, the render context can delete them
+    for (const auto &completion: completions_) {
+        glDeleteSync(completion.fence);
+    }
+    completions_.clear();
+
+    if (surface_ != EGL_NO_SURFACE) {
+        eglDestroySurface(display_, surface_);
+    }
+    if (context_ != EGL_NO_CONTEXT) {
+        eglDestroyContext(display_, context_);
+    }
+}
+
+UploadThread *UploadThread::get() {
+    return instance_;
+}
+
+void UploadThread::enqueue(std::function<void()> upload, std::function<void()> onReady) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back({std::move(upload), std::move(onReady)});
+    }
+    condition_.notify_one();
+}
+
+void UploadThread::submit(std::function<void()> upload, std::function<void()> onReady) {
+    if (instance_) {
+        instance_->enqueue(std::move(upload), std::move(onReady));
+        return;
+    }
+    upload();
+    if (onReady) {
+        onReady();
+    }
+}
+
+void UploadThread::poll() {
+    std::vector<Completion> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // fences complete in submission order, stop at the first one that is still pending
+        size_t count = 0;
+        for (const auto &completion: completions_) {
+            auto status = glClientWaitSync(completion.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                break;
+            }
+            count++;
+        }
+        finished.assign(std::make_move_iterator(completions_.begin()),
+                        std::make_move_iterator(completions_.begin() + count));
+        completions_.erase(completions_.begin(), completions_.begin() + count);
+    }
+
+    // callbacks run without the lock, they may queue more uploads
+    for (auto &completion: finished) {
+        glDeleteSync(completion.fence);
+        completion.onReady();
+    }
+}
+
+bool UploadThread::isIdle() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_.empty() && completions_.empty() && !busy_;
+}
+
+void UploadThread::run() {
+    // aout is per thread, the GL errors of the jobs are logged whole and tagged as uploads
+    setLogTag("AOUpload");
+    if (eglMakeCurrent(display_, surface_, surface_, context_) != EGL_TRUE) {
+        aout << "Unable to make the upload context current" << std::endl;
+    }
+    // decoded rows are tightly packed, whatever their channel count
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return !running_ || !jobs_.empty(); });
+            if (!running_) {
+                break;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+            busy_ = true;
+        }
+
+        job.upload();
+        CHECK_GL_ERROR();
+        // drop what the job captured here, before the ready callback can release the last
+        // reference on the render thread
+        job.upload = nullptr;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (job.onReady) {
+            // flush so the fence actually reaches the GPU, the render thread only polls it
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            completions_.push_back({fence, std::move(job.onReady)});
+        }
+        busy_ = false;
+    }
+
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
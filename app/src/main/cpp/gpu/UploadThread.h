@@ -0,0 +1,106 @@
+//
+// Created by Dark Matter on 6/16/24.
+//
+
+#ifndef LEARNOPENGL_UPLOADTHREAD_H
+#define LEARNOPENGL_UPLOADTHREAD_H
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * Runs buffer and texture uploads on a second EGL context that shares its objects with the render
+ * context, so big glBufferData / glTexSubImage calls don't block frame submission.
+ *
+ * GL names are generated by the caller on the render thread, the upload thread only fills them.
+ * After a job with a ready callback the upload thread inserts a fence, the render thread polls the
+ * fences every frame and runs the callbacks of finished uploads, that is where objects that can't
+ * be shared (vertex arrays) are created.
+ *
+ * The upload thread logs through its own aout stream, tagged AOUpload.
+ */
+class UploadThread {
+public:
+    /*!
+     * Creates the shared context, @a shareContext has to be the render context
+     */
+    UploadThread(EGLDisplay display, EGLConfig config, EGLContext shareContext);
+
+    /*!
+     * Stops the thread, queued uploads that didn't run yet are dropped
+     */
+    ~UploadThread();
+
+    UploadThread(const UploadThread &) = delete;
+
+    UploadThread &operator=(const UploadThread &) = delete;
+
+    /*!
+     * @return the running upload thread, or nullptr when uploads have to happen inline
+     */
+    static UploadThread *get();
+
+    /*!
+     * @return false if the shared context could not be created, nothing is uploaded then
+     */
+    bool isValid() const { return context_ != EGL_NO_CONTEXT; }
+
+    /*!
+     * Queues @a upload to run on the upload context. Jobs run in the order they were queued.
+     * @param onReady runs on the render thread, from poll(), once the GPU finished the upload
+     */
+    void enqueue(std::function<void()> upload, std::function<void()> onReady = nullptr);
+
+    /*!
+     * Queues @a upload on the running upload thread, or runs it and @a onReady right away when
+     * there is none
+     */
+    static void submit(std::function<void()> upload, std::function<void()> onReady = nullptr);
+
+    /*!
+     * Runs the ready callbacks of finished uploads, never blocks. Call once per frame from the
+     * render thread.
+     */
+    void poll();
+
+    /*!
+     * @return true when nothing is queued or waiting for its fence
+     */
+    bool isIdle();
+
+private:
+    struct Job {
+        std::function<void()> upload;
+        std::function<void()> onReady;
+    };
+
+    struct Completion {
+        GLsync fence;
+        std::function<void()> onReady;
+    };
+
+    void run();
+
+    EGLDisplay display_;
+    EGLContext context_;
+    EGLSurface surface_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<Job> jobs_;
+    std::vector<Completion> completions_;
+    bool running_ = false;
+    bool busy_ = false;
+
+    static UploadThread *instance_;
+};
+
+
+#endif //LEARNOPENGL_UPLOADTHREAD_H
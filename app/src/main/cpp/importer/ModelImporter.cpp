@@ -7,40 +7,423 @@
 #include "assimp/Importer.hpp"
 #include "utils.h"
 #include "AndroidOut.h"
+#include "core/JobSystem.h"
 #include "mesh/Mesh.h"
 #include "mesh/MeshRenderer.h"
+#include "texture/TextureArrayPacker.h"
+#include "assimp/GltfMaterial.h"
+#include <algorithm>
+#include <cstring>
 #include <unordered_map>
 #include <utility>
 
+/*!
+ * Occluders are drawn with all their triangles, meshes with more are left out
+ */
+static constexpr size_t kMaxOccluderTriangles = 2048;
+
+/*!
+ * A mesh only occludes if the largest face of its bounds is at least this fraction of the largest
+ * one of the model
+ */
+static constexpr float kOccluderMinAreaFraction = 0.05f;
+
+static constexpr size_t kMaxOccludersPerModel = 16;
+
+/*!
+ * @return area of the largest face of the box, big for walls and floors even though they are thin
+ */
+static float largestFaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 size = boundsMax - boundsMin;
+    float extents[3] = {size.x, size.y, size.z};
+    std::sort(extents, extents + 3);
+    return extents[1] * extents[2];
+}
+
+/*!
+ * @return true if nothing shows through the material, masked and blended ones have holes
+ */
+static bool isOpaque(const aiMaterial *aiMaterial) {
+    aiString alphaMode;
+    if (aiMaterial->Get(AI_MATKEY_GLTF_ALPHAMODE, alphaMode) == AI_SUCCESS) {
+        return strcmp(alphaMode.C_Str(), "OPAQUE") == 0;
+    }
+    float opacity = 1.0f;
+    return aiMaterial->Get(AI_MATKEY_OPACITY, opacity) != AI_SUCCESS || opacity >= 1.0f;
+}
+
+/*!
+ * Clips that don't say how fast they run are played at this rate
+ */
+static constexpr double kDefaultTicksPerSecond = 25.0;
+
+/*!
+ * assimp matrices are row major with the translation in the last column, just like Mat4f
+ */
+static Mat4f toMat4f(const aiMatrix4x4 &t) {
+    return Mat4f(t.a1, t.a2, t.a3, t.a4,
+                 t.b1, t.b2, t.b3, t.b4,
+                 t.c1, t.c2, t.c3, t.c4,
+                 t.d1, t.d2, t.d3, t.d4);
+}
+
 std::shared_ptr<MeshRenderer>
 ModelImporter::import(Assimp::Importer *importer, const char *modelPath) {
+    // every GL object created for this model is accounted to it
+    GpuResourceRegistry::OwnerScope ownerScope(modelPath);
     std::shared_ptr<MeshRenderer> meshRenderer = std::make_shared<MeshRenderer>();
     auto aiScene = importer->ReadFile(modelPath, ASSIMP_LOAD_FLAGS);
     aout << "aiScene imported . " << aiScene << std::endl;
+    packTextures(aiScene, modelPath);
     loadMesh(meshRenderer, aiScene, modelPath);
     return meshRenderer;
 }
 
 void ModelImporter::loadMesh(std::shared_ptr<MeshRenderer> &meshRenderer,
                              const aiScene *aiScene, const char *modelPath) {
-    for (int i = 0; i < aiScene->mNumMeshes; ++i) {
-        aiMesh *aiMesh = aiScene->mMeshes[i];
+    TransformHierarchy &hierarchy = meshRenderer->getHierarchy();
+    std::vector<const aiNode *> nodes;
+    if (aiScene->mRootNode) {
+        loadNode(aiScene->mRootNode, TransformHierarchy::kNoParent, hierarchy, nodes);
+    }
+    hierarchy.captureRestPose();
+
+    // nodes moved by a clip and everything below them can't be baked for good
+    std::vector<std::shared_ptr<const AnimationClip>> clips =
+            loadAnimations(aiScene, hierarchy, nodes);
+    std::vector<uint8_t> animated(nodes.size(), 0);
+    for (const auto &clip: clips) {
+        for (int node: clip->nodes) {
+            animated[node] = 1;
+        }
+    }
+    for (int node = 0; node < (int) nodes.size(); ++node) {
+        int parent = hierarchy.getParent(node);
+        if (parent != TransformHierarchy::kNoParent && animated[parent]) {
+            animated[node] = 1;
+        }
+    }
+
+    // nodes referencing the same mesh share its material. Materials load textures and must stay on
+    // this thread, only the vertex baking runs on the job system.
+    struct MeshInstance {
+        int node;
+        unsigned int meshIndex;
         std::vector<Vertex> vertices;
         std::vector<Index> indices;
+        // skin joints of the bones, or the one joint a rigid mesh below an animated node follows
+        std::vector<int> boneJoints;
+        int rigidJoint = -1;
+        uint32_t firstMorphWeight = UINT32_MAX;
+        std::vector<MorphDelta> morphDeltas;
+    };
+    std::vector<MeshInstance> instances;
+    std::vector<std::shared_ptr<Material>> materials(aiScene->mNumMeshes);
+    Skin skin;
+    MorphWeights morphWeights;
+    for (int node = 0; node < (int) nodes.size(); ++node) {
+        // the meshes of a node share its weights, the one with the most targets provides them
+        const aiMesh *morphMesh = nullptr;
+        for (unsigned int i = 0; i < nodes[node]->mNumMeshes; ++i) {
+            const aiMesh *aiMesh = aiScene->mMeshes[nodes[node]->mMeshes[i]];
+            if (aiMesh->mNumAnimMeshes > 0
+                && (!morphMesh || aiMesh->mNumAnimMeshes > morphMesh->mNumAnimMeshes)) {
+                morphMesh = aiMesh;
+            }
+        }
+        uint32_t firstMorphWeight = UINT32_MAX;
+        if (morphMesh) {
+            std::vector<float> defaults(morphMesh->mNumAnimMeshes);
+            for (unsigned int target = 0; target < morphMesh->mNumAnimMeshes; ++target) {
+                defaults[target] = morphMesh->mAnimMeshes[target]->mWeight;
+            }
+            firstMorphWeight = morphWeights.addNode(node, defaults.data(),
+                                                    morphMesh->mNumAnimMeshes);
+            if (firstMorphWeight == UINT32_MAX) {
+                aout << "Morph weights are used up, node " << nodes[node]->mName.C_Str()
+                     << " stays in its rest pose" << std::endl;
+            }
+        }
+        for (unsigned int i = 0; i < nodes[node]->mNumMeshes; ++i) {
+            unsigned int meshIndex = nodes[node]->mMeshes[i];
+            const aiMesh *aiMesh = aiScene->mMeshes[meshIndex];
+            if (!materials[meshIndex]) {
+                materials[meshIndex] = loadMaterial(aiScene, aiMesh, modelPath);
+            }
+            instances.push_back({node, meshIndex});
+            MeshInstance &instance = instances.back();
+            if (aiMesh->mNumAnimMeshes > 0) {
+                instance.firstMorphWeight = firstMorphWeight;
+            }
+            const Mat4f &bakeMatrix = hierarchy.getWorldMatrix(node);
+            if (aiMesh->HasBones()) {
+                // the bone offsets start from the unbaked mesh, the vertices are baked already
+                Mat4f unbake = bakeMatrix.inverseAffine();
+                for (unsigned int bone = 0; bone < aiMesh->mNumBones; ++bone) {
+                    const aiBone *aiBone = aiMesh->mBones[bone];
+                    int boneNode = hierarchy.find(aiBone->mName.C_Str());
+                    int joint = boneNode == TransformHierarchy::kNoParent ? -1
+                            : skin.addJoint(boneNode, toMat4f(aiBone->mOffsetMatrix) * unbake);
+                    if (joint < 0) {
+                        aout << "Bone " << aiBone->mName.C_Str() << " of mesh " << meshIndex
+                             << " can't be skinned, the mesh stays in its rest pose" << std::endl;
+                        instance.boneJoints.clear();
+                        break;
+                    }
+                    instance.boneJoints.push_back(joint);
+                }
+            } else if (animated[node]) {
+                instance.rigidJoint = skin.addJoint(node, bakeMatrix.inverseAffine());
+                if (instance.rigidJoint < 0) {
+                    aout << "Skin is full, mesh " << meshIndex << " stays in its rest pose"
+                         << std::endl;
+                }
+            }
+        }
+    }
 
-        loadSingleMesh(aiMesh, vertices, indices);
+    JobSystem::parallelFor(instances.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            MeshInstance &instance = instances[i];
+            const std::shared_ptr<Material> &material = materials[instance.meshIndex];
+            float textureLayer = 0;
+            if (material->diffuseTexture) {
+                textureLayer = (float) material->diffuseTexture->getLayer();
+            }
+            const aiMesh *aiMesh = aiScene->mMeshes[instance.meshIndex];
+            const Mat4f &bakeMatrix = hierarchy.getWorldMatrix(instance.node);
+            loadSingleMesh(aiMesh, instance.vertices, instance.indices, textureLayer, bakeMatrix,
+                           instance.boneJoints, instance.rigidJoint);
+            if (instance.firstMorphWeight != UINT32_MAX) {
+                loadMorphTargets(aiMesh, bakeMatrix, instance.firstMorphWeight,
+                                 instance.vertices, instance.morphDeltas);
+            }
+        }
+    }, JobAffinity::BIG);
 
-        std::shared_ptr<Material> material = loadMaterial(aiScene, aiMesh, modelPath);
+    // the deltas go into one texture in instance order, the vertices learn where theirs landed
+    auto morphTargets = std::make_unique<MorphTargets>(MorphTargets::detectMaxDeltas());
+    for (auto &instance: instances) {
+        if (!instance.morphDeltas.empty()
+            && !morphTargets->addMesh(instance.morphDeltas, instance.vertices)) {
+            instance.morphDeltas.clear();
+        }
+    }
 
-        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(vertices, indices,
-                                                            material);
+    std::vector<std::shared_ptr<Mesh>> meshes;
+    for (auto &instance: instances) {
+        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(instance.vertices, instance.indices,
+                                                            materials[instance.meshIndex]);
+        mesh->setNode(instance.node);
+        mesh->setSkinned(!instance.boneJoints.empty() || instance.rigidJoint >= 0);
+        mesh->setMorphed(!instance.morphDeltas.empty());
+        mesh->setResidency(meshResidency_, meshCache_,
+                           std::string(modelPath) + "#" + std::to_string(instance.meshIndex)
+                           + "@" + std::to_string(instance.node));
+        meshes.push_back(mesh);
+    }
+
+    // the biggest opaque meshes with few triangles hide the rest of the scene from the culler
+    std::vector<std::pair<float, Mesh *>> candidates;
+    float largestArea = 0.0f;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        Mesh *mesh = meshes[i].get();
+        float area = largestFaceArea(mesh->getBoundsMin(), mesh->getBoundsMax());
+        largestArea = std::max(largestArea, area);
+        const aiMaterial *aiMaterial = aiScene->mMaterials
+                ? aiScene->mMaterials[aiScene->mMeshes[instances[i].meshIndex]->mMaterialIndex]
+                : nullptr;
+        // animated meshes leave their bounds, they can't hide anything reliably
+        if (!mesh->isAnimated() && mesh->getIndexCount() / 3 <= kMaxOccluderTriangles
+            && (!aiMaterial || isOpaque(aiMaterial))) {
+            candidates.emplace_back(area, mesh);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto &a, const auto &b) { return a.first > b.first; });
+    size_t occluderCount = 0;
+    for (const auto &candidate: candidates) {
+        if (occluderCount == kMaxOccludersPerModel
+            || candidate.first < largestArea * kOccluderMinAreaFraction) {
+            break;
+        }
+        candidate.second->makeOccluder();
+        occluderCount++;
+    }
+
+    for (const auto &mesh: meshes) {
         meshRenderer->addMesh(mesh);
     }
+    if (morphTargets->getDeltaCount() > 0) {
+        aout << "Morphed with " << morphWeights.size() << " weights, "
+             << morphTargets->getDeltaCount() << " deltas" << std::endl;
+        meshRenderer->setMorphTargets(std::move(morphTargets));
+    }
+    if (skin.size() > 0 || morphWeights.size() > 0) {
+        aout << "Skinned with " << skin.size() << " joints, " << clips.size() << " clips"
+             << std::endl;
+        auto animator = std::make_unique<Animator>(hierarchy, std::move(skin),
+                                                   std::move(morphWeights), std::move(clips));
+        if (animator->getClipCount() > 0) {
+            animator->play(0);
+        }
+        meshRenderer->setAnimator(std::move(animator));
+    }
+    aout << "Imported " << nodes.size() << " nodes, " << occluderCount << " meshes occlude"
+         << std::endl;
+}
+
+/*!
+ * @return node a morph weight channel animates, glTF exporters name either the node or its mesh
+ */
+static int findMorphNode(const aiScene *aiScene, const TransformHierarchy &hierarchy,
+                         const std::vector<const aiNode *> &nodes, const aiString &name) {
+    int node = hierarchy.find(name.C_Str());
+    if (node != TransformHierarchy::kNoParent) {
+        return node;
+    }
+    for (node = 0; node < (int) nodes.size(); ++node) {
+        for (unsigned int i = 0; i < nodes[node]->mNumMeshes; ++i) {
+            if (aiScene->mMeshes[nodes[node]->mMeshes[i]]->mName == name) {
+                return node;
+            }
+        }
+    }
+    return TransformHierarchy::kNoParent;
+}
+
+std::vector<std::shared_ptr<const AnimationClip>>
+ModelImporter::loadAnimations(const aiScene *aiScene, const TransformHierarchy &hierarchy,
+                              const std::vector<const aiNode *> &nodes) {
+    std::vector<std::shared_ptr<const AnimationClip>> clips;
+    for (unsigned int i = 0; i < aiScene->mNumAnimations; ++i) {
+        const aiAnimation *aiAnimation = aiScene->mAnimations[i];
+        double ticksPerSecond = aiAnimation->mTicksPerSecond > 0.0
+                                ? aiAnimation->mTicksPerSecond : kDefaultTicksPerSecond;
+        auto clip = std::make_shared<AnimationClip>();
+        clip->name = aiAnimation->mName.C_Str();
+        clip->duration = (float) (aiAnimation->mDuration / ticksPerSecond);
+        for (unsigned int channel = 0; channel < aiAnimation->mNumChannels; ++channel) {
+            const aiNodeAnim *aiNodeAnim = aiAnimation->mChannels[channel];
+            int node = hierarchy.find(aiNodeAnim->mNodeName.C_Str());
+            if (node == TransformHierarchy::kNoParent) {
+                continue;
+            }
+            for (unsigned int key = 0; key < aiNodeAnim->mNumPositionKeys; ++key) {
+                const aiVectorKey &position = aiNodeAnim->mPositionKeys[key];
+                clip->positionTimes.push_back((float) (position.mTime / ticksPerSecond));
+                clip->positions.emplace_back(position.mValue.x, position.mValue.y,
+                                             position.mValue.z);
+            }
+            for (unsigned int key = 0; key < aiNodeAnim->mNumRotationKeys; ++key) {
+                const aiQuatKey &rotation = aiNodeAnim->mRotationKeys[key];
+                clip->rotationTimes.push_back((float) (rotation.mTime / ticksPerSecond));
+                clip->rotations.emplace_back(rotation.mValue.x, rotation.mValue.y,
+                                             rotation.mValue.z, rotation.mValue.w);
+            }
+            for (unsigned int key = 0; key < aiNodeAnim->mNumScalingKeys; ++key) {
+                const aiVectorKey &scale = aiNodeAnim->mScalingKeys[key];
+                clip->scaleTimes.push_back((float) (scale.mTime / ticksPerSecond));
+                clip->scales.emplace_back(scale.mValue.x, scale.mValue.y, scale.mValue.z);
+            }
+            clip->endChannel(node);
+        }
+        for (unsigned int channel = 0; channel < aiAnimation->mNumMorphMeshChannels; ++channel) {
+            const aiMeshMorphAnim *aiMorphAnim = aiAnimation->mMorphMeshChannels[channel];
+            int node = findMorphNode(aiScene, hierarchy, nodes, aiMorphAnim->mName);
+            if (node == TransformHierarchy::kNoParent || aiMorphAnim->mNumKeys == 0) {
+                continue;
+            }
+            // keys list (target, weight) pairs, the clip stores every weight of every key
+            uint32_t count = 0;
+            for (unsigned int key = 0; key < aiMorphAnim->mNumKeys; ++key) {
+                const aiMeshMorphKey &morphKey = aiMorphAnim->mKeys[key];
+                for (unsigned int value = 0; value < morphKey.mNumValuesAndWeights; ++value) {
+                    count = std::max(count, morphKey.mValues[value] + 1);
+                }
+            }
+            clip->beginMorphChannel(node, count);
+            for (unsigned int key = 0; key < aiMorphAnim->mNumKeys; ++key) {
+                const aiMeshMorphKey &morphKey = aiMorphAnim->mKeys[key];
+                clip->morphTimes.push_back((float) (morphKey.mTime / ticksPerSecond));
+                size_t first = clip->morphWeights.size();
+                clip->morphWeights.resize(first + count, 0.0f);
+                for (unsigned int value = 0; value < morphKey.mNumValuesAndWeights; ++value) {
+                    clip->morphWeights[first + morphKey.mValues[value]] =
+                            (float) morphKey.mWeights[value];
+                }
+            }
+            clip->endMorphChannel();
+        }
+        if (clip->getChannelCount() > 0 || clip->getMorphChannelCount() > 0) {
+            clips.push_back(std::move(clip));
+        }
+    }
+    return clips;
+}
+
+void ModelImporter::loadNode(const aiNode *pNode, int parent, TransformHierarchy &hierarchy,
+                             std::vector<const aiNode *> &nodes) {
+    int node = hierarchy.addNode(pNode->mName.C_Str(), parent, toMat4f(pNode->mTransformation));
+    nodes.push_back(pNode);
+    for (unsigned int i = 0; i < pNode->mNumChildren; ++i) {
+        loadNode(pNode->mChildren[i], node, hierarchy, nodes);
+    }
+}
+
+void ModelImporter::setMeshResidency(MeshResidency residency, MeshCache *meshCache) {
+    meshResidency_ = residency;
+    meshCache_ = meshCache;
+}
+
+/*!
+ * Normalizes @a v, zero vectors (missing tangents) stay zero
+ */
+static glm::vec3 safeNormalize(const glm::vec3 &v) {
+    float length = glm::length(v);
+    return length > 0.0f ? v / length : v;
+}
+
+/*!
+ * Keeps the four strongest of @a count joint weights and stores them as bytes that add up to 255
+ */
+static void packWeights(const std::pair<float, int> *influences, size_t count, Vertex &vertex) {
+    std::pair<float, int> strongest[4] = {};
+    for (size_t i = 0; i < count; ++i) {
+        auto weakest = std::min_element(strongest, strongest + 4);
+        if (influences[i].first > weakest->first) {
+            *weakest = influences[i];
+        }
+    }
+    float sum = 0.0f;
+    for (const auto &influence: strongest) {
+        sum += influence.first;
+    }
+    if (sum <= 0.0f) {
+        return;
+    }
+    int total = 0;
+    int largest = 0;
+    for (int i = 0; i < 4; ++i) {
+        vertex.joints[i] = (uint8_t) strongest[i].second;
+        vertex.weights[i] = (uint8_t) (strongest[i].first / sum * 255.0f + 0.5f);
+        total += vertex.weights[i];
+        if (strongest[i].first > strongest[largest].first) {
+            largest = i;
+        }
+    }
+    // rounding must not scale the vertex
+    vertex.weights[largest] = (uint8_t) (vertex.weights[largest] + 255 - total);
 }
 
 void ModelImporter::loadSingleMesh(const aiMesh *aiMesh, std::vector<Vertex> &vertices,
-                                   std::vector<Index> &indices) {
+                                   std::vector<Index> &indices, float textureLayer,
+                                   const Mat4f &bakeMatrix, const std::vector<int> &boneJoints,
+                                   int rigidJoint) {
     const aiVector3D zero(0, 0, 0);
+    Mat3f directionMatrix(bakeMatrix);
+    // normals need the inverse transpose to stay perpendicular under non-uniform scale
+    Mat3f normalMatrix = Mat3f(bakeMatrix.inverseAffine()).Transpose();
     for (int index = 0; index < aiMesh->mNumVertices; ++index) {
         const aiVector3D &aPos = aiMesh->mVertices[index];
         const aiVector3D &aNormal = aiMesh->mNormals[index];
@@ -48,11 +431,35 @@ void ModelImporter::loadSingleMesh(const aiMesh *aiMesh, std::vector<Vertex> &ve
         const auto aTextCoor = aiMesh->HasTextureCoords(0) ? aiMesh->mTextureCoords[0][index]
                                                            : zero;
 
-        vertices.emplace_back(glm::vec3(aPos.x, aPos.y, aPos.z),
+        glm::vec4 position = bakeMatrix * glm::vec4(aPos.x, aPos.y, aPos.z, 1.0f);
+        vertices.emplace_back(glm::vec3(position),
                               glm::vec2(aTextCoor.x, aTextCoor.y),
-                              glm::vec3(aNormal.x, aNormal.y, aNormal.z),
-                              glm::vec3(aTangent.x, aTangent.y, aTangent.z)
+                              safeNormalize(normalMatrix * glm::vec3(aNormal.x, aNormal.y, aNormal.z)),
+                              safeNormalize(directionMatrix * glm::vec3(aTangent.x, aTangent.y, aTangent.z))
         );
+        vertices.back().layer = textureLayer;
+        if (rigidJoint >= 0) {
+            vertices.back().joints[0] = (uint8_t) rigidJoint;
+            vertices.back().weights[0] = 255;
+        }
+    }
+
+    if (!boneJoints.empty()) {
+        // assimp lists the weights by bone, they are gathered by vertex
+        std::vector<std::vector<std::pair<float, int>>> influences(aiMesh->mNumVertices);
+        for (unsigned int bone = 0; bone < aiMesh->mNumBones; ++bone) {
+            const aiBone *aiBone = aiMesh->mBones[bone];
+            for (unsigned int weight = 0; weight < aiBone->mNumWeights; ++weight) {
+                const aiVertexWeight &vertexWeight = aiBone->mWeights[weight];
+                influences[vertexWeight.mVertexId].emplace_back(vertexWeight.mWeight,
+                                                                boneJoints[bone]);
+            }
+        }
+        size_t first = vertices.size() - aiMesh->mNumVertices;
+        for (unsigned int index = 0; index < aiMesh->mNumVertices; ++index) {
+            packWeights(influences[index].data(), influences[index].size(),
+                        vertices[first + index]);
+        }
     }
 
     for (int index = 0; index < aiMesh->mNumFaces; ++index) {
@@ -66,6 +473,47 @@ void ModelImporter::loadSingleMesh(const aiMesh *aiMesh, std::vector<Vertex> &ve
 
 }
 
+void ModelImporter::loadMorphTargets(const aiMesh *aiMesh, const Mat4f &bakeMatrix,
+                                     uint32_t firstWeight, std::vector<Vertex> &vertices,
+                                     std::vector<MorphDelta> &deltas) {
+    Mat3f directionMatrix(bakeMatrix);
+    Mat3f normalMatrix = Mat3f(bakeMatrix.inverseAffine()).Transpose();
+    size_t first = vertices.size() - aiMesh->mNumVertices;
+    for (unsigned int index = 0; index < aiMesh->mNumVertices; ++index) {
+        const aiVector3D &basePosition = aiMesh->mVertices[index];
+        const aiVector3D &baseNormal = aiMesh->mNormals[index];
+        Vertex &vertex = vertices[first + index];
+        auto start = (uint32_t) deltas.size();
+        for (unsigned int target = 0; target < aiMesh->mNumAnimMeshes; ++target) {
+            const aiAnimMesh *aiAnimMesh = aiMesh->mAnimMeshes[target];
+            if (index >= aiAnimMesh->mNumVertices) {
+                continue;
+            }
+            // assimp stores the targets as whole meshes, most of their vertices don't move
+            aiVector3D position = aiAnimMesh->HasPositions()
+                                  ? aiAnimMesh->mVertices[index] - basePosition : aiVector3D();
+            aiVector3D normal = aiAnimMesh->HasNormals()
+                                ? aiAnimMesh->mNormals[index] : baseNormal;
+            if (position == aiVector3D() && normal == baseNormal) {
+                continue;
+            }
+            glm::vec3 normalDelta =
+                    safeNormalize(normalMatrix * glm::vec3(normal.x, normal.y, normal.z))
+                    - vertex.normal;
+            deltas.push_back({directionMatrix * glm::vec3(position.x, position.y, position.z),
+                              normalDelta, firstWeight + target});
+            // the count has 8 bits
+            if (deltas.size() - start == 255) {
+                break;
+            }
+        }
+        auto count = (uint32_t) deltas.size() - start;
+        if (count > 0) {
+            vertex.morph = start | (count << kMorphStartBits);
+        }
+    }
+}
+
 std::shared_ptr<Material> ModelImporter::loadMaterial(const aiScene *pScene,
                                                       const aiMesh *aiMesh,
                                                       const std::string& path) {
@@ -74,18 +522,38 @@ std::shared_ptr<Material> ModelImporter::loadMaterial(const aiScene *pScene,
     if (pScene->mMaterials) {
         auto aiMaterial = pScene->mMaterials[aiMesh->mMaterialIndex];
 
-        auto diffuseTexture = getTexture(aiMaterial, path, aiTextureType_DIFFUSE);
+        auto diffuseTexture = getTexture(pScene, aiMaterial, path, aiTextureType_DIFFUSE);
         if(diffuseTexture){
             material->diffuseTexture = diffuseTexture;
+            material->diffuseSampler = getSampler(aiMaterial, aiTextureType_DIFFUSE);
         }
-        auto specularTexture = getTexture(aiMaterial, path, aiTextureType_SHININESS, GL_RED);
+        auto specularTexture = getTexture(pScene, aiMaterial, path, aiTextureType_SHININESS,
+                                          TextureSemantic::MASK);
         if(specularTexture){
             material->specularTexture = specularTexture;
+            material->specularSampler = getSampler(aiMaterial, aiTextureType_SHININESS);
         }
 
-        auto normalTexture = getTexture(aiMaterial, path, aiTextureType_NORMALS);
+        auto normalTexture = getTexture(pScene, aiMaterial, path, aiTextureType_NORMALS,
+                                        TextureSemantic::NORMAL);
         if(normalTexture){
             material->normalTexture = normalTexture;
+            material->normalSampler = getSampler(aiMaterial, aiTextureType_NORMALS);
+        }
+
+        auto ormTexture = getOcclusionRoughnessMetallicTexture(pScene, aiMaterial, path);
+        if(ormTexture){
+            material->occlusionRoughnessMetallicTexture = ormTexture;
+            // occlusion and metallic-roughness share one texture, use the sampler of whichever
+            // map the material has
+            for (auto type: {aiTextureType_METALNESS, aiTextureType_DIFFUSE_ROUGHNESS,
+                             aiTextureType_UNKNOWN, aiTextureType_AMBIENT_OCCLUSION,
+                             aiTextureType_LIGHTMAP}) {
+                if (aiMaterial->GetTextureCount(type) > 0) {
+                    material->occlusionRoughnessMetallicSampler = getSampler(aiMaterial, type);
+                    break;
+                }
+            }
         }
 
         if (aiMaterial->mNumProperties > 0) {
@@ -98,18 +566,177 @@ std::shared_ptr<Material> ModelImporter::loadMaterial(const aiScene *pScene,
             if(aiMaterial->Get(AI_MATKEY_COLOR_SPECULAR, specularColor) == AI_SUCCESS){
                 material->specularColor = {specularColor.r, specularColor.g, specularColor.b};
             }
+
+            // glTF says how to use the alpha, other formats only have an opacity
+            aiString alphaMode;
+            float opacity = 1.0f;
+            if (aiMaterial->Get(AI_MATKEY_GLTF_ALPHAMODE, alphaMode) == AI_SUCCESS) {
+                material->blended = strcmp(alphaMode.C_Str(), "BLEND") == 0;
+            } else if (aiMaterial->Get(AI_MATKEY_OPACITY, opacity) == AI_SUCCESS) {
+                material->blended = opacity < 1.0f;
+            }
         }
 
+        material->pbr = loadPbrMaterial(pScene, aiMaterial, path, *material);
     }
+    material->updateShader();
     return material;
 }
 
-std::shared_ptr<TextureAsset> ModelImporter::getTexture(const aiMaterial *aiMaterial,
-                                                        const std::string& path, aiTextureType type, GLint format )  {
+bool ModelImporter::loadPbrMaterial(const aiScene *aiScene, const aiMaterial *aiMaterial,
+                                    const std::string &path, Material &material) {
+    // assimp only sets the metallic factor for materials with a metallic-roughness model
+    if (aiMaterial->Get(AI_MATKEY_METALLIC_FACTOR, material.metallicFactor) != AI_SUCCESS) {
+        return false;
+    }
+    aiMaterial->Get(AI_MATKEY_ROUGHNESS_FACTOR, material.roughnessFactor);
+    aiColor4D baseColor(1.f, 1.f, 1.f, 1.f);
+    if (aiMaterial->Get(AI_MATKEY_BASE_COLOR, baseColor) == AI_SUCCESS) {
+        material.baseColorFactor = {baseColor.r, baseColor.g, baseColor.b, baseColor.a};
+    }
+    aiColor3D emissive(0.f, 0.f, 0.f);
+    if (aiMaterial->Get(AI_MATKEY_COLOR_EMISSIVE, emissive) == AI_SUCCESS) {
+        // KHR_materials_emissive_strength lets emission go beyond 1
+        float strength = 1.0f;
+        aiMaterial->Get(AI_MATKEY_EMISSIVE_INTENSITY, strength);
+        material.emissiveFactor = glm::vec3(emissive.r, emissive.g, emissive.b) * strength;
+    }
+    aiMaterial->Get(AI_MATKEY_GLTF_TEXTURE_SCALE(aiTextureType_NORMALS, 0), material.normalScale);
+    // the glTF importer reports occlusion as a light map
+    if (aiMaterial->Get(AI_MATKEY_GLTF_TEXTURE_STRENGTH(aiTextureType_LIGHTMAP, 0),
+                        material.occlusionStrength) != AI_SUCCESS) {
+        aiMaterial->Get(AI_MATKEY_GLTF_TEXTURE_STRENGTH(aiTextureType_AMBIENT_OCCLUSION, 0),
+                        material.occlusionStrength);
+    }
+
+    auto emissiveTexture = getTexture(aiScene, aiMaterial, path, aiTextureType_EMISSIVE);
+    if (emissiveTexture) {
+        material.emissiveTexture = emissiveTexture;
+        material.emissiveSampler = getSampler(aiMaterial, aiTextureType_EMISSIVE);
+    }
+    return true;
+}
+
+std::shared_ptr<TextureAsset> ModelImporter::getTexture(const aiScene *aiScene,
+                                                        const aiMaterial *aiMaterial,
+                                                        const std::string& path, aiTextureType type,
+                                                        TextureSemantic semantic)  {
+
+    TextureSource source;
+    if (!resolveTextureSource(aiScene, aiMaterial, path, type, source)) {
+        return nullptr;
+    }
+
+    std::shared_ptr<TextureAsset> textureId;
+    std::string key = textureKey(source.name, semantic);
+
+    if (textures_.find(key) == textures_.end()) {
+        // a failed decode is remembered as nullptr, the materials sharing the image don't retry it
+        auto texture = TextureAsset::loadAsset(assetManager, source, semantic);
+        textures_.insert(std::make_pair(key, texture));
+        textureId = texture;
+    }else{
+        textureId = textures_.at(key);
+        if (textureId) {
+            aout << "Texture already loaded " << textureId << std::endl;
+        }
+    }
+    return textureId;
+}
+
+std::shared_ptr<TextureAsset>
+ModelImporter::getOcclusionRoughnessMetallicTexture(const aiScene *aiScene,
+                                                    const aiMaterial *aiMaterial,
+                                                    const std::string &path) {
+    // the glTF importer reports metallic-roughness under several types depending on its version,
+    // and occlusion as a light map
+    TextureSource roughnessMetallic;
+    if (!resolveTextureSource(aiScene, aiMaterial, path, aiTextureType_METALNESS,
+                              roughnessMetallic)
+        && !resolveTextureSource(aiScene, aiMaterial, path, aiTextureType_DIFFUSE_ROUGHNESS,
+                                 roughnessMetallic)) {
+        resolveTextureSource(aiScene, aiMaterial, path, aiTextureType_UNKNOWN, roughnessMetallic);
+    }
+    TextureSource occlusion;
+    if (!resolveTextureSource(aiScene, aiMaterial, path, aiTextureType_AMBIENT_OCCLUSION,
+                              occlusion)) {
+        resolveTextureSource(aiScene, aiMaterial, path, aiTextureType_LIGHTMAP, occlusion);
+    }
+    if (!roughnessMetallic.isValid() && !occlusion.isValid()) {
+        return nullptr;
+    }
+
+    std::string key = textureKey(occlusion.name + "|" + roughnessMetallic.name,
+                                 TextureSemantic::OCCLUSION_ROUGHNESS_METALLIC);
+    auto it = textures_.find(key);
+    if (it != textures_.end()) {
+        return it->second;
+    }
+    auto texture = TextureAsset::loadOcclusionRoughnessMetallic(assetManager, occlusion,
+                                                                roughnessMetallic);
+    textures_.insert(std::make_pair(key, texture));
+    return texture;
+}
+
+SamplerState ModelImporter::readSamplerState(const aiMaterial *aiMaterial, aiTextureType type) {
+    SamplerState state;
+
+    auto toWrap = [](int mapMode) -> GLenum {
+        switch (mapMode) {
+            case aiTextureMapMode_Clamp:
+            case aiTextureMapMode_Decal:
+                return GL_CLAMP_TO_EDGE;
+            case aiTextureMapMode_Mirror:
+                return GL_MIRRORED_REPEAT;
+            default:
+                return GL_REPEAT;
+        }
+    };
+    int mapMode;
+    if (aiMaterial->Get(AI_MATKEY_MAPPINGMODE_U(type, 0), mapMode) == AI_SUCCESS) {
+        state.wrapS = toWrap(mapMode);
+    }
+    if (aiMaterial->Get(AI_MATKEY_MAPPINGMODE_V(type, 0), mapMode) == AI_SUCCESS) {
+        state.wrapT = toWrap(mapMode);
+    }
+
+    // glTF stores the GL enums themselves
+    int filter;
+    if (aiMaterial->Get(AI_MATKEY_GLTF_MAPPINGFILTER_MAG(type, 0), filter) == AI_SUCCESS
+        && (filter == GL_NEAREST || filter == GL_LINEAR)) {
+        state.magFilter = (GLenum) filter;
+    }
+    if (aiMaterial->Get(AI_MATKEY_GLTF_MAPPINGFILTER_MIN(type, 0), filter) == AI_SUCCESS) {
+        switch (filter) {
+            case GL_NEAREST:
+            case GL_LINEAR:
+            case GL_NEAREST_MIPMAP_NEAREST:
+            case GL_LINEAR_MIPMAP_NEAREST:
+            case GL_NEAREST_MIPMAP_LINEAR:
+            case GL_LINEAR_MIPMAP_LINEAR:
+                state.minFilter = (GLenum) filter;
+                break;
+            default:
+                break;
+        }
+    }
+    return state;
+}
+
+const GpuResource *ModelImporter::getSampler(const aiMaterial *aiMaterial, aiTextureType type) {
+    return samplerCache_->get(readSamplerState(aiMaterial, type));
+}
+
+std::string ModelImporter::textureKey(const std::string &path, TextureSemantic semantic) {
+    return path + "#" + std::to_string((int) semantic);
+}
 
+bool ModelImporter::resolveTextureSource(const aiScene *aiScene, const aiMaterial *aiMaterial,
+                                         const std::string &path, aiTextureType type,
+                                         TextureSource &outSource) {
     unsigned int textureCount = aiMaterial->GetTextureCount(type);
     if (textureCount == 0) {
-        return nullptr;
+        return false;
     }
 
     aiString materialMath;
@@ -127,31 +754,53 @@ std::shared_ptr<TextureAsset> ModelImporter::getTexture(const aiMaterial *aiMate
                                nullptr, nullptr) == AI_SUCCESS) {
         std::string p(materialMath.data);
 
+        const aiTexture *embedded = aiScene->GetEmbeddedTexture(materialMath.C_Str());
+        if (embedded) {
+            // embedded names are only unique within a model, prefix them with the model path
+            std::string name = path + p;
+            if (embedded->mHeight == 0) {
+                // compressed, mWidth holds the size of the encoded image in bytes
+                outSource = TextureSource::fromMemory(name, embedded->pcData, embedded->mWidth);
+            } else {
+                outSource = TextureSource::fromRawTexels(name, embedded->pcData,
+                                                         (int32_t) embedded->mWidth,
+                                                         (int32_t) embedded->mHeight);
+            }
+            return true;
+        }
+
         if (p.substr(0, 2) == ".\\") {
             p = p.substr(2, p.size() - 2);
         }
-        std::string fullPath = getStringAfterAssets(p);
         std::string::size_type lastIndex = p.find("assets/");
 
         if (lastIndex == std::string::npos) {
-            fullPath = dir + "/" + p;
+            outSource = TextureSource::fromAsset(dir + "/" + p);
         } else {
-            fullPath = getStringAfterAssets(p);
+            outSource = TextureSource::fromAsset(getStringAfterAssets(p));
         }
+        return true;
+    }
+    return false;
+}
 
-        std::shared_ptr<TextureAsset> textureId;
-
-        if (textures_.find(fullPath) == textures_.end()) {
-            auto texture = TextureAsset::loadAsset(assetManager, fullPath, format);
-            textures_.insert(std::make_pair(fullPath, texture));
-            textureId = texture;
-        }else{
-            textureId = textures_.at(fullPath);
-            aout << "Texture already loaded " << textureId << std::endl;
+void ModelImporter::packTextures(const aiScene *aiScene, const std::string &path) {
+    if (!aiScene->mMaterials) {
+        return;
+    }
+    TextureArrayPacker packer(assetManager);
+    for (int i = 0; i < aiScene->mNumMaterials; ++i) {
+        TextureSource source;
+        if (resolveTextureSource(aiScene, aiScene->mMaterials[i], path, aiTextureType_DIFFUSE,
+                                 source)
+            && textures_.find(textureKey(source.name, TextureSemantic::COLOR)) == textures_.end()) {
+            packer.addCandidate(source);
         }
-      return textureId;
     }
-   return nullptr;
+    for (const auto &packed: packer.pack()) {
+        textures_.insert(std::make_pair(textureKey(packed.first, TextureSemantic::COLOR),
+                                        packed.second));
+    }
 }
 
 std::string ModelImporter::getStringAfterAssets(const std::string &filePath) {
@@ -163,7 +812,10 @@ std::string ModelImporter::getStringAfterAssets(const std::string &filePath) {
     return ""; // Return an empty string if "assets" is not found
 }
 
-ModelImporter::ModelImporter(AAssetManager *aAssetManager, ShaderLoader* shaderLoader) : assetManager(aAssetManager), shaderLoader_(shaderLoader) {
+ModelImporter::ModelImporter(AAssetManager *aAssetManager, ShaderLoader* shaderLoader,
+                             SamplerCache *samplerCache) : assetManager(aAssetManager),
+                                                           shaderLoader_(shaderLoader),
+                                                           samplerCache_(samplerCache) {
 
 }
 
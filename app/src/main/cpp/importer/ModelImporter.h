@@ -12,31 +12,131 @@
 #include "mesh/MeshRenderer.h"
 #include "assimp/mesh.h"
 #include "assimp/material.h"
+#include "assimp/scene.h"
+#include "texture/SamplerCache.h"
+#include "mesh/MeshCache.h"
 
 class ModelImporter {
 private:
     AAssetManager *assetManager;
     ShaderLoader *shaderLoader_;
+    SamplerCache *samplerCache_;
+    MeshCache *meshCache_ = nullptr;
+    MeshResidency meshResidency_ = MeshResidency::KEEP;
     std::unordered_map<std::string, std::shared_ptr<TextureAsset>> textures_;
 public:
-    ModelImporter(AAssetManager *aAssetManager, ShaderLoader* shaderLoader);
+    ModelImporter(AAssetManager *aAssetManager, ShaderLoader* shaderLoader,
+                  SamplerCache *samplerCache);
 
     std::shared_ptr<MeshRenderer> import(Assimp::Importer *importer, const char *modelPath);
 
+    /*!
+     * Residency policy given to every imported mesh, @a meshCache is where discarded data goes
+     */
+    void setMeshResidency(MeshResidency residency, MeshCache *meshCache);
+
+    /*!
+     * Creates a mesh for every mesh reference in the node graph. The nodes go into the renderer's
+     * TransformHierarchy, each mesh is baked with the world matrix of its node. The biggest
+     * opaque meshes with few triangles are made occluders.
+     *
+     * Meshes with bones and meshes below animated nodes become skinned meshes of one Skin, the
+     * renderer gets an Animator playing the first clip. Morph targets are stored as sparse deltas
+     * in the renderer's MorphTargets, driven by the weights of their node.
+     */
     void loadMesh(std::shared_ptr<MeshRenderer> &meshRenderer,
                   const aiScene *aiScene, const char *modelPath);
 
+    /*!
+     * Adds @a pNode and its children to @a hierarchy depth first
+     * @param nodes receives the assimp node of every hierarchy node, in the same order
+     */
+    static void loadNode(const aiNode *pNode, int parent, TransformHierarchy &hierarchy,
+                         std::vector<const aiNode *> &nodes);
+
+    /*!
+     * Converts the animations of the scene to clips, channels of nodes that aren't in
+     * @a hierarchy are dropped. Morph weight channels name the node or the mesh they animate,
+     * @a nodes resolves the latter.
+     */
+    static std::vector<std::shared_ptr<const AnimationClip>>
+    loadAnimations(const aiScene *aiScene, const TransformHierarchy &hierarchy,
+                   const std::vector<const aiNode *> &nodes);
+
+    /*!
+     * Appends the morph target deltas of the vertices loadSingleMesh() just added, only vertices
+     * a target moves get one
+     * @param firstWeight weight of the first target in MorphData
+     * @param deltas receives the deltas grouped by vertex, the vertices point into it
+     */
+    static void loadMorphTargets(const aiMesh *aiMesh, const Mat4f &bakeMatrix,
+                                 uint32_t firstWeight, std::vector<Vertex> &vertices,
+                                 std::vector<MorphDelta> &deltas);
+
+    /*!
+     * @param bakeMatrix transforms positions, normals and tangents before they are stored
+     * @param boneJoints skin joint of every bone of @a aiMesh, the vertices keep their four
+     * strongest weights. Empty for meshes without bones.
+     * @param rigidJoint joint every vertex follows fully, -1 if none
+     */
     void loadSingleMesh(const aiMesh *aiMesh, std::vector<Vertex> &vertices,
-                        std::vector<Index> &indices);
+                        std::vector<Index> &indices, float textureLayer = 0,
+                        const Mat4f &bakeMatrix = Mat4f(),
+                        const std::vector<int> &boneJoints = {}, int rigidJoint = -1);
+
+    /*!
+     * Packs the small diffuse textures of the scene into texture arrays before the materials are
+     * loaded, so materials pick up the shared array instead of loading their own texture.
+     */
+    void packTextures(const aiScene *aiScene, const std::string &path);
 
     std::shared_ptr<Material> loadMaterial(const aiScene *pScene,
                                            const aiMesh *aiMesh,
                                            const std::string& path);
 
+    /*!
+     * Reads the glTF metallic-roughness factors and the emissive texture of @a aiMaterial, the
+     * other textures are shared with the Blinn-Phong material
+     * @return false if the material has no metallic-roughness model
+     */
+    bool loadPbrMaterial(const aiScene *aiScene, const aiMaterial *aiMaterial,
+                         const std::string &path, Material &material);
+
     static std::string getStringAfterAssets(const std::string &filePath);
 
+    /*!
+     * Finds where the texture of @a type lives. Paths starting with '*' (GLB buffers, data uris)
+     * point at textures embedded in the scene, those are decoded from the importer's memory instead
+     * of the assets/ directory.
+     */
+    static bool resolveTextureSource(const aiScene *aiScene, const aiMaterial *aiMaterial,
+                                     const std::string &path, aiTextureType type,
+                                     TextureSource &outSource);
+
+    std::shared_ptr<TextureAsset>
+    getTexture(const aiScene *aiScene, const aiMaterial *aiMaterial, const std::string& path,
+               aiTextureType type, TextureSemantic semantic = TextureSemantic::COLOR);
+
+    /*!
+     * Reads the wrap and filter modes of the texture of @a type, glTF samplers are reported by
+     * assimp as mapping modes and raw GL filter values
+     */
+    static SamplerState readSamplerState(const aiMaterial *aiMaterial, aiTextureType type);
+
+    const GpuResource *getSampler(const aiMaterial *aiMaterial, aiTextureType type);
+
+    /*!
+     * Loads occlusion, roughness and metallic of a material as one packed RGB texture
+     */
     std::shared_ptr<TextureAsset>
-    getTexture(const aiMaterial *aiMaterial, const std::string& path, aiTextureType type, GLint format = GL_RGBA);
+    getOcclusionRoughnessMetallicTexture(const aiScene *aiScene, const aiMaterial *aiMaterial,
+                                         const std::string &path);
+
+    /*!
+     * The same file may be loaded with different channel layouts, so cached textures are keyed by
+     * path and semantic
+     */
+    static std::string textureKey(const std::string &path, TextureSemantic semantic);
 };
 
 
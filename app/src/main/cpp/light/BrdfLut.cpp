@@ -0,0 +1,94 @@
+//
+// Created by Dark Matter on 6/29/24.
+//
+
+#include "BrdfLut.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+
+/*!
+ * @return the radical inverse of @a bits, the second coordinate of the Hammersley point set
+ */
+static float radicalInverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return (float) bits * 2.3283064365386963e-10f;
+}
+
+BrdfLut::BrdfLut() : table_(generate(kBrdfLutSize, kBrdfLutSamples)) {
+}
+
+std::vector<float> BrdfLut::generate(int size, int sampleCount) {
+    std::vector<float> table((size_t) size * size * 2);
+    for (int row = 0; row < size; ++row) {
+        float roughness = ((float) row + 0.5f) / (float) size;
+        float alpha = roughness * roughness;
+        // Schlick-GGX geometry term with the k used for image based lighting
+        float k = alpha / 2.0f;
+        for (int column = 0; column < size; ++column) {
+            float nDotV = ((float) column + 0.5f) / (float) size;
+            // the normal is +z, the view vector lies in the xz plane
+            float viewX = std::sqrt(1.0f - nDotV * nDotV);
+            float viewZ = nDotV;
+            float scale = 0.0f;
+            float bias = 0.0f;
+            for (int sample = 0; sample < sampleCount; ++sample) {
+                // GGX importance sampled half vector, the lobe is symmetric around z so only its
+                // x and z matter for the reflected vector
+                float u = ((float) sample + 0.5f) / (float) sampleCount;
+                float v = radicalInverse((uint32_t) sample);
+                float phi = 2.0f * (float) M_PI * v;
+                float cosTheta = std::sqrt((1.0f - u) / (1.0f + (alpha * alpha - 1.0f) * u));
+                float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+                float halfX = sinTheta * std::cos(phi);
+                float halfZ = cosTheta;
+                float vDotH = viewX * halfX + viewZ * halfZ;
+                float lightZ = 2.0f * vDotH * halfZ - viewZ;
+                if (lightZ <= 0.0f) {
+                    continue;
+                }
+                float nDotL = lightZ;
+                float nDotH = halfZ;
+                vDotH = std::max(vDotH, 0.0f);
+                float geometry = nDotV / (nDotV * (1.0f - k) + k)
+                                 * nDotL / (nDotL * (1.0f - k) + k);
+                float visibility = geometry * vDotH / (nDotH * nDotV);
+                float fresnel = std::pow(1.0f - vDotH, 5.0f);
+                scale += (1.0f - fresnel) * visibility;
+                bias += fresnel * visibility;
+            }
+            size_t texel = ((size_t) row * size + column) * 2;
+            table[texel] = scale / (float) sampleCount;
+            table[texel + 1] = bias / (float) sampleCount;
+        }
+    }
+    return table;
+}
+
+void BrdfLut::bind() {
+    if (!texture_.isValid()) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, kBrdfLutSize, kBrdfLutSize);
+        // GLES converts the floats to halves on upload
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kBrdfLutSize, kBrdfLutSize, GL_RG, GL_FLOAT,
+                        table_.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        texture_ = GpuResource(GpuResourceType::TEXTURE, texture,
+                               (size_t) kBrdfLutSize * kBrdfLutSize * 2 * sizeof(uint16_t));
+        CHECK_GL_ERROR();
+    }
+    glActiveTexture(BRDF_LUT_UNIT);
+    glBindTexture(GL_TEXTURE_2D, texture_.getId());
+    texture_.markUsed();
+}
@@ -0,0 +1,58 @@
+//
+// Created by Dark Matter on 6/29/24.
+//
+
+#ifndef LEARNOPENGL_BRDFLUT_H
+#define LEARNOPENGL_BRDFLUT_H
+
+#include <GLES3/gl3.h>
+#include <vector>
+#include "gpu/GpuResourceRegistry.h"
+
+/*!
+ * Texels per side of the BRDF table, the terms change slowly enough for linear filtering
+ */
+static constexpr int kBrdfLutSize = 32;
+
+/*!
+ * GGX samples integrated per texel
+ */
+static constexpr int kBrdfLutSamples = 256;
+
+/*!
+ * Split-sum environment BRDF of the PBR shader. Integrating the GGX lobe over the hemisphere only
+ * depends on n.v and roughness, so it is done once on the CPU into a small RG16F table: the scale
+ * of F0 in red and the bias in green. The fragment shader gets the specular response to ambient
+ * light from one filtered fetch as F0 * r + g.
+ */
+class BrdfLut {
+public:
+    BrdfLut();
+
+    BrdfLut(const BrdfLut &) = delete;
+
+    BrdfLut &operator=(const BrdfLut &) = delete;
+
+    /*!
+     * Binds the table to BRDF_LUT_UNIT, it is uploaded on the first call
+     */
+    void bind();
+
+    /*!
+     * Forgets the texture after the GL context was lost, the next bind() uploads it again
+     */
+    void restore() { texture_.reset(); }
+
+    /*!
+     * @return @a size x @a size scale and bias pairs, n.v along the rows and roughness down the
+     * columns, both sampled at texel centers
+     */
+    static std::vector<float> generate(int size, int sampleCount);
+
+private:
+    std::vector<float> table_;
+    GpuResource texture_;
+};
+
+
+#endif //LEARNOPENGL_BRDFLUT_H
@@ -9,15 +9,15 @@
 #include "Light.h"
 
 class DirectionalLight : public Light {
-private:
-    glm::vec3 localDirection = {0, 0, 0};
 public :
     glm::vec3 direction = {0, 0, 0};
 
-    void calLocalDirection(const Transform& worldTransform);
-    void bind(Shader *shader, const glm::vec3 & cameraLocalPos) override;
+    PassLight getPassLight() const override;
 
-    const glm::vec3 &GetLocalDirection();
+    /*!
+     * The directional light casts the shadows of the scene
+     */
+    void refreshComponents(EntityRegistry &registry, Entity entity) override;
 };
 
 
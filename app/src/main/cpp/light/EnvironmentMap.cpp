@@ -0,0 +1,580 @@
+//
+// Created by Dark Matter on 6/30/24.
+//
+
+#include "EnvironmentMap.h"
+#include "AndroidOut.h"
+#include "core/JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "glm/geometric.hpp"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+    constexpr uint32_t kEnvironmentMagic = 0x4d564e45; // "ENVM"
+    constexpr uint32_t kEnvironmentVersion = 2;
+
+    struct EnvironmentHeader {
+        uint32_t magic;
+        uint32_t version;
+        // everything compute() depends on besides the source
+        uint32_t cubeSize;
+        uint32_t mipCount;
+        uint32_t samples;
+        float lodBias;
+        uint32_t filterScheme;
+        uint32_t padding;
+        uint64_t sourceHash;
+    };
+
+    /*!
+     * One RGBA pixel in a register, the sums over the environment are done four channels at once
+     */
+    struct Simd4 {
+#if defined(__ARM_NEON)
+        float32x4_t value;
+
+        static Simd4 zero() { return {vdupq_n_f32(0.0f)}; }
+
+        static Simd4 load(const float *source) { return {vld1q_f32(source)}; }
+
+        void store(float *target) const { vst1q_f32(target, value); }
+
+        // this + v * weight
+        Simd4 madd(Simd4 v, float weight) const { return {vmlaq_n_f32(value, v.value, weight)}; }
+#elif defined(__SSE__)
+        __m128 value;
+
+        static Simd4 zero() { return {_mm_setzero_ps()}; }
+
+        static Simd4 load(const float *source) { return {_mm_loadu_ps(source)}; }
+
+        void store(float *target) const { _mm_storeu_ps(target, value); }
+
+        Simd4 madd(Simd4 v, float weight) const {
+            return {_mm_add_ps(value, _mm_mul_ps(v.value, _mm_set1_ps(weight)))};
+        }
+#else
+        float value[4];
+
+        static Simd4 zero() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+
+        static Simd4 load(const float *source) {
+            return {{source[0], source[1], source[2], source[3]}};
+        }
+
+        void store(float *target) const { memcpy(target, value, sizeof(value)); }
+
+        Simd4 madd(Simd4 v, float weight) const {
+            return {{value[0] + v.value[0] * weight, value[1] + v.value[1] * weight,
+                     value[2] + v.value[2] * weight, value[3] + v.value[3] * weight}};
+        }
+#endif
+    };
+
+    /*!
+     * GGX half vector around +z with the mip of the source to read its light from
+     */
+    struct PrefilterSample {
+        glm::vec3 half;
+        float nDotL;
+        float lod;
+    };
+}
+
+/*!
+ * @return texels of all mips of the cubemap
+ */
+static size_t cubeTexelCount() {
+    size_t count = 0;
+    for (int mip = 0; mip < kEnvironmentMipCount; ++mip) {
+        count += (size_t) 6 * EnvironmentMap::mipSize(mip) * EnvironmentMap::mipSize(mip);
+    }
+    return count;
+}
+
+/*!
+ * Spherical harmonics basis constants in the order of the coefficients
+ */
+static constexpr float kShBasis[9] = {0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f,
+                                      1.092548f, 0.315392f, 1.092548f, 0.546274f};
+
+/*!
+ * Convolution with the clamped cosine per band, divided by pi for the reflected radiance
+ */
+static constexpr float kShCosineLobe[9] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f,
+                                           0.25f, 0.25f, 0.25f, 0.25f};
+
+/*!
+ * @return the radical inverse of @a bits, the second coordinate of the Hammersley point set
+ */
+static float radicalInverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return (float) bits * 2.3283064365386963e-10f;
+}
+
+/*!
+ * Reads one line of the .hdr header without the line feed
+ * @return false at the end of @a data
+ */
+static bool readLine(const uint8_t *data, size_t size, size_t &offset, std::string &line) {
+    line.clear();
+    while (offset < size) {
+        char c = (char) data[offset++];
+        if (c == '\n') {
+            return true;
+        }
+        line.push_back(c);
+    }
+    return false;
+}
+
+/*!
+ * Reads one run length encoded scanline, every channel is stored after the previous one
+ * @return false if the data runs out or a run overflows the line
+ */
+static bool readRleScanline(const uint8_t *data, size_t size, size_t &offset, int width,
+                            uint8_t *rgbe) {
+    for (int channel = 0; channel < 4; ++channel) {
+        int x = 0;
+        while (x < width) {
+            if (offset >= size) {
+                return false;
+            }
+            int count = data[offset++];
+            if (count > 128) {
+                count -= 128;
+                if (offset >= size || x + count > width) {
+                    return false;
+                }
+                uint8_t value = data[offset++];
+                for (int i = 0; i < count; ++i) {
+                    rgbe[(x++) * 4 + channel] = value;
+                }
+            } else {
+                if (count == 0 || offset + count > size || x + count > width) {
+                    return false;
+                }
+                for (int i = 0; i < count; ++i) {
+                    rgbe[(x++) * 4 + channel] = data[offset++];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool EnvironmentMap::decodeHdr(const uint8_t *data, size_t size, HdrImage &image) {
+    size_t offset = 0;
+    std::string line;
+    if (!readLine(data, size, offset, line)
+        || (line.rfind("#?RADIANCE", 0) != 0 && line.rfind("#?RGBE", 0) != 0)) {
+        aout << "Environment isn't a Radiance HDR image" << std::endl;
+        return false;
+    }
+    // header variables up to an empty line, only the pixel format matters
+    while (true) {
+        if (!readLine(data, size, offset, line)) {
+            aout << "Environment header is truncated" << std::endl;
+            return false;
+        }
+        if (line.empty()) {
+            break;
+        }
+        if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+            aout << "Environment pixel format " << line << " isn't supported" << std::endl;
+            return false;
+        }
+    }
+    // rows top to bottom, columns left to right is the only orientation panoramas use
+    int width = 0;
+    int height = 0;
+    if (!readLine(data, size, offset, line)
+        || sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2
+        || width <= 0 || height <= 0 || width > 0x7fff || height > 0x7fff) {
+        aout << "Environment resolution " << line << " isn't supported" << std::endl;
+        return false;
+    }
+
+    std::vector<float> pixels((size_t) width * height * 4);
+    std::vector<uint8_t> rgbe((size_t) width * 4);
+    for (int y = 0; y < height; ++y) {
+        bool rle = width >= 8 && offset + 4 <= size && data[offset] == 2 && data[offset + 1] == 2
+                   && ((data[offset + 2] << 8) | data[offset + 3]) == width;
+        if (rle) {
+            offset += 4;
+            if (!readRleScanline(data, size, offset, width, rgbe.data())) {
+                aout << "Environment scanline " << y << " is corrupt" << std::endl;
+                return false;
+            }
+        } else {
+            if (offset + rgbe.size() > size) {
+                aout << "Environment scanline " << y << " is truncated" << std::endl;
+                return false;
+            }
+            memcpy(rgbe.data(), data + offset, rgbe.size());
+            offset += rgbe.size();
+        }
+        float *row = pixels.data() + (size_t) y * width * 4;
+        for (int x = 0; x < width; ++x) {
+            const uint8_t *texel = rgbe.data() + x * 4;
+            // shared exponent, the mantissas are 8 bit fractions
+            float scale = texel[3] == 0 ? 0.0f : std::ldexp(1.0f, (int) texel[3] - 136);
+            row[x * 4] = (float) texel[0] * scale;
+            row[x * 4 + 1] = (float) texel[1] * scale;
+            row[x * 4 + 2] = (float) texel[2] * scale;
+            row[x * 4 + 3] = 0.0f;
+        }
+    }
+    image.width = width;
+    image.height = height;
+    image.pixels = std::move(pixels);
+    return true;
+}
+
+void EnvironmentMap::compute(const HdrImage &image) {
+    computeIrradiance(image);
+
+    // 2x2 box filtered mips down to a few texels, the wide lobes read them instead of thousands
+    // of source texels
+    std::vector<HdrImage> pyramid;
+    std::vector<const HdrImage *> levels = {&image};
+    pyramid.reserve(32);
+    while (levels.back()->height > 2) {
+        const HdrImage &source = *levels.back();
+        HdrImage &level = pyramid.emplace_back();
+        level.width = std::max(1, source.width / 2);
+        level.height = std::max(1, source.height / 2);
+        level.pixels.resize((size_t) level.width * level.height * 4);
+        JobSystem::parallelFor(level.height, 16, [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+                const float *top = source.pixels.data() + y * 2 * source.width * 4;
+                const float *bottom = top + (size_t) source.width * 4;
+                float *row = level.pixels.data() + y * level.width * 4;
+                for (int x = 0; x < level.width; ++x) {
+                    int left = std::min(x * 2, source.width - 1) * 4;
+                    int right = std::min(x * 2 + 1, source.width - 1) * 4;
+                    Simd4::zero().madd(Simd4::load(top + left), 0.25f)
+                            .madd(Simd4::load(top + right), 0.25f)
+                            .madd(Simd4::load(bottom + left), 0.25f)
+                            .madd(Simd4::load(bottom + right), 0.25f).store(row + x * 4);
+                }
+            }
+        }, JobAffinity::BIG);
+        levels.push_back(&level);
+    }
+    prefilter(levels);
+}
+
+void EnvironmentMap::computeIrradiance(const HdrImage &image) {
+    // every row adds up its own projection, summed afterwards in a fixed order so the result
+    // doesn't depend on how the rows were split over the workers
+    std::vector<float> rowSums((size_t) image.height * 9 * 4);
+    float dPhi = 2.0f * (float) M_PI / (float) image.width;
+    float dTheta = (float) M_PI / (float) image.height;
+    JobSystem::parallelFor(image.height, 8, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            float theta = ((float) y + 0.5f) * dTheta;
+            float sinTheta = std::sin(theta);
+            float dirY = std::cos(theta);
+            // solid angle of the texels in this row
+            float solidAngle = dPhi * dTheta * sinTheta;
+            Simd4 sums[9];
+            for (auto &sum: sums) {
+                sum = Simd4::zero();
+            }
+            const float *row = image.pixels.data() + y * image.width * 4;
+            for (int x = 0; x < image.width; ++x) {
+                float phi = ((float) x + 0.5f) * dPhi - (float) M_PI;
+                float dirX = sinTheta * std::cos(phi);
+                float dirZ = sinTheta * std::sin(phi);
+                Simd4 radiance = Simd4::load(row + x * 4);
+                sums[0] = sums[0].madd(radiance, solidAngle);
+                sums[1] = sums[1].madd(radiance, dirY * solidAngle);
+                sums[2] = sums[2].madd(radiance, dirZ * solidAngle);
+                sums[3] = sums[3].madd(radiance, dirX * solidAngle);
+                sums[4] = sums[4].madd(radiance, dirX * dirY * solidAngle);
+                sums[5] = sums[5].madd(radiance, dirY * dirZ * solidAngle);
+                sums[6] = sums[6].madd(radiance, (3.0f * dirZ * dirZ - 1.0f) * solidAngle);
+                sums[7] = sums[7].madd(radiance, dirX * dirZ * solidAngle);
+                sums[8] = sums[8].madd(radiance, (dirX * dirX - dirY * dirY) * solidAngle);
+            }
+            for (int k = 0; k < 9; ++k) {
+                sums[k].store(rowSums.data() + (y * 9 + k) * 4);
+            }
+        }
+    }, JobAffinity::BIG);
+
+    for (int k = 0; k < 9; ++k) {
+        double sum[3] = {0.0, 0.0, 0.0};
+        for (int y = 0; y < image.height; ++y) {
+            const float *rowSum = rowSums.data() + ((size_t) y * 9 + k) * 4;
+            sum[0] += rowSum[0];
+            sum[1] += rowSum[1];
+            sum[2] += rowSum[2];
+        }
+        // projection times the basis constant, convolved and times the constant of the basis
+        // function the shader evaluates
+        auto scale = (double) (kShCosineLobe[k] * kShBasis[k] * kShBasis[k]);
+        irradiance_[k] = glm::vec3((float) (sum[0] * scale), (float) (sum[1] * scale),
+                                   (float) (sum[2] * scale));
+    }
+}
+
+/*!
+ * @return bilinear sample of @a level at (@a u, @a v), wrapping around horizontally
+ */
+static Simd4 sampleLevel(const HdrImage &level, float u, float v) {
+    float x = u * (float) level.width - 0.5f;
+    float y = std::clamp(v * (float) level.height - 0.5f, 0.0f, (float) (level.height - 1));
+    float x0 = std::floor(x);
+    float y0 = std::floor(y);
+    float fx = x - x0;
+    float fy = y - y0;
+    int left = ((int) x0 % level.width + level.width) % level.width;
+    int right = left + 1 == level.width ? 0 : left + 1;
+    int top = (int) y0;
+    int bottom = std::min(top + 1, level.height - 1);
+    const float *topRow = level.pixels.data() + (size_t) top * level.width * 4;
+    const float *bottomRow = level.pixels.data() + (size_t) bottom * level.width * 4;
+    return Simd4::zero().madd(Simd4::load(topRow + left * 4), (1.0f - fx) * (1.0f - fy))
+            .madd(Simd4::load(topRow + right * 4), fx * (1.0f - fy))
+            .madd(Simd4::load(bottomRow + left * 4), (1.0f - fx) * fy)
+            .madd(Simd4::load(bottomRow + right * 4), fx * fy);
+}
+
+/*!
+ * @return radiance arriving from @a direction, blended between the two levels around @a lod
+ */
+static Simd4 sampleEnvironment(const std::vector<const HdrImage *> &levels,
+                               const glm::vec3 &direction, float lod) {
+    float u = std::atan2(direction.z, direction.x) * (0.5f / (float) M_PI) + 0.5f;
+    float v = std::acos(std::clamp(direction.y, -1.0f, 1.0f)) / (float) M_PI;
+    lod = std::clamp(lod, 0.0f, (float) (levels.size() - 1));
+    auto lower = (size_t) lod;
+    float blend = lod - (float) lower;
+    Simd4 result = Simd4::zero().madd(sampleLevel(*levels[lower], u, v), 1.0f - blend);
+    if (blend > 0.0f) {
+        result = result.madd(sampleLevel(*levels[lower + 1], u, v), blend);
+    }
+    return result;
+}
+
+void EnvironmentMap::prefilter(const std::vector<const HdrImage *> &levels) {
+    const HdrImage &source = *levels[0];
+    float sourceSolidAngle = 4.0f * (float) M_PI / (float) ((size_t) source.width * source.height);
+
+    texels_.assign(cubeTexelCount(), 0);
+
+    uint32_t *mipTexels = texels_.data();
+    for (int mip = 0; mip < kEnvironmentMipCount; ++mip) {
+        int size = mipSize(mip);
+        float texelSolidAngle = 4.0f * (float) M_PI / (float) (6 * size * size);
+
+        // the sharpest mip is a mirror, it only reads the source at the size of its texels
+        std::vector<PrefilterSample> samples;
+        if (mip == 0) {
+            float lod = std::max(0.0f, 0.5f * std::log2(texelSolidAngle / sourceSolidAngle));
+            samples.push_back({glm::vec3(0.0f, 0.0f, 1.0f), 1.0f, lod});
+        } else {
+            float roughness = (float) mip / (float) (kEnvironmentMipCount - 1);
+            float alpha = roughness * roughness;
+            float alpha2 = alpha * alpha;
+            for (int sample = 0; sample < kEnvironmentSamples; ++sample) {
+                float u = ((float) sample + 0.5f) / (float) kEnvironmentSamples;
+                float phi = 2.0f * (float) M_PI * radicalInverse((uint32_t) sample);
+                float cosTheta = std::sqrt((1.0f - u) / (1.0f + (alpha2 - 1.0f) * u));
+                float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+                // the view vector is the normal, so n.l = 2 (n.h)² - 1
+                float nDotL = 2.0f * cosTheta * cosTheta - 1.0f;
+                if (nDotL <= 0.0f) {
+                    continue;
+                }
+                // with n = v the pdf of l is D / 4, each sample covers 1 / (count * pdf)
+                float denominator = cosTheta * cosTheta * (alpha2 - 1.0f) + 1.0f;
+                float distribution = alpha2 / ((float) M_PI * denominator * denominator);
+                float sampleSolidAngle = 4.0f / ((float) kEnvironmentSamples * distribution);
+                float lod = 0.5f * std::log2(sampleSolidAngle / sourceSolidAngle)
+                            + kEnvironmentLodBias;
+                samples.push_back({glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi),
+                                             cosTheta), nDotL, lod});
+            }
+        }
+
+        JobSystem::parallelFor((size_t) 6 * size, 4, [&](size_t begin, size_t end) {
+            for (size_t line = begin; line < end; ++line) {
+                int face = (int) (line / size);
+                int y = (int) (line % size);
+                uint32_t *row = mipTexels + line * size;
+                float v = ((float) y + 0.5f) / (float) size * 2.0f - 1.0f;
+                for (int x = 0; x < size; ++x) {
+                    float u = ((float) x + 0.5f) / (float) size * 2.0f - 1.0f;
+                    glm::vec3 normal = cubeDirection(face, u, v);
+                    glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f)
+                                                              : glm::vec3(1.0f, 0.0f, 0.0f);
+                    glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+                    glm::vec3 bitangent = glm::cross(normal, tangent);
+                    Simd4 sum = Simd4::zero();
+                    float weight = 0.0f;
+                    for (const auto &sample: samples) {
+                        glm::vec3 half = tangent * sample.half.x + bitangent * sample.half.y
+                                         + normal * sample.half.z;
+                        glm::vec3 light = 2.0f * sample.half.z * half - normal;
+                        sum = sum.madd(sampleEnvironment(levels, light, sample.lod),
+                                       sample.nDotL);
+                        weight += sample.nDotL;
+                    }
+                    float rgba[4];
+                    sum.store(rgba);
+                    float inverseWeight = 1.0f / weight;
+                    rgba[0] *= inverseWeight;
+                    rgba[1] *= inverseWeight;
+                    rgba[2] *= inverseWeight;
+                    row[x] = packR11G11B10(rgba);
+                }
+            }
+        }, JobAffinity::BIG);
+        mipTexels += (size_t) 6 * size * size;
+    }
+}
+
+const uint32_t *EnvironmentMap::getTexels(int mip, int face) const {
+    size_t offset = 0;
+    for (int i = 0; i < mip; ++i) {
+        offset += (size_t) 6 * mipSize(i) * mipSize(i);
+    }
+    return texels_.data() + offset + (size_t) face * mipSize(mip) * mipSize(mip);
+}
+
+glm::vec3 EnvironmentMap::cubeDirection(int face, float u, float v) {
+    glm::vec3 direction;
+    switch (face) {
+        case 0:
+            direction = glm::vec3(1.0f, -v, -u);
+            break;
+        case 1:
+            direction = glm::vec3(-1.0f, -v, u);
+            break;
+        case 2:
+            direction = glm::vec3(u, 1.0f, v);
+            break;
+        case 3:
+            direction = glm::vec3(u, -1.0f, -v);
+            break;
+        case 4:
+            direction = glm::vec3(u, -v, 1.0f);
+            break;
+        default:
+            direction = glm::vec3(-u, -v, -1.0f);
+            break;
+    }
+    return glm::normalize(direction);
+}
+
+/*!
+ * @return @a value as an unsigned float with a 5 bit exponent and @a mantissaBits of mantissa
+ */
+static uint32_t packSmallFloat(float value, uint32_t mantissaBits) {
+    uint32_t largest = (30u << mantissaBits) | ((1u << mantissaBits) - 1);
+    // negative values and NaNs are black
+    if (!(value > 0.0f)) {
+        return 0;
+    }
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent >= 31) {
+        return largest;
+    }
+    if (exponent <= 0) {
+        if (exponent < -(int) mantissaBits) {
+            return 0;
+        }
+        // denormal, the implicit one becomes part of the mantissa
+        mantissa |= 0x800000;
+        uint32_t shift = 24 - mantissaBits - exponent;
+        uint32_t packed = mantissa >> shift;
+        packed += (mantissa >> (shift - 1)) & 1;
+        return packed;
+    }
+    // a mantissa that rounds up carries into the exponent, which is still the right number
+    uint32_t packed = ((uint32_t) exponent << mantissaBits) | (mantissa >> (23 - mantissaBits));
+    packed += (mantissa >> (22 - mantissaBits)) & 1;
+    return std::min(packed, largest);
+}
+
+uint32_t EnvironmentMap::packR11G11B10(const float *rgb) {
+    return packSmallFloat(rgb[0], 6) | (packSmallFloat(rgb[1], 6) << 11)
+           | (packSmallFloat(rgb[2], 5) << 22);
+}
+
+uint64_t EnvironmentMap::hashSource(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/*!
+ * @return the header of an environment computed from @a sourceHash by this build
+ */
+static EnvironmentHeader makeHeader(uint64_t sourceHash) {
+    return {kEnvironmentMagic, kEnvironmentVersion, kEnvironmentCubeSize, kEnvironmentMipCount,
+            kEnvironmentSamples, kEnvironmentLodBias, kEnvironmentFilterScheme, 0, sourceHash};
+}
+
+bool EnvironmentMap::store(const std::string &path, uint64_t sourceHash) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        aout << "Environment cache can't write " << path << std::endl;
+        return false;
+    }
+    EnvironmentHeader header = makeHeader(sourceHash);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(irradiance_), sizeof(irradiance_));
+    file.write(reinterpret_cast<const char *>(texels_.data()),
+               (std::streamsize) (texels_.size() * sizeof(uint32_t)));
+    return file.good();
+}
+
+bool EnvironmentMap::load(const std::string &path, uint64_t sourceHash) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    EnvironmentHeader header{};
+    EnvironmentHeader expected = makeHeader(sourceHash);
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    // the header has no implicit padding, every byte of it must match
+    if (!file || memcmp(&header, &expected, sizeof(header)) != 0) {
+        aout << "Environment cache " << path << " is stale" << std::endl;
+        return false;
+    }
+
+    glm::vec3 irradiance[9];
+    std::vector<uint32_t> texels(cubeTexelCount());
+    file.read(reinterpret_cast<char *>(irradiance), sizeof(irradiance));
+    file.read(reinterpret_cast<char *>(texels.data()),
+              (std::streamsize) (texels.size() * sizeof(uint32_t)));
+    if (!file) {
+        aout << "Environment cache " << path << " is truncated" << std::endl;
+        return false;
+    }
+    std::copy(irradiance, irradiance + 9, irradiance_);
+    texels_ = std::move(texels);
+    return true;
+}
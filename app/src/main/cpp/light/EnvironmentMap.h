@@ -0,0 +1,135 @@
+//
+// Created by Dark Matter on 6/30/24.
+//
+
+#ifndef LEARNOPENGL_ENVIRONMENTMAP_H
+#define LEARNOPENGL_ENVIRONMENTMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "glm/vec3.hpp"
+
+/*!
+ * Texels per side of the sharpest mip of the prefiltered cubemap
+ */
+static constexpr int kEnvironmentCubeSize = 128;
+
+/*!
+ * Mips of the prefiltered cubemap, roughness goes from 0 to 1 across them. The last one has 4
+ * texels per side, enough for the widest lobe.
+ */
+static constexpr int kEnvironmentMipCount = 6;
+
+/*!
+ * GGX samples per texel of the rough mips, each one is read from a source mip matching its
+ * footprint so few are enough
+ */
+static constexpr int kEnvironmentSamples = 64;
+
+/*!
+ * Mips the GGX samples read above their footprint, one level blurrier hides the sample pattern
+ */
+static constexpr float kEnvironmentLodBias = 1.0f;
+
+/*!
+ * How compute() filters the cubemap: GGX lobes importance sampled from a box filtered pyramid of
+ * the source. The cache stores it with the numbers above, changing any of them recomputes cached
+ * environments. Bump it when the filtering itself changes.
+ */
+static constexpr uint32_t kEnvironmentFilterScheme = 1;
+
+/*!
+ * Linear HDR image, RGBA floats so a pixel fills one SIMD register. Alpha is unused.
+ */
+struct HdrImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+};
+
+/*!
+ * Diffuse and specular image based lighting precomputed from an equirectangular HDR image:
+ *  - nine spherical harmonics coefficients of the irradiance (Ramamoorthi and Hanrahan), already
+ *    convolved with the cosine lobe and scaled by the basis constants, the shader evaluates them
+ *    with a handful of multiply-adds
+ *  - a cubemap whose mips are prefiltered with GGX lobes of growing roughness, read along the
+ *    reflected vector
+ *
+ * The work is spread over the job system and only needs the C++ library, so it runs on a desktop
+ * as well. The result is saved as a compact binary file with the texels packed as R11G11B10
+ * floats, the format of the GL texture, so a cached environment is uploaded without conversion.
+ */
+class EnvironmentMap {
+public:
+    /*!
+     * Decodes a Radiance .hdr file (RGBE, flat or run length encoded scanlines)
+     * @return false if @a data isn't one, @a image is untouched then
+     */
+    static bool decodeHdr(const uint8_t *data, size_t size, HdrImage &image);
+
+    /*!
+     * Projects @a image onto the spherical harmonics and prefilters the cubemap
+     */
+    void compute(const HdrImage &image);
+
+    /*!
+     * @return 64 bit FNV-1a hash of the encoded image, what the cache is keyed on
+     */
+    static uint64_t hashSource(const uint8_t *data, size_t size);
+
+    /*!
+     * Writes the result, @a sourceHash identifies the image it was computed from
+     * @return true if the file was written completely
+     */
+    bool store(const std::string &path, uint64_t sourceHash) const;
+
+    /*!
+     * Reads back what store() wrote. Files of another image or filtered with other parameters are
+     * rejected.
+     * @return true if the environment was loaded, it is untouched otherwise
+     */
+    bool load(const std::string &path, uint64_t sourceHash);
+
+    bool isValid() const { return !texels_.empty(); }
+
+    /*!
+     * @return the nine irradiance coefficients in the order frag.frag evaluates them: 1, y, z, x,
+     * xy, yz, 3z² - 1, xz, x² - y². Already divided by pi, they give what a white Lambert surface
+     * reflects.
+     */
+    const glm::vec3 *getIrradiance() const { return irradiance_; }
+
+    /*!
+     * @return packed texels of @a face of @a mip, row by row, faces in GL order (+X, -X, +Y, -Y,
+     * +Z, -Z)
+     */
+    const uint32_t *getTexels(int mip, int face) const;
+
+    static constexpr int mipSize(int mip) { return kEnvironmentCubeSize >> mip; }
+
+    /*!
+     * @return direction through the point (@a u, @a v) in [-1, 1] of cubemap @a face, GL layout
+     */
+    static glm::vec3 cubeDirection(int face, float u, float v);
+
+    /*!
+     * Packs the non-negative @a rgb like GL_UNSIGNED_INT_10F_11F_11F_REV, rounded to nearest.
+     * Values beyond the format are clamped to its largest one.
+     */
+    static uint32_t packR11G11B10(const float *rgb);
+
+private:
+    glm::vec3 irradiance_[9] = {};
+    // every mip after the previous one, the six faces of a mip one after another
+    std::vector<uint32_t> texels_;
+
+    void computeIrradiance(const HdrImage &image);
+
+    // levels are the source image and its box filtered mips, the widest lobes read small ones
+    void prefilter(const std::vector<const HdrImage *> &levels);
+};
+
+
+#endif //LEARNOPENGL_ENVIRONMENTMAP_H
@@ -0,0 +1,127 @@
+//
+// Created by Dark Matter on 6/30/24.
+//
+
+#include "ImageBasedLight.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "utils.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <sys/stat.h>
+
+ImageBasedLight::~ImageBasedLight() {
+    JobSystem::wait(loadCounter_);
+}
+
+void ImageBasedLight::load(AAssetManager *assetManager, const std::string &assetPath,
+                           const std::string &cacheDirectory) {
+    // one load at a time, the job of the previous one writes loaded_ as well
+    JobSystem::wait(loadCounter_);
+    JobSystem::submit([this, assetManager, assetPath, cacheDirectory]() {
+        loaded_ = loadEnvironment(assetManager, assetPath, cacheDirectory);
+    }, &loadCounter_, JobAffinity::LITTLE);
+}
+
+std::unique_ptr<EnvironmentMap>
+ImageBasedLight::loadEnvironment(AAssetManager *assetManager, const std::string &assetPath,
+                                 const std::string &cacheDirectory) {
+    // buffer mode maps uncompressed assets instead of copying
+    AAsset *asset = AAssetManager_open(assetManager, assetPath.c_str(), AASSET_MODE_BUFFER);
+    if (!asset) {
+        aout << "Environment asset not found : " << assetPath << std::endl;
+        return nullptr;
+    }
+    auto size = (size_t) AAsset_getLength(asset);
+    auto data = static_cast<const uint8_t *>(AAsset_getBuffer(asset));
+    if (!data) {
+        aout << "Environment asset can't be read : " << assetPath << std::endl;
+        AAsset_close(asset);
+        return nullptr;
+    }
+
+    // one cache file per asset path, the content hash inside tells whether it is still current
+    mkdir(cacheDirectory.c_str(), 0700);
+    char name[32];
+    snprintf(name, sizeof(name), "%016zx.env", std::hash<std::string>()(assetPath));
+    std::string cachePath = cacheDirectory + "/" + name;
+
+    auto environment = std::make_unique<EnvironmentMap>();
+    uint64_t sourceHash = EnvironmentMap::hashSource(data, size);
+    bool loaded = environment->load(cachePath, sourceHash);
+    if (!loaded) {
+        auto start = std::chrono::steady_clock::now();
+        HdrImage image;
+        loaded = EnvironmentMap::decodeHdr(data, size, image);
+        if (loaded) {
+            environment->compute(image);
+            environment->store(cachePath, sourceHash);
+            std::chrono::duration<float, std::milli> elapsed =
+                    std::chrono::steady_clock::now() - start;
+            aout << "Environment " << assetPath << " prefiltered in " << elapsed.count() << " ms"
+                 << std::endl;
+        }
+    }
+    AAsset_close(asset);
+    return loaded ? std::move(environment) : nullptr;
+}
+
+void ImageBasedLight::bind() {
+    if (loadCounter_.isDone() && loaded_) {
+        environment_ = std::move(loaded_);
+        // uploaded again below
+        restore();
+    }
+    if (!buffer_.isValid()) {
+        EnvironmentData data{};
+        if (environment_) {
+            for (int i = 0; i < 9; ++i) {
+                data.irradiance[i] = glm::vec4(environment_->getIrradiance()[i], 0.0f);
+            }
+            data.params = glm::vec4(1.0f, (float) (kEnvironmentMipCount - 1), 0.0f, 0.0f);
+        } else {
+            data.params = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+        }
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(data), &data, GL_STATIC_DRAW);
+        buffer_ = GpuResource(GpuResourceType::BUFFER, buffer, sizeof(data));
+        CHECK_GL_ERROR();
+    }
+    if (!texture_.isValid() && environment_) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, kEnvironmentMipCount, GL_R11F_G11F_B10F,
+                       kEnvironmentCubeSize, kEnvironmentCubeSize);
+        size_t bytes = 0;
+        for (int mip = 0; mip < kEnvironmentMipCount; ++mip) {
+            int size = EnvironmentMap::mipSize(mip);
+            for (int face = 0; face < 6; ++face) {
+                // the texels are packed like the texture stores them, nothing is converted
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, 0, 0, size, size,
+                                GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV,
+                                environment_->getTexels(mip, face));
+            }
+            bytes += (size_t) 6 * size * size * sizeof(uint32_t);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        texture_ = GpuResource(GpuResourceType::TEXTURE, texture, bytes);
+        CHECK_GL_ERROR();
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, ENVIRONMENT_DATA_UNIFORM_BINDING, buffer_.getId());
+    buffer_.markUsed();
+    glActiveTexture(ENVIRONMENT_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_.getId());
+    texture_.markUsed();
+}
+
+void ImageBasedLight::restore() {
+    buffer_.reset();
+    texture_.reset();
+}
@@ -0,0 +1,78 @@
+//
+// Created by Dark Matter on 6/30/24.
+//
+
+#ifndef LEARNOPENGL_IMAGEBASEDLIGHT_H
+#define LEARNOPENGL_IMAGEBASEDLIGHT_H
+
+#include <GLES3/gl3.h>
+#include <android/asset_manager.h>
+#include <memory>
+#include <string>
+#include "glm/vec4.hpp"
+#include "core/JobSystem.h"
+#include "gpu/GpuResourceRegistry.h"
+#include "EnvironmentMap.h"
+
+/*!
+ * std140 layout of the EnvironmentData uniform block
+ */
+struct EnvironmentData {
+    // EnvironmentMap::getIrradiance(), w unused
+    glm::vec4 irradiance[9];
+    // x: weight of the environment, 1 with one and 0 without. y: last mip of the cubemap. z: weight
+    // of the flat ambient term of the lights, the environment replaces it.
+    glm::vec4 params;
+};
+
+/*!
+ * Ambient light of the PBR materials from an environment map: the irradiance coefficients go into
+ * a uniform block and the prefiltered mips into an R11F_G11F_B10F cubemap. Without an environment
+ * the block tells the shader to keep the flat ambient intensity of the lights.
+ */
+class ImageBasedLight {
+public:
+    /*!
+     * Waits for a load that is still running
+     */
+    ~ImageBasedLight();
+
+    /*!
+     * Starts loading the equirectangular .hdr asset at @a assetPath on a job, the first bind()
+     * after it finished switches to it. The prefiltered result is cached in @a cacheDirectory,
+     * later starts read it back instead of decoding and filtering again. A missing asset, or one
+     * that isn't a Radiance HDR image, keeps the flat ambient.
+     */
+    void load(AAssetManager *assetManager, const std::string &assetPath,
+              const std::string &cacheDirectory);
+
+    /*!
+     * Binds the uniform block to ENVIRONMENT_DATA_UNIFORM_BINDING and the cubemap to
+     * ENVIRONMENT_UNIT, both are uploaded on the first call after a load finished
+     */
+    void bind();
+
+    /*!
+     * Forgets the GL objects after the context was lost, the next bind() uploads them again
+     */
+    void restore();
+
+private:
+    /*!
+     * Reads the cached environment of the asset, or decodes and prefilters it. Runs on a job.
+     * @return nullptr if the asset couldn't be loaded
+     */
+    static std::unique_ptr<EnvironmentMap> loadEnvironment(AAssetManager *assetManager,
+                                                           const std::string &assetPath,
+                                                           const std::string &cacheDirectory);
+
+    std::unique_ptr<EnvironmentMap> environment_;
+    // written by the load job, taken over by the first bind() after loadCounter_ is done
+    std::unique_ptr<EnvironmentMap> loaded_;
+    JobCounter loadCounter_;
+    GpuResource buffer_;
+    GpuResource texture_;
+};
+
+
+#endif //LEARNOPENGL_IMAGEBASEDLIGHT_H
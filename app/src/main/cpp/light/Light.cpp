@@ -5,20 +5,48 @@
 #include "Light.h"
 #include "Utility.h"
 
-void Light::bind(Shader *shader, const glm::vec3& cameraLocalPos) {
+void PassLight::bind(Shader *shader, const glm::vec3 &cameraLocalPos,
+                     const glm::vec3 &localDirection) const {
 
     if (shader->getLightColorLocation() != -1)
         glUniform3f(shader->getLightColorLocation(), color.r, color.g, color.b);
 
     if (shader->getAmbientIntensityLocation() != -1)
         glUniform1f(shader->getAmbientIntensityLocation(), ambientIntensity);
-    glUniform1f(shader->lightTypeLocation, 0);
+    glUniform1f(shader->lightTypeLocation, type == DIRECTIONAL ? 1 : 0);
     CHECK_GL_ERROR();
     glUniform3f(shader->getCameraLocalPosLocation(), cameraLocalPos.x, cameraLocalPos.y, cameraLocalPos.z);
 
+    if (type == DIRECTIONAL) {
+        if (shader->getLightDirectionLocation() != -1)
+            glUniform3f(shader->getLightDirectionLocation(), localDirection.x, localDirection.y,
+                        localDirection.z);
+
+        // the PBR programs shade in world space, towards the light like localDirection
+        if (shader->getLightWorldDirectionLocation() != -1)
+            glUniform3f(shader->getLightWorldDirectionLocation(), -direction.x, -direction.y,
+                        -direction.z);
+
+        if (shader->getDiffuseIntensityLocation() != -1)
+            glUniform1f(shader->getDiffuseIntensityLocation(), diffuseIntensity);
+    }
+
     CHECK_GL_ERROR();
 }
 
+PassLight Light::getPassLight() const {
+    return {BASE, glm::vec3(color), ambientIntensity, diffuseIntensity, glm::vec3(0.0f)};
+}
+
+void Light::writeComponents(EntityRegistry &registry, Entity entity) {
+    registry.add(entity, LightSource{});
+    refreshComponents(registry, entity);
+}
+
+void Light::refreshComponents(EntityRegistry &registry, Entity entity) {
+    *registry.get<LightSource>(entity) = LightSource{getPassLight(), glm::vec3(0.0f)};
+}
+
 Light::Light() {
 
 }
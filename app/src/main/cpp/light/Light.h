@@ -6,6 +6,7 @@
 #define LEARNOPENGL_LIGHT_H
 
 #include "vec4.hpp"
+#include "vec3.hpp"
 #include "core/Component.h"
 #include "shader/Shader.h"
 #include "core/Behaviour.h"
@@ -14,6 +15,37 @@ enum LightType {
     BASE, DIRECTIONAL
 };
 
+/*!
+ * What a pass needs of a light, copied by the update so the render thread never touches the
+ * component while the next update moves it
+ */
+struct PassLight {
+    LightType type;
+    glm::vec3 color;
+    float ambientIntensity;
+    float diffuseIntensity;
+    // world direction the light shines in, zero for BASE lights
+    glm::vec3 direction;
+
+    /*!
+     * @param cameraLocalPos camera position in the model space of the drawn object
+     * @param localDirection towards the light in the model space of the drawn object, see
+     * Transform::worldDirectionToLocal()
+     */
+    void bind(Shader *shader, const glm::vec3 &cameraLocalPos,
+              const glm::vec3 &localDirection) const;
+};
+
+/*!
+ * Scene component of the lights drawn as a separate pass over the renderables, point and spot
+ * lights are ClusteredLights instead
+ */
+struct LightSource {
+    PassLight pass;
+    // towards the light, zero for lights that don't cast shadows
+    glm::vec3 shadowDirection;
+};
+
 class Light : public Behaviour {
 public:
     Light();
@@ -21,7 +53,14 @@ public:
     float ambientIntensity = 1.0;
     float diffuseIntensity = 1.0;
 
-    void bind(Shader *shader, const glm::vec3 & cameraLocalPos) override;
+    /*!
+     * @return the state of the light its pass is drawn with
+     */
+    virtual PassLight getPassLight() const;
+
+    void writeComponents(EntityRegistry &registry, Entity entity) override;
+
+    void refreshComponents(EntityRegistry &registry, Entity entity) override;
 };
 
 
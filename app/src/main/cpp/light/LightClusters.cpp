@@ -0,0 +1,281 @@
+//
+// Created by Dark Matter on 6/24/24.
+//
+
+#include "LightClusters.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "utils.h"
+#include "core/JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/*!
+ * Depth where the exponential slices start, everything closer lands in the first slice
+ */
+static constexpr float kClusterNearDepth = 0.5f;
+
+/*!
+ * A light is cut off where its attenuated intensity drops below this
+ */
+static constexpr float kLightCutoff = 1.0f / 256.0f;
+
+/*!
+ * Tests a sphere against the bounds of four tiles, @a zDistance2 is the squared distance along
+ * view z which is the same for the whole slice
+ * @return bit i is set if the sphere touches tile i
+ */
+static inline int testTiles(const float *minX, const float *maxX, const float *minY,
+                            const float *maxY, float x, float y, float zDistance2,
+                            float radius2) {
+#if defined(__ARM_NEON)
+    float32x4_t centerX = vdupq_n_f32(x);
+    float32x4_t centerY = vdupq_n_f32(y);
+    float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t dx = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(minX), centerX),
+                                         vsubq_f32(centerX, vld1q_f32(maxX))), zero);
+    float32x4_t dy = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(minY), centerY),
+                                         vsubq_f32(centerY, vld1q_f32(maxY))), zero);
+    float32x4_t distance2 = vmlaq_f32(vmlaq_f32(vdupq_n_f32(zDistance2), dx, dx), dy, dy);
+    uint32x4_t inside = vcleq_f32(distance2, vdupq_n_f32(radius2));
+    static const uint32_t kBits[4] = {1, 2, 4, 8};
+    uint32x4_t bits = vandq_u32(inside, vld1q_u32(kBits));
+    uint32x2_t pairs = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+    return (int) vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+#elif defined(__SSE__)
+    __m128 centerX = _mm_set1_ps(x);
+    __m128 centerY = _mm_set1_ps(y);
+    __m128 zero = _mm_setzero_ps();
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(minX), centerX),
+                                      _mm_sub_ps(centerX, _mm_load_ps(maxX))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(minY), centerY),
+                                      _mm_sub_ps(centerY, _mm_load_ps(maxY))), zero);
+    __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                  _mm_set1_ps(zDistance2));
+    return _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_set1_ps(radius2)));
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        float dx = std::max(std::max(minX[i] - x, x - maxX[i]), 0.0f);
+        float dy = std::max(std::max(minY[i] - y, y - maxY[i]), 0.0f);
+        if (dx * dx + dy * dy + zDistance2 <= radius2) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+static_assert(kClusterTiles % 4 == 0, "tiles are tested in groups of four");
+
+LightClusters::LightClusters() : slices_(kClusterSlices) {
+    dataRing_ = StreamingBuffer::createUniformRing(sizeof(ClusterData));
+    createTextures();
+}
+
+void LightClusters::createTextures() {
+    // every cluster starts out empty, the shader must never see undefined counts
+    std::vector<uint32_t> emptyRanges(kClusterCount * 2, 0);
+    for (auto &textures: textures_) {
+        GLuint ids[2];
+        glGenTextures(2, ids);
+
+        glBindTexture(GL_TEXTURE_2D, ids[0]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG32UI, kClusterTiles, kClusterSlices);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kClusterTiles, kClusterSlices, GL_RG_INTEGER,
+                        GL_UNSIGNED_INT, emptyRanges.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        textures.ranges = GpuResource(GpuResourceType::TEXTURE, ids[0],
+                                      kClusterCount * 2 * sizeof(uint32_t));
+
+        glBindTexture(GL_TEXTURE_2D, ids[1]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, kLightIndexTextureWidth,
+                       kLightIndexTextureRows);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        textures.indices = GpuResource(GpuResourceType::TEXTURE, ids[1], kMaxLightIndices);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    CHECK_GL_ERROR();
+}
+
+void LightClusters::restore() {
+    dataRing_->restore();
+    createTextures();
+}
+
+void LightClusters::setProjection(const Mat4f &projection, float near, float far, float width,
+                                  float height) {
+    float tanX = 1.0f / projection.m[0][0];
+    float tanY = 1.0f / projection.m[1][1];
+    float depthRatio = logf(far / kClusterNearDepth);
+    far_ = far;
+    scale_ = glm::vec4(kClusterTilesX / width, kClusterTilesY / height,
+                       kClusterSlices / depthRatio,
+                       -logf(kClusterNearDepth) * kClusterSlices / depthRatio);
+
+    for (int slice = 0; slice < kClusterSlices; ++slice) {
+        ClusterSlice &bounds = slices_[slice];
+        bounds.minZ = slice == 0 ? near : kClusterNearDepth
+                                          * expf(depthRatio * slice / kClusterSlices);
+        bounds.maxZ = kClusterNearDepth * expf(depthRatio * (slice + 1) / kClusterSlices);
+        for (int tileY = 0; tileY < kClusterTilesY; ++tileY) {
+            float y0 = (-1.0f + 2.0f * tileY / kClusterTilesY) * tanY;
+            float y1 = (-1.0f + 2.0f * (tileY + 1) / kClusterTilesY) * tanY;
+            for (int tileX = 0; tileX < kClusterTilesX; ++tileX) {
+                float x0 = (-1.0f + 2.0f * tileX / kClusterTilesX) * tanX;
+                float x1 = (-1.0f + 2.0f * (tileX + 1) / kClusterTilesX) * tanX;
+                // the tile widens with depth, its box spans both ends of the slice
+                int tile = tileX + tileY * kClusterTilesX;
+                bounds.minX[tile] = std::min(x0 * bounds.minZ, x0 * bounds.maxZ);
+                bounds.maxX[tile] = std::max(x1 * bounds.minZ, x1 * bounds.maxZ);
+                bounds.minY[tile] = std::min(y0 * bounds.minZ, y0 * bounds.maxZ);
+                bounds.maxY[tile] = std::max(y1 * bounds.minZ, y1 * bounds.maxZ);
+            }
+        }
+    }
+}
+
+float LightClusters::lightRadius(const ClusteredLight &light, float maxRadius) {
+    float intensity = std::max(std::max(light.color.r, light.color.g), light.color.b)
+                      * std::max(light.attenuation.w, light.color.a);
+    // solve constant + linear * d + exp * d^2 = intensity / cutoff
+    float c = light.attenuation.x - intensity / kLightCutoff;
+    float l = light.attenuation.y;
+    float e = light.attenuation.z;
+    float radius = maxRadius;
+    if (e > 0.0f) {
+        radius = (-l + sqrtf(std::max(l * l - 4.0f * e * c, 0.0f))) / (2.0f * e);
+    } else if (l > 0.0f) {
+        radius = -c / l;
+    }
+    return std::clamp(radius, 0.0f, maxRadius);
+}
+
+void LightClusters::build(const Mat4f &view, const glm::vec3 &cameraPosition,
+                          const std::vector<ClusteredLight> &lights, ClusterFrame &frame) const {
+    ClusterData &data = frame.data;
+    data.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+    // the third row of the camera matrix is the view direction
+    data.cameraForward = glm::vec4(view.m[2][0], view.m[2][1], view.m[2][2], 0.0f);
+    data.scale = scale_;
+
+    // view space bounding spheres and the slices they cover
+    struct LightBounds {
+        float x, y, z, radius2;
+        int firstSlice, lastSlice;
+    };
+    std::vector<LightBounds> bounds;
+    const ClusterSlice &lastSlice = slices_[kClusterSlices - 1];
+    for (const auto &light: lights) {
+        if (bounds.size() == kMaxClusteredLights) {
+            break;
+        }
+        const glm::vec3 &position = light.position;
+        float radius = lightRadius(light, far_);
+        glm::vec4 center = view * glm::vec4(position, 1.0f);
+        if (center.z + radius < slices_[0].minZ || center.z - radius > lastSlice.maxZ) {
+            continue;
+        }
+
+        auto index = bounds.size();
+        data.positionRadius[index] = glm::vec4(position, radius);
+        data.color[index] = light.color;
+        data.attenuation[index] = light.attenuation;
+        data.direction[index] = light.direction;
+
+        auto sliceOf = [this](float depth) {
+            return std::clamp((int) (logf(depth) * scale_.z + scale_.w), 0, kClusterSlices - 1);
+        };
+        bounds.push_back({center.x, center.y, center.z, radius * radius,
+                          sliceOf(std::max(center.z - radius, slices_[0].minZ)),
+                          sliceOf(std::min(center.z + radius, lastSlice.maxZ))});
+    }
+    data.size = glm::vec4(kClusterTilesX, kClusterTilesY, kClusterSlices, (float) bounds.size());
+
+    frame.clusterCounts.assign(kClusterCount, 0);
+    frame.clusterLights.resize(kClusterCount * kMaxLightsPerCluster);
+    frame.ranges.resize(kClusterCount * 2);
+    frame.indices.resize(kMaxLightIndices);
+
+    // every slice is written by one job only
+    JobSystem::parallelFor(kClusterSlices, 2, [&](size_t begin, size_t end) {
+        for (auto slice = (int) begin; slice < (int) end; ++slice) {
+            const ClusterSlice &sliceBounds = slices_[slice];
+            uint8_t *counts = &frame.clusterCounts[slice * kClusterTiles];
+            uint8_t *lists = &frame.clusterLights[slice * kClusterTiles * kMaxLightsPerCluster];
+            for (size_t light = 0; light < bounds.size(); ++light) {
+                const LightBounds &sphere = bounds[light];
+                if (slice < sphere.firstSlice || slice > sphere.lastSlice) {
+                    continue;
+                }
+                float dz = std::max(std::max(sliceBounds.minZ - sphere.z,
+                                             sphere.z - sliceBounds.maxZ), 0.0f);
+                for (int tile = 0; tile < kClusterTiles; tile += 4) {
+                    int mask = testTiles(&sliceBounds.minX[tile], &sliceBounds.maxX[tile],
+                                         &sliceBounds.minY[tile], &sliceBounds.maxY[tile],
+                                         sphere.x, sphere.y, dz * dz, sphere.radius2);
+                    for (; mask != 0; mask &= mask - 1) {
+                        int cluster = tile + __builtin_ctz(mask);
+                        if (counts[cluster] < kMaxLightsPerCluster) {
+                            lists[cluster * kMaxLightsPerCluster + counts[cluster]++] =
+                                    (uint8_t) light;
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // pack the lists behind each other
+    size_t indexCount = 0;
+    for (int cluster = 0; cluster < kClusterCount; ++cluster) {
+        size_t count = std::min((size_t) frame.clusterCounts[cluster],
+                                kMaxLightIndices - indexCount);
+        memcpy(&frame.indices[indexCount], &frame.clusterLights[cluster * kMaxLightsPerCluster],
+               count);
+        frame.ranges[cluster * 2] = (uint32_t) indexCount;
+        frame.ranges[cluster * 2 + 1] = (uint32_t) count;
+        indexCount += count;
+    }
+    frame.indexCount = indexCount;
+}
+
+void LightClusters::beginFrame(const ClusterFrame &frame) {
+    frame_ = (frame_ + 1) % kStreamingFrames;
+    const ClusterTextures &textures = textures_[frame_];
+
+    dataRing_->beginFrame();
+    size_t offset = dataRing_->push(&frame.data, sizeof(ClusterData));
+    glBindBufferRange(GL_UNIFORM_BUFFER, CLUSTER_DATA_UNIFORM_BINDING, dataRing_->getBuffer(),
+                      (GLintptr) offset, sizeof(ClusterData));
+
+    glActiveTexture(CLUSTER_RANGES_UNIT);
+    glBindTexture(GL_TEXTURE_2D, textures.ranges.getId());
+    if (!frame.ranges.empty()) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kClusterTiles, kClusterSlices, GL_RG_INTEGER,
+                        GL_UNSIGNED_INT, frame.ranges.data());
+    }
+
+    glActiveTexture(LIGHT_INDEX_UNIT);
+    glBindTexture(GL_TEXTURE_2D, textures.indices.getId());
+    if (frame.indexCount > 0) {
+        auto rows = (GLsizei) ((frame.indexCount + kLightIndexTextureWidth - 1)
+                               / kLightIndexTextureWidth);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kLightIndexTextureWidth, rows, GL_RED_INTEGER,
+                        GL_UNSIGNED_BYTE, frame.indices.data());
+    }
+    CHECK_GL_ERROR();
+}
+
+void LightClusters::endFrame() {
+    dataRing_->endFrame();
+}
@@ -0,0 +1,177 @@
+//
+// Created by Dark Matter on 6/24/24.
+//
+
+#ifndef LEARNOPENGL_LIGHTCLUSTERS_H
+#define LEARNOPENGL_LIGHTCLUSTERS_H
+
+#include <GLES3/gl3.h>
+#include <memory>
+#include <vector>
+#include "vec4.hpp"
+#include "math/mat4f.h"
+#include "gpu/GpuResourceRegistry.h"
+#include "gpu/StreamingBuffer.h"
+
+/*!
+ * The view frustum is split into kClusterTilesX * kClusterTilesY screen tiles and kClusterSlices
+ * exponentially growing depth slices, every cluster lists the point and spot lights touching it.
+ */
+static constexpr int kClusterTilesX = 16;
+static constexpr int kClusterTilesY = 9;
+static constexpr int kClusterTiles = kClusterTilesX * kClusterTilesY;
+static constexpr int kClusterSlices = 24;
+static constexpr int kClusterCount = kClusterTiles * kClusterSlices;
+
+/*!
+ * Light indices are stored as bytes, has to match MAX_CLUSTERED_LIGHTS in frag.frag. The light
+ * arrays of ClusterData fill the 16KB every device supports for a uniform block.
+ */
+static constexpr int kMaxClusteredLights = 255;
+
+/*!
+ * Lights beyond this many in a single cluster are dropped
+ */
+static constexpr int kMaxLightsPerCluster = 64;
+
+/*!
+ * The light index list is a kLightIndexTextureWidth x kLightIndexTextureRows R8UI texture
+ */
+static constexpr int kLightIndexTextureWidth = 1024;
+static constexpr int kLightIndexTextureRows = 64;
+static constexpr int kMaxLightIndices = kLightIndexTextureWidth * kLightIndexTextureRows;
+
+/*!
+ * Scene component of a point or spot light that is shaded through the clusters, packed like the
+ * light arrays of ClusterData so build() never touches the light objects
+ */
+struct ClusteredLight {
+    glm::vec3 position;
+    // rgb color, ambient intensity in a
+    glm::vec4 color;
+    // spot direction and cosine of the cut off angle, w below -1 for point lights
+    glm::vec4 direction;
+    // constant, linear and quadratic attenuation, diffuse intensity in w
+    glm::vec4 attenuation;
+};
+
+/*!
+ * std140 layout of the ClusterData uniform block in frag.frag
+ */
+struct ClusterData {
+    // xyz camera position in world space
+    glm::vec4 cameraPosition;
+    // xyz view direction
+    glm::vec4 cameraForward;
+    // tiles per pixel in x and y, slice = log(depth) * z + w
+    glm::vec4 scale;
+    // tiles in x and y, slices, number of lights
+    glm::vec4 size;
+    // world position, radius beyond which the light is ignored
+    glm::vec4 positionRadius[kMaxClusteredLights];
+    // rgb color, ambient intensity in a
+    glm::vec4 color[kMaxClusteredLights];
+    // spot direction and cosine of the cut off angle, w below -1 for point lights
+    glm::vec4 direction[kMaxClusteredLights];
+    // constant, linear and quadratic attenuation, diffuse intensity in w
+    glm::vec4 attenuation[kMaxClusteredLights];
+};
+
+static_assert(sizeof(ClusterData) <= 16384, "ClusterData must fit the minimum uniform block size");
+
+/*!
+ * Light assignment of one frame. Written by the scene update, read by the render thread.
+ */
+struct ClusterFrame {
+    ClusterData data;
+    // first index and light count of every cluster, tile fastest then slice
+    std::vector<uint32_t> ranges;
+    // kMaxLightIndices entries, the first indexCount are used
+    std::vector<uint8_t> indices;
+    size_t indexCount = 0;
+
+    // per cluster scratch lists of build()
+    std::vector<uint8_t> clusterCounts;
+    std::vector<uint8_t> clusterLights;
+};
+
+/*!
+ * Clustered forward shading for many point and spot lights. Every frame the lights are assigned
+ * to view space clusters on the CPU, slices are spread over the job system and the light bounds
+ * are tested against four clusters per SIMD instruction. The fragment shader finds its cluster
+ * from the window position and view depth and only shades the lights listed there.
+ */
+class LightClusters {
+public:
+    LightClusters();
+
+    LightClusters(const LightClusters &) = delete;
+
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    /*!
+     * Rebuilds the view space bounds of all clusters
+     * @param projection perspective built by Utility::buildPerspectiveMat
+     */
+    void setProjection(const Mat4f &projection, float near, float far, float width, float height);
+
+    /*!
+     * Assigns @a lights to the clusters, safe to call from a worker thread
+     * @param view camera matrix of the frame
+     */
+    void build(const Mat4f &view, const glm::vec3 &cameraPosition,
+               const std::vector<ClusteredLight> &lights, ClusterFrame &frame) const;
+
+    /*!
+     * Uploads @a frame and binds the uniform block and textures for the draws of this frame
+     */
+    void beginFrame(const ClusterFrame &frame);
+
+    /*!
+     * Call after the last draw reading the clusters
+     */
+    void endFrame();
+
+    /*!
+     * Creates the textures and the uniform ring again after the GL context was lost
+     */
+    void restore();
+
+private:
+    /*!
+     * View space bounds of the tiles of one depth slice, structure of arrays so four tiles load
+     * into one register
+     */
+    struct ClusterSlice {
+        float minZ;
+        float maxZ;
+        alignas(16) float minX[kClusterTiles];
+        alignas(16) float maxX[kClusterTiles];
+        alignas(16) float minY[kClusterTiles];
+        alignas(16) float maxY[kClusterTiles];
+    };
+
+    struct ClusterTextures {
+        GpuResource ranges;
+        GpuResource indices;
+    };
+
+    void createTextures();
+
+    /*!
+     * @return distance at which the light's contribution drops below what 8 bit color can show
+     */
+    static float lightRadius(const ClusteredLight &light, float maxRadius);
+
+    std::vector<ClusterSlice> slices_;
+    glm::vec4 scale_{0.0f};
+    float far_ = 100.0f;
+
+    std::shared_ptr<StreamingBuffer> dataRing_;
+    // one set per frame in flight, used round robin like the regions of dataRing_
+    ClusterTextures textures_[kStreamingFrames];
+    int frame_ = 0;
+};
+
+
+#endif //LEARNOPENGL_LIGHTCLUSTERS_H
@@ -8,20 +8,22 @@ glm::vec3 PointLight::getLocalPosition() {
     return localPosition_;
 }
 
-void PointLight::bind(Shader *shader, const glm::vec3 &cameraLocalPos) {
-    Light::bind(shader, cameraLocalPos);
+void PointLight::writeComponents(EntityRegistry &registry, Entity entity) {
+    // shaded through the clusters instead of a pass of its own
+    registry.add(entity, ClusteredLight{});
+    refreshComponents(registry, entity);
+}
 
-    glUniform3f(shader->getPointLightColor(index), color.r, color.g,  color.b);
-    glUniform1f(shader->getPointLightAmbientIntensity(index), ambientIntensity );
-    glUniform1f(shader->getPointLightDiffuseIntensity(index), diffuseIntensity );
-    glUniform3f(shader->getPointLightLocalPosition(index), localPosition_.x, localPosition_.y, localPosition_.z );
-    glUniform1f(shader->getPointLightAttenuationConstant(index), attenuation.constant);
-    glUniform1f(shader->getPointLightAttenuationLinear(index), attenuation.linear);
-    glUniform1f(shader->getPointLightAttenuationExp(index), attenuation.exp);
+void PointLight::refreshComponents(EntityRegistry &registry, Entity entity) {
+    *registry.get<ClusteredLight>(entity) = ClusteredLight{
+            transform->getPosition(), glm::vec4(glm::vec3(color), ambientIntensity),
+            glm::vec4(0.0f, 0.0f, 0.0f, -2.0f),
+            glm::vec4(attenuation.constant, attenuation.linear, attenuation.exp,
+                      diffuseIntensity)};
 }
 
 void PointLight::calculateLocalPosition(const Transform& worldTransform) {
-    localPosition_ = worldTransform.worldToLocal(this->transform->position);
+    localPosition_ = worldTransform.worldToLocal(this->transform->getPosition());
 }
 
 
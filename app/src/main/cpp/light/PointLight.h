@@ -7,6 +7,7 @@
 
 
 #include "Light.h"
+#include "LightClusters.h"
 
 struct LightAttenuation {
     float constant = 1.0;
@@ -14,17 +15,21 @@ struct LightAttenuation {
     float exp = 0.0;
 };
 
+/*!
+ * Shaded through the light clusters, its range follows from the attenuation
+ */
 class PointLight : public Light {
 
 public :
-    int index = 0;
     LightAttenuation attenuation;
 
     void calculateLocalPosition(const Transform &worldTransform);
 
     glm::vec3 getLocalPosition();
 
-    void bind(Shader *shader, const glm::vec3 &cameraLocalPos) override;
+    void writeComponents(EntityRegistry &registry, Entity entity) override;
+
+    void refreshComponents(EntityRegistry &registry, Entity entity) override;
 
 protected:
     glm::vec3 localPosition_;
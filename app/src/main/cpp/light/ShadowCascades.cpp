@@ -0,0 +1,223 @@
+//
+// Created by Dark Matter on 6/25/24.
+//
+
+#include "ShadowCascades.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "utils.h"
+#include "glm/geometric.hpp"
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+
+/*!
+ * Blend between logarithmic and uniform cascade splits, 1 is fully logarithmic
+ */
+static constexpr float kCascadeSplitLambda = 0.75f;
+
+/*!
+ * How far behind a cascade (towards the light) casters are still drawn into it
+ */
+static constexpr float kShadowCasterDistance = 50.0f;
+
+/*!
+ * Slope scaled and constant depth offset of the shadow pass against self shadowing
+ */
+static constexpr float kShadowSlopeBias = 2.0f;
+static constexpr float kShadowConstantBias = 4.0f;
+
+ShadowCascades::ShadowCascades(ShadowQuality quality)
+        : quality_(quality), settings_(settingsFor(quality)) {
+    dataRing_ = StreamingBuffer::createUniformRing(sizeof(ShadowData));
+    createMap();
+}
+
+ShadowQuality ShadowCascades::detectQuality() {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    double memoryGb = pages > 0 && pageSize > 0
+                      ? (double) pages * (double) pageSize / (1024.0 * 1024.0 * 1024.0) : 0.0;
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    ShadowQuality quality = ShadowQuality::HIGH;
+    if (memoryGb < 3.0 || maxTextureSize < 2048) {
+        quality = ShadowQuality::LOW;
+    } else if (memoryGb < 6.0) {
+        quality = ShadowQuality::MEDIUM;
+    }
+    aout << "Shadow quality " << (int) quality << " for " << memoryGb << " GB and "
+         << maxTextureSize << " texel textures" << std::endl;
+    return quality;
+}
+
+ShadowSettings ShadowCascades::settingsFor(ShadowQuality quality) {
+    switch (quality) {
+        case ShadowQuality::LOW:
+            return {1024, 2, GL_DEPTH_COMPONENT16, 0, 20.0f};
+        case ShadowQuality::MEDIUM:
+            return {2048, 3, GL_DEPTH_COMPONENT16, 1, 30.0f};
+        case ShadowQuality::HIGH:
+            return {2048, 4, GL_DEPTH_COMPONENT24, 1, 40.0f};
+    }
+    return {1024, 2, GL_DEPTH_COMPONENT16, 0, 20.0f};
+}
+
+void ShadowCascades::setQuality(ShadowQuality quality) {
+    quality_ = quality;
+    settings_ = settingsFor(quality);
+    createMap();
+}
+
+void ShadowCascades::restore() {
+    dataRing_->restore();
+    createMap();
+}
+
+void ShadowCascades::createMap() {
+    framebuffers_.clear();
+    map_.reset();
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, settings_.depthFormat, settings_.resolution,
+                   settings_.resolution, settings_.cascadeCount);
+    // linear filtering with comparison gives a 2x2 PCF per tap for free
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    size_t texelBytes = settings_.depthFormat == GL_DEPTH_COMPONENT16 ? 2 : 4;
+    map_ = GpuResource(GpuResourceType::TEXTURE, texture,
+                       texelBytes * settings_.resolution * settings_.resolution
+                       * settings_.cascadeCount);
+
+    GLenum noColor = GL_NONE;
+    for (int cascade = 0; cascade < settings_.cascadeCount; ++cascade) {
+        GLuint framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+        glDrawBuffers(1, &noColor);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            aout << "Shadow cascade " << cascade << " framebuffer is incomplete" << std::endl;
+        }
+        framebuffers_.emplace_back(GpuResourceType::FRAMEBUFFER, framebuffer, 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CHECK_GL_ERROR();
+}
+
+void ShadowCascades::setProjection(const Mat4f &projection, float near) {
+    tanX_ = 1.0f / projection.m[0][0];
+    tanY_ = 1.0f / projection.m[1][1];
+    near_ = near;
+}
+
+void ShadowCascades::build(const Mat4f &view, const glm::vec3 &cameraPosition,
+                           const glm::vec3 &lightDirection, ShadowFrame &frame) const {
+    frame.cascadeCount = 0;
+    frame.data.params = glm::vec4(0.0f);
+    // the light direction points from the surface to the light
+    if (glm::dot(lightDirection, lightDirection) <= 0.0f) {
+        return;
+    }
+
+    // light space rotation, the light looks down +z like the camera
+    glm::vec3 forward = -glm::normalize(lightDirection);
+    glm::vec3 up = std::abs(forward.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                               : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 right = glm::normalize(glm::cross(up, forward));
+    up = glm::cross(forward, right);
+    Mat4f lightView(right.x, right.y, right.z, 0.0f,
+                    up.x, up.y, up.z, 0.0f,
+                    forward.x, forward.y, forward.z, 0.0f,
+                    0.0f, 0.0f, 0.0f, 1.0f);
+
+    // maps x and y from [-1, 1] and depth from [-1, 1] to [0, 1] for sampling
+    const Mat4f toTexture(0.5f, 0.0f, 0.0f, 0.5f,
+                          0.0f, 0.5f, 0.0f, 0.5f,
+                          0.0f, 0.0f, 0.5f, 0.5f,
+                          0.0f, 0.0f, 0.0f, 1.0f);
+
+    glm::vec3 cameraForward(view.m[2][0], view.m[2][1], view.m[2][2]);
+    float slope2 = tanX_ * tanX_ + tanY_ * tanY_;
+    float distance = settings_.distance;
+    int cascadeCount = settings_.cascadeCount;
+    float splitNear = near_;
+    for (int cascade = 0; cascade < cascadeCount; ++cascade) {
+        float fraction = (float) (cascade + 1) / (float) cascadeCount;
+        float logSplit = near_ * powf(distance / near_, fraction);
+        float uniformSplit = near_ + (distance - near_) * fraction;
+        float splitFar = kCascadeSplitLambda * logSplit + (1 - kCascadeSplitLambda) * uniformSplit;
+
+        // smallest sphere around the slice, its center is on the view axis where the near and
+        // far corners are equally far away
+        float centerDepth = std::min((splitNear + splitFar) * (1.0f + slope2) * 0.5f, splitFar);
+        float farOffset = splitFar - centerDepth;
+        float radius = sqrtf(splitFar * splitFar * slope2 + farOffset * farOffset);
+        // rounded up so float noise can't change the texel size from frame to frame
+        radius = ceilf(radius * 16.0f) / 16.0f;
+
+        // move the projection in whole texels only
+        float texelSize = 2.0f * radius / (float) settings_.resolution;
+        glm::vec4 center = lightView * glm::vec4(cameraPosition + cameraForward * centerDepth,
+                                                 1.0f);
+        center.x = floorf(center.x / texelSize) * texelSize;
+        center.y = floorf(center.y / texelSize) * texelSize;
+
+        float minZ = center.z - radius - kShadowCasterDistance;
+        float maxZ = center.z + radius;
+        float depthRange = maxZ - minZ;
+        Mat4f projection(1.0f / radius, 0.0f, 0.0f, -center.x / radius,
+                         0.0f, 1.0f / radius, 0.0f, -center.y / radius,
+                         0.0f, 0.0f, 2.0f / depthRange, -2.0f * minZ / depthRange - 1.0f,
+                         0.0f, 0.0f, 0.0f, 1.0f);
+
+        frame.viewProjections[cascade] = projection * lightView;
+        frame.data.matrices[cascade] = toTexture * frame.viewProjections[cascade];
+        frame.data.cascades[cascade] = glm::vec4(splitFar, texelSize, 0.0f, 0.0f);
+        splitNear = splitFar;
+    }
+    frame.cascadeCount = cascadeCount;
+    frame.data.params = glm::vec4((float) cascadeCount, 1.0f / (float) settings_.resolution,
+                                  (float) settings_.filterRadius, 0.0f);
+}
+
+void ShadowCascades::beginCascade(int cascade) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffers_[cascade].getId());
+    glViewport(0, 0, settings_.resolution, settings_.resolution);
+    // both faces cast, single sided assets would lose their shadows otherwise
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(kShadowSlopeBias, kShadowConstantBias);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowCascades::endCascades(GLsizei width, GLsizei height) {
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glEnable(GL_CULL_FACE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+}
+
+void ShadowCascades::beginFrame(const ShadowFrame &frame) {
+    dataRing_->beginFrame();
+    size_t offset = dataRing_->push(&frame.data, sizeof(ShadowData));
+    glBindBufferRange(GL_UNIFORM_BUFFER, SHADOW_DATA_UNIFORM_BINDING, dataRing_->getBuffer(),
+                      (GLintptr) offset, sizeof(ShadowData));
+    glActiveTexture(SHADOW_MAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, map_.getId());
+    map_.markUsed();
+    CHECK_GL_ERROR();
+}
+
+void ShadowCascades::endFrame() {
+    dataRing_->endFrame();
+}
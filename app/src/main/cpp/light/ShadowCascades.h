@@ -0,0 +1,155 @@
+//
+// Created by Dark Matter on 6/25/24.
+//
+
+#ifndef LEARNOPENGL_SHADOWCASCADES_H
+#define LEARNOPENGL_SHADOWCASCADES_H
+
+#include <GLES3/gl3.h>
+#include <memory>
+#include <vector>
+#include "vec4.hpp"
+#include "math/mat4f.h"
+#include "gpu/GpuResourceRegistry.h"
+#include "gpu/StreamingBuffer.h"
+
+/*!
+ * Has to match MAX_SHADOW_CASCADES in frag.frag
+ */
+static constexpr int kMaxShadowCascades = 4;
+
+/*!
+ * Shadow map budget of a device class, picked once by ShadowCascades::detectQuality()
+ */
+enum class ShadowQuality {
+    // 2 cascades of 1024 texels, one hardware filtered tap
+    LOW,
+    // 3 cascades of 2048 texels, 3x3 taps
+    MEDIUM,
+    // 4 cascades of 2048 texels with 24 bit depth, 3x3 taps
+    HIGH
+};
+
+struct ShadowSettings {
+    GLsizei resolution;
+    int cascadeCount;
+    GLenum depthFormat;
+    // PCF taps reach this many texels to every side, 0 is a single tap
+    int filterRadius;
+    // view depth the last cascade ends at
+    float distance;
+};
+
+/*!
+ * std140 layout of the ShadowData uniform block in frag.frag
+ */
+struct ShadowData {
+    // world space to shadow map coordinates and depth in [0, 1], row major
+    Mat4f matrices[kMaxShadowCascades];
+    // view depth the cascade ends at, world size of one texel
+    glm::vec4 cascades[kMaxShadowCascades];
+    // cascade count (0 without shadows), size of a texel in uv, filter radius in texels
+    glm::vec4 params;
+};
+
+/*!
+ * Shadow state of one frame. Written by the scene update, read by the render thread.
+ */
+struct ShadowFrame {
+    ShadowData data;
+    // light projection * light view of every cascade, what the depth pass draws with
+    Mat4f viewProjections[kMaxShadowCascades];
+    int cascadeCount = 0;
+};
+
+/*!
+ * Cascaded shadow maps for the directional light. The camera frustum up to the shadow distance is
+ * split into cascades, each one is covered by an orthographic light projection fitted to the
+ * bounding sphere of its slice. The sphere only depends on the camera projection, so the size of a
+ * texel stays the same while the camera turns, and the projection is moved in whole texels only,
+ * so shadow edges don't shimmer while it moves.
+ *
+ * The cascades live in the layers of one depth texture array, the fragment shader reads them with
+ * hardware depth comparison and filters with a tier dependent number of PCF taps.
+ */
+class ShadowCascades {
+public:
+    explicit ShadowCascades(ShadowQuality quality);
+
+    ShadowCascades(const ShadowCascades &) = delete;
+
+    ShadowCascades &operator=(const ShadowCascades &) = delete;
+
+    /*!
+     * Picks a tier from the device memory and the maximum texture size, call with a current context
+     */
+    static ShadowQuality detectQuality();
+
+    static ShadowSettings settingsFor(ShadowQuality quality);
+
+    /*!
+     * Recreates the shadow map with the budget of @a quality
+     */
+    void setQuality(ShadowQuality quality);
+
+    constexpr ShadowQuality getQuality() const { return quality_; }
+
+    constexpr const ShadowSettings &getSettings() const { return settings_; }
+
+    /*!
+     * @param projection camera perspective built by Utility::buildPerspectiveMat
+     */
+    void setProjection(const Mat4f &projection, float near);
+
+    /*!
+     * Fits the cascades to the camera, safe to call from a worker thread
+     * @param view camera matrix of the frame
+     * @param lightDirection towards the light casting the shadows, no cascades are built when it
+     * is zero
+     */
+    void build(const Mat4f &view, const glm::vec3 &cameraPosition,
+               const glm::vec3 &lightDirection, ShadowFrame &frame) const;
+
+    /*!
+     * Renders into the layer of @a cascade from now on, sets the depth only state
+     */
+    void beginCascade(int cascade);
+
+    /*!
+     * Goes back to the window with a @a width x @a height viewport and the usual state
+     */
+    void endCascades(GLsizei width, GLsizei height);
+
+    /*!
+     * Uploads @a frame and binds the uniform block and the shadow map for the draws of this frame
+     */
+    void beginFrame(const ShadowFrame &frame);
+
+    /*!
+     * Call after the last draw reading the shadow map
+     */
+    void endFrame();
+
+    /*!
+     * Creates the shadow map and the uniform ring again after the GL context was lost
+     */
+    void restore();
+
+private:
+    void createMap();
+
+    ShadowQuality quality_;
+    ShadowSettings settings_;
+    // slopes of the camera frustum and its near plane
+    float tanX_ = 1.0f;
+    float tanY_ = 1.0f;
+    float near_ = 0.01f;
+
+    GpuResource map_;
+    // one per cascade, each has a layer of map_ attached
+    std::vector<GpuResource> framebuffers_;
+    std::shared_ptr<StreamingBuffer> dataRing_;
+};
+
+
+#endif //LEARNOPENGL_SHADOWCASCADES_H
@@ -13,19 +13,7 @@ glm::vec3 SpotLight::getLocalDirection() {
     return localDirection;
 }
 
-void SpotLight::bind(Shader *shader, const glm::vec3 &cameraLocalPos) {
-    Light::bind(shader, cameraLocalPos);
-
-    glUniform3f(shader->getSpotLightColor(index), color.r, color.g,  color.b);
-    glUniform1f(shader->getSpotLightAmbientIntensity(index), ambientIntensity );
-    glUniform1f(shader->getSpotLightDiffuseIntensity(index), diffuseIntensity );
-    glUniform3f(shader->getSpotLightLocalPosition(index), localPosition_.x, localPosition_.y, localPosition_.z );
-    glUniform1f(shader->getSpotLightAttenuationConstant(index), attenuation.constant);
-    glUniform1f(shader->getSpotLightAttenuationLinear(index), attenuation.linear);
-    glUniform1f(shader->getSpotLightAttenuationExp(index), attenuation.exp);
-
-    glm::vec3 localDirectionNorm = glm::normalize(localDirection);
-    glUniform3f(shader->getSpotLightDirection(index), localDirectionNorm.x, localDirectionNorm.y, localDirectionNorm.z);
-    glUniform1f(shader->getSpotLightDirection(index), cutOff);
+void SpotLight::refreshComponents(EntityRegistry &registry, Entity entity) {
+    PointLight::refreshComponents(registry, entity);
+    registry.get<ClusteredLight>(entity)->direction = glm::vec4(glm::normalize(direction), cutOff);
 }
-
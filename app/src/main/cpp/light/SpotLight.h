@@ -11,13 +11,14 @@
 class SpotLight : public PointLight {
 public:
     glm::vec3 direction;
+    // cosine of the cone half angle
     float cutOff = 0.0;
 
     void calculateDirectionAndPosition(const Transform &transform);
 
     glm::vec3 getLocalDirection();
 
-    void bind(Shader *shader, const glm::vec3 &cameraLocalPos) override;
+    void refreshComponents(EntityRegistry &registry, Entity entity) override;
 
 private:
     glm::vec3 localDirection;
@@ -29,15 +29,26 @@ void handle_cmd(android_app *pApp, int32_t cmd) {
             // "game" class if that suits your needs. Remember to change all instances of userData
             // if you change the class here as a reinterpret_cast is dangerous this in the
             // android_main function and the APP_CMD_TERM_WINDOW handler case.
-            pApp->userData = new Renderer(pApp);
+            //
+            // When coming back from the background the renderer still holds the scene, it only
+            // needs the new window
+            if (pApp->userData) {
+                reinterpret_cast<Renderer *>(pApp->userData)->onSurfaceCreated();
+            } else {
+                pApp->userData = new Renderer(pApp);
+            }
             break;
         case APP_CMD_TERM_WINDOW:
-            // The window is being destroyed. Use this to clean up your userData to avoid leaking
-            // resources.
+            // The window is being destroyed. The renderer keeps its GL context and scene so
+            // resuming doesn't import everything again, it is deleted when the app is destroyed.
             //
             // We have to check if userData is assigned just in case this comes in really quickly
             if (pApp->userData) {
-                //
+                reinterpret_cast<Renderer *>(pApp->userData)->onSurfaceDestroyed();
+            }
+            break;
+        case APP_CMD_DESTROY:
+            if (pApp->userData) {
                 auto *pRenderer = reinterpret_cast<Renderer *>(pApp->userData);
                 pApp->userData = nullptr;
                 delete pRenderer;
@@ -100,8 +111,10 @@ void android_main(struct android_app *pApp) {
             // Process game input
             pRenderer->handleInput();
 
-            // Render a frame
-            pRenderer->render();
+            // Render a frame, unless we are in the background without a window
+            if (pRenderer->hasSurface()) {
+                pRenderer->render();
+            }
         }
     } while (!pApp->destroyRequested);
 }
@@ -4,6 +4,75 @@
 #include "glm/geometric.hpp"
 #include "glm.hpp"
 
+// the products are done row by row with 4 wide vectors where the CPU has them
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/*!
+ * out = a * b for row major 4x4 matrices, @a out must not alias @a a or @a b
+ */
+static inline void multiply4x4(const float *a, const float *b, float *out) {
+#if defined(__ARM_NEON)
+    float32x4_t b0 = vld1q_f32(b);
+    float32x4_t b1 = vld1q_f32(b + 4);
+    float32x4_t b2 = vld1q_f32(b + 8);
+    float32x4_t b3 = vld1q_f32(b + 12);
+    for (int i = 0; i < 4; ++i) {
+        const float *row = a + 4 * i;
+        float32x4_t r = vmulq_n_f32(b0, row[0]);
+        r = vmlaq_n_f32(r, b1, row[1]);
+        r = vmlaq_n_f32(r, b2, row[2]);
+        r = vmlaq_n_f32(r, b3, row[3]);
+        vst1q_f32(out + 4 * i, r);
+    }
+#elif defined(__SSE__)
+    __m128 b0 = _mm_loadu_ps(b);
+    __m128 b1 = _mm_loadu_ps(b + 4);
+    __m128 b2 = _mm_loadu_ps(b + 8);
+    __m128 b3 = _mm_loadu_ps(b + 12);
+    for (int i = 0; i < 4; ++i) {
+        const float *row = a + 4 * i;
+        __m128 r = _mm_mul_ps(b0, _mm_set1_ps(row[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(b1, _mm_set1_ps(row[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(b2, _mm_set1_ps(row[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(b3, _mm_set1_ps(row[3])));
+        _mm_storeu_ps(out + 4 * i, r);
+    }
+#else
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            out[4 * i + j] = a[4 * i] * b[j] +
+                             a[4 * i + 1] * b[4 + j] +
+                             a[4 * i + 2] * b[8 + j] +
+                             a[4 * i + 3] * b[12 + j];
+        }
+    }
+#endif
+}
+
+/*!
+ * Writes the upper 3x3 of rz * ry * rx (see initRotationX/Y/Z) for angles in radians, with one
+ * sin and cos per axis instead of two matrix products
+ */
+static inline void rotationRows(float x, float y, float z, float rows[3][3]) {
+    float sx = sinf(x), cx = cosf(x);
+    float sy = sinf(y), cy = cosf(y);
+    float sz = sinf(z), cz = cosf(z);
+
+    rows[0][0] = cz * cy;
+    rows[0][1] = sz * cx + cz * sy * sx;
+    rows[0][2] = sz * sx - cz * sy * cx;
+    rows[1][0] = -sz * cy;
+    rows[1][1] = cz * cx - sz * sy * sx;
+    rows[1][2] = cz * sx + sz * sy * cx;
+    rows[2][0] = sy;
+    rows[2][1] = -cy * sx;
+    rows[2][2] = cy * cx;
+}
+
 // Default constructor initializing to identity matrix
 Mat4f::Mat4f() {
     for (int i = 0; i < 4; ++i) {
@@ -86,17 +155,57 @@ void Mat4f::initRotationZ(float z) {
 
 // Initialize rotation matrix for combined rotations
 void Mat4f::initRotationMatrix(float rotationX, float rotationY, float rotationZ) {
-    Mat4f rx, ry, rz;
+    float rows[3][3];
+    rotationRows(ToRadian(rotationX), ToRadian(rotationY), ToRadian(rotationZ), rows);
+
+    initIdentity();
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            m[i][j] = rows[i][j];
+        }
+    }
+}
 
-    float x = ToRadian(rotationX);
-    float y = ToRadian(rotationY);
-    float z = ToRadian(rotationZ);
+void Mat4f::initTransform(const glm::vec3 &translation, const glm::vec3 &rotation,
+                          const glm::vec3 &scale) {
+    float rows[3][3];
+    rotationRows(ToRadian(rotation.x), ToRadian(rotation.y), ToRadian(rotation.z), rows);
 
-    rx.initRotationX(x);
-    ry.initRotationY(y);
-    rz.initRotationZ(z);
+    // scaling multiplies the columns, the translation is the last column
+    for (int i = 0; i < 3; ++i) {
+        m[i][0] = rows[i][0] * scale.x;
+        m[i][1] = rows[i][1] * scale.y;
+        m[i][2] = rows[i][2] * scale.z;
+        m[i][3] = translation[i];
+    }
+    m[3][0] = 0.0f;
+    m[3][1] = 0.0f;
+    m[3][2] = 0.0f;
+    m[3][3] = 1.0f;
+}
 
-    *this = rz * ry * rx;
+void Mat4f::initTransform(const glm::vec3 &translation, const Quaternion &rotation,
+                          const glm::vec3 &scale) {
+    float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+    float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+    float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+    m[0][0] = (1.0f - 2.0f * (yy + zz)) * scale.x;
+    m[0][1] = 2.0f * (xy - wz) * scale.y;
+    m[0][2] = 2.0f * (xz + wy) * scale.z;
+    m[0][3] = translation.x;
+    m[1][0] = 2.0f * (xy + wz) * scale.x;
+    m[1][1] = (1.0f - 2.0f * (xx + zz)) * scale.y;
+    m[1][2] = 2.0f * (yz - wx) * scale.z;
+    m[1][3] = translation.y;
+    m[2][0] = 2.0f * (xz - wy) * scale.x;
+    m[2][1] = 2.0f * (yz + wx) * scale.y;
+    m[2][2] = (1.0f - 2.0f * (xx + yy)) * scale.z;
+    m[2][3] = translation.z;
+    m[3][0] = 0.0f;
+    m[3][1] = 0.0f;
+    m[3][2] = 0.0f;
+    m[3][3] = 1.0f;
 }
 
 // Initialize translation matrix
@@ -192,14 +301,7 @@ std::unique_ptr<Mat4f> Mat4f::Identity() {
 // Matrix multiplication
 Mat4f Mat4f::operator*(const Mat4f &other) const {
     Mat4f ret;
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            ret.m[i][j] = m[i][0] * other.m[0][j] +
-                          m[i][1] * other.m[1][j] +
-                          m[i][2] * other.m[2][j] +
-                          m[i][3] * other.m[3][j];
-        }
-    }
+    multiply4x4(&m[0][0], &other.m[0][0], &ret.m[0][0]);
     return ret;
 }
 
@@ -207,16 +309,138 @@ Mat4f Mat4f::operator*(const Mat4f &other) const {
 glm::vec4 Mat4f::operator*(const glm::vec4 &other) const {
     glm::vec4 ret;
     for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            ret[j] = m[i][0] * other[0] +
-                     m[i][1] * other[1] +
-                     m[i][2] * other[2] +
-                     m[i][3] * other[3];
-        }
+        ret[i] = m[i][0] * other[0] +
+                 m[i][1] * other[1] +
+                 m[i][2] * other[2] +
+                 m[i][3] * other[3];
     }
     return ret;
 }
 
+void Mat4f::multiplyArray(const Mat4f &a, const Mat4f *in, Mat4f *out, size_t count) {
+    // the rows of a stay in registers, every product only loads and stores its own matrix. All
+    // rows of in[i] are loaded before out[i] is written, so the arrays may alias.
+#if defined(__ARM_NEON)
+    float32x4_t aRows[4];
+    for (int row = 0; row < 4; ++row) {
+        aRows[row] = vld1q_f32(a.m[row]);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const float *b = &in[i].m[0][0];
+        float32x4_t b0 = vld1q_f32(b);
+        float32x4_t b1 = vld1q_f32(b + 4);
+        float32x4_t b2 = vld1q_f32(b + 8);
+        float32x4_t b3 = vld1q_f32(b + 12);
+        for (int row = 0; row < 4; ++row) {
+            float32x2_t low = vget_low_f32(aRows[row]);
+            float32x2_t high = vget_high_f32(aRows[row]);
+            float32x4_t r = vmulq_lane_f32(b0, low, 0);
+            r = vmlaq_lane_f32(r, b1, low, 1);
+            r = vmlaq_lane_f32(r, b2, high, 0);
+            r = vmlaq_lane_f32(r, b3, high, 1);
+            vst1q_f32(out[i].m[row], r);
+        }
+    }
+#elif defined(__SSE__)
+    __m128 aSplat[4][4];
+    for (int row = 0; row < 4; ++row) {
+        for (int k = 0; k < 4; ++k) {
+            aSplat[row][k] = _mm_set1_ps(a.m[row][k]);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const float *b = &in[i].m[0][0];
+        __m128 b0 = _mm_loadu_ps(b);
+        __m128 b1 = _mm_loadu_ps(b + 4);
+        __m128 b2 = _mm_loadu_ps(b + 8);
+        __m128 b3 = _mm_loadu_ps(b + 12);
+        for (int row = 0; row < 4; ++row) {
+            __m128 r = _mm_mul_ps(b0, aSplat[row][0]);
+            r = _mm_add_ps(r, _mm_mul_ps(b1, aSplat[row][1]));
+            r = _mm_add_ps(r, _mm_mul_ps(b2, aSplat[row][2]));
+            r = _mm_add_ps(r, _mm_mul_ps(b3, aSplat[row][3]));
+            _mm_storeu_ps(out[i].m[row], r);
+        }
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        Mat4f ret;
+        multiply4x4(&a.m[0][0], &in[i].m[0][0], &ret.m[0][0]);
+        out[i] = ret;
+    }
+#endif
+}
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "transformPoints reads packed points");
+
+void Mat4f::transformPoints(const Mat4f &a, const glm::vec3 *in, glm::vec3 *out,
+                            size_t count) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    // four points at a time, vld3 splits them into x, y and z vectors so each output coordinate
+    // is three multiply adds. The rows of a stay in registers, the stores may alias the matrix.
+    // The four points are loaded before they are written, the arrays may alias too.
+    float32x4_t aRows[3];
+    for (int row = 0; row < 3; ++row) {
+        aRows[row] = vld1q_f32(a.m[row]);
+    }
+    for (; i + 4 <= count; i += 4) {
+        float32x4x3_t p = vld3q_f32(&in[i].x);
+        float32x4x3_t r;
+        for (int row = 0; row < 3; ++row) {
+            float32x2_t low = vget_low_f32(aRows[row]);
+            float32x2_t high = vget_high_f32(aRows[row]);
+            float32x4_t v = vmlaq_lane_f32(vdupq_lane_f32(high, 1), p.val[0], low, 0);
+            v = vmlaq_lane_f32(v, p.val[1], low, 1);
+            r.val[row] = vmlaq_lane_f32(v, p.val[2], high, 0);
+        }
+        vst3q_f32(&out[i].x, r);
+    }
+#endif
+    // SSE has no deinterleaving loads, the shuffles cost more than the compiler's own
+    // vectorization of this loop (Mat4fBenchmark), so x86 only takes this path
+    for (; i < count; ++i) {
+        glm::vec3 p = in[i];
+        out[i] = glm::vec3(a.m[0][0] * p.x + a.m[0][1] * p.y + a.m[0][2] * p.z + a.m[0][3],
+                           a.m[1][0] * p.x + a.m[1][1] * p.y + a.m[1][2] * p.z + a.m[1][3],
+                           a.m[2][0] * p.x + a.m[2][1] * p.y + a.m[2][2] * p.z + a.m[2][3]);
+    }
+}
+
+Mat4f Mat4f::inverseAffine() const {
+    // cofactors of the upper 3x3
+    float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    if (fabsf(det) < 1e-12f) {
+        Mat4f copy = *this;
+        return copy.inverse();
+    }
+    float invDet = 1.0f / det;
+
+    Mat4f inv;
+    inv.m[0][0] = c00 * invDet;
+    inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+    inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+    inv.m[1][0] = c01 * invDet;
+    inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+    inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+    inv.m[2][0] = c02 * invDet;
+    inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+    inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+    // the inverse translation is the translation rotated back
+    for (int i = 0; i < 3; ++i) {
+        inv.m[i][3] = -(inv.m[i][0] * m[0][3] + inv.m[i][1] * m[1][3] + inv.m[i][2] * m[2][3]);
+    }
+    inv.m[3][0] = 0.0f;
+    inv.m[3][1] = 0.0f;
+    inv.m[3][2] = 0.0f;
+    inv.m[3][3] = 1.0f;
+    return inv;
+}
+
 Mat4f Mat4f::inverse() {
     Mat4f invMat;
     glm::mat4 mat = glm::mat4(1.0);
@@ -34,6 +34,20 @@ struct Mat4f {
     void initCamera(glm::vec3 target, glm::vec3 pos, glm::vec3 up);
     void initIdentity();
 
+    /*!
+     * Builds translation * rotation * scale in one go, without the three intermediate matrices
+     * and their products
+     * @param rotation euler angles in degrees, applied like initRotationMatrix
+     */
+    void initTransform(const glm::vec3 &translation, const glm::vec3 &rotation,
+                       const glm::vec3 &scale);
+
+    /*!
+     * Same as above with the rotation given as a unit quaternion, needs no trigonometry at all
+     */
+    void initTransform(const glm::vec3 &translation, const Quaternion &rotation,
+                       const glm::vec3 &scale);
+
     // Static method to create an identity matrix and return a unique_ptr
     static std::unique_ptr<Mat4f> Identity();
 
@@ -43,6 +57,23 @@ struct Mat4f {
 
     Mat4f inverse();
 
+    /*!
+     * Inverse of a matrix whose last row is (0, 0, 0, 1), like every TRS matrix. Much cheaper than
+     * inverse(), falls back to it for singular matrices.
+     */
+    Mat4f inverseAffine() const;
+
+    /*!
+     * out[i] = a * in[i] for @a count matrices, @a in and @a out may be the same array
+     */
+    static void multiplyArray(const Mat4f &a, const Mat4f *in, Mat4f *out, size_t count);
+
+    /*!
+     * Transforms @a count points by the affine part of @a a, @a in and @a out may be the same array
+     */
+    static void transformPoints(const Mat4f &a, const glm::vec3 *in, glm::vec3 *out,
+                                size_t count);
+
     void lookAt(glm::vec3 target, glm::vec3 pos, glm::vec3 up);
 };
 
@@ -1,5 +1,6 @@
 // Created by Dark Matter on 5/8/24.
 #include <cmath> // Include cmath for the M_PI constant
+#include <cstdint>
 #include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 
@@ -10,22 +11,33 @@
 #define ToDegree(x) (float)(((x) * 180.0f / M_PI))
 
 struct Vertex {
+    // for buffers that are filled right after, like reads from the mesh cache
+    Vertex() = default;
+
     constexpr Vertex(const glm::vec3 &inPosition,
                      const glm::vec2 &inUV, const glm::vec3  &tangent)
             : position(inPosition),
-              uv(inUV), normal(glm::vec3{}), tangent(tangent) {};
+              uv(inUV), normal(glm::vec3{}), tangent(tangent), layer(0) {};
 
     constexpr Vertex(const glm::vec3 &inPosition,
                      const glm::vec2 &inUV,
                      const glm::vec3 &inNormal, const glm::vec3  &tangent)
             : position(inPosition),
-                uv(inUV), normal(inNormal), tangent(tangent) {}
+                uv(inUV), normal(inNormal), tangent(tangent), layer(0) {}
 
     glm::vec3 position;
     glm::vec3 normal;
     glm::vec2 uv;
     glm::vec3 tangent;
     glm::vec3 biTangent;
+    // layer of the diffuse texture when it was packed into a texture array
+    float layer;
+    // skinning joints and their weights out of 255, all weights 0 for vertices that aren't skinned
+    uint8_t joints[4] = {};
+    uint8_t weights[4] = {};
+    // first morph target delta of the vertex in the low 24 bits and the number of deltas in the
+    // top 8, 0 for vertices no target moves
+    uint32_t morph = 0;
 };
 
 #endif // LEARNOPENGL_MATH_H
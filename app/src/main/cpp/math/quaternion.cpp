@@ -27,6 +27,14 @@ Quaternion::Quaternion(float _x, float _y, float _z, float _w)
     w = _w;
 }
 
+Quaternion Quaternion::fromEuler(float x, float y, float z)
+{
+    // Mat4f rotates clockwise around each axis, hence the negated angles
+    return Quaternion(-z, glm::vec3(0, 0, 1))
+           * Quaternion(-y, glm::vec3(0, 1, 0))
+           * Quaternion(-x, glm::vec3(1, 0, 0));
+}
+
 void Quaternion::Normalize()
 {
     float Length = sqrtf(x * x + y * y + z * z + w * w);
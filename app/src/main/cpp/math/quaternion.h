@@ -15,6 +15,12 @@ struct Quaternion
 
     Quaternion(float _x, float _y, float _z, float _w);
 
+    /*!
+     * Rotation from euler angles in degrees that matches Mat4f::initRotationMatrix, i.e. the
+     * rotation matrix of the result equals rz * ry * rx
+     */
+    static Quaternion fromEuler(float x, float y, float z);
+
     void Normalize();
 
     Quaternion Conjugate() const;
@@ -0,0 +1,380 @@
+//
+// Created by Dark Matter on 6/19/24.
+//
+
+#include "GeometryArena.h"
+#include "Mesh.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "gpu/UploadThread.h"
+#include "shader/Shader.h"
+#include <algorithm>
+#include <cassert>
+
+GeometryArena *GeometryArena::instance_ = nullptr;
+GLuint GeometryArena::boundVertexArray_ = 0;
+
+bool GeometryRange::isReady() const {
+    return page && page->vao.isCurrent()
+           && *uploadedGeneration == GpuResourceRegistry::instance().getGeneration();
+}
+
+GeometryPage::~GeometryPage() {
+    // the fence of a lost context is gone with it
+    if (storageFence && vao.isCurrent()) {
+        glDeleteSync(storageFence);
+    }
+}
+
+GeometryArena::GeometryArena() {
+    instance_ = this;
+}
+
+GeometryArena::~GeometryArena() {
+    if (instance_ == this) {
+        instance_ = nullptr;
+    }
+    resetBindings();
+}
+
+GeometryArena *GeometryArena::get() {
+    return instance_;
+}
+
+bool GeometryArena::upload(const std::shared_ptr<Mesh> &mesh) {
+    GeometryRange &range = mesh->getGeometry();
+    if (!range.page && !allocate(*mesh, range)) {
+        return false;
+    }
+
+    // the page's vertex array expects indices relative to the start of the page
+    std::vector<Index> indices(mesh->getIndexData(), mesh->getIndexData() + range.indexCount);
+    for (auto &index: indices) {
+        index = (Index) (index + range.firstVertex);
+    }
+
+    std::vector<glm::vec3> positions(range.vertexCount);
+    const Vertex *vertices = mesh->getVertexData();
+    for (size_t i = 0; i < positions.size(); ++i) {
+        positions[i] = vertices[i].position;
+    }
+
+    GLuint vbo = range.page->vbo.getId();
+    GLuint ibo = range.page->ibo.getId();
+    GLuint positionBuffer = range.page->positions.getId();
+    auto vertexOffset = (GLintptr) (range.firstVertex * sizeof(Vertex));
+    auto positionOffset = (GLintptr) (range.firstVertex * sizeof(glm::vec3));
+    auto indexOffset = (GLintptr) (range.firstIndex * sizeof(Index));
+    // a fresh flag, callbacks of uploads from a lost context can't mark this one ready
+    range.uploadedGeneration = std::make_shared<int64_t>(-1);
+    auto uploadedGeneration = range.uploadedGeneration;
+    auto generation = GpuResourceRegistry::instance().getGeneration();
+    GLsync storageFence = range.page->storageFence;
+
+    UploadThread::submit([vbo, ibo, positionBuffer, vertexOffset, positionOffset, indexOffset, mesh,
+                                 storageFence, indices = std::move(indices),
+                                 positions = std::move(positions)]() {
+        // the storage was made by the render context, the writes queue behind it on the GPU
+        glWaitSync(storageFence, 0, GL_TIMEOUT_IGNORED);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, vertexOffset,
+                        (GLsizeiptr) (sizeof(Vertex) * mesh->getVertexCount()),
+                        mesh->getVertexData());
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, positionOffset,
+                        (GLsizeiptr) (sizeof(glm::vec3) * positions.size()), positions.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset,
+                        (GLsizeiptr) (sizeof(Index) * indices.size()), indices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }, [mesh, uploadedGeneration, generation]() {
+        *uploadedGeneration = generation;
+        // the data lives in the arena now
+        mesh->releaseCpuData();
+    });
+    return true;
+}
+
+bool GeometryArena::allocate(Mesh &mesh, GeometryRange &range) {
+    Shader *shader = mesh.getMaterial()->getShader();
+    size_t vertexCount = mesh.getVertexCount();
+    size_t indexCount = mesh.getIndexCount();
+    if (vertexCount > kArenaPageVertices) {
+        aout << "Mesh " << &mesh << " has too many vertices for the geometry arena" << std::endl;
+        return false;
+    }
+
+    for (const auto &page: pages_) {
+        // the variants of a program share its vertex layout, and so its pages
+        if (page->shader->hasSameVertexLayout(*shader)
+            && allocate(*page, vertexCount, indexCount, range)) {
+            return true;
+        }
+    }
+
+    auto page = std::make_unique<GeometryPage>(shader, kArenaPageVertices,
+                                               std::max(kArenaPageIndices, indexCount));
+    createStorage(*page);
+    bool allocated = allocate(*page, vertexCount, indexCount, range);
+    assert(allocated);
+    pages_.push_back(std::move(page));
+    aout << "Geometry arena page " << pages_.size() << " created" << std::endl;
+    return allocated;
+}
+
+bool GeometryArena::allocate(GeometryPage &page, size_t vertexCount, size_t indexCount,
+                             GeometryRange &range) {
+    size_t firstVertex = 0;
+    size_t firstIndex = 0;
+    if (!page.vertices.allocate(vertexCount, firstVertex)) {
+        return false;
+    }
+    if (!page.indices.allocate(indexCount, firstIndex)) {
+        page.vertices.free(firstVertex, vertexCount);
+        return false;
+    }
+    range.page = &page;
+    range.firstVertex = firstVertex;
+    range.vertexCount = vertexCount;
+    range.firstIndex = firstIndex;
+    range.indexCount = indexCount;
+    return true;
+}
+
+bool GeometryArena::merge(const std::vector<const GeometryRange *> &ranges,
+                          GeometryRange &merged) {
+    if (ranges.empty()) {
+        return false;
+    }
+    GeometryPage *page = ranges.front()->page;
+    size_t indexCount = 0;
+    for (const auto *range: ranges) {
+        assert(range->page == page && range->isReady());
+        indexCount += range->indexCount;
+    }
+
+    // keep the range if it already has the right size, e.g. after context loss
+    if (merged.page != page || merged.indexCount != indexCount) {
+        release(merged);
+        size_t firstIndex = 0;
+        if (!page->indices.allocate(indexCount, firstIndex)) {
+            return false;
+        }
+        merged.page = page;
+        merged.firstVertex = 0;
+        merged.vertexCount = 0;
+        merged.firstIndex = firstIndex;
+        merged.indexCount = indexCount;
+    }
+
+    // source and destination don't overlap, so both can be the same buffer
+    glBindBuffer(GL_COPY_READ_BUFFER, page->ibo.getId());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page->ibo.getId());
+    auto writeOffset = (GLintptr) (merged.firstIndex * sizeof(Index));
+    for (const auto *range: ranges) {
+        auto size = (GLsizeiptr) (range->indexCount * sizeof(Index));
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            (GLintptr) (range->firstIndex * sizeof(Index)), writeOffset, size);
+        writeOffset += size;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    CHECK_GL_ERROR();
+
+    // the copy is ordered before every later draw on this context
+    merged.uploadedGeneration = std::make_shared<int64_t>(
+            GpuResourceRegistry::instance().getGeneration());
+    return true;
+}
+
+void GeometryArena::release(GeometryRange &range) {
+    if (!range.page) {
+        return;
+    }
+    range.page->vertices.free(range.firstVertex, range.vertexCount);
+    range.page->indices.free(range.firstIndex, range.indexCount);
+    range.page = nullptr;
+    *range.uploadedGeneration = -1;
+}
+
+void GeometryArena::restore() {
+    resetBindings();
+    for (const auto &page: pages_) {
+        createStorage(*page);
+    }
+}
+
+void GeometryArena::bind(const GeometryPage *page) {
+    bindVertexArray(page ? page->vao.getId() : 0);
+}
+
+void GeometryArena::bindPositions(const GeometryPage *page) {
+    bindVertexArray(page ? page->depthVao.getId() : 0);
+}
+
+void GeometryArena::bindVertexArray(GLuint vao) {
+    if (boundVertexArray_ != vao) {
+        glBindVertexArray(vao);
+        boundVertexArray_ = vao;
+    }
+}
+
+void GeometryArena::resetBindings() {
+    boundVertexArray_ = 0;
+}
+
+void GeometryArena::createStorage(GeometryPage &page) {
+    size_t vertexBytes = sizeof(Vertex) * page.vertices.getCapacity();
+    size_t indexBytes = sizeof(Index) * page.indices.getCapacity();
+
+    GLuint vbo, ibo, vao;
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+    page.vbo = GpuResource(GpuResourceType::BUFFER, vbo, vertexBytes);
+    page.ibo = GpuResource(GpuResourceType::BUFFER, ibo, indexBytes);
+
+    // vertex arrays can't be shared between contexts, they are always made on the render thread
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    boundVertexArray_ = 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) vertexBytes, nullptr, GL_STATIC_DRAW);
+    GLint positionAttrib = page.shader->getPositionAttrib();
+    glEnableVertexAttribArray(positionAttrib);
+    glVertexAttribPointer(
+            positionAttrib,
+            3,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(Vertex),
+            (void *) (0)
+    );
+
+    GLint uvAttrib = page.shader->getUvAttrib();
+    glEnableVertexAttribArray(uvAttrib);
+    glVertexAttribPointer(
+            uvAttrib,
+            2,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(Vertex),
+            (void *) offsetof(Vertex, uv)
+    );
+
+    GLint normalAttribute = page.shader->normalAttribute;
+    glEnableVertexAttribArray(normalAttribute);
+    glVertexAttribPointer(
+            normalAttribute,
+            3,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(Vertex),
+            (void *) offsetof(Vertex, normal)
+    );
+
+    GLint tangentAttribute = page.shader->tangentAttribute;
+    glEnableVertexAttribArray(tangentAttribute);
+    glVertexAttribPointer(
+            tangentAttribute,
+            3,
+            GL_FLOAT,
+            GL_FALSE,
+            sizeof(Vertex),
+            (void *) offsetof(Vertex, tangent)
+    );
+
+    GLint layerAttribute = page.shader->layerAttribute;
+    if (layerAttribute != -1) {
+        glEnableVertexAttribArray(layerAttribute);
+        glVertexAttribPointer(
+                layerAttribute,
+                1,
+                GL_FLOAT,
+                GL_FALSE,
+                sizeof(Vertex),
+                (void *) offsetof(Vertex, layer)
+        );
+    }
+
+    GLint jointsAttribute = page.shader->jointsAttribute;
+    if (jointsAttribute != -1) {
+        glEnableVertexAttribArray(jointsAttribute);
+        glVertexAttribIPointer(
+                jointsAttribute,
+                4,
+                GL_UNSIGNED_BYTE,
+                sizeof(Vertex),
+                (void *) offsetof(Vertex, joints)
+        );
+    }
+
+    GLint weightsAttribute = page.shader->weightsAttribute;
+    if (weightsAttribute != -1) {
+        glEnableVertexAttribArray(weightsAttribute);
+        glVertexAttribPointer(
+                weightsAttribute,
+                4,
+                GL_UNSIGNED_BYTE,
+                GL_TRUE,
+                sizeof(Vertex),
+                (void *) offsetof(Vertex, weights)
+        );
+    }
+
+    GLint morphAttribute = page.shader->morphAttribute;
+    if (morphAttribute != -1) {
+        glEnableVertexAttribArray(morphAttribute);
+        glVertexAttribIPointer(
+                morphAttribute,
+                1,
+                GL_UNSIGNED_INT,
+                sizeof(Vertex),
+                (void *) offsetof(Vertex, morph)
+        );
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) indexBytes, nullptr, GL_STATIC_DRAW);
+
+    page.vao = GpuResource(GpuResourceType::VERTEX_ARRAY, vao, 0);
+
+    size_t positionBytes = sizeof(glm::vec3) * page.vertices.getCapacity();
+    GLuint positionBuffer, depthVao;
+    glGenBuffers(1, &positionBuffer);
+    page.positions = GpuResource(GpuResourceType::BUFFER, positionBuffer, positionBytes);
+
+    glGenVertexArrays(1, &depthVao);
+    glBindVertexArray(depthVao);
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) positionBytes, nullptr, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(kDepthPositionAttribute);
+    glVertexAttribPointer(kDepthPositionAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3),
+                          (void *) 0);
+    // skinned and morphed depth draws need the joints and morph ranges too, they are read from
+    // the full vertices
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(kDepthJointsAttribute);
+    glVertexAttribIPointer(kDepthJointsAttribute, 4, GL_UNSIGNED_BYTE, sizeof(Vertex),
+                           (void *) offsetof(Vertex, joints));
+    glEnableVertexAttribArray(kDepthWeightsAttribute);
+    glVertexAttribPointer(kDepthWeightsAttribute, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+                          (void *) offsetof(Vertex, weights));
+    glEnableVertexAttribArray(kDepthMorphAttribute);
+    glVertexAttribIPointer(kDepthMorphAttribute, 1, GL_UNSIGNED_INT, sizeof(Vertex),
+                           (void *) offsetof(Vertex, morph));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    page.depthVao = GpuResource(GpuResourceType::VERTEX_ARRAY, depthVao, 0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // the upload context fills the buffers, it has to see the storage first. A fence of a lost
+    // context is gone with it, the old one is only dropped.
+    page.storageFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // another context can only wait for a fence that reached the GPU
+    glFlush();
+    CHECK_GL_ERROR();
+}
@@ -0,0 +1,181 @@
+//
+// Created by Dark Matter on 6/19/24.
+//
+
+#ifndef LEARNOPENGL_GEOMETRYARENA_H
+#define LEARNOPENGL_GEOMETRYARENA_H
+
+#include <GLES3/gl3.h>
+#include <memory>
+#include <vector>
+#include "gpu/GpuResourceRegistry.h"
+#include "gpu/RangeAllocator.h"
+
+class Mesh;
+
+class Shader;
+
+/*!
+ * Vertices per page, indices are 16 bit so a draw can't reach further than this
+ */
+static constexpr size_t kArenaPageVertices = 65536;
+
+/*!
+ * Indices per page, meshes with more get a page of their own
+ */
+static constexpr size_t kArenaPageIndices = 256 * 1024;
+
+/*!
+ * Attribute location of the position in the position only vertex array, depth programs bind
+ * inPosition to it
+ */
+static constexpr GLuint kDepthPositionAttribute = 0;
+
+/*!
+ * Attribute locations of the skinning joints and weights and the morph target range in the
+ * position only vertex array
+ */
+static constexpr GLuint kDepthJointsAttribute = 1;
+static constexpr GLuint kDepthWeightsAttribute = 2;
+static constexpr GLuint kDepthMorphAttribute = 3;
+
+/*!
+ * One vertex buffer, index buffer and vertex array shared by many meshes. All meshes in a page
+ * use shaders with the same attribute locations, so the vertex array fits every one of them.
+ *
+ * Depth only passes read the positions from a second, tightly packed buffer through their own
+ * vertex array, so they fetch 12 bytes per vertex instead of the whole Vertex. Only the skinning
+ * joints and weights and the morph target range still come from the full vertices.
+ */
+struct GeometryPage {
+    GeometryPage(Shader *shader, size_t vertexCapacity, size_t indexCapacity)
+            : shader(shader), vertices(vertexCapacity), indices(indexCapacity) {}
+
+    ~GeometryPage();
+
+    GeometryPage(const GeometryPage &) = delete;
+
+    GeometryPage &operator=(const GeometryPage &) = delete;
+
+    Shader *shader;
+    RangeAllocator vertices;
+    RangeAllocator indices;
+    GpuResource vao;
+    GpuResource vbo;
+    GpuResource ibo;
+    // position only stream, shares the index buffer
+    GpuResource depthVao;
+    GpuResource positions;
+    // signaled once the storage exists, the upload context waits for it before writing
+    GLsync storageFence = nullptr;
+};
+
+/*!
+ * Where the geometry of a mesh lives inside a page. Indices are stored rebased by firstVertex, so
+ * the range is drawn with a plain glDrawElements at firstIndex.
+ */
+struct GeometryRange {
+    GeometryPage *page = nullptr;
+    size_t firstVertex = 0;
+    size_t vertexCount = 0;
+    size_t firstIndex = 0;
+    size_t indexCount = 0;
+    // registry generation of the last finished upload, -1 while uploading
+    std::shared_ptr<int64_t> uploadedGeneration = std::make_shared<int64_t>(-1);
+
+    /*!
+     * @return true if the data of this range is on the GPU in the current context
+     */
+    bool isReady() const;
+};
+
+/*!
+ * Sub-allocates the static meshes into a few large buffers instead of one vertex array, vertex
+ * buffer and index buffer per mesh. Consecutive draws from the same page keep the vertex array
+ * bound. Ranges of unloaded meshes go back to the page's free list and are reused.
+ *
+ * GLES 3.0 has no base vertex draws, so the indices are rebased while uploading instead and pages
+ * are limited to what 16 bit indices can address.
+ */
+class GeometryArena {
+public:
+    GeometryArena();
+
+    ~GeometryArena();
+
+    GeometryArena(const GeometryArena &) = delete;
+
+    GeometryArena &operator=(const GeometryArena &) = delete;
+
+    /*!
+     * @return the arena of the renderer, or nullptr when there is none
+     */
+    static GeometryArena *get();
+
+    /*!
+     * Copies the mesh data into the arena, on the UploadThread when there is one. The mesh gets a
+     * range the first time, later calls (after context loss) fill the range it already has. The
+     * mesh data is released by its residency policy once the upload finished.
+     * @return false if the mesh doesn't fit in a page
+     */
+    bool upload(const std::shared_ptr<Mesh> &mesh);
+
+    /*!
+     * Copies the indices of @a ranges one after another into a new index range of their page, so
+     * they are drawn with a single call. The copy happens on the GPU, the meshes don't need their
+     * CPU data for it. All ranges have to be ready and in the same page.
+     * @param merged receives the new range, it has no vertices of its own
+     * @return false if the page has no room for the indices
+     */
+    bool merge(const std::vector<const GeometryRange *> &ranges, GeometryRange &merged);
+
+    /*!
+     * Gives the range back to its page
+     */
+    void release(GeometryRange &range);
+
+    /*!
+     * Creates the buffers and vertex arrays of all pages again after the GL context was lost, the
+     * meshes have to be uploaded again afterwards
+     */
+    void restore();
+
+    /*!
+     * Binds the vertex array of @a page unless it is bound already
+     */
+    static void bind(const GeometryPage *page);
+
+    /*!
+     * Binds the position only vertex array of @a page unless it is bound already
+     */
+    static void bindPositions(const GeometryPage *page);
+
+    /*!
+     * Forgets the bound vertex array, after a context change or foreign binds
+     */
+    static void resetBindings();
+
+    size_t getPageCount() const { return pages_.size(); }
+
+private:
+    std::vector<std::unique_ptr<GeometryPage>> pages_;
+
+    static GeometryArena *instance_;
+    static GLuint boundVertexArray_;
+
+    bool allocate(Mesh &mesh, GeometryRange &range);
+
+    static bool allocate(GeometryPage &page, size_t vertexCount, size_t indexCount,
+                         GeometryRange &range);
+
+    static void bindVertexArray(GLuint vao);
+
+    /*!
+     * Creates the buffer storage and the vertex arrays of @a page, and the fence uploads to it
+     * wait for
+     */
+    static void createStorage(GeometryPage &page);
+};
+
+
+#endif //LEARNOPENGL_GEOMETRYARENA_H
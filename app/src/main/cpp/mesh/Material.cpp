@@ -7,6 +7,11 @@
 #include "AndroidOut.h"
 #include "utils.h"
 #include "Utility.h"
+#include <algorithm>
+#include <iterator>
+
+GLuint Material::boundTextureArray_ = 0;
+GLuint Material::boundSamplers_[16] = {};
 
 Shader *Material::getShader() const {
     return shader_;
@@ -17,6 +22,35 @@ void Material::loadShader() {
     shader_ = shaderLoader_->load(shaderPath);
 }
 
+void Material::updateShader() {
+    if (!pbr) {
+        loadShader();
+        return;
+    }
+    // a variant per texture set keeps the branches and the fetches of missing textures out of
+    // the fragment shader
+    std::string defines = "#define PBR\n";
+    if (diffuseTexture) {
+        defines += "#define HAS_BASE_COLOR_TEXTURE\n";
+        if (diffuseTexture->isArrayLayer()) {
+            defines += "#define HAS_BASE_COLOR_ARRAY\n";
+        }
+    }
+    if (normalTexture) {
+        defines += "#define HAS_NORMAL_TEXTURE\n";
+    }
+    if (occlusionRoughnessMetallicTexture) {
+        defines += "#define HAS_ORM_TEXTURE\n";
+    }
+    if (emissiveTexture) {
+        defines += "#define HAS_EMISSIVE_TEXTURE\n";
+    }
+    Shader *variant = shaderLoader_->load(shaderPath, defines);
+    if (variant) {
+        shader_ = variant;
+    }
+}
+
 
 Material::~Material() {
     aout << "Material::destroy" << std::endl;
@@ -28,18 +62,112 @@ void Material::unbindTexture() const {
     CHECK_GL_ERROR();
 }
 
+void Material::resetBindings() {
+    boundTextureArray_ = 0;
+    std::fill(std::begin(boundSamplers_), std::end(boundSamplers_), 0);
+}
+
+void Material::bindSampler(GLuint unitIndex, const GpuResource *sampler) {
+    assert(unitIndex < ARRAY_SIZE_IN_ELEMENTS(boundSamplers_));
+    GLuint samplerId = sampler ? sampler->getId() : 0;
+    if (boundSamplers_[unitIndex] != samplerId) {
+        glBindSampler(unitIndex, samplerId);
+        boundSamplers_[unitIndex] = samplerId;
+    }
+}
+
+bool Material::isReady() const {
+    for (const auto *texture: {diffuseTexture.get(), specularTexture.get(), normalTexture.get(),
+                               occlusionRoughnessMetallicTexture.get(), emissiveTexture.get()}) {
+        if (texture && !texture->isReady()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * @return true if both textures are bound the same way, layers of one array compare equal because
+ * the layer comes from the vertices
+ */
+static bool isSameBinding(const TextureAsset *a, const TextureAsset *b) {
+    if (!a || !b) {
+        return a == b;
+    }
+    if (a->isArrayLayer() && b->isArrayLayer()) {
+        return a->getTextureID() == b->getTextureID();
+    }
+    return a == b;
+}
+
+bool Material::canBatchWith(const Material &other) const {
+    return shader_ == other.shader_
+           && isSameBinding(diffuseTexture.get(), other.diffuseTexture.get())
+           && isSameBinding(specularTexture.get(), other.specularTexture.get())
+           && isSameBinding(normalTexture.get(), other.normalTexture.get())
+           && isSameBinding(occlusionRoughnessMetallicTexture.get(),
+                            other.occlusionRoughnessMetallicTexture.get())
+           && isSameBinding(emissiveTexture.get(), other.emissiveTexture.get())
+           && diffuseSampler == other.diffuseSampler
+           && specularSampler == other.specularSampler
+           && normalSampler == other.normalSampler
+           && occlusionRoughnessMetallicSampler == other.occlusionRoughnessMetallicSampler
+           && emissiveSampler == other.emissiveSampler
+           && diffuseColor == other.diffuseColor
+           && specularColor == other.specularColor
+           && ambientColor == other.ambientColor
+           && pbr == other.pbr
+           && baseColorFactor == other.baseColorFactor
+           && emissiveFactor == other.emissiveFactor
+           && metallicFactor == other.metallicFactor
+           && roughnessFactor == other.roughnessFactor
+           && normalScale == other.normalScale
+           && occlusionStrength == other.occlusionStrength
+           && blended == other.blended;
+}
+
+bool Material::restore() const {
+    bool restored = true;
+    for (auto *texture: {diffuseTexture.get(), specularTexture.get(), normalTexture.get(),
+                         occlusionRoughnessMetallicTexture.get(), emissiveTexture.get()}) {
+        if (texture && !texture->restore()) {
+            restored = false;
+        }
+    }
+    return restored;
+}
+
 Material::Material(ShaderLoader *shaderLoader) : shaderLoader_(shaderLoader) {
     diffuseColor = glm::vec4(0, 0, 0, 1);
     loadShader();
 }
 
 void Material::bindTexture() const {
+    for (const auto *texture: {diffuseTexture.get(), specularTexture.get(), normalTexture.get(),
+                               occlusionRoughnessMetallicTexture.get(), emissiveTexture.get()}) {
+        if (texture) {
+            texture->markUsed();
+        }
+    }
 
 
-    if (diffuseTexture) {
+    if (diffuseTexture && diffuseTexture->isArrayLayer()) {
+        // the array is shared by many materials, only rebind it when another array was used
+        if (boundTextureArray_ != diffuseTexture->getTextureID()) {
+            glActiveTexture(COLOR_TEXTURE_ARRAY_UNIT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, diffuseTexture->getTextureID());
+            boundTextureArray_ = diffuseTexture->getTextureID();
+        }
+        bindSampler(COLOR_TEXTURE_ARRAY_UNIT_INDEX, diffuseSampler);
+        glUniform1i(shader_->getUseDiffTextureLocation(), GL_TRUE);
+        glUniform1i(shader_->getUseTextureArrayLocation(), GL_TRUE);
+        glUniform1i(shader_->getTextureArrayLocation(), COLOR_TEXTURE_ARRAY_UNIT_INDEX);
+    } else if (diffuseTexture) {
         glActiveTexture(COLOR_TEXTURE_UNIT);
         glBindTexture(GL_TEXTURE_2D, diffuseTexture->getTextureID());
+        bindSampler(COLOR_TEXTURE_UNIT_INDEX, diffuseSampler);
         glUniform1i(shader_->getUseDiffTextureLocation(), GL_TRUE);
+        glUniform1i(shader_->getUseTextureArrayLocation(), GL_FALSE);
         glUniform1i(shader_->getDiffColorLocation(), COLOR_TEXTURE_UNIT_INDEX);
     }
 
@@ -48,6 +176,7 @@ void Material::bindTexture() const {
     if (specularTexture) {
         glActiveTexture(SPECULAR_EXPONENT_UNIT);
         glBindTexture(GL_TEXTURE_2D, specularTexture->getTextureID());
+        bindSampler(SPECULAR_EXPONENT_UNIT_INDEX, specularSampler);
         glUniform1i(shader_->getSpecularExponentLocation(), SPECULAR_EXPONENT_UNIT_INDEX);
     }
 
@@ -56,9 +185,34 @@ void Material::bindTexture() const {
     if (normalTexture) {
         glActiveTexture(NORMAL_UNIT);
         glBindTexture(GL_TEXTURE_2D, normalTexture->getTextureID());
+        bindSampler(NORMAL_UNIT_INDEX, normalSampler);
         glUniform1i(shader_->getNormalTexLocation(), NORMAL_UNIT_INDEX);
     }
 
+    if (occlusionRoughnessMetallicTexture) {
+        glActiveTexture(OCCLUSION_ROUGHNESS_METALLIC_UNIT);
+        glBindTexture(GL_TEXTURE_2D, occlusionRoughnessMetallicTexture->getTextureID());
+        bindSampler(OCCLUSION_ROUGHNESS_METALLIC_UNIT_INDEX, occlusionRoughnessMetallicSampler);
+    }
+
+    if (emissiveTexture) {
+        glActiveTexture(EMISSIVE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, emissiveTexture->getTextureID());
+        bindSampler(EMISSIVE_UNIT_INDEX, emissiveSampler);
+    }
+
+    if (shader_->isPbr()) {
+        bindPbrUniforms();
+        return;
+    }
+
+    glUniform1i(shader_->getUseOcclusionTextureLocation(),
+                occlusionRoughnessMetallicTexture ? GL_TRUE : GL_FALSE);
+    if (occlusionRoughnessMetallicTexture) {
+        glUniform1i(shader_->getOcclusionRoughnessMetallicLocation(),
+                    OCCLUSION_ROUGHNESS_METALLIC_UNIT_INDEX);
+    }
+
     //Push Color to fragment shader
     glUniform3fv(shader_->getAmbientColorLocation(), 1, (const GLfloat *) &ambientColor.x);
 
@@ -73,4 +227,13 @@ void Material::bindTexture() const {
     CHECK_GL_ERROR();
 }
 
-
+void Material::bindPbrUniforms() const {
+    const PbrMaterialLocations &locations = shader_->getPbrMaterialLocations();
+    glUniform4fv(locations.baseColorFactor, 1, (const GLfloat *) &baseColorFactor.x);
+    glUniform3fv(locations.emissiveFactor, 1, (const GLfloat *) &emissiveFactor.x);
+    glUniform1f(locations.metallicFactor, metallicFactor);
+    glUniform1f(locations.roughnessFactor, roughnessFactor);
+    glUniform1f(locations.normalScale, normalScale);
+    glUniform1f(locations.occlusionStrength, occlusionStrength);
+    CHECK_GL_ERROR();
+}
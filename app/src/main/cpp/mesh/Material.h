@@ -17,28 +17,94 @@ public:
     std::shared_ptr<TextureAsset> diffuseTexture;
     std::shared_ptr<TextureAsset> specularTexture;
     std::shared_ptr<TextureAsset> normalTexture;
+    std::shared_ptr<TextureAsset> occlusionRoughnessMetallicTexture;
+    std::shared_ptr<TextureAsset> emissiveTexture;
+
+    // sampler objects from the SamplerCache, one per texture slot
+    const GpuResource *diffuseSampler = nullptr;
+    const GpuResource *specularSampler = nullptr;
+    const GpuResource *normalSampler = nullptr;
+    const GpuResource *occlusionRoughnessMetallicSampler = nullptr;
+    const GpuResource *emissiveSampler = nullptr;
 
     glm::vec3 diffuseColor = {0.0, 0.0, 0.0};
     glm::vec3 specularColor = {0.0, 0.0, 0.0};
     glm::vec3 ambientColor = {0.0, 0.0, 0.0};
 
+    // glTF metallic-roughness model, the colors above are ignored then. diffuseTexture holds the
+    // base color, the texture factors multiply what the textures store.
+    bool pbr = false;
+    glm::vec4 baseColorFactor = {1.0, 1.0, 1.0, 1.0};
+    glm::vec3 emissiveFactor = {0.0, 0.0, 0.0};
+    float metallicFactor = 1.0f;
+    float roughnessFactor = 1.0f;
+    float normalScale = 1.0f;
+    float occlusionStrength = 1.0f;
+
+    // drawn after the opaque meshes, back to front with blending and without depth writes
+    bool blended = false;
+
     Material(ShaderLoader* shaderLoader);
 
     ~Material();
 
     Shader *getShader() const;
 
+    /*!
+     * Picks the shader for the lighting model and the textures of the material. PBR materials get
+     * a variant that only samples the textures they have, call again after changing them.
+     */
+    void updateShader();
+
     void bindTexture() const;
 
     void unbindTexture() const;
 
+    /*!
+     * Uploads the textures again after the GL context was lost
+     * @return false if one of them could not be restored
+     */
+    bool restore() const;
+
+    /*!
+     * @return true if drawing with @a other sets exactly the same state, e.g. materials that only
+     * differ in the layer of the same texture array, their meshes can be drawn in one call
+     */
+    bool canBatchWith(const Material &other) const;
+
+    /*!
+     * @return true when none of the textures is still uploading
+     */
+    bool isReady() const;
+
+    /*!
+     * Forgets which texture array and samplers are bound, call when the GL state was changed behind
+     * our back
+     */
+    static void resetBindings();
+
 
 private :
     Shader* shader_;
-    std::shared_ptr<ShaderLoader> shaderLoader_;
+    // owned by the Renderer, materials must not free it
+    ShaderLoader *shaderLoader_;
     const char* shaderPath = "default";
 
+    // texture array bound on COLOR_TEXTURE_ARRAY_UNIT, shared by all materials
+    static GLuint boundTextureArray_;
+
+    // sampler bound to every texture unit we use, samplers are shared by many materials too
+    static GLuint boundSamplers_[16];
+
+    static void bindSampler(GLuint unitIndex, const GpuResource *sampler);
+
     void loadShader();
+
+    /*!
+     * Sets the factors of the metallic-roughness model, the PBR variant samples its textures from
+     * fixed units
+     */
+    void bindPbrUniforms() const;
 };
 
 
@@ -4,6 +4,8 @@
 
 #include "Mesh.h"
 #include "AndroidOut.h"
+#include "MeshCache.h"
+#include "glm/common.hpp"
 
 #include <utility>
 
@@ -12,7 +14,20 @@ Mesh::Mesh(std::vector<Vertex> vertices, std::vector<Index> indices,
            const std::shared_ptr<Material>& material)
         : vertices_(std::move(vertices)),
           indices_(std::move(indices)), material_(material) {
+    vertexCount_ = vertices_.size();
+    indexCount_ = indices_.size();
+    computeBounds();
+}
 
+void Mesh::computeBounds() {
+    if (vertices_.empty()) {
+        return;
+    }
+    boundsMin_ = boundsMax_ = vertices_.front().position;
+    for (const auto &vertex: vertices_) {
+        boundsMin_ = glm::min(boundsMin_, vertex.position);
+        boundsMax_ = glm::max(boundsMax_, vertex.position);
+    }
 }
 
  const Vertex *Mesh::getVertexData() const {
@@ -20,7 +35,7 @@ Mesh::Mesh(std::vector<Vertex> vertices, std::vector<Index> indices,
 }
 
  const size_t Mesh::getIndexCount() const {
-    return indices_.size();
+    return indexCount_;
 }
 
  const Index *Mesh::getIndexData() const {
@@ -28,26 +43,80 @@ Mesh::Mesh(std::vector<Vertex> vertices, std::vector<Index> indices,
 }
 
  const size_t Mesh::getVertexCount()  {
-    return vertices_.size();
+    return vertexCount_;
 }
 
-GLuint Mesh::getVAO() const { return vao; }
-
-void Mesh::setVAO(GLuint vaoID) { vao = vaoID; }
+void Mesh::makeOccluder() {
+    if (vertices_.empty()) {
+        return;
+    }
+    occluder_ = std::make_unique<OccluderGeometry>();
+    occluder_->positions.reserve(vertices_.size());
+    for (const auto &vertex: vertices_) {
+        occluder_->positions.push_back(vertex.position);
+    }
+    occluder_->indices = indices_;
+}
 
-GLuint Mesh::getVBO() const { return vbo; }
+void Mesh::setResidency(MeshResidency residency, MeshCache *meshCache, std::string cacheKey) {
+    residency_ = residency;
+    meshCache_ = meshCache;
+    cacheKey_ = std::move(cacheKey);
+}
 
-void Mesh::setVBO(GLuint vboID) { vbo = vboID; }
+void Mesh::releaseCpuData() {
+    if (residency_ == MeshResidency::KEEP || vertices_.empty()) {
+        return;
+    }
+    if (!meshCache_ || !meshCache_->store(cacheKey_, vertices_, indices_)) {
+        // without a cache entry the data could never come back, keep it
+        aout << "Mesh " << this << " keeps its data, it could not be cached" << std::endl;
+        return;
+    }
+
+    if (residency_ == MeshResidency::PICKING) {
+        pickingPositions_.reserve(vertices_.size());
+        for (const auto &vertex: vertices_) {
+            pickingPositions_.push_back(vertex.position);
+        }
+    } else {
+        std::vector<Index>().swap(indices_);
+    }
+    std::vector<Vertex>().swap(vertices_);
+}
 
-GLuint Mesh::getIBO() const { return ibo; }
+bool Mesh::reloadCpuData() {
+    if (!vertices_.empty()) {
+        return true;
+    }
+    if (!meshCache_ || !meshCache_->load(cacheKey_, vertices_, indices_)) {
+        return false;
+    }
+    if (vertices_.size() != vertexCount_ || indices_.size() != indexCount_) {
+        aout << "Mesh cache entry " << cacheKey_ << " doesn't match the mesh" << std::endl;
+        std::vector<Vertex>().swap(vertices_);
+        return false;
+    }
+    std::vector<glm::vec3>().swap(pickingPositions_);
+    return true;
+}
 
-void Mesh::setIBO(GLuint iboID) { ibo = iboID; }
+void Mesh::markUsed() const {
+    if (geometry_.page) {
+        geometry_.page->vao.markUsed();
+        geometry_.page->vbo.markUsed();
+        geometry_.page->ibo.markUsed();
+    }
+}
 
 Material* Mesh::getMaterial() const{
 return material_.get();
 }
 
 Mesh::~Mesh() {
+    if (GeometryArena::get()) {
+        GeometryArena::get()->release(geometry_);
+    }
     aout << "Mesh is destroyed : " << this << std::endl;
 }
 
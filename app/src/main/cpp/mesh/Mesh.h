@@ -9,8 +9,26 @@
 #include "Material.h"
 #include "math/math.h"
 #include "Model.h"
+#include "GeometryArena.h"
+#include "culling/OcclusionCuller.h"
+#include <memory>
+#include <string>
 #include <vector>
 
+class MeshCache;
+
+/*!
+ * What a mesh keeps in RAM once its data is in GL buffers.
+ */
+enum class MeshResidency {
+    // keep the full vertex and index data
+    KEEP,
+    // drop everything, it can be read back from the MeshCache when the buffers need rebuilding
+    DISCARD,
+    // keep positions and indices only, enough for ray picking
+    PICKING
+};
+
 class Mesh {
 public:
     Mesh(
@@ -22,17 +40,12 @@ public:
 
     ~Mesh();
 
-    GLuint getVAO() const;
-
-    void setVAO(GLuint vaoID);
-
-    GLuint getVBO() const;
+    /*!
+     * @return where the mesh lives in the GeometryArena, the page is null before the first upload
+     */
+    GeometryRange &getGeometry() { return geometry_; }
 
-    void setVBO(GLuint vboID);
-
-    GLuint getIBO() const;
-
-    void setIBO(GLuint iboID);
+    const GeometryRange &getGeometry() const { return geometry_; }
 
     const Vertex *getVertexData() const;
 
@@ -44,13 +57,118 @@ public:
 
     Material *getMaterial() const;
 
+    /*!
+     * Node of the renderer's TransformHierarchy the mesh belongs to, its vertices are baked in the
+     * node's rest pose. Below 0 for meshes that don't belong to a node.
+     */
+    void setNode(int node) { node_ = node; }
+
+    constexpr int getNode() const { return node_; }
+
+    /*!
+     * Sets what happens to the CPU copy of the data after upload. Meshes that discard their data
+     * write it to @a meshCache under @a cacheKey first, so it can be reloaded.
+     */
+    void setResidency(MeshResidency residency, MeshCache *meshCache = nullptr,
+                      std::string cacheKey = "");
+
+    constexpr MeshResidency getResidency() const { return residency_; }
+
+    /*!
+     * Applies the residency policy, call once the data has been copied into GL buffers
+     */
+    void releaseCpuData();
+
+    /*!
+     * Brings the full vertex and index data back from the mesh cache
+     * @return true if the data is available, either because it was kept or reloaded
+     */
+    bool reloadCpuData();
+
+    /*!
+     * @return true while the full vertex data is in memory
+     */
+    bool hasCpuData() const { return !vertices_.empty(); }
+
+    /*!
+     * Positions kept by the PICKING policy, index them with getIndexData()
+     */
+    const std::vector<glm::vec3> &getPickingPositions() const { return pickingPositions_; }
+
+    /*!
+     * Stamps the arena page of this mesh as used in the current frame
+     */
+    void markUsed() const;
+
+    /*!
+     * @return true once the data is uploaded to the arena
+     */
+    bool isReady() const { return geometry_.isReady(); }
+
+    /*!
+     * Model space bounding box of the vertices, it stays valid after the data was released
+     */
+    const glm::vec3 &getBoundsMin() const { return boundsMin_; }
+
+    const glm::vec3 &getBoundsMax() const { return boundsMax_; }
+
+    /*!
+     * Keeps a position only copy of the mesh that the OcclusionCuller draws, it stays when the
+     * data is released. Needs the full vertex data.
+     */
+    void makeOccluder();
+
+    /*!
+     * @return the occluder copy, nullptr for meshes that don't hide anything
+     */
+    const OccluderGeometry *getOccluder() const { return occluder_.get(); }
+
+    /*!
+     * Marks the mesh as skinned, its vertices reference joints of the renderer's Animator and are
+     * moved by them instead of by the node
+     */
+    void setSkinned(bool skinned) { skinned_ = skinned; }
+
+    constexpr bool isSkinned() const { return skinned_; }
+
+    /*!
+     * Marks the mesh as morphed, its vertices point at deltas in the renderer's MorphTargets
+     */
+    void setMorphed(bool morphed) { morphed_ = morphed; }
+
+    constexpr bool isMorphed() const { return morphed_; }
+
+    /*!
+     * @return true if the animator moves the vertices, the bounds only hold for the rest pose
+     */
+    constexpr bool isAnimated() const { return skinned_ || morphed_; }
+
 protected :
+    /*!
+     * Fits the bounds to vertices_, meshes filling vertices_ themselves call it once they did
+     */
+    void computeBounds();
+
     std::vector<Vertex> vertices_;
     std::vector<Index> indices_;
     std::shared_ptr<Material> material_;
-    GLuint vao = -1;
-    GLuint vbo = -1;
-    GLuint ibo = -1;
+    int node_ = -1;
+    bool skinned_ = false;
+    bool morphed_ = false;
+
+    // counts stay valid after the data itself was released
+    size_t vertexCount_ = 0;
+    size_t indexCount_ = 0;
+    glm::vec3 boundsMin_{0.0f};
+    glm::vec3 boundsMax_{0.0f};
+
+    MeshResidency residency_ = MeshResidency::KEEP;
+    MeshCache *meshCache_ = nullptr;
+    std::string cacheKey_;
+    std::vector<glm::vec3> pickingPositions_;
+    std::unique_ptr<OccluderGeometry> occluder_;
+    // given back to the arena together with the mesh
+    GeometryRange geometry_;
 
 };
 
@@ -0,0 +1,87 @@
+//
+// Created by Dark Matter on 6/14/24.
+//
+
+#include "MeshCache.h"
+#include "AndroidOut.h"
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sys/stat.h>
+#include <utility>
+
+namespace {
+    constexpr uint32_t kMeshCacheMagic = 0x4853454d; // "MESH"
+    constexpr uint32_t kMeshCacheVersion = 3;
+
+    struct MeshCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t indexSize;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+    };
+}
+
+MeshCache::MeshCache(std::string directory) : directory_(std::move(directory)) {
+    mkdir(directory_.c_str(), 0700);
+}
+
+bool MeshCache::store(const std::string &key, const std::vector<Vertex> &vertices,
+                      const std::vector<Index> &indices) const {
+    std::ofstream file(filePath(key), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        aout << "Mesh cache can't write " << key << std::endl;
+        return false;
+    }
+    MeshCacheHeader header = {kMeshCacheMagic, kMeshCacheVersion, sizeof(Vertex), sizeof(Index),
+                              (uint32_t) vertices.size(), (uint32_t) indices.size()};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(vertices.data()),
+               (std::streamsize) (vertices.size() * sizeof(Vertex)));
+    file.write(reinterpret_cast<const char *>(indices.data()),
+               (std::streamsize) (indices.size() * sizeof(Index)));
+    return file.good();
+}
+
+bool MeshCache::load(const std::string &key, std::vector<Vertex> &vertices,
+                     std::vector<Index> &indices) const {
+    std::ifstream file(filePath(key), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    MeshCacheHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || header.magic != kMeshCacheMagic || header.version != kMeshCacheVersion
+        || header.vertexSize != sizeof(Vertex) || header.indexSize != sizeof(Index)) {
+        aout << "Mesh cache entry for " << key << " is stale" << std::endl;
+        return false;
+    }
+
+    std::vector<Vertex> cachedVertices(header.vertexCount);
+    std::vector<Index> cachedIndices(header.indexCount);
+    file.read(reinterpret_cast<char *>(cachedVertices.data()),
+              (std::streamsize) (cachedVertices.size() * sizeof(Vertex)));
+    file.read(reinterpret_cast<char *>(cachedIndices.data()),
+              (std::streamsize) (cachedIndices.size() * sizeof(Index)));
+    if (!file) {
+        aout << "Mesh cache entry for " << key << " is truncated" << std::endl;
+        return false;
+    }
+    vertices = std::move(cachedVertices);
+    indices = std::move(cachedIndices);
+    return true;
+}
+
+bool MeshCache::contains(const std::string &key) const {
+    struct stat info{};
+    return stat(filePath(key).c_str(), &info) == 0;
+}
+
+std::string MeshCache::filePath(const std::string &key) const {
+    // keys are model paths, hash them into a flat file name
+    char name[32];
+    snprintf(name, sizeof(name), "%016zx.mesh", std::hash<std::string>()(key));
+    return directory_ + "/" + name;
+}
@@ -0,0 +1,52 @@
+//
+// Created by Dark Matter on 6/14/24.
+//
+
+#ifndef LEARNOPENGL_MESHCACHE_H
+#define LEARNOPENGL_MESHCACHE_H
+
+#include <string>
+#include <vector>
+#include "math/math.h"
+#include "Model.h"
+
+/*!
+ * Stores the vertex and index data of imported meshes as flat binary files in the app's internal
+ * storage. Meshes that drop their CPU copy after upload read it back from here, which is much
+ * cheaper than running the importer again.
+ */
+class MeshCache {
+public:
+    /*!
+     * @param directory where the cache files live, created if missing
+     */
+    explicit MeshCache(std::string directory);
+
+    /*!
+     * Writes the mesh data for @a key, replacing what was stored before
+     * @return true if the file was written completely
+     */
+    bool store(const std::string &key, const std::vector<Vertex> &vertices,
+               const std::vector<Index> &indices) const;
+
+    /*!
+     * Reads back what was stored for @a key. Files written by a build with a different vertex
+     * layout are rejected.
+     * @return true if the data was found and is valid, the vectors are untouched otherwise
+     */
+    bool load(const std::string &key, std::vector<Vertex> &vertices,
+              std::vector<Index> &indices) const;
+
+    /*!
+     * @return true if data for @a key has been stored
+     */
+    bool contains(const std::string &key) const;
+
+private:
+    std::string directory_;
+
+    std::string filePath(const std::string &key) const;
+};
+
+
+#endif //LEARNOPENGL_MESHCACHE_H
@@ -5,11 +5,13 @@
 #include "MeshRenderer.h"
 #include "AndroidOut.h"
 #include "core/Behaviour.h"
-#include "light/DirectionalLight.h"
 #include "camera/Camera.h"
-#include "light/PointLight.h"
-#include "light/SpotLight.h"
 #include "Utility.h"
+#include "utils.h"
+#include "glm/common.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 
 MeshRenderer::MeshRenderer() {
     transform->setRotation(0, 0, 0);
@@ -18,41 +20,61 @@ MeshRenderer::MeshRenderer() {
 }
 
 
-void MeshRenderer::render(Mat4f *projectionMatrix,Camera* camera, Light *light) {
+/*!
+ * Layout of the DrawData uniform block in vert.vert
+ */
+struct DrawData {
+    Mat4f projection;
+    Mat4f model;
+};
+
+void MeshRenderer::render(const Mat4f &projectionMatrix, const Transform &frameTransform,
+                          const glm::vec3 &cameraPosition, const PassLight *light,
+                          StreamingBuffer *drawData, RenderQueue queue, int buffer) {
     unsigned int textureN = 0;
-    Mat4f modelMatrix = transform->matrix();
+    const DrawList &list = drawLists_[buffer];
+    // only while the renderer is torn down, prepareBatches() keeps the list in step otherwise
+    if (list.batchesVersion != batchesVersion_) {
+        return;
+    }
+    // the same for every batch, and kept here so the light itself is only read
+    glm::vec3 cameraLocalPos3f = frameTransform.worldToLocal(cameraPosition);
+    glm::vec3 localDirection(0.0f);
+    if (light && light->type == DIRECTIONAL) {
+        localDirection = frameTransform.worldDirectionToLocal(light->direction);
+    }
+
+    size_t restOffset = SIZE_MAX;
+    size_t boundOffset = SIZE_MAX;
+    bool poseBound = false;
     CHECK_GL_ERROR();
-    for (const auto &mesh: meshes_) {
-        Material *material = mesh->getMaterial();
+    for (uint32_t index: queue == RenderQueue::BLENDED ? list.blended : list.opaque) {
+        const Batch &batch = batches_[index];
+        bindDrawData(batch, projectionMatrix, frameTransform, drawData, restOffset, boundOffset);
+        bindPoseData(batch, poseBound);
+        Material *material = batch.meshes.front()->getMaterial();
         CHECK_GL_ERROR();
         Shader *shader = material->getShader();
-        shader->setProjectionMatrix(projectionMatrix);
-        shader->setModelMatrix(modelMatrix);
+        // depth passes leave their own program bound
+        shader->bind();
         material->bindTexture();
         CHECK_GL_ERROR();
-        auto* pDirectionalLight = dynamic_cast<DirectionalLight*>(light);
-        if(pDirectionalLight){
-            pDirectionalLight->calLocalDirection(*transform);
+        // point and spot lights come from the clusters, only pass lights are bound here
+        if (light) {
+            light->bind(shader, cameraLocalPos3f, localDirection);
         }
-        CHECK_GL_ERROR();
-        auto* pSpotLight = dynamic_cast<SpotLight*>(light);
-        if(pSpotLight){
-
-            pSpotLight->calculateDirectionAndPosition(*this->transform);
-        }else{
-            auto* pPointLight = dynamic_cast<PointLight*>(light);
-            if(pPointLight){
-                pPointLight->calculateLocalPosition(*this->transform);
+
+        for (const auto *mesh: batch.meshes) {
+            mesh->markUsed();
+        }
+        // meshes in the same page share the vertex array, it is only bound when the page changes
+        if (batch.geometry.isReady()) {
+            drawRange(batch.geometry);
+        } else {
+            for (const auto *mesh: batch.meshes) {
+                drawRange(mesh->getGeometry());
             }
         }
-        CHECK_GL_ERROR();
-        auto cameraLocalPos3f = transform->worldToLocal(camera->transform->position);
-
-        light->bind(shader, cameraLocalPos3f);
-
-        glBindVertexArray(mesh->getVAO());
-        glDrawElements(GL_TRIANGLES, mesh->getIndexCount(), GL_UNSIGNED_SHORT, (void *) 0);
-        glBindVertexArray(0);
         material->unbindTexture();
         textureN++;
        // aout << "textureN : " << textureN << std::endl;
@@ -62,80 +84,286 @@ void MeshRenderer::render(Mat4f *projectionMatrix,Camera* camera, Light *light)
 }
 
 
-void MeshRenderer::initMesh(Mesh *mesh) const {
-    GLuint vao, vbo, ibo;
-
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER,
-                 sizeof(Vertex) * mesh->getVertexCount(),
-                 mesh->getVertexData(),
-                 GL_STATIC_DRAW);
-    GLint positionAttrib = mesh->getMaterial()->getShader()->getPositionAttrib();
-    glEnableVertexAttribArray(positionAttrib);
-    glVertexAttribPointer(
-            positionAttrib,
-            3,
-            GL_FLOAT,
-            GL_FALSE,
-            sizeof(Vertex),
-            (void *) (0)
-    );
-
-    GLint uvAttrib = mesh->getMaterial()->getShader()->getUvAttrib();
-    glEnableVertexAttribArray(uvAttrib);
-    glVertexAttribPointer(
-            uvAttrib,
-            2,
-            GL_FLOAT,
-            GL_FALSE,
-            sizeof(Vertex),
-            (void *) offsetof(Vertex, uv)
-    );
-
-    GLint normalAttribute = mesh->getMaterial()->getShader()->normalAttribute;
-    glEnableVertexAttribArray(normalAttribute);
-    glVertexAttribPointer(
-            normalAttribute,
-            3,
-            GL_FLOAT,
-            GL_FALSE,
-            sizeof(Vertex),
-            (void *) offsetof(Vertex, normal)
-    );
-
-    GLint tangentAttribute = mesh->getMaterial()->getShader()->tangentAttribute;
-    glEnableVertexAttribArray(tangentAttribute);
-    glVertexAttribPointer(
-            tangentAttribute,
-            3,
-            GL_FLOAT,
-            GL_FALSE,
-            sizeof(Vertex),
-            (void *) offsetof(Vertex, tangent)
-    );
-
-
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 sizeof(Index) * mesh->getIndexCount(),
-                 mesh->getIndexData(), GL_STATIC_DRAW);
-
-    glBindVertexArray(vao);
-
-    mesh->setVAO(vao);
-    mesh->setVBO(vbo);
-    mesh->setIBO(ibo);
-
-    glBindVertexArray(0);
-    glDisableVertexAttribArray(positionAttrib);
-    glDisableVertexAttribArray(uvAttrib);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+void MeshRenderer::renderDepth(const Mat4f &projectionMatrix, const Transform &frameTransform,
+                               StreamingBuffer *drawData, bool shadowCasters, int buffer) {
+    const DrawList &list = drawLists_[buffer];
+    if (list.batchesVersion != batchesVersion_) {
+        return;
+    }
+
+    Mat4f modelProjection = projectionMatrix * frameTransform.matrix();
+    size_t restOffset = SIZE_MAX;
+    size_t boundOffset = SIZE_MAX;
+    bool poseBound = false;
+    for (uint32_t index: shadowCasters ? list.casters : list.opaque) {
+        const Batch &batch = batches_[index];
+        bindDrawData(batch, modelProjection, frameTransform, drawData, restOffset, boundOffset);
+        bindPoseData(batch, poseBound);
+        if (batch.geometry.isReady()) {
+            GeometryArena::bindPositions(batch.geometry.page);
+            glDrawElements(GL_TRIANGLES, (GLsizei) batch.geometry.indexCount, GL_UNSIGNED_SHORT,
+                           (void *) (batch.geometry.firstIndex * sizeof(Index)));
+            continue;
+        }
+        for (const auto *mesh: batch.meshes) {
+            const GeometryRange &geometry = mesh->getGeometry();
+            GeometryArena::bindPositions(geometry.page);
+            glDrawElements(GL_TRIANGLES, (GLsizei) geometry.indexCount, GL_UNSIGNED_SHORT,
+                           (void *) (geometry.firstIndex * sizeof(Index)));
+        }
+    }
+}
+
+void MeshRenderer::bindDrawData(const Batch &batch, const Mat4f &projectionMatrix,
+                                const Transform &frameTransform, StreamingBuffer *drawData,
+                                size_t &restOffset, size_t &boundOffset) const {
+    size_t offset;
+    if (batch.node >= 0) {
+        const Mat4f &restDelta = hierarchy_.getRestDelta(batch.node);
+        DrawData nodeData{projectionMatrix * restDelta, frameTransform.matrix() * restDelta};
+        offset = drawData->push(&nodeData, sizeof(nodeData));
+    } else {
+        if (restOffset == SIZE_MAX) {
+            DrawData data{projectionMatrix, frameTransform.matrix()};
+            restOffset = drawData->push(&data, sizeof(data));
+        }
+        offset = restOffset;
+    }
+    if (offset != boundOffset) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_DATA_UNIFORM_BINDING, drawData->getBuffer(),
+                          (GLintptr) offset, sizeof(DrawData));
+        boundOffset = offset;
+    }
+}
+
+void MeshRenderer::bindPoseData(const Batch &batch, bool &poseBound) const {
+    // static meshes never read the blocks, whatever ranges are bound serve them
+    if (!batch.animated || poseBound) {
+        return;
+    }
+    if (skinOffset_ != SIZE_MAX) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, SKIN_DATA_UNIFORM_BINDING, poseBuffer_,
+                          (GLintptr) skinOffset_, sizeof(SkinData));
+    }
+    if (morphOffset_ != SIZE_MAX) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, MORPH_DATA_UNIFORM_BINDING, poseBuffer_,
+                          (GLintptr) morphOffset_, sizeof(MorphData));
+    }
+    if (morphTargets_) {
+        morphTargets_->bind();
+    }
+    poseBound = true;
+}
+
+void MeshRenderer::setAnimator(std::unique_ptr<Animator> animator) {
+    animator_ = std::move(animator);
+    for (int buffer = 0; buffer < 2; ++buffer) {
+        skinPalettes_[buffer] = animator_ ? std::make_unique<SkinData>() : nullptr;
+        morphPalettes_[buffer] = animator_ ? std::make_unique<MorphData>() : nullptr;
+    }
+}
+
+void MeshRenderer::animate(float deltaTime, int buffer) {
+    if (animator_) {
+        animator_->update(deltaTime, *skinPalettes_[buffer], *morphPalettes_[buffer]);
+    }
+}
+
+void MeshRenderer::collectOccluders(const Mat4f &projectionMatrix,
+                                    std::vector<OccluderDraw> &occluders) {
+    hierarchy_.update();
+    for (const auto *mesh: readyOccluders_) {
+        occluders.push_back({mesh->getOccluder(),
+                             nodeProjection(mesh->getNode(), projectionMatrix)});
+    }
+}
+
+void MeshRenderer::buildDrawList(int buffer, OcclusionCuller *culler,
+                                 const Mat4f &projectionMatrix, const Mat4f &shadowProjection,
+                                 bool hidden) {
+    hierarchy_.update();
+    DrawList &list = drawLists_[buffer];
+    list.opaque.clear();
+    list.blended.clear();
+    list.casters.clear();
+    for (uint32_t index = 0; index < batches_.size(); ++index) {
+        const Batch &batch = batches_[index];
+        list.casters.push_back(index);
+        if (hidden) {
+            continue;
+        }
+        // the rest pose bounds say nothing about where the animator moved the vertices
+        if (culler && !batch.animated
+            && !culler->isVisible(nodeProjection(batch.node, projectionMatrix), batch.boundsMin,
+                                  batch.boundsMax)) {
+            continue;
+        }
+        (batch.blended ? list.blended : list.opaque).push_back(index);
+    }
+    sortBatches(projectionMatrix, false, list.order, list.opaque);
+    sortBatches(projectionMatrix, true, list.order, list.blended);
+    sortBatches(shadowProjection, false, list.order, list.casters);
+    list.batchesVersion = batchesVersion_;
+}
+
+void MeshRenderer::prepareBatches(int buffer, const Mat4f &projectionMatrix,
+                                  const Mat4f &shadowProjection) {
+    hierarchy_.update();
+    updateBatches();
+    // meshes still uploading are not drawn, they must not hide anything either
+    readyOccluders_.clear();
+    for (auto *mesh: occluders_) {
+        if (mesh->isReady()) {
+            readyOccluders_.push_back(mesh);
+        }
+    }
+    // the list of this frame points at the old batches, it is drawn without culling
+    if (drawLists_[buffer].batchesVersion != batchesVersion_) {
+        buildDrawList(buffer, nullptr, projectionMatrix, shadowProjection, false);
+    }
+}
+
+Mat4f MeshRenderer::nodeProjection(int node, const Mat4f &projectionMatrix) const {
+    return hierarchy_.isAtRest(node) ? projectionMatrix
+                                     : projectionMatrix * hierarchy_.getRestDelta(node);
+}
+
+void MeshRenderer::sortBatches(const Mat4f &projectionMatrix, bool backToFront,
+                               std::vector<std::pair<float, uint32_t>> &order,
+                               std::vector<uint32_t> &indices) const {
+    order.clear();
+    for (uint32_t index: indices) {
+        const Batch &batch = batches_[index];
+        glm::vec4 center((batch.boundsMin + batch.boundsMax) * 0.5f, 1.0f);
+        // clip z grows with the distance for the camera and the orthographic light projections
+        float depth = (nodeProjection(batch.node, projectionMatrix) * center).z;
+        order.emplace_back(backToFront ? -depth : depth, index);
+    }
+    std::sort(order.begin(), order.end());
+    for (size_t i = 0; i < order.size(); ++i) {
+        indices[i] = order[i].second;
+    }
+}
+
+void MeshRenderer::drawRange(const GeometryRange &geometry) {
+    GeometryArena::bind(geometry.page);
+    glDrawElements(GL_TRIANGLES, (GLsizei) geometry.indexCount, GL_UNSIGNED_SHORT,
+                   (void *) (geometry.firstIndex * sizeof(Index)));
+}
+
+void MeshRenderer::updateBatches() {
+    size_t readyCount = 0;
+    for (const auto &mesh: meshes_) {
+        if (mesh->isReady() && mesh->getMaterial()->isReady()) {
+            readyCount++;
+        }
+    }
+    bool batchesReady = true;
+    for (const auto &batch: batches_) {
+        // merged ranges are lost with the context, ranges that never merged stay empty
+        if (batch.geometry.page && !batch.geometry.isReady()) {
+            batchesReady = false;
+        }
+    }
+    if (readyCount == batchedMeshCount_ && batchesReady
+        && hierarchy_.getRestVersion() == batchedRestVersion_) {
+        return;
+    }
+
+    // group the meshes that are drawn, meshes still uploading join once they are ready
+    std::vector<Batch> batches;
+    for (const auto &mesh: meshes_) {
+        if (!mesh->isReady() || !mesh->getMaterial()->isReady()) {
+            continue;
+        }
+        // meshes of moved nodes need their own matrix, the ones at rest are all drawn alike.
+        // Animated meshes are placed by the animator, never by the node.
+        bool animated = mesh->isAnimated();
+        int node = animated || hierarchy_.isAtRest(mesh->getNode()) ? -1 : mesh->getNode();
+        auto batch = std::find_if(batches.begin(), batches.end(),
+                                  [&mesh, node, animated](const Batch &batch) {
+            const Mesh *first = batch.meshes.front();
+            return batch.node == node && batch.animated == animated
+                   && first->getGeometry().page == mesh->getGeometry().page
+                   && first->getMaterial()->canBatchWith(*mesh->getMaterial());
+        });
+        if (batch == batches.end()) {
+            batches.push_back(Batch{{mesh.get()}, node});
+            batch = batches.end() - 1;
+            batch->blended = mesh->getMaterial()->blended;
+            batch->animated = animated;
+            batch->boundsMin = mesh->getBoundsMin();
+            batch->boundsMax = mesh->getBoundsMax();
+        } else {
+            batch->meshes.push_back(mesh.get());
+            batch->boundsMin = glm::min(batch->boundsMin, mesh->getBoundsMin());
+            batch->boundsMax = glm::max(batch->boundsMax, mesh->getBoundsMax());
+        }
+    }
+
+    // batches that didn't change keep their merged indices, the rest is copied anew
+    auto *arena = GeometryArena::get();
+    for (auto &batch: batches) {
+        if (batch.meshes.size() < 2) {
+            continue;
+        }
+        auto previous = std::find_if(batches_.begin(), batches_.end(),
+                                     [&batch](const Batch &previous) {
+                                         return previous.meshes == batch.meshes;
+                                     });
+        if (previous != batches_.end()) {
+            batch.geometry = std::move(previous->geometry);
+            previous->geometry = GeometryRange();
+            if (batch.geometry.isReady()) {
+                continue;
+            }
+        }
+        std::vector<const GeometryRange *> ranges;
+        for (const auto *mesh: batch.meshes) {
+            ranges.push_back(&mesh->getGeometry());
+        }
+        if (!arena->merge(ranges, batch.geometry)) {
+            aout << "No room to merge " << batch.meshes.size() << " meshes" << std::endl;
+        }
+    }
+    releaseBatches();
+    batches_ = std::move(batches);
+    batchesVersion_++;
+    bounds_.valid = !batches_.empty();
+    if (bounds_.valid) {
+        bounds_.min = batches_.front().boundsMin;
+        bounds_.max = batches_.front().boundsMax;
+    }
+    for (const auto &batch: batches_) {
+        bounds_.min = glm::min(bounds_.min, batch.boundsMin);
+        bounds_.max = glm::max(bounds_.max, batch.boundsMax);
+        // animated meshes and moved nodes are not drawn where their rest pose box is
+        bounds_.valid = bounds_.valid && !batch.animated && batch.node == -1;
+    }
+    batchedMeshCount_ = readyCount;
+    batchedRestVersion_ = hierarchy_.getRestVersion();
+    aout << "MeshRenderer draws " << readyCount << " meshes in " << batches_.size()
+         << " batches" << std::endl;
+}
+
+void MeshRenderer::releaseBatches() {
+    auto *arena = GeometryArena::get();
+    for (auto &batch: batches_) {
+        if (arena) {
+            arena->release(batch.geometry);
+        }
+    }
+    batches_.clear();
+    batchesVersion_++;
+    bounds_ = RenderBounds();
+}
+
+void MeshRenderer::initMesh(const std::shared_ptr<Mesh> &mesh) {
+    auto *arena = GeometryArena::get();
+    assert(arena);
+    if (!arena->upload(mesh)) {
+        aout << "Mesh " << mesh << " could not be uploaded" << std::endl;
+    }
 }
 
 void MeshRenderer::onAttach() {
@@ -158,16 +386,51 @@ void MeshRenderer::update() {
 
 void MeshRenderer::addMesh(const std::shared_ptr<Mesh> &mesh) {
     meshes_.push_back(mesh);
+    if (mesh->getOccluder()) {
+        occluders_.push_back(mesh.get());
+    }
     CHECK_GL_ERROR();
    // mesh->getMaterial()->getShader()->bind();
-    initMesh(mesh.get());
+    initMesh(mesh);
 }
 
 MeshRenderer::~MeshRenderer() {
+    releaseBatches();
     aout << "MeshRenderer is destroyed." << std::endl;
 
 }
 
+void MeshRenderer::writeComponents(EntityRegistry &registry, Entity entity) {
+    registry.add(entity, Renderable{this});
+    registry.add(entity, WorldTransform{});
+    registry.add(entity, RenderBounds{});
+    refreshComponents(registry, entity);
+}
+
+void MeshRenderer::refreshComponents(EntityRegistry &registry, Entity entity) {
+    Transform &world = registry.get<WorldTransform>(entity)->transform;
+    world = *transform;
+    // built here on the copy, the render thread only reads its caches
+    world.matrix();
+    world.inverseMatrix();
+    *registry.get<RenderBounds>(entity) = bounds_;
+}
+
+void MeshRenderer::onContextRestored() {
+    if (morphTargets_) {
+        morphTargets_->restore();
+    }
+    for (const auto &mesh: meshes_) {
+        mesh->getMaterial()->restore();
+        // buffers are filled from the kept data or the mesh cache, never from the importer
+        if (!mesh->reloadCpuData()) {
+            aout << "Mesh " << mesh << " lost its data, it can't be restored" << std::endl;
+            continue;
+        }
+        initMesh(mesh);
+    }
+}
+
 void MeshRenderer::onDestroy() {
     Component::onDestroy();
     for (const auto &mesh: meshes_) {
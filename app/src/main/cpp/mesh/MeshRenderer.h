@@ -10,6 +10,41 @@
 #include "core/Component.h"
 #include "light/Light.h"
 #include "camera/Camera.h"
+#include "gpu/StreamingBuffer.h"
+#include "transform/TransformHierarchy.h"
+#include "culling/OcclusionCuller.h"
+#include "animation/Animator.h"
+#include <memory>
+
+/*!
+ * Which meshes a pass draws, the queue is picked by Material::blended
+ */
+enum class RenderQueue {
+    // drawn front to back, so hidden fragments fail the depth test before they are shaded
+    OPAQUE,
+    // drawn back to front over the opaque meshes
+    BLENDED
+};
+
+class MeshRenderer;
+
+/*!
+ * Scene component of the entities drawn by the render pass
+ */
+struct Renderable {
+    MeshRenderer *renderer;
+};
+
+/*!
+ * Model space box around the batched meshes of a renderer in their rest pose, the occlusion
+ * culling tests the whole renderer against it before its batches
+ */
+struct RenderBounds {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+    // false without batches or with animated or moved ones, the box doesn't hold those vertices
+    bool valid = false;
+};
 
 class MeshRenderer : public Component {
 public :
@@ -21,20 +56,228 @@ public :
 
     void onCreate() override;
 
-    void render(Mat4f *projectionMatrix,Camera* camera, Light *light);
+    /*!
+     * Draws the meshes of @a queue in its order, the matrices are written to @a drawData once and
+     * shared by the meshes
+     * @param frameTransform copy of the transform taken for this frame, the update of the next
+     * frame may already be moving the real one
+     * @param cameraPosition world position of the camera in this frame
+     * @param light state of the light of this pass copied by the update, nullptr when there is
+     * none
+     * @param buffer draw list of this frame, see buildDrawList()
+     */
+    void render(const Mat4f &projectionMatrix, const Transform &frameTransform,
+                const glm::vec3 &cameraPosition, const PassLight *light, StreamingBuffer *drawData,
+                RenderQueue queue, int buffer);
+
+    /*!
+     * Draws the depth of the meshes from the position only streams of their pages, the depth
+     * program has to be bound. Uses the same batches as render().
+     * @param projectionMatrix projection * view of the pass, without the model matrix
+     * @param shadowCasters draws every batch in the order of the light, otherwise only the
+     * visible opaque ones in the order of the camera
+     */
+    void renderDepth(const Mat4f &projectionMatrix, const Transform &frameTransform,
+                     StreamingBuffer *drawData, bool shadowCasters, int buffer);
+
+    /*!
+     * Adds the occluder meshes that were ready when the batches were prepared to @a occluders
+     * @param projectionMatrix projection * view * model
+     */
+    void collectOccluders(const Mat4f &projectionMatrix, std::vector<OccluderDraw> &occluders);
+
+    /*!
+     * Culls the batches and sorts the ones of every pass into draw list @a buffer, the render pass
+     * draws the other list meanwhile. Runs in the scene update, doesn't touch GL.
+     * @param culler hides batches behind the occluders, nullptr keeps everything visible
+     * @param projectionMatrix projection * view * model of the camera
+     * @param shadowProjection light projection * model, the shadow casters are sorted by it
+     * @param hidden the whole renderer was culled by its RenderBounds, only the shadow casters
+     * are listed
+     */
+    void buildDrawList(int buffer, OcclusionCuller *culler, const Mat4f &projectionMatrix,
+                       const Mat4f &shadowProjection, bool hidden);
+
+    /*!
+     * Regroups the batches on the render thread, before the next update reads them. If that
+     * changed them, draw list @a buffer is built again without culling.
+     */
+    void prepareBatches(int buffer, const Mat4f &projectionMatrix, const Mat4f &shadowProjection);
 
     void update() override;
 
     void onDestroy() override;
 
+    void onContextRestored() override;
+
+    /*!
+     * Adds the Renderable, its WorldTransform and its RenderBounds
+     */
+    void writeComponents(EntityRegistry &registry, Entity entity) override;
+
+    void refreshComponents(EntityRegistry &registry, Entity entity) override;
+
     void addMesh(const std::shared_ptr<Mesh> &mesh);
 
+    /*!
+     * Node graph of the model, relative to this component's transform
+     */
+    TransformHierarchy &getHierarchy() { return hierarchy_; }
+
+    /*!
+     * Plays the clips of the model, the skinned meshes follow its joints and the morphed ones its
+     * morph target weights
+     */
+    void setAnimator(std::unique_ptr<Animator> animator);
+
+    /*!
+     * Deltas the morphed meshes point at
+     */
+    void setMorphTargets(std::unique_ptr<MorphTargets> morphTargets) {
+        morphTargets_ = std::move(morphTargets);
+    }
+
+    Animator *getAnimator() const { return animator_.get(); }
+
+    /*!
+     * Advances the animator by @a deltaTime seconds and writes the pose to palette @a buffer, the
+     * other palette may be drawn meanwhile. Does nothing without an animator.
+     */
+    void animate(float deltaTime, int buffer);
+
+    /*!
+     * @return joint matrices animate() wrote to @a buffer, nullptr if nothing is skinned
+     */
+    const SkinData *getSkin(int buffer) const {
+        return animator_ && animator_->getSkin().size() > 0 ? skinPalettes_[buffer].get()
+                                                            : nullptr;
+    }
+
+    /*!
+     * @return morph target weights animate() wrote to @a buffer, nullptr if nothing is morphed
+     */
+    const MorphData *getMorph(int buffer) const {
+        return animator_ && animator_->getMorphWeights().size() > 0
+               ? morphPalettes_[buffer].get() : nullptr;
+    }
+
+    /*!
+     * Ranges of @a buffer with this frame's SkinData and MorphData blocks, SIZE_MAX for the ones
+     * the model doesn't have. Bound before the first animated batch.
+     */
+    void bindPose(GLuint buffer, size_t skinOffset, size_t morphOffset) {
+        poseBuffer_ = buffer;
+        skinOffset_ = skinOffset;
+        morphOffset_ = morphOffset;
+    }
+
 
 private :
+    /*!
+     * Ready meshes that are drawn with the same state. Their indices are merged into one range of
+     * their arena page, so the whole batch is a single draw call.
+     */
+    struct Batch {
+        std::vector<Mesh *> meshes;
+        // node the meshes belong to if it left its rest pose, -1 for meshes at rest
+        int node = -1;
+        // merged indices, not ready when the page had no room, the meshes are drawn one by one then
+        GeometryRange geometry;
+        bool blended = false;
+        // vertices moved by the joints or morph targets of the animator, drawn with the model
+        // matrix like meshes at rest
+        bool animated = false;
+        // model space box around all meshes in their rest pose
+        glm::vec3 boundsMin{0.0f};
+        glm::vec3 boundsMax{0.0f};
+    };
+
+    /*!
+     * Batch indices of one frame in drawing order
+     */
+    struct DrawList {
+        // visible opaque batches front to back, visible blended ones back to front
+        std::vector<uint32_t> opaque;
+        std::vector<uint32_t> blended;
+        // every batch front to back from the light, hidden ones still cast shadows
+        std::vector<uint32_t> casters;
+        // depth and index scratch of the sort
+        std::vector<std::pair<float, uint32_t>> order;
+        // batchesVersion_ the indices refer to
+        uint32_t batchesVersion = 0;
+    };
+
     std::vector<std::shared_ptr<Mesh>> meshes_;
+    std::vector<Batch> batches_;
+    // changes whenever batches_ is rebuilt
+    uint32_t batchesVersion_ = 0;
+    // box of batches_, copied into the pool by refreshComponents()
+    RenderBounds bounds_;
+    // meshes with an occluder copy, and the ones of them that were ready when prepared
+    std::vector<Mesh *> occluders_;
+    std::vector<Mesh *> readyOccluders_;
+    // written by buildDrawList() into one while the render pass reads the other
+    DrawList drawLists_[2];
+    TransformHierarchy hierarchy_;
+    std::unique_ptr<Animator> animator_;
+    std::unique_ptr<MorphTargets> morphTargets_;
+    // written by animate() into one while the render pass reads the other
+    std::unique_ptr<SkinData> skinPalettes_[2];
+    std::unique_ptr<MorphData> morphPalettes_[2];
+    GLuint poseBuffer_ = 0;
+    size_t skinOffset_ = SIZE_MAX;
+    size_t morphOffset_ = SIZE_MAX;
+    // ready meshes when the batches were built, they are rebuilt when more become ready
+    size_t batchedMeshCount_ = 0;
+    uint32_t batchedRestVersion_ = 0;
     float rotation;
 
-    void initMesh(Mesh *mesh) const;
+    /*!
+     * Regroups the meshes when one finished uploading, a node left or returned to its rest pose or
+     * merged ranges were lost with the context. Batches whose meshes didn't change are kept.
+     */
+    void updateBatches();
+
+    void releaseBatches();
+
+    /*!
+     * Sorts the batches of @a indices by the depth of their center, front to back or back to front
+     * @param projectionMatrix projection * view * model
+     * @param order scratch space
+     */
+    void sortBatches(const Mat4f &projectionMatrix, bool backToFront,
+                     std::vector<std::pair<float, uint32_t>> &order,
+                     std::vector<uint32_t> &indices) const;
+
+    /*!
+     * @return the matrix the meshes of @a node are drawn with, @a projectionMatrix for meshes at
+     * rest
+     */
+    Mat4f nodeProjection(int node, const Mat4f &projectionMatrix) const;
+
+    /*!
+     * Binds the matrices of @a batch, they are written to @a drawData when needed. Meshes at rest
+     * are baked in model space and share one block, moved nodes get their own.
+     * @param projectionMatrix projection * view * model
+     * @param restOffset block of the meshes at rest, SIZE_MAX until it was written
+     * @param boundOffset block bound at the moment, SIZE_MAX if none
+     */
+    void bindDrawData(const Batch &batch, const Mat4f &projectionMatrix,
+                      const Transform &frameTransform, StreamingBuffer *drawData,
+                      size_t &restOffset, size_t &boundOffset) const;
+
+    /*!
+     * Binds the pose of this frame and the morph targets once @a batch is the first animated one
+     * of the pass
+     */
+    void bindPoseData(const Batch &batch, bool &poseBound) const;
+
+    static void drawRange(const GeometryRange &geometry);
+
+    /*!
+     * Uploads the mesh into the GeometryArena, on the UploadThread when there is one
+     */
+    static void initMesh(const std::shared_ptr<Mesh> &mesh);
 };
 
 
@@ -85,5 +85,6 @@ Cube::Cube(float size, ShaderLoader* shaderLoader) {
     size_ = size;
     generateVertices();
     generateIndices();
+    computeBounds();
     material_ = std::make_shared<Material>(shaderLoader);
 }
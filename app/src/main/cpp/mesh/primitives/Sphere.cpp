@@ -12,6 +12,7 @@ Sphere::Sphere(float radius, int latitudeSegments,
     material_ = std::make_shared<Material>(shaderLoader);
     generateVertices();
     generateIndices();
+    computeBounds();
 }
 
 void Sphere::generateVertices() {
@@ -0,0 +1,79 @@
+//
+// Created by Dark Matter on 6/25/24.
+//
+
+#include "DepthShader.h"
+#include "Shader.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "utils.h"
+#include "mesh/GeometryArena.h"
+#include <shader/Shaders.h>
+
+DepthShader::DepthShader() {
+    create();
+}
+
+void DepthShader::restore() {
+    aout << "Restoring depth program" << std::endl;
+    create();
+}
+
+void DepthShader::create() {
+    GLuint program = glCreateProgram();
+    GLuint vertexShader = Shader::compileShader(depthVertexShaderSource, GL_VERTEX_SHADER);
+    GLuint fragmentShader = Shader::compileShader(depthFragmentShaderSource, GL_FRAGMENT_SHADER);
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    // the position only vertex arrays are set up for this location
+    glBindAttribLocation(program, kDepthPositionAttribute, "inPosition");
+    glBindAttribLocation(program, kDepthJointsAttribute, "inJoints");
+    glBindAttribLocation(program, kDepthWeightsAttribute, "inWeights");
+    glBindAttribLocation(program, kDepthMorphAttribute, "inMorph");
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLchar log[512];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        aout << "Failed to link depth program with:\n" << log << std::endl;
+        glDeleteProgram(program);
+        program_.reset();
+        return;
+    }
+
+    GLint binaryLength = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    program_ = GpuResource(GpuResourceType::PROGRAM, program, binaryLength);
+    GLuint drawDataBlockIndex = glGetUniformBlockIndex(program, "DrawData");
+    if (drawDataBlockIndex == GL_INVALID_INDEX) {
+        aout << "Depth program has no DrawData block" << std::endl;
+        program_.reset();
+        return;
+    }
+    glUniformBlockBinding(program, drawDataBlockIndex, DRAW_DATA_UNIFORM_BINDING);
+    GLuint skinDataBlockIndex = glGetUniformBlockIndex(program, "SkinData");
+    if (skinDataBlockIndex == GL_INVALID_INDEX) {
+        aout << "Depth program has no SkinData block" << std::endl;
+        program_.reset();
+        return;
+    }
+    glUniformBlockBinding(program, skinDataBlockIndex, SKIN_DATA_UNIFORM_BINDING);
+    GLuint morphDataBlockIndex = glGetUniformBlockIndex(program, "MorphData");
+    if (morphDataBlockIndex == GL_INVALID_INDEX) {
+        aout << "Depth program has no MorphData block" << std::endl;
+        program_.reset();
+        return;
+    }
+    glUniformBlockBinding(program, morphDataBlockIndex, MORPH_DATA_UNIFORM_BINDING);
+    Shader::useProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uMorphTargets"), MORPH_TARGET_UNIT_INDEX);
+    CHECK_GL_ERROR();
+}
+
+void DepthShader::bind() const {
+    Shader::useProgram(program_.getId());
+}
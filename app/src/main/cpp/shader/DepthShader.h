@@ -0,0 +1,40 @@
+//
+// Created by Dark Matter on 6/25/24.
+//
+
+#ifndef LEARNOPENGL_DEPTHSHADER_H
+#define LEARNOPENGL_DEPTHSHADER_H
+
+#include <GLES3/gl3.h>
+#include "gpu/GpuResourceRegistry.h"
+
+/*!
+ * Program of the depth only passes. It reads nothing but the position only stream of the
+ * GeometryArena, the DrawData, SkinData and MorphData blocks and the morph targets, materials
+ * don't matter to it.
+ */
+class DepthShader {
+public:
+    DepthShader();
+
+    DepthShader(const DepthShader &) = delete;
+
+    DepthShader &operator=(const DepthShader &) = delete;
+
+    /*!
+     * Builds the program again after the GL context was lost
+     */
+    void restore();
+
+    void bind() const;
+
+    bool isValid() const { return program_.isValid(); }
+
+private:
+    void create();
+
+    GpuResource program_;
+};
+
+
+#endif //LEARNOPENGL_DEPTHSHADER_H
@@ -15,10 +15,23 @@
 #include <stdio.h>
 
 
-Shader::Shader() {
+GLuint Shader::boundProgram_ = 0;
+bool Shader::overdrawView_ = false;
+
+Shader::Shader(std::string defines) : defines_(std::move(defines)) {
+    create();
+}
+
+void Shader::restore() {
+    aout << "Restoring shader program" << std::endl;
+    create();
+}
+
+void Shader::create() {
     program_ = glCreateProgram();
     GLuint vertexShader = compileShader(vertexShaderSource, GL_VERTEX_SHADER);
-    GLuint fragmentShader = compileShader(fragmentShaderSource, GL_FRAGMENT_SHADER);
+    GLuint fragmentShader = compileShader(addDefines(fragmentShaderSource).c_str(),
+                                          GL_FRAGMENT_SHADER);
 
     glAttachShader(program_, vertexShader);
     glAttachShader(program_, fragmentShader);
@@ -40,37 +53,102 @@ Shader::Shader() {
         }
         glDeleteProgram(program_);
     } else {
-        projectionMatrixLocation_ = glGetUniformLocation(program_, "uProjection");
-        modelProjectionMatrixLocation_ = glGetUniformLocation(program_, "uModelProjection");
+        GLint binaryLength = 0;
+        glGetProgramiv(program_, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+        programResource_ = GpuResource(GpuResourceType::PROGRAM, program_, binaryLength);
+
+        drawDataBlockIndex_ = glGetUniformBlockIndex(program_, "DrawData");
+        if (drawDataBlockIndex_ != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program_, drawDataBlockIndex_, DRAW_DATA_UNIFORM_BINDING);
+        }
         materialLoc.diffuseColor = glGetUniformLocation(program_, "uMaterial.diffuseColor");
         materialLoc.useDiffText_ = glGetUniformLocation(program_, "uMaterial.useTexture");
+        materialLoc.useTextureArray = glGetUniformLocation(program_, "uMaterial.useTextureArray");
+        materialLoc.textureArrayLocation = glGetUniformLocation(program_, "uTextureArray");
         materialLoc.ambientColor = glGetUniformLocation(program_, "uMaterial.ambientColor");
         lightLoc.color = glGetUniformLocation(program_, "uLight.light.color");
         lightLoc.ambientIntensity = glGetUniformLocation(program_, "uLight.light.ambientIntensity");
         lightLoc.diffuseIntensity = glGetUniformLocation(program_, "uLight.light.diffuseIntensity");
         lightLoc.direction = glGetUniformLocation(program_, "uLight.direction");
+        lightLoc.worldDirection = glGetUniformLocation(program_, "uLight.worldDirection");
         lightTypeLocation = glGetUniformLocation(program_, "uLight.light.type");
         positionAttribute_ = glGetAttribLocation(program_, "inPosition");
         normalAttribute = glGetAttribLocation(program_, "inNormal");
         tangentAttribute = glGetAttribLocation(program_, "inTangent");
+        layerAttribute = glGetAttribLocation(program_, "inLayer");
+        jointsAttribute = glGetAttribLocation(program_, "inJoints");
+        weightsAttribute = glGetAttribLocation(program_, "inWeights");
+        morphAttribute = glGetAttribLocation(program_, "inMorph");
         uvAttribute_ = glGetAttribLocation(program_, "inUV");
         materialLoc.samplerSpecularExponentLocation = glGetUniformLocation(program_,
                                                                            "uSpecTexture");
         materialLoc.normalTextureLocation = glGetUniformLocation(program_,
                                                                            "uNormalTexture");
         materialLoc.specularColor = glGetUniformLocation(program_, "uMaterial.specularColor");
+        materialLoc.occlusionRoughnessMetallicLocation = glGetUniformLocation(program_,
+                                                                              "uORMTexture");
+        materialLoc.useOcclusionTexture = glGetUniformLocation(program_,
+                                                               "uMaterial.useOcclusionTexture");
+        pbrLoc_.baseColorFactor = glGetUniformLocation(program_, "uPbr.baseColorFactor");
+        pbrLoc_.emissiveFactor = glGetUniformLocation(program_, "uPbr.emissiveFactor");
+        pbrLoc_.metallicFactor = glGetUniformLocation(program_, "uPbr.metallicFactor");
+        pbrLoc_.roughnessFactor = glGetUniformLocation(program_, "uPbr.roughnessFactor");
+        pbrLoc_.normalScale = glGetUniformLocation(program_, "uPbr.normalScale");
+        pbrLoc_.occlusionStrength = glGetUniformLocation(program_, "uPbr.occlusionStrength");
         cameraLocalPosLocation_ = glGetUniformLocation(program_, "uCameraLocalPos");
-        numberOfPointLightLocation_ = glGetUniformLocation(program_, "uNumOfLights");
-        numberOfSpotLightLocation_ = glGetUniformLocation(program_, "uNumOfSpotLights");
-
-        loadPointLightUniforms();
+        overdrawLocation_ = glGetUniformLocation(program_, "uOverdraw");
+        appliedOverdraw_ = -1;
+        clusterDataBlockIndex_ = glGetUniformBlockIndex(program_, "ClusterData");
+        if (clusterDataBlockIndex_ != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program_, clusterDataBlockIndex_, CLUSTER_DATA_UNIFORM_BINDING);
+        }
+        shadowDataBlockIndex_ = glGetUniformBlockIndex(program_, "ShadowData");
+        if (shadowDataBlockIndex_ != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program_, shadowDataBlockIndex_, SHADOW_DATA_UNIFORM_BINDING);
+        }
+        skinDataBlockIndex_ = glGetUniformBlockIndex(program_, "SkinData");
+        if (skinDataBlockIndex_ != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program_, skinDataBlockIndex_, SKIN_DATA_UNIFORM_BINDING);
+        }
+        morphDataBlockIndex_ = glGetUniformBlockIndex(program_, "MorphData");
+        if (morphDataBlockIndex_ != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program_, morphDataBlockIndex_, MORPH_DATA_UNIFORM_BINDING);
+        }
+        // only the PBR variants read the environment
+        GLuint environmentDataBlockIndex = glGetUniformBlockIndex(program_, "EnvironmentData");
+        if (environmentDataBlockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program_, environmentDataBlockIndex,
+                                  ENVIRONMENT_DATA_UNIFORM_BINDING);
+        }
+        // the cluster textures, the shadow map, the morph targets, the BRDF table and the
+        // environment stay on their units for every draw
+        useProgram(program_);
+        glUniform1i(glGetUniformLocation(program_, "uClusterRanges"), CLUSTER_RANGES_UNIT_INDEX);
+        glUniform1i(glGetUniformLocation(program_, "uLightIndices"), LIGHT_INDEX_UNIT_INDEX);
+        glUniform1i(glGetUniformLocation(program_, "uShadowMap"), SHADOW_MAP_UNIT_INDEX);
+        glUniform1i(glGetUniformLocation(program_, "uMorphTargets"), MORPH_TARGET_UNIT_INDEX);
+        glUniform1i(glGetUniformLocation(program_, "uBrdfLut"), BRDF_LUT_UNIT_INDEX);
+        glUniform1i(glGetUniformLocation(program_, "uEnvironment"), ENVIRONMENT_UNIT_INDEX);
+        if (isPbr()) {
+            // the material textures of the variants never move either
+            glUniform1i(glGetUniformLocation(program_, "uTexture"), COLOR_TEXTURE_UNIT_INDEX);
+            glUniform1i(materialLoc.textureArrayLocation, COLOR_TEXTURE_ARRAY_UNIT_INDEX);
+            glUniform1i(materialLoc.normalTextureLocation, NORMAL_UNIT_INDEX);
+            glUniform1i(materialLoc.occlusionRoughnessMetallicLocation,
+                        OCCLUSION_ROUGHNESS_METALLIC_UNIT_INDEX);
+            glUniform1i(glGetUniformLocation(program_, "uEmissiveTexture"), EMISSIVE_UNIT_INDEX);
+        }
 
-        if (projectionMatrixLocation_ == INVALID_UNIFORM_LOCATION
+        if (drawDataBlockIndex_ == GL_INVALID_INDEX
+            || clusterDataBlockIndex_ == GL_INVALID_INDEX
+            || shadowDataBlockIndex_ == GL_INVALID_INDEX
+            || skinDataBlockIndex_ == GL_INVALID_INDEX
+            || morphDataBlockIndex_ == GL_INVALID_INDEX
             || positionAttribute_ == INVALID_UNIFORM_LOCATION
-            || materialLoc.useDiffText_ == INVALID_UNIFORM_LOCATION
-            || materialLoc.diffuseColor == INVALID_UNIFORM_LOCATION
+            || (!isPbr() && (materialLoc.useDiffText_ == INVALID_UNIFORM_LOCATION
+                             || materialLoc.diffuseColor == INVALID_UNIFORM_LOCATION))
             || uvAttribute_ == INVALID_UNIFORM_LOCATION) {
-            glDeleteProgram(program_);
+            programResource_.reset();
         }
     }
     bind();
@@ -79,88 +157,26 @@ Shader::Shader() {
 
 }
 
-void Shader::loadSpotLightUniforms() {
-    for (int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(spotLightLocation); ++i) {
-        char name[128];
-        memset(name, 0, sizeof(name));
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].light.color", i);
-        spotLightLocation[i].color = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].light.ambientIntensity", i);
-        spotLightLocation[i].ambientIntensity = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].localPos", i);
-        spotLightLocation[i].localPosition = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].light.diffuseIntensity", i);
-        spotLightLocation[i].diffuseIntensity = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].atten.constant", i);
-        spotLightLocation[i].attenuation.constant = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].atten.linear", i);
-        spotLightLocation[i].attenuation.linear = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].atten.exp", i);
-        spotLightLocation[i].attenuation.exp = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].direction", i);
-        spotLightLocation[i].direction = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uSpotLights[%d].cutOff", i);
-        spotLightLocation[i].cutOff = glGetUniformLocation(program_, name);
-
-        if (
-                spotLightLocation[i].color == INVALID_UNIFORM_LOCATION ||
-                spotLightLocation[i].ambientIntensity == INVALID_UNIFORM_LOCATION ||
-                spotLightLocation[i].localPosition == INVALID_UNIFORM_LOCATION ||
-                spotLightLocation[i].diffuseIntensity == INVALID_UNIFORM_LOCATION ||
-                spotLightLocation[i].attenuation.constant == INVALID_UNIFORM_LOCATION ||
-                spotLightLocation[i].attenuation.linear == INVALID_UNIFORM_LOCATION ||
-                spotLightLocation[i].attenuation.exp == INVALID_UNIFORM_LOCATION
-                ) {
-            glDeleteProgram(program_);
-        }
+std::string Shader::addDefines(const char *source) const {
+    std::string code(source);
+    if (defines_.empty()) {
+        return code;
     }
+    // nothing but comments may come before #version
+    size_t lineEnd = code.find('\n');
+    code.insert(lineEnd == std::string::npos ? code.size() : lineEnd + 1, defines_);
+    return code;
 }
 
-void Shader::loadPointLightUniforms() {
-    for (int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(pointLightLocation); ++i) {
-        char name[128];
-        memset(name, 0, sizeof(name));
-        SNPRINTF(name, sizeof(name), "uPointLights[%d].light.color", i);
-        pointLightLocation[i].color = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uPointLights[%d].light.ambientIntensity", i);
-        pointLightLocation[i].ambientIntensity = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uPointLights[%d].localPos", i);
-        pointLightLocation[i].localPosition = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uPointLights[%d].light.diffuseIntensity", i);
-        pointLightLocation[i].diffuseIntensity = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uPointLights[%d].atten.constant", i);
-        pointLightLocation[i].attenuation.constant = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uPointLights[%d].atten.linear", i);
-        pointLightLocation[i].attenuation.linear = glGetUniformLocation(program_, name);
-
-        SNPRINTF(name, sizeof(name), "uPointLights[%d].atten.exp", i);
-        pointLightLocation[i].attenuation.exp = glGetUniformLocation(program_, name);
-
-        if (
-                pointLightLocation[i].color == INVALID_UNIFORM_LOCATION ||
-                pointLightLocation[i].ambientIntensity == INVALID_UNIFORM_LOCATION ||
-                pointLightLocation[i].localPosition == INVALID_UNIFORM_LOCATION ||
-                pointLightLocation[i].diffuseIntensity == INVALID_UNIFORM_LOCATION ||
-                pointLightLocation[i].attenuation.constant == INVALID_UNIFORM_LOCATION ||
-                pointLightLocation[i].attenuation.linear == INVALID_UNIFORM_LOCATION ||
-                pointLightLocation[i].attenuation.exp == INVALID_UNIFORM_LOCATION
-                ) {
-            glDeleteProgram(program_);
-        }
-    }
+bool Shader::hasSameVertexLayout(const Shader &other) const {
+    return positionAttribute_ == other.positionAttribute_
+           && uvAttribute_ == other.uvAttribute_
+           && normalAttribute == other.normalAttribute
+           && tangentAttribute == other.tangentAttribute
+           && layerAttribute == other.layerAttribute
+           && jointsAttribute == other.jointsAttribute
+           && weightsAttribute == other.weightsAttribute
+           && morphAttribute == other.morphAttribute;
 }
 
 GLint Shader::getPositionAttrib() const {
@@ -199,21 +215,26 @@ std::string Shader::readFile(std::string &fileName) const {
 
 
 void Shader::bind() const {
-    CHECK_GL_ERROR();
-    glUseProgram(program_);
-    CHECK_GL_ERROR();
+    useProgram(program_);
+    if (appliedOverdraw_ != (int) overdrawView_ && overdrawLocation_ != INVALID_UNIFORM_LOCATION) {
+        glUniform1i(overdrawLocation_, overdrawView_);
+        appliedOverdraw_ = overdrawView_;
+    }
 }
 
 void Shader::unbind() const {
-    glUseProgram(0);
+    useProgram(0);
 }
 
-void Shader::setProjectionMatrix(const Mat4f *projectionMatrix) const {
-    glUniformMatrix4fv(projectionMatrixLocation_, 1, GL_TRUE, &projectionMatrix->m[0][0]);
+void Shader::useProgram(GLuint program) {
+    if (boundProgram_ != program) {
+        glUseProgram(program);
+        boundProgram_ = program;
+    }
 }
 
-void Shader::setModelMatrix(const Mat4f &matrix) const {
-    glUniformMatrix4fv(modelProjectionMatrixLocation_, 1, GL_TRUE, &matrix.m[0][0]);
+void Shader::resetBindings() {
+    boundProgram_ = 0;
 }
 
 GLint Shader::getDiffColorLocation() const {
@@ -228,6 +249,14 @@ GLint Shader::getUseDiffTextureLocation() const {
     return materialLoc.useDiffText_;
 }
 
+GLint Shader::getUseTextureArrayLocation() const {
+    return materialLoc.useTextureArray;
+}
+
+GLint Shader::getTextureArrayLocation() const {
+    return materialLoc.textureArrayLocation;
+}
+
 GLint Shader::getLightColorLocation() const {
     return lightLoc.color;
 }
@@ -243,6 +272,14 @@ GLint Shader::getNormalTexLocation() const {
     return materialLoc.normalTextureLocation;
 }
 
+GLint Shader::getOcclusionRoughnessMetallicLocation() const {
+    return materialLoc.occlusionRoughnessMetallicLocation;
+}
+
+GLint Shader::getUseOcclusionTextureLocation() const {
+    return materialLoc.useOcclusionTexture;
+}
+
 GLint Shader::getSpecularColorLocation() const {
     return materialLoc.specularColor;
 }
@@ -255,119 +292,10 @@ GLint Shader::getLightDirectionLocation() const {
     return lightLoc.direction;
 }
 
-GLint Shader::getDiffuseIntensityLocation() const {
-    return lightLoc.diffuseIntensity;
-}
-
-bool Shader::isValidIndex(int index) const {
-    if (index >= 0 && index < MAX_POINT_LIGHTS) {
-        return true;
-    } else {
-        std::cerr << "Index out of bounds: " << index << std::endl;
-        return false;
-    }
-}
-
-GLint Shader::getPointLightColor(int index) const {
-    if (isValidIndex(index)) {
-        return pointLightLocation[index].color;
-    } else {
-        return -1; // or appropriate error value
-    }
-}
-
-GLint Shader::getPointLightAmbientIntensity(int index) const {
-    if (isValidIndex(index)) {
-        return pointLightLocation[index].ambientIntensity;
-    } else {
-        return -1; // or appropriate error value
-    }
-}
-
-GLint Shader::getPointLightDiffuseIntensity(int index) const {
-    if (isValidIndex(index)) {
-        return pointLightLocation[index].diffuseIntensity;
-    } else {
-        return -1; // or appropriate error value
-    }
-}
-
-
-GLint Shader::getPointLightLocalPosition(int index) const {
-    if (isValidIndex(index)) {
-        return pointLightLocation[index].localPosition;
-    } else {
-        return -1; // or appropriate error value
-    }
-}
-
-GLint Shader::getPointLightAttenuationConstant(int index) const {
-    if (isValidIndex(index)) {
-        return pointLightLocation[index].attenuation.constant;
-    } else {
-        return 0; // or appropriate error value
-    }
-}
-
-GLint Shader::getPointLightAttenuationLinear(int index) const {
-    if (isValidIndex(index)) {
-        return pointLightLocation[index].attenuation.linear;
-    } else {
-        return 0; // or appropriate error value
-    }
-}
-
-GLint Shader::getPointLightAttenuationExp(int index) const {
-    if (isValidIndex(index)) {
-        return pointLightLocation[index].attenuation.exp;
-    } else {
-        return 0; // or appropriate error value
-    }
-}
-
-GLint Shader::getNumberOfLightsLocation() const {
-    return numberOfPointLightLocation_;
-}
-
-GLint Shader::getNumberOfSpotLightsLocation() const {
-    return numberOfSpotLightLocation_;
-}
-
-GLint Shader::getSpotLightColor(int index) const {
-    return spotLightLocation->color;
-}
-
-GLint Shader::getSpotLightAmbientIntensity(int index) const {
-    return spotLightLocation->ambientIntensity;
-}
-
-GLint Shader::getSpotLightDiffuseIntensity(int index) const {
-    return spotLightLocation->diffuseIntensity;
-}
-
-GLint Shader::getSpotLightLocalPosition(int index) const {
-    return spotLightLocation->localPosition;
-}
-
-GLint Shader::getSpotLightAttenuationConstant(int index) const {
-    return spotLightLocation->attenuation.constant;
-}
-
-GLint Shader::getSpotLightAttenuationLinear(int index) const {
-    return spotLightLocation->attenuation.linear;
-}
-
-GLint Shader::getSpotLightAttenuationExp(int index) const {
-    return spotLightLocation->attenuation.exp;
-}
-
-GLint Shader::getSpotLightDirection(int index) const {
-    return spotLightLocation->direction;
+GLint Shader::getLightWorldDirectionLocation() const {
+    return lightLoc.worldDirection;
 }
 
-GLint Shader::getSpotLightCutOff(int index) const {
-    return spotLightLocation->cutOff;
+GLint Shader::getDiffuseIntensityLocation() const {
+    return lightLoc.diffuseIntensity;
 }
-
-
-
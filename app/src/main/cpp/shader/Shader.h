@@ -7,12 +7,24 @@
 
 
 #include <__fwd/string.h>
+#include <string>
 #include <GLES3/gl3.h>
 #include "detail/type_mat4x4.hpp"
 #include "math/mat4f.h"
-
-const int MAX_POINT_LIGHTS = 10;
-const int MAX_SPOT_LIGHTS = 10;
+#include "gpu/GpuResourceRegistry.h"
+
+
+/*!
+ * Uniforms of the glTF metallic-roughness material, only the PBR variant of frag.frag has them
+ */
+struct PbrMaterialLocations {
+    GLint baseColorFactor = -1;
+    GLint emissiveFactor = -1;
+    GLint metallicFactor = -1;
+    GLint roughnessFactor = -1;
+    GLint normalScale = -1;
+    GLint occlusionStrength = -1;
+};
 
 class Shader {
 public:
@@ -20,15 +32,46 @@ public:
     GLint lightTypeLocation = 0;
     GLint normalAttribute = 0;
     GLint tangentAttribute = 0;
-
-
-    Shader();
-
+    GLint layerAttribute = 0;
+    GLint jointsAttribute = -1;
+    GLint weightsAttribute = -1;
+    GLint morphAttribute = -1;
+
+
+    /*!
+     * @param defines "#define NAME" lines compiled into the fragment shader, every combination is
+     * a variant with its own program
+     */
+    explicit Shader(std::string defines = "");
+
+    /*!
+     * Builds the program again after the GL context was lost, uniform locations are looked up anew
+     */
+    void restore();
+
+    /*!
+     * Makes the program current unless it is already
+     */
     void bind() const;
 
     void unbind() const;
 
-    void setProjectionMatrix(const Mat4f *projectionMatrix) const;
+    /*!
+     * glUseProgram that skips the call when @a program is current already, every program goes
+     * through it so the tracking stays right
+     */
+    static void useProgram(GLuint program);
+
+    /*!
+     * Forgets the current program, after a context change
+     */
+    static void resetBindings();
+
+    /*!
+     * Makes every program count the fragments it shades instead of lighting them, applied when
+     * the program is bound
+     */
+    static void setOverdrawView(bool overdrawView) { overdrawView_ = overdrawView; }
 
     GLint getPositionAttrib() const;
 
@@ -36,6 +79,10 @@ public:
 
     GLint getUseDiffTextureLocation() const;
 
+    GLint getUseTextureArrayLocation() const;
+
+    GLint getTextureArrayLocation() const;
+
     GLint getUvAttrib() const;
 
     GLint getAmbientColorLocation() const;
@@ -52,111 +99,90 @@ public:
 
     GLint getLightDirectionLocation() const;
 
-    GLint getDiffuseIntensityLocation() const;
-
-    GLint getNumberOfLightsLocation() const;
-
-    GLint getPointLightColor(int index) const;
+    GLint getLightWorldDirectionLocation() const;
 
-    GLint getPointLightAmbientIntensity(int index) const;
-
-    GLint getPointLightDiffuseIntensity(int index) const;
-
-    GLint getPointLightLocalPosition(int index) const;
-
-    GLint getPointLightAttenuationConstant(int index) const;
-
-    GLint getPointLightAttenuationLinear(int index) const;
-
-    GLint getPointLightAttenuationExp(int index) const;
-
-
-    GLint getNumberOfSpotLightsLocation() const;
-
-    GLint getSpotLightColor(int index) const;
-
-    GLint getSpotLightAmbientIntensity(int index) const;
+    GLint getDiffuseIntensityLocation() const;
 
-    GLint getSpotLightDiffuseIntensity(int index) const;
+    GLint getNormalTexLocation() const;
 
-    GLint getSpotLightLocalPosition(int index) const;
+    GLint getOcclusionRoughnessMetallicLocation() const;
 
-    GLint getSpotLightAttenuationConstant(int index) const;
+    GLint getUseOcclusionTextureLocation() const;
 
-    GLint getSpotLightAttenuationLinear(int index) const;
+    /*!
+     * @return true for the PBR variant, it takes the uniforms of getPbrMaterialLocations()
+     * instead of the Blinn-Phong material
+     */
+    bool isPbr() const { return pbrLoc_.baseColorFactor != -1; }
 
-    GLint getSpotLightAttenuationExp(int index) const;
+    const PbrMaterialLocations &getPbrMaterialLocations() const { return pbrLoc_; }
 
-    GLint getSpotLightDirection(int index) const;
+    /*!
+     * @return true if vertex arrays built for @a other fit this program too
+     */
+    bool hasSameVertexLayout(const Shader &other) const;
 
-    GLint getSpotLightCutOff(int index) const;
+    /*!
+     * @return the compiled shader object, 0 if it failed to compile
+     */
+    static GLuint compileShader(const char *shaderCode, GLenum shaderType);
+private:
+    void create();
 
-    GLint getNormalTexLocation() const;
+    /*!
+     * @return @a source with the defines of the variant inserted after its #version line
+     */
+    std::string addDefines(const char *source) const;
 
-    void setModelMatrix(const Mat4f &matrix) const;
-private:
+    std::string defines_;
     GLuint program_ = 0;
-    GLint projectionMatrixLocation_ = 0;
-    GLint modelProjectionMatrixLocation_ = 0;
+    // owns program_ once it linked
+    GpuResource programResource_;
+    // DrawData block with the projection and model matrices, bound to DRAW_DATA_UNIFORM_BINDING
+    GLuint drawDataBlockIndex_ = GL_INVALID_INDEX;
     GLint positionAttribute_ = 0;
     GLint uvAttribute_ = 0;
     GLint cameraLocalPosLocation_ = 0;
-    GLint numberOfPointLightLocation_ = 0;
-    GLint numberOfSpotLightLocation_ = 0;
+    // ClusterData block with the point and spot lights, bound to CLUSTER_DATA_UNIFORM_BINDING
+    GLuint clusterDataBlockIndex_ = GL_INVALID_INDEX;
+    // ShadowData block with the cascade matrices, bound to SHADOW_DATA_UNIFORM_BINDING
+    GLuint shadowDataBlockIndex_ = GL_INVALID_INDEX;
+    // SkinData block with the joint matrices, bound to SKIN_DATA_UNIFORM_BINDING
+    GLuint skinDataBlockIndex_ = GL_INVALID_INDEX;
+    // MorphData block with the morph target weights, bound to MORPH_DATA_UNIFORM_BINDING
+    GLuint morphDataBlockIndex_ = GL_INVALID_INDEX;
+
+    // uOverdraw and the value it was last set to, -1 before the first bind
+    GLint overdrawLocation_ = -1;
+    mutable int appliedOverdraw_ = -1;
+
+    static GLuint boundProgram_;
+    static bool overdrawView_;
 
     struct {
         GLint diffuseColor = 0;
         GLint useDiffText_ = 0;
+        GLint useTextureArray = 0;
+        GLint textureArrayLocation = 0;
         GLint ambientColor = 0;
         GLint samplerSpecularExponentLocation = 0;
         GLint normalTextureLocation = 0;
+        GLint occlusionRoughnessMetallicLocation = 0;
+        GLint useOcclusionTexture = 0;
         GLint specularColor = 0;
     } materialLoc;
 
-    struct {
-        GLint color = 0;
-        GLint ambientIntensity = 0;
-        GLint diffuseIntensity = 0;
-        GLint direction = 0;
-    } lightLoc;
+    PbrMaterialLocations pbrLoc_;
 
     struct {
         GLint color = 0;
         GLint ambientIntensity = 0;
         GLint diffuseIntensity = 0;
-        GLint localPosition = 0;
-        struct {
-            GLint constant = 1.0;
-            GLint linear = 0.0;
-            GLint exp = 0.0;
-        } attenuation;
-    } pointLightLocation[MAX_POINT_LIGHTS];
-
-    struct {
-        GLint color = 0;
-        GLint ambientIntensity = 0;
-        GLint diffuseIntensity = 0;
-        GLint localPosition = 0;
         GLint direction = 0;
-        GLint cutOff = 0;
-        struct {
-            GLint constant = 1.0;
-            GLint linear = 0.0;
-            GLint exp = 0.0;
-        } attenuation;
-    } spotLightLocation[MAX_SPOT_LIGHTS];
+        GLint worldDirection = -1;
+    } lightLoc;
 
     std::string readFile(std::string &fileName) const;
-
-    static GLuint compileShader(const char *shaderCode, GLenum shaderType);
-
-    bool isValidIndex(int index) const;
-
-    void loadPointLightUniforms();
-
-    void loadSpotLightUniforms();
-
-
 };
 
 
@@ -19,14 +19,26 @@ ShaderLoader::ShaderLoader() : shaders_() {
     }
 }
 
-void ShaderLoader::setNumOfLights(int count) const {
-    for (const auto &item: shaders_){
-        glUniform1i(item.second->getNumberOfLightsLocation(), count);
+Shader *ShaderLoader::load(const char *name, const std::string &defines) {
+    if (defines.empty()) {
+        return load(name);
     }
+    std::string key = std::string(name) + "\n" + defines;
+    auto it = shaders_.find(key);
+    if (it != shaders_.end()) {
+        return it->second.get();
+    }
+    // variants compile the sources of their program with a few more defines
+    if (!load(name)) {
+        return nullptr;
+    }
+    std::shared_ptr<Shader> shader = std::make_shared<Shader>(defines);
+    shaders_.insert(std::make_pair(key, shader));
+    return shader.get();
 }
 
-void ShaderLoader::setNumOfSpotLights(int count) const {
-    for (const auto &item: shaders_){
-        glUniform1i(item.second->getNumberOfSpotLightsLocation(), count);
+void ShaderLoader::restore() {
+    for (const auto &item: shaders_) {
+        item.second->restore();
     }
 }
@@ -16,9 +16,18 @@ private:
 
 public:
     ShaderLoader();
-    void setNumOfLights(int count) const;
-    void setNumOfSpotLights(int count) const;
     Shader *load(const char *name);
+
+    /*!
+     * @return variant of the program @a name compiled with @a defines, built on the first request
+     * and shared afterwards. nullptr if there is no such program.
+     */
+    Shader *load(const char *name, const std::string &defines);
+
+    /*!
+     * Rebuilds every program after the GL context was lost, Shader pointers stay valid
+     */
+    void restore();
 };
 
 
@@ -0,0 +1,6 @@
+#version 300 es
+precision mediump float;
+
+// depth only, there is no color attachment
+void main() {
+}
@@ -0,0 +1,62 @@
+#version 300 es
+// position only stream of the GeometryArena, matches kDepthPositionAttribute
+layout(location = 0) in vec3 inPosition;
+// read from the full vertices, match kDepthJointsAttribute, kDepthWeightsAttribute and
+// kDepthMorphAttribute
+layout(location = 1) in uvec4 inJoints;
+layout(location = 2) in vec4 inWeights;
+layout(location = 3) in uint inMorph;
+// the depth pre-pass and the shading pass must compute the same depth
+invariant gl_Position;
+
+// same block as vert.vert, uProjection holds the light or camera projection * model
+layout(std140, row_major) uniform DrawData {
+    mat4 uProjection;
+    mat4 uModelProjection;
+};
+
+// skinning joints of the draw as the top three rows of every joint matrix, matches SkinData in
+// Animator.h. Static meshes have all weights 0 and skip it.
+#define MAX_SKIN_JOINTS 128
+layout(std140) uniform SkinData {
+    vec4 uSkinJoints[MAX_SKIN_JOINTS * 3];
+};
+
+// sparse morph target deltas as pairs of texels: position and weight index, then the normal.
+// MorphData holds the weights of the draw, matches MorphData in MorphTargets.h.
+#define MAX_MORPH_WEIGHTS 256
+#define MORPH_TEXTURE_WIDTH 1024u
+uniform highp sampler2D uMorphTargets;
+layout(std140) uniform MorphData {
+    vec4 uMorphWeights[MAX_MORPH_WEIGHTS / 4];
+};
+
+void main() {
+    // morph targets move the vertex before the joints do, the position math is kept identical
+    // in both shaders
+    vec4 position = vec4(inPosition, 1.0);
+    uint morphCount = inMorph >> 24;
+    uint morphTexel = (inMorph & 0xffffffu) * 2u;
+    for (uint i = 0u; i < morphCount; ++i) {
+        uint texel = morphTexel + i * 2u;
+        vec4 delta = texelFetch(uMorphTargets, ivec2(texel & (MORPH_TEXTURE_WIDTH - 1u),
+                                                      texel / MORPH_TEXTURE_WIDTH), 0);
+        int weight = int(delta.w);
+        position.xyz += uMorphWeights[weight >> 2][weight & 3] * delta.xyz;
+    }
+    // weighted sum of the joint matrices, kept identical in vert.vert and depth.vert
+    vec4 skin0 = vec4(1.0, 0.0, 0.0, 0.0);
+    vec4 skin1 = vec4(0.0, 1.0, 0.0, 0.0);
+    vec4 skin2 = vec4(0.0, 0.0, 1.0, 0.0);
+    if (dot(inWeights, vec4(1.0)) > 0.0) {
+        ivec4 joints = ivec4(inJoints) * 3;
+        skin0 = inWeights.x * uSkinJoints[joints.x] + inWeights.y * uSkinJoints[joints.y]
+                + inWeights.z * uSkinJoints[joints.z] + inWeights.w * uSkinJoints[joints.w];
+        skin1 = inWeights.x * uSkinJoints[joints.x + 1] + inWeights.y * uSkinJoints[joints.y + 1]
+                + inWeights.z * uSkinJoints[joints.z + 1] + inWeights.w * uSkinJoints[joints.w + 1];
+        skin2 = inWeights.x * uSkinJoints[joints.x + 2] + inWeights.y * uSkinJoints[joints.y + 2]
+                + inWeights.z * uSkinJoints[joints.z + 2] + inWeights.w * uSkinJoints[joints.w + 2];
+    }
+    position = vec4(dot(skin0, position), dot(skin1, position), dot(skin2, position), 1.0);
+    gl_Position = uProjection * position;
+}
@@ -1,18 +1,25 @@
 #version 300 es
 precision mediump float;
-const int MAX_POINT_LIGHTS = 10;
-const int MAX_SPOT_LIGHTS = 10;
+// light indices are stored as bytes, matches kMaxClusteredLights
+#define MAX_CLUSTERED_LIGHTS 255
+// matches kMaxShadowCascades
+#define MAX_SHADOW_CASCADES 4
+// the overdraw view adds 1 / OVERDRAW_LAYERS per fragment, matches kOverdrawLayers
+#define OVERDRAW_LAYERS 32.0
 in vec2 fragUV;
 in vec3 normal0;
 in vec3 localPos0;
 in vec3 tangent0;
-in vec3 worldPos0;
+in highp vec3 worldPos0;
+flat in float fragLayer;
 
 struct Material {
     vec3 diffuseColor;
     vec3 ambientColor;
     vec3 specularColor;
     bool useTexture;
+    bool useTextureArray;
+    bool useOcclusionTexture;
 };
 
 struct Light {
@@ -25,47 +32,109 @@ struct Light {
 
 struct DirectionalLight {
     Light light;
+    // towards the light in model space, and in world space for the PBR path
     vec3 direction;
+    vec3 worldDirection;
 };
 
-struct Attenuation {
-    float constant;
-    float linear;
-    float exp;
-};
-struct PointLight {
-    Light light;
-    Attenuation atten;
-    vec3 localPos;
+// point and spot lights in world space, filled by LightClusters every frame
+layout(std140) uniform ClusterData {
+    highp vec4 uClusterCamera;
+    highp vec4 uClusterForward;
+    // tiles per pixel in x and y, slice = log(depth) * z + w
+    highp vec4 uClusterScale;
+    // tiles in x and y, slices, number of lights
+    highp vec4 uClusterSize;
+    highp vec4 uLightPositionRadius[MAX_CLUSTERED_LIGHTS];
+    // rgb color, ambient intensity in a
+    vec4 uLightColor[MAX_CLUSTERED_LIGHTS];
+    // spot direction and cosine of the cut off, w below -1 for point lights
+    vec4 uLightDirection[MAX_CLUSTERED_LIGHTS];
+    // constant, linear and quadratic attenuation, diffuse intensity in w
+    vec4 uLightAttenuation[MAX_CLUSTERED_LIGHTS];
 };
 
-struct SpotLight {
-    PointLight pointLight;
-    vec3 direction;
-    float cutOff;
+// cascades of the directional light's shadow map, filled by ShadowCascades every frame
+layout(std140, row_major) uniform ShadowData {
+    // world space to shadow map uv and depth
+    highp mat4 uShadowMatrices[MAX_SHADOW_CASCADES];
+    // view depth the cascade ends at, world size of one texel
+    highp vec4 uShadowCascades[MAX_SHADOW_CASCADES];
+    // cascade count (0 without shadows), size of a texel in uv, filter radius in texels
+    highp vec4 uShadowParams;
 };
 
-
 uniform sampler2D uTexture;
+uniform mediump sampler2DArray uTextureArray;
 uniform sampler2D uSpecTexture;
 uniform sampler2D uNormalTexture;
+// occlusion in r, roughness in g, metallic in b
+uniform sampler2D uORMTexture;
 uniform Material uMaterial;
 uniform DirectionalLight uLight;
-uniform int uNumOfLights;
-uniform PointLight uPointLights[MAX_POINT_LIGHTS];
-uniform int uNumOfSpotLights;
-uniform SpotLight uSpotLights[MAX_SPOT_LIGHTS];
 uniform vec3 uCameraLocalPos;
+// first light index and light count of every cluster, x is the tile, y the slice
+uniform highp usampler2D uClusterRanges;
+// light indices of all clusters, 1024 per row
+uniform highp usampler2D uLightIndices;
+// one layer per cascade, compared in hardware
+uniform highp sampler2DArrayShadow uShadowMap;
+// counts the fragments shaded per pixel instead of lighting them
+uniform bool uOverdraw;
+
+#ifdef PBR
+#define PI 3.14159265
+// smoother surfaces lose their highlight to mediump precision
+#define MIN_ROUGHNESS 0.089
+
+// glTF metallic-roughness factors, multiplied with the textures of the variant
+struct PbrMaterial {
+    vec4 baseColorFactor;
+    vec3 emissiveFactor;
+    float metallicFactor;
+    float roughnessFactor;
+    float normalScale;
+    float occlusionStrength;
+};
+
+struct PbrSurface {
+    vec3 normal;
+    vec3 diffuse;
+    vec3 f0;
+    float roughness;
+    // ambient light reflected per unit of ambient intensity, occlusion applied
+    vec3 ambient;
+};
+
+uniform PbrMaterial uPbr;
+uniform sampler2D uEmissiveTexture;
+// split-sum BRDF by n.v and roughness: scale of F0 in r, bias in g
+uniform sampler2D uBrdfLut;
+
+// image based light, filled by ImageBasedLight
+layout(std140) uniform EnvironmentData {
+    // irradiance harmonics for 1, y, z, x, xy, yz, 3zz - 1, xz, xx - yy
+    vec4 uIrradiance[9];
+    // intensity (0 without an environment), last mip, weight of the lights' ambient intensity
+    vec4 uEnvironmentParams;
+};
+// world space cubemap, roughness goes from 0 to 1 across the mips
+uniform mediump samplerCube uEnvironment;
+#endif
 
 out vec4 outColor;
 
-vec3 calculateBumpedNormal(){
+vec3 calculateBumpedNormal(float scale){
     vec3 normal = normalize(normal0);
     vec3 tangent = normalize(tangent0);
     tangent = normalize(tangent - dot(tangent, normal) * normal);
     vec3 biTangent = cross(tangent, normal);
-    vec3 bumpedNormal = texture(uNormalTexture, fragUV).xyz;
-    bumpedNormal = 2.0 * bumpedNormal - vec3(1.0, 1.0,1.0);
+    // normal maps only store x and y, z is rebuilt from the unit length
+    vec3 bumpedNormal;
+    bumpedNormal.xy = 2.0 * texture(uNormalTexture, fragUV).rg - vec2(1.0, 1.0);
+    bumpedNormal.z = sqrt(max(1.0 - dot(bumpedNormal.xy, bumpedNormal.xy), 0.0));
+    // glTF scales x and y of the unpacked normal
+    bumpedNormal.xy *= scale;
     vec3 newNormal;
     mat3 tbn = mat3(tangent, biTangent, normal);
     newNormal = tbn * bumpedNormal;
@@ -74,9 +143,14 @@ vec3 calculateBumpedNormal(){
 
 }
 
-vec4 calculateLightInternal(Light light, vec3 direction, vec3 normal) {
+// visibility only dims the diffuse and specular part, ambient light reaches into shadows
+vec4 calculateLightInternal(Light light, vec3 direction, vec3 normal, vec3 pixelToCamera,
+                            float visibility) {
 
     vec3 ambientColor = uMaterial.ambientColor * light.color * light.ambientIntensity;
+    if (uMaterial.useOcclusionTexture) {
+        ambientColor *= texture(uORMTexture, fragUV).r;
+    }
 
     vec4 diffuseColor = vec4(0.0, 0.0, 0.0, 1.0);
     vec4 specularColor = vec4(0.0, 0.0, 0.0, 1.0);
@@ -84,7 +158,6 @@ vec4 calculateLightInternal(Light light, vec3 direction, vec3 normal) {
 
     if (diffuseFactor > 0.0) {
         diffuseColor = vec4(light.color, 1.0) * light.diffuseIntensity * diffuseFactor * vec4(uMaterial.diffuseColor, 1.0);
-        vec3 pixelToCamera = normalize(uCameraLocalPos - localPos0);
         vec3 lightReflect = normalize(reflect(direction, normal));
         float specularFactor = dot(pixelToCamera, lightReflect);
         if (specularFactor > 0.0) {
@@ -94,60 +167,255 @@ vec4 calculateLightInternal(Light light, vec3 direction, vec3 normal) {
         }
     }
 
-    vec4 color = clamp((vec4(ambientColor, 1.0) + diffuseColor + specularColor), 0.0, 1.0);
+    vec4 color = clamp((vec4(ambientColor, 1.0) + (diffuseColor + specularColor) * visibility),
+                       0.0, 1.0);
     return color;
 }
 
+// fraction of the directional light reaching this fragment
+float calculateShadow() {
+    int cascadeCount = int(uShadowParams.x);
+    highp float depth = dot(worldPos0 - uClusterCamera.xyz, uClusterForward.xyz);
+    int cascade = 0;
+    while (cascade < cascadeCount && depth > uShadowCascades[cascade].x) {
+        cascade++;
+    }
+    if (cascade == cascadeCount) {
+        return 1.0;
+    }
+
+    // pushed out along the normal by about a texel, keeps lit surfaces from shadowing themselves
+    highp vec3 position = worldPos0 + normalize(normal0) * uShadowCascades[cascade].y * 1.5;
+    highp vec4 coord = uShadowMatrices[cascade] * vec4(position, 1.0);
+    int radius = int(uShadowParams.z);
+    float visibility = 0.0;
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            highp vec2 uv = coord.xy + vec2(float(x), float(y)) * uShadowParams.y;
+            visibility += texture(uShadowMap, vec4(uv, float(cascade), coord.z));
+        }
+    }
+    float taps = float((2 * radius + 1) * (2 * radius + 1));
+    return visibility / taps;
+}
+
 vec4 calculateDirectionalLight(vec3 normal) {
-    vec4 color = calculateLightInternal(uLight.light, uLight.direction, normal);
+    vec4 color = calculateLightInternal(uLight.light, uLight.direction, normal,
+                                        normalize(uCameraLocalPos - localPos0),
+                                        calculateShadow());
     return color;
 }
 
-vec4 calculatePointLight(PointLight pointLight, vec3 normal) {
-    vec3 direction = localPos0 - pointLight.localPos;
-    float distance = length(direction);
-    direction = normalize(direction);
-    vec4 color = calculateLightInternal(pointLight.light, direction, normal);
-    float attenuation = pointLight.atten.constant + pointLight.atten.linear * distance + pointLight.atten.exp * distance * distance;
+// spot cone and distance attenuation of clustered light @index, 0 outside of its reach.
+// @direction is set to the unit vector from the light to the fragment.
+float calculateFalloff(int index, out highp vec3 direction) {
+    highp vec4 positionRadius = uLightPositionRadius[index];
+    direction = worldPos0 - positionRadius.xyz;
+    highp float distance = length(direction);
+    if (distance > positionRadius.w || distance <= 0.0) {
+        return 0.0;
+    }
+    direction /= distance;
 
-    return color / attenuation;
+    float spotLightIntensity = 1.0;
+    vec4 spot = uLightDirection[index];
+    if (spot.w >= -1.0) {
+        float spotLightFactor = dot(direction, spot.xyz);
+        if (spotLightFactor <= spot.w) {
+            return 0.0;
+        }
+        spotLightIntensity = 1.0 - (1.0 - spotLightFactor) / (1.0 - spot.w);
+    }
+
+    vec4 attenuation = uLightAttenuation[index];
+    float falloff = attenuation.x + attenuation.y * distance + attenuation.z * distance * distance;
+    return spotLightIntensity / falloff;
 }
 
-vec4 calculateSpotLight(SpotLight spotLight, vec3 normal) {
-    vec3 lightToPixel = normalize(localPos0 - spotLight.pointLight.localPos);
-    float spotLightFactor = dot(lightToPixel, spotLight.direction);
-    if(spotLightFactor > spotLight.cutOff){
-        vec4 color = calculatePointLight(spotLight.pointLight, normal);
-        float spotLightIntensity = (1.0 - (1.0 - spotLightFactor)/ (1.0 - cos(spotLight.cutOff)));
-        return color * spotLightIntensity;
+vec4 calculateClusteredLight(int index, vec3 normal) {
+    highp vec3 direction;
+    float falloff = calculateFalloff(index, direction);
+    if (falloff <= 0.0) {
+        return vec4(0.0);
     }
-    return vec4(0.0, 0.0, 0.0, 0.0);
+    Light light = Light(uLightColor[index].rgb, uLightColor[index].a, 0.0,
+                        uLightAttenuation[index].w);
+    vec4 color = calculateLightInternal(light, direction, normal,
+                                        normalize(uClusterCamera.xyz - worldPos0), 1.0);
+    return color * falloff;
 }
 
-void main() {
+// first light index and light count of the cluster of this fragment
+uvec2 findClusterRange() {
+    highp float depth = dot(worldPos0 - uClusterCamera.xyz, uClusterForward.xyz);
+    int slice = int(clamp(log(max(depth, 1e-4)) * uClusterScale.z + uClusterScale.w,
+                          0.0, uClusterSize.z - 1.0));
+    ivec2 tile = ivec2(clamp(gl_FragCoord.xy * uClusterScale.xy, vec2(0.0),
+                             uClusterSize.xy - 1.0));
+    return texelFetch(uClusterRanges, ivec2(tile.x + tile.y * int(uClusterSize.x), slice), 0).rg;
+}
+
+int getClusterLight(uint item) {
+    return int(texelFetch(uLightIndices, ivec2(int(item & 1023u), int(item >> 10u)), 0).r);
+}
+
+// only the lights listed for the cluster of this fragment are evaluated
+vec4 calculateClusteredLights(vec3 normal) {
+    uvec2 range = findClusterRange();
+    vec4 color = vec4(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        color += calculateClusteredLight(getClusterLight(range.x + i), normal);
+    }
+    return color;
+}
+
+#ifdef PBR
+// Lambert plus a GGX lobe with the fast height correlated Smith term and Schlick's Fresnel.
+// Light intensities are tuned for Lambert without the 1 / PI, the lobe is scaled to match.
+vec3 shadePbr(PbrSurface surface, vec3 toLight, vec3 toCamera, vec3 radiance) {
+    float nDotL = dot(surface.normal, toLight);
+    if (nDotL <= 0.0) {
+        return vec3(0.0);
+    }
+    vec3 halfway = normalize(toLight + toCamera);
+    float nDotV = max(dot(surface.normal, toCamera), 1e-4);
+    float nDotH = max(dot(surface.normal, halfway), 0.0);
+    float lDotH = max(dot(toLight, halfway), 0.0);
+    float alpha = surface.roughness * surface.roughness;
+    // the peak of the distribution is far beyond mediump for smooth surfaces
+    highp float alpha2 = alpha * alpha;
+    highp float d = nDotH * nDotH * (alpha2 - 1.0) + 1.0;
+    highp float distribution = alpha2 / (d * d);
+    float visibility = 0.5 / mix(2.0 * nDotL * nDotV, nDotL + nDotV, alpha);
+    float fresnelWeight = pow(1.0 - lDotH, 5.0);
+    vec3 fresnel = surface.f0 + (1.0 - surface.f0) * fresnelWeight;
+    vec3 specular = fresnel * float(min(distribution * visibility, 16384.0));
+    return (surface.diffuse + specular) * radiance * nDotL;
+}
+
+vec3 calculateDirectionalLightPbr(PbrSurface surface, vec3 toCamera) {
+    Light light = uLight.light;
+    vec3 radiance = light.color * light.diffuseIntensity * calculateShadow();
+    return light.color * light.ambientIntensity * surface.ambient
+           + shadePbr(surface, normalize(uLight.worldDirection), toCamera, radiance);
+}
 
+vec3 calculateClusteredLightsPbr(PbrSurface surface, vec3 toCamera) {
+    uvec2 range = findClusterRange();
+    vec3 color = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int index = getClusterLight(range.x + i);
+        highp vec3 direction;
+        float falloff = calculateFalloff(index, direction);
+        if (falloff <= 0.0) {
+            continue;
+        }
+        vec4 lightColor = uLightColor[index];
+        vec3 radiance = lightColor.rgb * uLightAttenuation[index].w;
+        color += (lightColor.rgb * lightColor.a * surface.ambient
+                  + shadePbr(surface, -direction, toCamera, radiance)) * falloff;
+    }
+    return color;
+}
 
+// diffuse light from the irradiance harmonics plus the specular light of the prefiltered mip
+// matching the roughness, weighted like the ambient term
+vec3 calculateEnvironmentPbr(PbrSurface surface, vec3 toCamera, vec3 specularScale,
+                             float occlusion) {
+    vec3 n = surface.normal;
+    vec3 irradiance = uIrradiance[0].rgb
+                      + uIrradiance[1].rgb * n.y + uIrradiance[2].rgb * n.z
+                      + uIrradiance[3].rgb * n.x + uIrradiance[4].rgb * (n.x * n.y)
+                      + uIrradiance[5].rgb * (n.y * n.z)
+                      + uIrradiance[6].rgb * (3.0 * n.z * n.z - 1.0)
+                      + uIrradiance[7].rgb * (n.x * n.z)
+                      + uIrradiance[8].rgb * (n.x * n.x - n.y * n.y);
+    vec3 specular = textureLod(uEnvironment, reflect(-toCamera, n),
+                               surface.roughness * uEnvironmentParams.y).rgb;
+    return (surface.diffuse * max(irradiance, 0.0) + specular * specularScale)
+           * occlusion * uEnvironmentParams.x;
+}
+
+vec4 shadeMaterialPbr() {
+    vec4 baseColor = uPbr.baseColorFactor;
+#ifdef HAS_BASE_COLOR_TEXTURE
+#ifdef HAS_BASE_COLOR_ARRAY
+    vec4 baseColorTexel = texture(uTextureArray, vec3(fragUV, fragLayer));
+#else
+    vec4 baseColorTexel = texture(uTexture, fragUV);
+#endif
+    // the textures hold sRGB, squaring is close enough and far cheaper than the exact curve
+    baseColorTexel.rgb *= baseColorTexel.rgb;
+    baseColor *= baseColorTexel;
+#endif
+
+    float metallic = uPbr.metallicFactor;
+    float roughness = uPbr.roughnessFactor;
+    float occlusion = 1.0;
+#ifdef HAS_ORM_TEXTURE
+    vec3 orm = texture(uORMTexture, fragUV).rgb;
+    occlusion = 1.0 + uPbr.occlusionStrength * (orm.r - 1.0);
+    roughness *= orm.g;
+    metallic *= orm.b;
+#endif
+
+    PbrSurface surface;
+#ifdef HAS_NORMAL_TEXTURE
+    surface.normal = calculateBumpedNormal(uPbr.normalScale);
+#else
+    surface.normal = normalize(normal0);
+#endif
+    surface.diffuse = baseColor.rgb * (1.0 - metallic);
+    surface.f0 = mix(vec3(0.04), baseColor.rgb, metallic);
+    surface.roughness = clamp(roughness, MIN_ROUGHNESS, 1.0);
+    // the normal is in world space, so is everything it is lit with
+    vec3 toCamera = normalize(uClusterCamera.xyz - worldPos0);
+    vec2 environment = texture(uBrdfLut, vec2(max(dot(surface.normal, toCamera), 0.0),
+                                              surface.roughness)).rg;
+    vec3 specularScale = surface.f0 * environment.x + environment.y;
+    // the flat ambient of the lights only stands in while there is no environment
+    surface.ambient = (surface.diffuse + specularScale) * occlusion * uEnvironmentParams.z;
+
+    vec3 color = calculateDirectionalLightPbr(surface, toCamera)
+                 + calculateClusteredLightsPbr(surface, toCamera)
+                 + calculateEnvironmentPbr(surface, toCamera, specularScale, occlusion);
+    vec3 emissive = uPbr.emissiveFactor;
+#ifdef HAS_EMISSIVE_TEXTURE
+    vec3 emissiveTexel = texture(uEmissiveTexture, fragUV).rgb;
+    emissive *= emissiveTexel * emissiveTexel;
+#endif
+    color += emissive;
+    // back to the sRGB the framebuffer is shown as
+    return vec4(sqrt(clamp(color, 0.0, 1.0)), baseColor.a);
+}
+#endif
+
+void main() {
+    if (uOverdraw) {
+        // added up by the blending, red holds the count
+        outColor = vec4(1.0 / OVERDRAW_LAYERS, 0.5 / OVERDRAW_LAYERS, 0.0, 1.0);
+        return;
+    }
+
+#ifdef PBR
+    outColor = shadeMaterialPbr();
+#else
     vec4 finalColor = vec4(1.0, 1.0, 1.0, 1.0);
     vec4 diffuseColor = vec4(0.0, 0.0, 0.0, 1.0);
     vec4 specularColor = vec4(0.0, 0.0, 0.0, 1.0);
 
     if (uMaterial.useTexture) {
-        vec4 textureColor = texture(uTexture, fragUV);
+        vec4 textureColor = uMaterial.useTextureArray
+                ? texture(uTextureArray, vec3(fragUV, fragLayer))
+                : texture(uTexture, fragUV);
         finalColor = textureColor;
     }
-    vec3 normal = calculateBumpedNormal();
+    vec3 normal = calculateBumpedNormal(1.0);
     vec4 lighColor = calculateDirectionalLight(normal);
 
-    for(int i = 0 ; i < uNumOfLights; i++){
-        PointLight pointLight = uPointLights[i];
-        lighColor += calculatePointLight(pointLight, normal);
-    }
-
-    for(int i = 0 ; i < uNumOfSpotLights; i++){
-        SpotLight spotLight = uSpotLights[i];
-        lighColor += calculateSpotLight(spotLight, normal);
-    }
+    lighColor += calculateClusteredLights(normal);
 
     outColor = finalColor * lighColor;
+#endif
 
 }
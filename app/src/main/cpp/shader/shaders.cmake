@@ -8,6 +8,15 @@ file(READ "${CMAKE_SOURCE_DIR}/shader/frag.frag" FRAG_SHADER_SOURCE)
 string(REPLACE "\n" "\\n" FRAG_SHADER_SOURCE "${FRAG_SHADER_SOURCE}")
 string(REPLACE "\"" "\\\"" FRAG_SHADER_SOURCE "${FRAG_SHADER_SOURCE}")
 
+# Read the depth only shaders of the shadow and depth passes
+file(READ "${CMAKE_SOURCE_DIR}/shader/depth.vert" DEPTH_VERT_SHADER_SOURCE)
+string(REPLACE "\n" "\\n" DEPTH_VERT_SHADER_SOURCE "${DEPTH_VERT_SHADER_SOURCE}")
+string(REPLACE "\"" "\\\"" DEPTH_VERT_SHADER_SOURCE "${DEPTH_VERT_SHADER_SOURCE}")
+
+file(READ "${CMAKE_SOURCE_DIR}/shader/depth.frag" DEPTH_FRAG_SHADER_SOURCE)
+string(REPLACE "\n" "\\n" DEPTH_FRAG_SHADER_SOURCE "${DEPTH_FRAG_SHADER_SOURCE}")
+string(REPLACE "\"" "\\\"" DEPTH_FRAG_SHADER_SOURCE "${DEPTH_FRAG_SHADER_SOURCE}")
+
 # Configure the header file with embedded shaders
 configure_file(
         "${CMAKE_SOURCE_DIR}/shader/Shaders.h.in"
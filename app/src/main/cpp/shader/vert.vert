@@ -1,23 +1,88 @@
 #version 300 es
-in vec3 inPosition;
-in vec2 inUV;
-in vec3 inNormal;
-in vec3 inTangent;
+// fixed locations, the variants of the program share the vertex arrays of the geometry arena
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inUV;
+layout(location = 2) in vec3 inNormal;
+layout(location = 3) in vec3 inTangent;
+layout(location = 4) in float inLayer;
+layout(location = 5) in uvec4 inJoints;
+layout(location = 6) in vec4 inWeights;
+layout(location = 7) in uint inMorph;
 
 out vec2 fragUV;
 out vec3 normal0;
 out vec3 localPos0;
 out vec3 tangent0;
 out vec3 worldPos0;
+flat out float fragLayer;
+// the depth pre-pass and the shading pass must compute the same depth
+invariant gl_Position;
 
-uniform mat4 uProjection;
-uniform mat4 uModelProjection;
+// filled per draw from the StreamingBuffer, row major like Mat4f
+layout(std140, row_major) uniform DrawData {
+    mat4 uProjection;
+    mat4 uModelProjection;
+};
+
+// skinning joints of the draw as the top three rows of every joint matrix, matches SkinData in
+// Animator.h. Static meshes have all weights 0 and skip it.
+#define MAX_SKIN_JOINTS 128
+layout(std140) uniform SkinData {
+    vec4 uSkinJoints[MAX_SKIN_JOINTS * 3];
+};
+
+// sparse morph target deltas as pairs of texels: position and weight index, then the normal.
+// MorphData holds the weights of the draw, matches MorphData in MorphTargets.h.
+#define MAX_MORPH_WEIGHTS 256
+#define MORPH_TEXTURE_WIDTH 1024u
+uniform highp sampler2D uMorphTargets;
+layout(std140) uniform MorphData {
+    vec4 uMorphWeights[MAX_MORPH_WEIGHTS / 4];
+};
 
 void main() {
     fragUV = inUV;
-    gl_Position = uProjection * vec4(inPosition, 1.0);
-    localPos0 = inPosition;
-    normal0 = (uModelProjection * vec4(inNormal, 0.0)).xyz;
-    tangent0 = (uModelProjection * vec4(inTangent, 0.0)).xyz;
-    worldPos0 = (uModelProjection * vec4(inPosition, 1.0)).xyz;
+    fragLayer = inLayer;
+    // morph targets move the vertex before the joints do, the position math is kept identical
+    // in both shaders
+    vec4 position = vec4(inPosition, 1.0);
+    vec3 morphNormal = inNormal;
+    uint morphCount = inMorph >> 24;
+    uint morphTexel = (inMorph & 0xffffffu) * 2u;
+    for (uint i = 0u; i < morphCount; ++i) {
+        uint texel = morphTexel + i * 2u;
+        vec4 delta = texelFetch(uMorphTargets, ivec2(texel & (MORPH_TEXTURE_WIDTH - 1u),
+                                                      texel / MORPH_TEXTURE_WIDTH), 0);
+        int weight = int(delta.w);
+        position.xyz += uMorphWeights[weight >> 2][weight & 3] * delta.xyz;
+        texel++;
+        vec3 normalDelta = texelFetch(uMorphTargets, ivec2(texel & (MORPH_TEXTURE_WIDTH - 1u),
+                                                           texel / MORPH_TEXTURE_WIDTH), 0).xyz;
+        morphNormal += uMorphWeights[weight >> 2][weight & 3] * normalDelta;
+    }
+    // weighted sum of the joint matrices, kept identical in vert.vert and depth.vert
+    vec4 skin0 = vec4(1.0, 0.0, 0.0, 0.0);
+    vec4 skin1 = vec4(0.0, 1.0, 0.0, 0.0);
+    vec4 skin2 = vec4(0.0, 0.0, 1.0, 0.0);
+    if (dot(inWeights, vec4(1.0)) > 0.0) {
+        ivec4 joints = ivec4(inJoints) * 3;
+        skin0 = inWeights.x * uSkinJoints[joints.x] + inWeights.y * uSkinJoints[joints.y]
+                + inWeights.z * uSkinJoints[joints.z] + inWeights.w * uSkinJoints[joints.w];
+        skin1 = inWeights.x * uSkinJoints[joints.x + 1] + inWeights.y * uSkinJoints[joints.y + 1]
+                + inWeights.z * uSkinJoints[joints.z + 1] + inWeights.w * uSkinJoints[joints.w + 1];
+        skin2 = inWeights.x * uSkinJoints[joints.x + 2] + inWeights.y * uSkinJoints[joints.y + 2]
+                + inWeights.z * uSkinJoints[joints.z + 2] + inWeights.w * uSkinJoints[joints.w + 2];
+    }
+    position = vec4(dot(skin0, position), dot(skin1, position), dot(skin2, position), 1.0);
+    // joint matrices carry no shear, their upper 3x3 transforms normals well enough
+    vec4 skinNormal = vec4(morphNormal, 0.0);
+    skinNormal = vec4(dot(skin0, skinNormal), dot(skin1, skinNormal), dot(skin2, skinNormal), 0.0);
+    vec4 skinTangent = vec4(inTangent, 0.0);
+    skinTangent = vec4(dot(skin0, skinTangent), dot(skin1, skinTangent), dot(skin2, skinTangent),
+                       0.0);
+    gl_Position = uProjection * position;
+    localPos0 = position.xyz;
+    normal0 = (uModelProjection * skinNormal).xyz;
+    tangent0 = (uModelProjection * skinTangent).xyz;
+    worldPos0 = (uModelProjection * position).xyz;
 }
\ No newline at end of file
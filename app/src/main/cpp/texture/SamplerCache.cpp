@@ -0,0 +1,66 @@
+//
+// Created by Dark Matter on 6/12/24.
+//
+
+#include "SamplerCache.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include <GLES2/gl2ext.h>
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+bool SamplerState::operator<(const SamplerState &other) const {
+    return std::tie(wrapS, wrapT, minFilter, magFilter, anisotropic)
+           < std::tie(other.wrapS, other.wrapT, other.minFilter, other.magFilter,
+                      other.anisotropic);
+}
+
+SamplerCache::SamplerCache() : maxAnisotropy_(1.0f) {
+    auto extensions = (const char *) glGetString(GL_EXTENSIONS);
+    if (extensions && strstr(extensions, "GL_EXT_texture_filter_anisotropic")) {
+        GLfloat maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        maxAnisotropy_ = std::min(maxAnisotropy, kMaxSamplerAnisotropy);
+    }
+    aout << "Sampler anisotropy " << maxAnisotropy_ << std::endl;
+}
+
+SamplerCache::~SamplerCache() {
+    samplers_.clear();
+}
+
+const GpuResource *SamplerCache::get(const SamplerState &state) {
+    auto it = samplers_.find(state);
+    if (it != samplers_.end()) {
+        return &it->second;
+    }
+
+    auto inserted = samplers_.emplace(state, createSampler(state));
+    return &inserted.first->second;
+}
+
+void SamplerCache::restore() {
+    // the map nodes stay where they are, so materials holding on to them see the new samplers
+    for (auto &sampler: samplers_) {
+        sampler.second = createSampler(sampler.first);
+    }
+}
+
+GpuResource SamplerCache::createSampler(const SamplerState &state) const {
+    GLuint sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, (GLint) state.wrapS);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, (GLint) state.wrapT);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, (GLint) state.minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, (GLint) state.magFilter);
+
+    // anisotropy only changes anything once mip levels are sampled
+    bool mipmapped = state.minFilter != GL_NEAREST && state.minFilter != GL_LINEAR;
+    if (state.anisotropic && mipmapped && supportsAnisotropy()) {
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy_);
+    }
+    CHECK_GL_ERROR();
+
+    return {GpuResourceType::SAMPLER, sampler, 0};
+}
@@ -0,0 +1,66 @@
+//
+// Created by Dark Matter on 6/12/24.
+//
+
+#ifndef LEARNOPENGL_SAMPLERCACHE_H
+#define LEARNOPENGL_SAMPLERCACHE_H
+
+#include <GLES3/gl3.h>
+#include <map>
+#include "gpu/GpuResourceRegistry.h"
+
+/*!
+ * Anisotropy used for mipmapped samplers, clamped to what the driver supports.
+ */
+static constexpr float kMaxSamplerAnisotropy = 8.0f;
+
+/*!
+ * Wrap and filter state of a texture lookup, as described by the model's material. Defaults match
+ * the glTF defaults: repeat, trilinear and anisotropic when available.
+ */
+struct SamplerState {
+    GLenum wrapS = GL_REPEAT;
+    GLenum wrapT = GL_REPEAT;
+    GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+    bool anisotropic = true;
+
+    bool operator<(const SamplerState &other) const;
+};
+
+/*!
+ * Creates one GL sampler object per distinct SamplerState and keeps it for the lifetime of the
+ * cache. Sampling state lives in the samplers instead of the textures, so a texture can be used by
+ * materials that sample it differently without being uploaded twice.
+ */
+class SamplerCache {
+public:
+    /*!
+     * Must be created with a current GL context, it checks for EXT_texture_filter_anisotropic
+     */
+    SamplerCache();
+
+    ~SamplerCache();
+
+    /*!
+     * @return the sampler for @a state, created on first use. The pointer stays valid for the
+     * lifetime of the cache, also across restore()
+     */
+    const GpuResource *get(const SamplerState &state);
+
+    /*!
+     * Recreates every sampler after the GL context was lost
+     */
+    void restore();
+
+    constexpr bool supportsAnisotropy() const { return maxAnisotropy_ > 1.0f; }
+
+private:
+    std::map<SamplerState, GpuResource> samplers_;
+    float maxAnisotropy_;
+
+    GpuResource createSampler(const SamplerState &state) const;
+};
+
+
+#endif //LEARNOPENGL_SAMPLERCACHE_H
@@ -0,0 +1,152 @@
+//
+// Created by Dark Matter on 6/10/24.
+//
+
+#include "TextureArrayPacker.h"
+#include "AndroidOut.h"
+#include "Utility.h"
+#include "gpu/UploadThread.h"
+#include "core/JobSystem.h"
+#include <algorithm>
+#include <cmath>
+
+TextureArrayPacker::TextureArrayPacker(AAssetManager *assetManager) : assetManager_(assetManager) {
+
+}
+
+void TextureArrayPacker::addCandidate(const TextureSource &source) {
+    if (queued_.find(source.name) != queued_.end()) {
+        return;
+    }
+    queued_[source.name] = true;
+
+    int32_t width = 0;
+    int32_t height = 0;
+    if (!TextureAsset::readSize(assetManager_, source, width, height)) {
+        return;
+    }
+    if (width > kMaxPackedTextureSize || height > kMaxPackedTextureSize) {
+        return;
+    }
+
+    for (auto &bucket: buckets_) {
+        if (bucket.width == width && bucket.height == height) {
+            bucket.sources.push_back(source);
+            return;
+        }
+    }
+    buckets_.push_back({width, height, {source}});
+}
+
+std::unordered_map<std::string, std::shared_ptr<TextureAsset>> TextureArrayPacker::pack() {
+    std::unordered_map<std::string, std::shared_ptr<TextureAsset>> packed;
+
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if (maxLayers <= 1) {
+        return packed;
+    }
+
+    for (const auto &bucket: buckets_) {
+        if (bucket.sources.size() < kMinTexturesPerArray) {
+            continue;
+        }
+        for (size_t first = 0; first < bucket.sources.size(); first += maxLayers) {
+            size_t count = std::min(bucket.sources.size() - first, (size_t) maxLayers);
+            if (count < kMinTexturesPerArray) {
+                break;
+            }
+            createArray(bucket, first, count, packed);
+        }
+    }
+
+    aout << "Packed " << packed.size() << " textures into arrays" << std::endl;
+    buckets_.clear();
+    queued_.clear();
+    return packed;
+}
+
+std::shared_ptr<TextureAsset>
+TextureArrayPacker::createArray(const Bucket &bucket, size_t first, size_t count,
+                                std::unordered_map<std::string, std::shared_ptr<TextureAsset>> &packed) const {
+    std::vector<TextureSource> sources;
+    for (size_t i = 0; i < count; ++i) {
+        sources.push_back(bucket.sources[first + i].retain());
+    }
+
+    std::vector<std::pair<std::string, GLint>> layers;
+    auto textureArray = uploadArray(assetManager_, bucket.width, bucket.height, sources, layers);
+    for (const auto &layer: layers) {
+        packed[layer.first] = TextureAsset::createLayer(textureArray, layer.second);
+    }
+
+    // decoding is deterministic, so a rebuilt array ends up with the same layers
+    textureArray->setRestore([assetManager = assetManager_, width = bucket.width,
+                                     height = bucket.height, sources = std::move(sources)]() {
+        std::vector<std::pair<std::string, GLint>> restoredLayers;
+        return uploadArray(assetManager, width, height, sources, restoredLayers);
+    });
+    return textureArray;
+}
+
+std::shared_ptr<TextureAsset>
+TextureArrayPacker::uploadArray(AAssetManager *assetManager, int32_t width, int32_t height,
+                                const std::vector<TextureSource> &sources,
+                                std::vector<std::pair<std::string, GLint>> &layers) {
+    auto levels = (GLsizei) std::floor(std::log2((float) std::max(width, height))) + 1;
+    auto layerCount = (GLsizei) sources.size();
+
+    // the name is shared with the upload context, storage and layers are filled there
+    GLuint textureId;
+    glGenTextures(1, &textureId);
+    auto textureArray = TextureAsset::wrap(
+            textureId, GL_TEXTURE_2D_ARRAY,
+            TextureAsset::storageSize(width, height, 4, (int32_t) layerCount));
+    auto onReady = textureArray->beginUpload();
+
+    UploadThread::submit([textureId, levels, width, height, layerCount]() {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, layerCount);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    });
+
+    // Layers are decoded in batches of one per thread and handed over in order, the upload thread
+    // frees each image after copying it, so only a batch is ever held in memory
+    JobSystem *jobSystem = JobSystem::get();
+    size_t batchSize = jobSystem ? (size_t) jobSystem->getWorkerCount() + 1 : 1;
+    for (size_t first = 0; first < sources.size(); first += batchSize) {
+        size_t count = std::min(batchSize, sources.size() - first);
+        std::vector<TextureImage> images(count);
+        std::vector<char> decoded(count, 0);
+        JobSystem::parallelFor(count, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                decoded[i] = TextureAsset::decode(assetManager, sources[first + i], images[i]);
+            }
+        }, JobAffinity::BIG);
+
+        for (size_t i = 0; i < count; ++i) {
+            if (!decoded[i]) {
+                continue;
+            }
+            auto layer = (GLint) layers.size();
+            layers.emplace_back(sources[first + i].name, layer);
+            UploadThread::submit([textureId, layer, image = std::move(images[i])]() {
+                glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, image.width, image.height, 1,
+                                GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+                glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            });
+        }
+    }
+
+    UploadThread::submit([textureId]() {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        CHECK_GL_ERROR();
+    }, std::move(onReady));
+
+    aout << "Texture array " << textureId << " " << width << "x" << height
+         << " with " << layers.size() << " layers" << std::endl;
+    return textureArray;
+}
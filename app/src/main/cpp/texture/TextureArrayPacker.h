@@ -0,0 +1,72 @@
+//
+// Created by Dark Matter on 6/10/24.
+//
+
+#ifndef LEARNOPENGL_TEXTUREARRAYPACKER_H
+#define LEARNOPENGL_TEXTUREARRAYPACKER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TextureAsset.h"
+
+/*!
+ * Textures up to this size (in both dimensions) are considered for packing.
+ */
+static constexpr int32_t kMaxPackedTextureSize = 1024;
+
+/*!
+ * A size bucket needs at least this many textures before an array is worth creating.
+ */
+static constexpr int kMinTexturesPerArray = 2;
+
+/*!
+ * Packs small material textures of the same size into GL_TEXTURE_2D_ARRAY layers at import time,
+ * so meshes using different textures can be drawn with a single texture bind. The layer a texture
+ * lands in is reported back through the returned TextureAsset, the importer writes it into the
+ * vertex data.
+ */
+class TextureArrayPacker {
+public:
+    explicit TextureArrayPacker(AAssetManager *assetManager);
+
+    /*!
+     * Queues a texture for packing. Textures that are too big or can't be read are ignored.
+     */
+    void addCandidate(const TextureSource &source);
+
+    /*!
+     * Decodes and uploads all queued textures that share their size with at least
+     * @a kMinTexturesPerArray others.
+     * @return layer views for every packed texture, keyed by source name
+     */
+    std::unordered_map<std::string, std::shared_ptr<TextureAsset>> pack();
+
+private:
+    struct Bucket {
+        int32_t width;
+        int32_t height;
+        std::vector<TextureSource> sources;
+    };
+
+    AAssetManager *assetManager_;
+    std::vector<Bucket> buckets_;
+    std::unordered_map<std::string, bool> queued_;
+
+    std::shared_ptr<TextureAsset> createArray(const Bucket &bucket, size_t first, size_t count,
+                                              std::unordered_map<std::string, std::shared_ptr<TextureAsset>> &packed) const;
+
+    /*!
+     * Creates the array texture and decodes @a sources into its layers, sources that fail to
+     * decode are skipped
+     * @param layers receives the layer of every uploaded source
+     */
+    static std::shared_ptr<TextureAsset>
+    uploadArray(AAssetManager *assetManager, int32_t width, int32_t height,
+                const std::vector<TextureSource> &sources,
+                std::vector<std::pair<std::string, GLint>> &layers);
+};
+
+
+#endif //LEARNOPENGL_TEXTUREARRAYPACKER_H
@@ -10,78 +10,83 @@ void Transform::setScale(float scaleX, float scaleY, float scaleZ) {
     this->scale_.x = scaleX;
     this->scale_.y = scaleY;
     this->scale_.z = scaleZ;
+    markDirty();
 }
 
 void Transform::setPosition(float x, float y, float z) {
-    this->position.x = x;
-    this->position.y = y;
-    this->position.z = z;
+    this->position_.x = x;
+    this->position_.y = y;
+    this->position_.z = z;
+    markDirty();
 }
 
+void Transform::setPosition(const glm::vec3 &position) {
+    this->position_ = position;
+    markDirty();
+}
+
+void Transform::translate(const glm::vec3 &offset) {
+    this->position_ += offset;
+    markDirty();
+}
 
 void Transform::setRotation(float x, float y, float z) {
-    this->rotation_.x = x;
-    this->rotation_.y = y;
-    this->rotation_.z = z;
+    this->rotation_ = Quaternion::fromEuler(x, y, z);
+    markDirty();
 }
 
-void Transform::rotate(float x, float y, float z) {
-    this->rotation_.x += x;
-    this->rotation_.y += y;
-    this->rotation_.z += z;
+void Transform::setRotation(const Quaternion &rotation) {
+    this->rotation_ = rotation;
+    this->rotation_.Normalize();
+    markDirty();
 }
 
-Mat4f Transform::getReversedTranslation() const {
-    Mat4f reversedTranslation;
-    reversedTranslation.initTranslation(-position.x, -position.y, -position.z);
-    return reversedTranslation;
+void Transform::rotate(float x, float y, float z) {
+    this->rotation_ = this->rotation_ * Quaternion::fromEuler(x, y, z);
+    // keeps rounding errors from piling up over many small rotations
+    this->rotation_.Normalize();
+    markDirty();
 }
 
 glm::vec3 Transform::worldToLocal(glm::vec3 worldPosition) const{
-    Mat4f cameraToLocalTranslation = getReversedTranslation();
-    Mat4f cameraToLocalRotation = getReversedRotation();
-    Mat4f cameraToLocalTransformation = cameraToLocalRotation * cameraToLocalTranslation;
-    glm::vec4 cameraWorldPos = glm::vec4 (worldPosition, 1.0);
-    glm::vec4 cameraLocalPos = cameraToLocalTransformation * cameraWorldPos;
-    return cameraWorldPos;
+    glm::vec4 localPosition = inverseMatrix() * glm::vec4(worldPosition, 1.0);
+    return localPosition;
 }
 
-Mat4f Transform::getReversedRotation() const{
-    Mat4f reversedTranslation;
-    reversedTranslation.initRotationMatrix(-rotation_.x, -rotation_.y, -rotation_.z);
-    return reversedTranslation;
+const Mat4f &Transform::matrix() const {
+    if (matrixDirty_) {
+        matrix_.initTransform(position_, rotation_, scale_);
+        matrixDirty_ = false;
+    }
+    return matrix_;
 }
 
-Mat4f Transform::matrix() const {
-    Mat4f rotMat;
-
-    rotMat.initRotationMatrix(rotation_.x, rotation_.y, rotation_.z);
-
-    Mat4f transMat;
-    transMat.initTranslation(position.x, position.y, position.z);
-
-    Mat4f scaleMat;
-    scaleMat.initScaleMatrix(scale_.x, scale_.y, scale_.z);
+const Mat4f &Transform::inverseMatrix() const {
+    if (inverseDirty_) {
+        inverseMatrix_ = matrix().inverseAffine();
+        inverseDirty_ = false;
+    }
+    return inverseMatrix_;
+}
 
-    return transMat * rotMat * scaleMat;
+void Transform::markDirty() {
+    matrixDirty_ = true;
+    inverseDirty_ = true;
 }
 
 Transform::Transform() :
-        position(0, 0, 0),
-        rotation_(0, 0, 0, 0),
+        position_(0, 0, 0),
+        rotation_(0, 0, 0, 1),
         scale_(1, 1, 1) {
 }
 
-glm::vec3 Transform::getPosition() {
-    return position;
-}
-
 void Transform::setYPosition(float y) {
-    this->position.y = y;
+    this->position_.y = y;
+    markDirty();
 }
 
-float Transform::getPositionY() {
-    return position.y;
+float Transform::getPositionY() const {
+    return position_.y;
 }
 
 glm::vec3 Transform::worldDirectionToLocal(glm::vec3 direction) const {
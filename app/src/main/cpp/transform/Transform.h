@@ -10,29 +10,64 @@
 #include "../math/mat4f.h"
 #include "../math/quaternion.h"
 
+/*!
+ * Position, rotation and scale of a component. The matrix and its inverse are cached and only
+ * rebuilt after one of them changed, so asking for them many times per frame is cheap.
+ */
 class Transform {
 public :
-    glm::vec3 position;
-
     Transform();
     void setScale(float scaleX, float scaleY, float scaleZ);
     void setPosition(float x, float y, float z);
+    void setPosition(const glm::vec3 &position);
+    void translate(const glm::vec3 &offset);
     void setYPosition( float y);
-    float getPositionY();
+    float getPositionY() const;
+
+    /*!
+     * Sets the rotation from euler angles in degrees, applied like Mat4f::initRotationMatrix
+     */
     void setRotation(float x, float y, float z);
+
+    void setRotation(const Quaternion &rotation);
+
+    /*!
+     * Rotates by euler angles in degrees on top of the current rotation, around the local axes
+     */
     void rotate(float x, float y, float z);
-    Mat4f matrix() const;
-    glm::vec3 getPosition();
-    Mat4f getReversedRotation() const;
-    Mat4f getReversedTranslation() const;
+
+    const Quaternion &getRotation() const { return rotation_; }
+
+    const glm::vec3 &getScale() const { return scale_; }
+
+    const glm::vec3 &getPosition() const { return position_; }
+
+    /*!
+     * @return translation * rotation * scale, rebuilt only after a change
+     */
+    const Mat4f &matrix() const;
+
+    /*!
+     * @return the inverse of matrix(), rebuilt only after a change
+     */
+    const Mat4f &inverseMatrix() const;
+
     glm::vec3 worldToLocal(glm::vec3 worldPosition) const;
 
     glm::vec3 worldDirectionToLocal(glm::vec3 direction) const;
 
 protected:
+    glm::vec3 position_;
+    // unit quaternion
     Quaternion rotation_;
     glm::vec3 scale_;
 
+    mutable Mat4f matrix_;
+    mutable Mat4f inverseMatrix_;
+    mutable bool matrixDirty_ = true;
+    mutable bool inverseDirty_ = true;
+
+    void markDirty();
 };
 
 
@@ -0,0 +1,153 @@
+//
+// Created by Dark Matter on 6/21/24.
+//
+
+#include "TransformHierarchy.h"
+#include "core/JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+
+/*!
+ * How far a rest delta may be off identity while the node still counts as at rest
+ */
+static constexpr float kRestEpsilon = 1e-5f;
+
+/*!
+ * Hierarchies smaller than this update on the calling thread, and subtrees smaller than this are
+ * not split any further
+ */
+static constexpr int kParallelUpdateNodes = 512;
+
+int TransformHierarchy::addNode(const std::string &name, int parent, const Mat4f &localMatrix) {
+    auto node = (int) parents_.size();
+    // depth first order keeps every subtree contiguous
+    assert(parent == kNoParent || (parent < node && subtreeEnds_[parent] == node));
+
+    names_.push_back(name);
+    parents_.push_back(parent);
+    subtreeEnds_.push_back(node + 1);
+    localMatrices_.push_back(localMatrix);
+    worldMatrices_.push_back(parent == kNoParent ? localMatrix
+                                                 : worldMatrices_[parent] * localMatrix);
+    restInverses_.emplace_back();
+    restDeltas_.emplace_back();
+    dirty_.push_back(0);
+    atRest_.push_back(1);
+
+    for (int ancestor = parent; ancestor != kNoParent; ancestor = parents_[ancestor]) {
+        subtreeEnds_[ancestor] = node + 1;
+    }
+    return node;
+}
+
+void TransformHierarchy::setLocalMatrix(int node, const Mat4f &localMatrix) {
+    localMatrices_[node] = localMatrix;
+    if (!dirty_[node]) {
+        dirty_[node] = 1;
+        dirtyCount_++;
+    }
+}
+
+int TransformHierarchy::find(const std::string &name) const {
+    for (size_t i = 0; i < names_.size(); ++i) {
+        if (names_[i] == name) {
+            return (int) i;
+        }
+    }
+    return kNoParent;
+}
+
+bool TransformHierarchy::update() {
+    if (dirtyCount_ == 0) {
+        return false;
+    }
+    auto count = (int) parents_.size();
+    JobSystem *jobSystem = JobSystem::get();
+    if (!jobSystem || count < kParallelUpdateNodes) {
+        restVersion_ += updateRange(0, count);
+    } else {
+        // Subtrees don't depend on each other once their root is done. Big ones get their root
+        // updated here and are replaced by the subtrees of its children, until every subtree is
+        // small enough to balance across the workers.
+        int target = std::max(kParallelUpdateNodes, count / (jobSystem->getWorkerCount() * 4));
+        std::vector<std::pair<int, int>> subtrees;
+        for (int root = 0; root < count; root = subtreeEnds_[root]) {
+            subtrees.emplace_back(root, subtreeEnds_[root]);
+        }
+        for (size_t i = 0; i < subtrees.size();) {
+            auto [first, end] = subtrees[i];
+            if (end - first <= target) {
+                ++i;
+                continue;
+            }
+            restVersion_ += updateRange(first, first + 1);
+            subtrees[i] = subtrees.back();
+            subtrees.pop_back();
+            for (int child = first + 1; child < end; child = subtreeEnds_[child]) {
+                subtrees.emplace_back(child, subtreeEnds_[child]);
+            }
+        }
+
+        std::atomic<uint32_t> restChanges{0};
+        JobSystem::parallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                restChanges += updateRange(subtrees[i].first, subtrees[i].second);
+            }
+        });
+        restVersion_ += restChanges.load();
+    }
+    std::fill(dirty_.begin(), dirty_.end(), 0);
+    dirtyCount_ = 0;
+    return true;
+}
+
+uint32_t TransformHierarchy::updateRange(int first, int end) {
+    // parents come first, their world matrix is final when the children are reached
+    uint32_t restChanges = 0;
+    for (int node = first; node < end; ++node) {
+        int parent = parents_[node];
+        if (parent != kNoParent && dirty_[parent]) {
+            dirty_[node] = 1;
+        }
+        if (!dirty_[node]) {
+            continue;
+        }
+        worldMatrices_[node] = parent == kNoParent ? localMatrices_[node]
+                                                   : worldMatrices_[parent] * localMatrices_[node];
+        if (updateRestState(node)) {
+            restChanges++;
+        }
+    }
+    return restChanges;
+}
+
+void TransformHierarchy::captureRestPose() {
+    update();
+    for (size_t node = 0; node < parents_.size(); ++node) {
+        restInverses_[node] = worldMatrices_[node].inverseAffine();
+        restDeltas_[node] = Mat4f();
+        atRest_[node] = 1;
+    }
+    restVersion_++;
+}
+
+bool TransformHierarchy::updateRestState(int node) {
+    restDeltas_[node] = worldMatrices_[node] * restInverses_[node];
+    bool atRest = true;
+    for (int i = 0; i < 4 && atRest; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            float identity = i == j ? 1.0f : 0.0f;
+            if (fabsf(restDeltas_[node].m[i][j] - identity) > kRestEpsilon) {
+                atRest = false;
+                break;
+            }
+        }
+    }
+    if (atRest == (bool) atRest_[node]) {
+        return false;
+    }
+    atRest_[node] = atRest;
+    return true;
+}
@@ -0,0 +1,117 @@
+//
+// Created by Dark Matter on 6/21/24.
+//
+
+#ifndef LEARNOPENGL_TRANSFORMHIERARCHY_H
+#define LEARNOPENGL_TRANSFORMHIERARCHY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../math/mat4f.h"
+
+/*!
+ * Parent/child transforms of an imported model, e.g. the glTF node graph. Nodes live in flat arrays
+ * in depth first order: a parent always comes before its children and every subtree is a
+ * contiguous range, so world matrices are updated in one linear pass and subtrees can be updated
+ * independently of each other.
+ *
+ * Only nodes whose local matrix changed, and their descendants, are recomputed. A hierarchy
+ * without changes costs nothing per frame.
+ *
+ * The importer bakes the world matrix of every node into its vertices and records it as the rest
+ * pose. Nodes at rest need no matrix of their own when drawn, moved nodes are drawn with
+ * getRestDelta().
+ */
+class TransformHierarchy {
+public:
+    static constexpr int kNoParent = -1;
+
+    /*!
+     * Appends a node. Nodes have to be added depth first, @a parent must be the last added node or
+     * one of its ancestors.
+     * @return index of the new node
+     */
+    int addNode(const std::string &name, int parent, const Mat4f &localMatrix);
+
+    void setLocalMatrix(int node, const Mat4f &localMatrix);
+
+    const Mat4f &getLocalMatrix(int node) const { return localMatrices_[node]; }
+
+    /*!
+     * @return the matrix from the node to the root of the hierarchy, valid after update()
+     */
+    const Mat4f &getWorldMatrix(int node) const { return worldMatrices_[node]; }
+
+    int getParent(int node) const { return parents_[node]; }
+
+    const std::string &getName(int node) const { return names_[node]; }
+
+    /*!
+     * @return index one past the last descendant of @a node
+     */
+    int getSubtreeEnd(int node) const { return subtreeEnds_[node]; }
+
+    /*!
+     * @return the first node called @a name, or kNoParent
+     */
+    int find(const std::string &name) const;
+
+    size_t size() const { return parents_.size(); }
+
+    /*!
+     * Recomputes the world matrices of changed nodes and their descendants. Big hierarchies are
+     * split into independent subtrees that update on the job system.
+     * @return true if any world matrix changed
+     */
+    bool update();
+
+    /*!
+     * Remembers the current world matrices as the pose the vertices were baked with
+     */
+    void captureRestPose();
+
+    /*!
+     * @return true while the node's world matrix equals its rest pose, nodes below 0 are always
+     * at rest
+     */
+    bool isAtRest(int node) const { return node < 0 || atRest_[node]; }
+
+    /*!
+     * @return world matrix * inverse rest world matrix, moves vertices baked in the rest pose to
+     * where the node is now
+     */
+    const Mat4f &getRestDelta(int node) const { return restDeltas_[node]; }
+
+    /*!
+     * @return counter bumped whenever a node leaves or returns to its rest pose
+     */
+    uint32_t getRestVersion() const { return restVersion_; }
+
+private:
+    std::vector<std::string> names_;
+    std::vector<int> parents_;
+    std::vector<int> subtreeEnds_;
+    std::vector<Mat4f> localMatrices_;
+    std::vector<Mat4f> worldMatrices_;
+    std::vector<Mat4f> restInverses_;
+    std::vector<Mat4f> restDeltas_;
+    std::vector<uint8_t> dirty_;
+    std::vector<uint8_t> atRest_;
+    size_t dirtyCount_ = 0;
+    uint32_t restVersion_ = 0;
+
+    /*!
+     * Updates the nodes in [first, end), their parents outside the range have to be up to date
+     * @return number of nodes that left or returned to their rest pose
+     */
+    uint32_t updateRange(int first, int end);
+
+    /*!
+     * @return true if the node left or returned to its rest pose
+     */
+    bool updateRestState(int node);
+};
+
+
+#endif //LEARNOPENGL_TRANSFORMHIERARCHY_H
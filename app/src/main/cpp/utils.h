@@ -13,8 +13,33 @@
 #define COLOR_TEXTURE_UNIT_INDEX  0
 #define NORMAL_UNIT  GL_TEXTURE1
 #define NORMAL_UNIT_INDEX  1
+#define COLOR_TEXTURE_ARRAY_UNIT  GL_TEXTURE2
+#define COLOR_TEXTURE_ARRAY_UNIT_INDEX  2
+#define OCCLUSION_ROUGHNESS_METALLIC_UNIT  GL_TEXTURE3
+#define OCCLUSION_ROUGHNESS_METALLIC_UNIT_INDEX  3
+#define CLUSTER_RANGES_UNIT  GL_TEXTURE4
+#define CLUSTER_RANGES_UNIT_INDEX  4
+#define LIGHT_INDEX_UNIT  GL_TEXTURE5
+#define LIGHT_INDEX_UNIT_INDEX  5
 #define SPECULAR_EXPONENT_UNIT  GL_TEXTURE6
 #define SPECULAR_EXPONENT_UNIT_INDEX  6
+#define SHADOW_MAP_UNIT  GL_TEXTURE7
+#define SHADOW_MAP_UNIT_INDEX  7
+#define MORPH_TARGET_UNIT  GL_TEXTURE8
+#define MORPH_TARGET_UNIT_INDEX  8
+#define EMISSIVE_UNIT  GL_TEXTURE9
+#define EMISSIVE_UNIT_INDEX  9
+#define BRDF_LUT_UNIT  GL_TEXTURE10
+#define BRDF_LUT_UNIT_INDEX  10
+#define ENVIRONMENT_UNIT  GL_TEXTURE11
+#define ENVIRONMENT_UNIT_INDEX  11
+
+#define DRAW_DATA_UNIFORM_BINDING  0
+#define CLUSTER_DATA_UNIFORM_BINDING  1
+#define SHADOW_DATA_UNIFORM_BINDING  2
+#define SKIN_DATA_UNIFORM_BINDING  3
+#define MORPH_DATA_UNIFORM_BINDING  4
+#define ENVIRONMENT_DATA_UNIFORM_BINDING  5
 
 
 #define ARRAY_SIZE_IN_ELEMENTS(a) (sizeof(a)/sizeof(a[0]))
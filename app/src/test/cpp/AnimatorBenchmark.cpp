@@ -0,0 +1,94 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "animation/Animator.h"
+#include "core/JobSystem.h"
+#include <chrono>
+#include <cstdio>
+
+/*!
+ * Characters a scene animates and the update time they have to fit in
+ */
+static constexpr int kCharacters = 100;
+static constexpr float kBudgetMs = 4.0f;
+
+static constexpr int kJoints = 64;
+static constexpr int kKeys = 40;
+static constexpr int kFrames = 300;
+
+/*!
+ * @return update time of all characters per frame in ms, animated like Scene::update does
+ */
+static float measure(std::vector<std::unique_ptr<Animator>> &animators,
+                     std::vector<SkinData> &skins, std::vector<MorphData> &morphs) {
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < kFrames; ++frame) {
+        JobSystem::parallelFor(animators.size(), 4, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                animators[i]->update(1.0f / 60.0f, skins[i], morphs[i]);
+            }
+        });
+    }
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / kFrames;
+}
+
+int main() {
+    // eight chains of eight joints below one root, every joint has all three tracks
+    TransformHierarchy hierarchy;
+    Mat4f offset;
+    offset.initTranslation(0.0f, 0.1f, 0.0f);
+    int parent = TransformHierarchy::kNoParent;
+    for (int joint = 0; joint < kJoints; ++joint) {
+        parent = hierarchy.addNode("joint" + std::to_string(joint),
+                                   joint % 8 == 0 ? (joint == 0 ? -1 : 0) : parent, offset);
+    }
+    hierarchy.update();
+    hierarchy.captureRestPose();
+
+    auto clip = std::make_shared<AnimationClip>();
+    clip->duration = 2.0f;
+    for (int joint = 0; joint < kJoints; ++joint) {
+        for (int key = 0; key < kKeys; ++key) {
+            float time = clip->duration * (float) key / (kKeys - 1);
+            clip->positionTimes.push_back(time);
+            clip->positions.emplace_back(0.0f, 0.1f + 0.01f * std::sin(time), 0.0f);
+            clip->rotationTimes.push_back(time);
+            clip->rotations.emplace_back(0.0f, std::sin(time * 0.5f), 0.0f,
+                                         std::cos(time * 0.5f));
+            clip->scaleTimes.push_back(time);
+            clip->scales.emplace_back(1.0f, 1.0f, 1.0f);
+        }
+        clip->endChannel(joint);
+    }
+    Skin skin;
+    for (int joint = 0; joint < kJoints; ++joint) {
+        skin.addJoint(joint, hierarchy.getWorldMatrix(joint).inverseAffine());
+    }
+
+    std::vector<std::unique_ptr<Animator>> animators;
+    for (int i = 0; i < kCharacters; ++i) {
+        animators.push_back(std::make_unique<Animator>(
+                hierarchy, skin, MorphWeights{},
+                std::vector<std::shared_ptr<const AnimationClip>>{clip}));
+        animators.back()->play(0);
+        // characters don't move in sync
+        animators.back()->setSpeed(0.8f + 0.004f * (float) i);
+    }
+    std::vector<SkinData> skins(kCharacters);
+    std::vector<MorphData> morphs(kCharacters);
+
+    float inlineMs = measure(animators, skins, morphs);
+    float parallelMs;
+    int workers;
+    {
+        JobSystem jobs;
+        workers = jobs.getWorkerCount();
+        parallelMs = measure(animators, skins, morphs);
+    }
+    printf("%d characters with %d joints and %d keys per track:\n", kCharacters, kJoints, kKeys);
+    printf("  one thread   %.3f ms per frame\n", inlineMs);
+    printf("  %d workers    %.3f ms per frame, budget %.1f ms\n", workers, parallelMs, kBudgetMs);
+    return parallelMs <= kBudgetMs ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "animation/Animator.h"
+
+static const Quaternion kIdentity(0.0f, 0.0f, 0.0f, 1.0f);
+
+static Mat4f makeTransform(const glm::vec3 &translation, Quaternion rotation,
+                           const glm::vec3 &scale) {
+    rotation.Normalize();
+    Mat4f matrix;
+    matrix.initTransform(translation, rotation, scale);
+    return matrix;
+}
+
+static Quaternion aroundY(float radians) {
+    return Quaternion(0.0f, std::sin(radians * 0.5f), 0.0f, std::cos(radians * 0.5f));
+}
+
+/*!
+ * @return the largest difference between the joint matrix and the top rows of @a expected
+ */
+static float jointError(const SkinMatrix &joint, const Mat4f &expected) {
+    float error = 0.0f;
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            error = std::max(error, std::abs(joint.rows[row][column] - expected.m[row][column]));
+        }
+    }
+    return error;
+}
+
+static glm::vec3 jointTranslation(const SkinMatrix &joint) {
+    return glm::vec3(joint.rows[0].w, joint.rows[1].w, joint.rows[2].w);
+}
+
+static void testRestPoseIsIdentity() {
+    TransformHierarchy hierarchy;
+    int root = hierarchy.addNode("root", TransformHierarchy::kNoParent,
+                                 makeTransform(glm::vec3(1.0f, 2.0f, 3.0f),
+                                               Quaternion(0.3f, 0.5f, -0.2f, 0.8f),
+                                               glm::vec3(2.0f, 1.0f, 0.5f)));
+    // mirrored child, the animator decomposes it into a negative scale
+    int child = hierarchy.addNode("child", root,
+                                  makeTransform(glm::vec3(0.0f, 1.0f, 0.0f), kIdentity,
+                                                glm::vec3(-1.0f, 1.0f, 1.0f)));
+    hierarchy.update();
+    hierarchy.captureRestPose();
+    Skin skin;
+    CHECK(skin.addJoint(root, hierarchy.getWorldMatrix(root).inverseAffine()) == 0);
+    CHECK(skin.addJoint(child, hierarchy.getWorldMatrix(child).inverseAffine()) == 1);
+    // the same joint is reused
+    CHECK(skin.addJoint(child, hierarchy.getWorldMatrix(child).inverseAffine()) == 1);
+
+    Animator animator(hierarchy, skin, {}, {});
+    SkinData skinData{};
+    MorphData morphData{};
+    animator.update(0.0f, skinData, morphData);
+    Mat4f identity;
+    identity.initIdentity();
+    CHECK(jointError(skinData.joints[0], identity) < 1e-5f);
+    CHECK(jointError(skinData.joints[1], identity) < 1e-5f);
+}
+
+/*!
+ * Root with one child, the clip moves the root along x then y and turns the child
+ */
+struct TwoNodeRig {
+    TransformHierarchy hierarchy;
+    Skin skin;
+    std::shared_ptr<AnimationClip> clip = std::make_shared<AnimationClip>();
+
+    TwoNodeRig() {
+        Mat4f identity;
+        identity.initIdentity();
+        int root = hierarchy.addNode("root", TransformHierarchy::kNoParent, identity);
+        int child = hierarchy.addNode("child", root,
+                                      makeTransform(glm::vec3(0.0f, 0.0f, 1.0f), kIdentity,
+                                                    glm::vec3(1.0f)));
+        hierarchy.update();
+        hierarchy.captureRestPose();
+        skin.addJoint(root, identity);
+        skin.addJoint(child, hierarchy.getWorldMatrix(child).inverseAffine());
+
+        clip->duration = 2.0f;
+        float times[3] = {0.0f, 1.0f, 2.0f};
+        glm::vec3 positions[3] = {glm::vec3(0.0f), glm::vec3(2.0f, 0.0f, 0.0f),
+                                  glm::vec3(2.0f, 4.0f, 0.0f)};
+        for (int key = 0; key < 3; ++key) {
+            clip->positionTimes.push_back(times[key]);
+            clip->positions.push_back(positions[key]);
+        }
+        clip->endChannel(root);
+        // the second key is stored with the opposite sign, nlerp has to take the short way
+        Quaternion quarter = aroundY((float) M_PI * 0.5f);
+        clip->rotationTimes = {0.0f, 1.0f};
+        clip->rotations = {kIdentity, Quaternion(-quarter.x, -quarter.y, -quarter.z, -quarter.w)};
+        clip->endChannel(child);
+    }
+};
+
+static void testSampling() {
+    TwoNodeRig rig;
+    Animator animator(rig.hierarchy, rig.skin, {}, {rig.clip});
+    animator.play(0);
+    SkinData skinData{};
+    MorphData morphData{};
+
+    animator.update(0.5f, skinData, morphData);
+    glm::vec3 position = jointTranslation(skinData.joints[0]);
+    CHECK_NEAR(position.x, 1.0f, 1e-5f);
+    CHECK_NEAR(position.y, 0.0f, 1e-5f);
+
+    animator.update(1.0f, skinData, morphData);
+    position = jointTranslation(skinData.joints[0]);
+    CHECK_NEAR(position.x, 2.0f, 1e-5f);
+    CHECK_NEAR(position.y, 2.0f, 1e-5f);
+
+    // looping wraps the time, the cached keys go back to the start
+    animator.update(0.6f, skinData, morphData);
+    CHECK_NEAR(animator.getTime(), 0.1f, 1e-5f);
+    position = jointTranslation(skinData.joints[0]);
+    CHECK_NEAR(position.x, 0.2f, 1e-5f);
+    CHECK_NEAR(position.y, 0.0f, 1e-5f);
+
+    // a clip that doesn't loop holds its last key
+    animator.play(0, false);
+    animator.update(5.0f, skinData, morphData);
+    CHECK_NEAR(animator.getTime(), 2.0f, 1e-5f);
+    position = jointTranslation(skinData.joints[0]);
+    CHECK_NEAR(position.x, 2.0f, 1e-5f);
+    CHECK_NEAR(position.y, 4.0f, 1e-5f);
+}
+
+static void testPaletteMatchesHierarchy() {
+    TwoNodeRig rig;
+    Animator animator(rig.hierarchy, rig.skin, {}, {rig.clip});
+    animator.play(0);
+    SkinData skinData{};
+    MorphData morphData{};
+    animator.update(0.5f, skinData, morphData);
+
+    // the same pose built by the hierarchy: root at (1, 0, 0), child turned 45 degrees
+    TransformHierarchy expected = rig.hierarchy;
+    expected.setLocalMatrix(0, makeTransform(glm::vec3(1.0f, 0.0f, 0.0f), kIdentity,
+                                             glm::vec3(1.0f)));
+    expected.setLocalMatrix(1, makeTransform(glm::vec3(0.0f, 0.0f, 1.0f),
+                                             aroundY((float) M_PI * 0.25f), glm::vec3(1.0f)));
+    expected.update();
+    for (int joint = 0; joint < 2; ++joint) {
+        Mat4f matrix = expected.getWorldMatrix(rig.skin.jointNodes[joint])
+                       * rig.skin.inverseBindMatrices[joint];
+        CHECK(jointError(skinData.joints[joint], matrix) < 1e-5f);
+    }
+}
+
+static void testMorphWeights() {
+    TransformHierarchy hierarchy;
+    Mat4f identity;
+    identity.initIdentity();
+    int face = hierarchy.addNode("face", TransformHierarchy::kNoParent, identity);
+    int jaw = hierarchy.addNode("jaw", face, identity);
+    hierarchy.update();
+    hierarchy.captureRestPose();
+
+    MorphWeights weights;
+    float jawDefaults[3] = {0.5f, 0.5f, 0.5f};
+    CHECK(weights.addNode(jaw, jawDefaults, 3) == 0);
+    float faceDefaults[2] = {0.25f, 0.75f};
+    CHECK(weights.addNode(face, faceDefaults, 2) == 3);
+
+    auto clip = std::make_shared<AnimationClip>();
+    clip->duration = 1.0f;
+    clip->beginMorphChannel(face, 2);
+    clip->morphTimes = {0.0f, 1.0f};
+    clip->morphWeights = {0.0f, 1.0f, 1.0f, 0.0f};
+    clip->endMorphChannel();
+
+    Animator animator(hierarchy, {}, weights, {clip});
+    SkinData skinData{};
+    MorphData morphData{};
+    // the defaults until a clip plays
+    animator.update(0.0f, skinData, morphData);
+    CHECK(morphData.weights[0].w == 0.25f && morphData.weights[1].x == 0.75f);
+
+    animator.play(0, false);
+    animator.update(0.25f, skinData, morphData);
+    CHECK_NEAR(morphData.weights[0].w, 0.25f, 1e-6f);
+    CHECK_NEAR(morphData.weights[1].x, 0.75f, 1e-6f);
+    animator.update(0.5f, skinData, morphData);
+    CHECK_NEAR(morphData.weights[0].w, 0.75f, 1e-6f);
+    CHECK_NEAR(morphData.weights[1].x, 0.25f, 1e-6f);
+    // weights no channel animates keep their defaults
+    CHECK(morphData.weights[0].x == 0.5f);
+}
+
+int main() {
+    testRestPoseIsIdentity();
+    testSampling();
+    testPaletteMatchesHierarchy();
+    testMorphWeights();
+    return checkResult();
+}
@@ -0,0 +1,46 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#ifndef LEARNOPENGL_CHECK_H
+#define LEARNOPENGL_CHECK_H
+
+#include <cmath>
+#include <cstdio>
+
+/*!
+ * Failed checks of the running test, main() returns checkResult() so ctest sees them
+ */
+inline int checkFailures = 0;
+
+/*!
+ * Reports a failed check and keeps going, one run shows every broken case
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++checkFailures; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        double checkActual = (double) (actual); \
+        double checkExpected = (double) (expected); \
+        if (!(std::abs(checkActual - checkExpected) <= (double) (tolerance))) { \
+            fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s) failed: %g != %g\n", __FILE__, __LINE__, \
+                    #actual, #expected, checkActual, checkExpected); \
+            ++checkFailures; \
+        } \
+    } while (0)
+
+inline int checkResult() {
+    if (checkFailures > 0) {
+        fprintf(stderr, "%d checks failed\n", checkFailures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif //LEARNOPENGL_CHECK_H
@@ -0,0 +1,125 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "core/EntityRegistry.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+static constexpr int kEntities = 100000;
+static constexpr int kFrames = 100;
+
+struct Position {
+    float x, y, z;
+};
+
+struct Velocity {
+    float x, y, z;
+};
+
+/*!
+ * Packed like ClusteredLight, every eighth entity has one
+ */
+struct PackedLight {
+    float position[3];
+    float color[4];
+    float attenuation[4];
+};
+
+/*!
+ * The heap objects the scene kept before the registry, classified with dynamic_cast every frame
+ */
+struct Object {
+    virtual ~Object() = default;
+
+    Position position{};
+    Velocity velocity{};
+};
+
+struct LightObject : Object {
+    PackedLight light{};
+};
+
+template<typename Fn>
+static float measure(Fn &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < kFrames; ++frame) {
+        fn();
+    }
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / kFrames;
+}
+
+int main() {
+    EntityRegistry registry;
+    std::vector<std::unique_ptr<Object>> objects;
+    std::vector<Entity> entities;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kEntities; ++i) {
+        Entity entity = registry.create();
+        registry.add(entity, Position{(float) i, 0.0f, 0.0f});
+        registry.add(entity, Velocity{1.0f, 0.5f, 0.25f});
+        if (i % 8 == 0) {
+            registry.add(entity, PackedLight{});
+        }
+        entities.push_back(entity);
+    }
+    std::chrono::duration<float, std::milli> createMs = std::chrono::steady_clock::now() - start;
+    for (int i = 0; i < kEntities; ++i) {
+        objects.push_back(i % 8 == 0 ? std::make_unique<LightObject>()
+                                     : std::make_unique<Object>());
+    }
+    // the objects were created over time in the app, the heap isn't in order
+    for (size_t i = objects.size() - 1; i > 0; --i) {
+        std::swap(objects[i], objects[(i * 7919) % (i + 1)]);
+    }
+
+    float sum = 0.0f;
+    float moveMs = measure([&]() {
+        registry.each<Velocity, Position>([](Entity, Velocity &velocity, Position &position) {
+            position.x += velocity.x * 0.016f;
+            position.y += velocity.y * 0.016f;
+            position.z += velocity.z * 0.016f;
+        });
+    });
+    float lightMs = measure([&]() {
+        registry.each<PackedLight>([&](Entity, PackedLight &light) {
+            sum += light.color[0] + light.attenuation[0];
+        });
+    });
+    float objectMoveMs = measure([&]() {
+        for (auto &object: objects) {
+            object->position.x += object->velocity.x * 0.016f;
+            object->position.y += object->velocity.y * 0.016f;
+            object->position.z += object->velocity.z * 0.016f;
+        }
+    });
+    float objectLightMs = measure([&]() {
+        for (auto &object: objects) {
+            if (auto *light = dynamic_cast<LightObject *>(object.get())) {
+                sum += light->light.color[0] + light->light.attenuation[0];
+            }
+        }
+    });
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kEntities; i += 2) {
+        registry.destroy(entities[i]);
+    }
+    for (int i = 0; i < kEntities; i += 2) {
+        Entity entity = registry.create();
+        registry.add(entity, Position{});
+        registry.add(entity, Velocity{});
+    }
+    std::chrono::duration<float, std::milli> churnMs = std::chrono::steady_clock::now() - start;
+
+    printf("%d entities (%g):\n", kEntities, sum);
+    printf("  create and add        %8.3f ms\n", createMs.count());
+    printf("  destroy and recreate  %8.3f ms for half of them\n", churnMs.count());
+    printf("  move                  %8.3f ms per frame, heap objects %8.3f ms\n", moveMs,
+           objectMoveMs);
+    printf("  walk the lights       %8.3f ms per frame, dynamic_cast %8.3f ms\n", lightMs,
+           objectLightMs);
+    return 0;
+}
@@ -0,0 +1,124 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "core/EntityRegistry.h"
+#include <thread>
+
+struct Position {
+    float x, y, z;
+};
+
+struct Velocity {
+    float x, y, z;
+};
+
+static void testHandles() {
+    EntityRegistry registry;
+    Entity first = registry.create();
+    Entity second = registry.create();
+    CHECK(first != second);
+    CHECK(registry.getEntityCount() == 2);
+    CHECK(!Entity().isValid());
+
+    registry.destroy(first);
+    CHECK(!registry.isAlive(first));
+    CHECK(registry.getEntityCount() == 1);
+    // the index is recycled, the old handle stays dead
+    Entity third = registry.create();
+    CHECK(third.index == first.index);
+    CHECK(third != first);
+    CHECK(registry.isAlive(third));
+    CHECK(!registry.isAlive(first));
+    registry.destroy(first);
+    CHECK(registry.getEntityCount() == 2);
+}
+
+static void testPools() {
+    EntityRegistry registry;
+    Entity entities[4];
+    for (int i = 0; i < 4; ++i) {
+        entities[i] = registry.create();
+        registry.add(entities[i], Position{(float) i, 0.0f, 0.0f});
+    }
+    registry.add(entities[1], Velocity{1.0f, 0.0f, 0.0f});
+    registry.add(entities[3], Velocity{3.0f, 0.0f, 0.0f});
+    // adding again overwrites in place
+    registry.add(entities[3], Velocity{2.0f, 0.0f, 0.0f});
+    CHECK(registry.pool<Velocity>().size() == 2);
+    CHECK(registry.get<Velocity>(entities[0]) == nullptr);
+
+    int visited = 0;
+    registry.each<Velocity, Position>([&](Entity, Velocity &velocity, Position &position) {
+        position.x += velocity.x;
+        visited++;
+    });
+    CHECK(visited == 2);
+    CHECK(registry.get<Position>(entities[1])->x == 2.0f);
+    CHECK(registry.get<Position>(entities[3])->x == 5.0f);
+
+    // removal moves the last component into the gap
+    registry.destroy(entities[0]);
+    CHECK(registry.pool<Position>().size() == 3);
+    CHECK(registry.pool<Position>().entityAt(0) == entities[3]);
+    CHECK(registry.get<Position>(entities[3])->x == 5.0f);
+    CHECK(registry.get<Position>(entities[0]) == nullptr);
+
+    // a recycled index doesn't see the components of the entity before it
+    registry.destroy(entities[1]);
+    Entity recycled = registry.create();
+    CHECK(recycled.index == entities[1].index);
+    CHECK(registry.get<Velocity>(recycled) == nullptr);
+    CHECK(registry.get<Velocity>(entities[1]) == nullptr);
+
+    // another pool is refreshed through get() while one is walked, its layout stays as it was
+    Entity first = registry.pool<Position>().entityAt(0);
+    registry.each<Velocity>([&](Entity entity, Velocity &velocity) {
+        *registry.get<Position>(entity) = Position{velocity.x, 1.0f, 0.0f};
+    });
+    CHECK(registry.pool<Position>().size() == 2);
+    CHECK(registry.pool<Position>().entityAt(0) == first);
+    CHECK(registry.get<Position>(entities[3])->x == 2.0f);
+    CHECK(registry.get<Position>(entities[3])->y == 1.0f);
+}
+
+template<int N>
+struct Tag {
+    int value;
+};
+
+template<int... N>
+static void touchPools(EntityRegistry &registry, std::integer_sequence<int, N...>) {
+    Entity entity = registry.create();
+    (registry.add(entity, Tag<N>{N}), ...);
+}
+
+static void testTypeIdsAcrossThreads() {
+    // every thread sets up its own registry, the component types get their ids concurrently
+    std::vector<std::thread> threads;
+    std::vector<EntityRegistry> registries(4);
+    for (auto &registry: registries) {
+        threads.emplace_back([&registry]() {
+            touchPools(registry, std::make_integer_sequence<int, 64>());
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    bool distinct = true;
+    for (auto &registry: registries) {
+        Entity entity{0, 0};
+        distinct = distinct && registry.get<Tag<0>>(entity)->value == 0
+                   && registry.get<Tag<31>>(entity)->value == 31
+                   && registry.get<Tag<63>>(entity)->value == 63;
+    }
+    CHECK(distinct);
+}
+
+int main() {
+    testHandles();
+    testPools();
+    testTypeIdsAcrossThreads();
+    return checkResult();
+}
@@ -0,0 +1,196 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "core/JobSystem.h"
+#include "light/EnvironmentMap.h"
+#include <cstring>
+#include <vector>
+
+/*!
+ * @return the unsigned float with @a mantissaBits at the bottom of @a bits
+ */
+static float unpackSmallFloat(uint32_t bits, int mantissaBits) {
+    uint32_t exponent = (bits >> mantissaBits) & 31;
+    uint32_t mantissa = bits & ((1u << mantissaBits) - 1);
+    if (exponent == 0) {
+        return std::ldexp((float) mantissa, -14 - mantissaBits);
+    }
+    return std::ldexp(1.0f + (float) mantissa / (float) (1 << mantissaBits), (int) exponent - 15);
+}
+
+static float red(uint32_t texel) { return unpackSmallFloat(texel & 2047, 6); }
+
+static float blue(uint32_t texel) { return unpackSmallFloat(texel >> 22, 5); }
+
+/*!
+ * @return the red irradiance the shader evaluates for @a normal
+ */
+static float evaluateIrradiance(const EnvironmentMap &environment, float x, float y, float z) {
+    const glm::vec3 *sh = environment.getIrradiance();
+    return sh[0].x + sh[1].x * y + sh[2].x * z + sh[3].x * x + sh[4].x * x * y + sh[5].x * y * z
+           + sh[6].x * (3.0f * z * z - 1.0f) + sh[7].x * x * z + sh[8].x * (x * x - y * y);
+}
+
+static HdrImage makeImage(int width, int height, float (*radiance)(float y)) {
+    HdrImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t) width * height * 4);
+    for (int y = 0; y < height; ++y) {
+        float theta = ((float) y + 0.5f) / (float) height * (float) M_PI;
+        float value = radiance(std::cos(theta));
+        for (int x = 0; x < width; ++x) {
+            float *pixel = image.pixels.data() + ((size_t) y * width + x) * 4;
+            pixel[0] = pixel[1] = pixel[2] = value;
+            pixel[3] = 0.0f;
+        }
+    }
+    return image;
+}
+
+static float constantRadiance(float) { return 1.0f; }
+
+static float skyRadiance(float y) { return y > 0.0f ? 1.0f : 0.0f; }
+
+static void testConstantEnvironment() {
+    EnvironmentMap environment;
+    environment.compute(makeImage(256, 128, constantRadiance));
+    // a white Lambert surface reflects a constant radiance of 1 as 1 in every direction
+    CHECK_NEAR(environment.getIrradiance()[0].x, 1.0f, 1e-3f);
+    for (int k = 1; k < 9; ++k) {
+        CHECK_NEAR(environment.getIrradiance()[k].x, 0.0f, 1e-3f);
+    }
+    for (int mip = 0; mip < kEnvironmentMipCount; ++mip) {
+        int size = EnvironmentMap::mipSize(mip);
+        CHECK_NEAR(red(environment.getTexels(mip, mip % 6)[size * size / 2]), 1.0f, 1.0f / 32);
+    }
+}
+
+static void testHalfSky() {
+    EnvironmentMap environment;
+    environment.compute(makeImage(256, 128, skyRadiance));
+    CHECK_NEAR(evaluateIrradiance(environment, 0.0f, 1.0f, 0.0f), 1.0f, 0.05f);
+    CHECK_NEAR(evaluateIrradiance(environment, 0.0f, -1.0f, 0.0f), 0.0f, 0.05f);
+    CHECK_NEAR(evaluateIrradiance(environment, 1.0f, 0.0f, 0.0f), 0.5f, 0.05f);
+    // the sharpest mip mirrors the sky above and the ground below
+    int center = kEnvironmentCubeSize * kEnvironmentCubeSize / 2 + kEnvironmentCubeSize / 2;
+    CHECK_NEAR(red(environment.getTexels(0, 2)[center]), 1.0f, 1.0f / 32);
+    CHECK_NEAR(red(environment.getTexels(0, 3)[center]), 0.0f, 1.0f / 32);
+}
+
+static void testComputeIsDeterministic() {
+    HdrImage image = makeImage(256, 128, skyRadiance);
+    EnvironmentMap inline_;
+    inline_.compute(image);
+    EnvironmentMap parallel;
+    {
+        JobSystem jobs(4);
+        parallel.compute(image);
+    }
+    CHECK(memcmp(inline_.getIrradiance(), parallel.getIrradiance(), sizeof(glm::vec3) * 9) == 0);
+    CHECK(memcmp(inline_.getTexels(0, 0), parallel.getTexels(0, 0),
+                 (size_t) 6 * kEnvironmentCubeSize * kEnvironmentCubeSize * sizeof(uint32_t))
+          == 0);
+}
+
+static void testPackR11G11B10() {
+    auto pack = [](float value) {
+        float rgb[3] = {value, value, value};
+        return EnvironmentMap::packR11G11B10(rgb);
+    };
+    CHECK(pack(0.0f) == 0);
+    CHECK(pack(-1.0f) == 0);
+    CHECK(pack(NAN) == 0);
+    CHECK(red(pack(1.0f)) == 1.0f && blue(pack(1.0f)) == 1.0f);
+    CHECK(red(pack(0.5f)) == 0.5f);
+    // largest values of the 11 and 10 bit formats
+    CHECK(red(pack(1e9f)) == 65024.0f);
+    CHECK(blue(pack(1e9f)) == 64512.0f);
+    // denormals keep their precision, values below them are black
+    CHECK(red(pack(std::ldexp(1.0f, -15))) == std::ldexp(1.0f, -15));
+    CHECK(red(pack(std::ldexp(1.0f, -22))) == 0.0f);
+    CHECK_NEAR(red(pack(3.14159f)), 3.14159f, 1.0f / 32);
+}
+
+static void appendHeader(std::vector<uint8_t> &file, const char *header) {
+    file.insert(file.end(), header, header + strlen(header));
+}
+
+static void testDecodeRle() {
+    std::vector<uint8_t> file;
+    appendHeader(file, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 2 +X 16\n");
+    for (int y = 0; y < 2; ++y) {
+        uint8_t start[4] = {2, 2, 0, 16};
+        file.insert(file.end(), start, start + 4);
+        // every channel is one run over the whole line
+        uint8_t rgbe[4] = {128, 64, 32, 129};
+        for (uint8_t channel: rgbe) {
+            file.push_back(128 + 16);
+            file.push_back(channel);
+        }
+    }
+    HdrImage image;
+    CHECK(EnvironmentMap::decodeHdr(file.data(), file.size(), image));
+    CHECK(image.width == 16 && image.height == 2);
+    CHECK(image.pixels.size() == 16 * 2 * 4);
+    CHECK(image.pixels[0] == 1.0f && image.pixels[1] == 0.5f && image.pixels[2] == 0.25f);
+    CHECK(image.pixels.back() == 0.0f && image.pixels[image.pixels.size() - 2] == 0.25f);
+
+    // a run past the end of the line is corrupt
+    file[file.size() - 2] = 128 + 17;
+    HdrImage corrupt;
+    CHECK(!EnvironmentMap::decodeHdr(file.data(), file.size(), corrupt));
+    CHECK(corrupt.width == 0);
+}
+
+static void testDecodeFlat() {
+    std::vector<uint8_t> file;
+    appendHeader(file, "#?RGBE\n\n-Y 1 +X 2\n");
+    uint8_t pixels[8] = {128, 128, 128, 128, 0, 0, 0, 0};
+    file.insert(file.end(), pixels, pixels + 8);
+    HdrImage image;
+    CHECK(EnvironmentMap::decodeHdr(file.data(), file.size(), image));
+    CHECK(image.pixels[0] == 0.5f && image.pixels[4] == 0.0f);
+    CHECK(!EnvironmentMap::decodeHdr(file.data(), file.size() - 1, image));
+    CHECK(!EnvironmentMap::decodeHdr(file.data(), 10, image));
+}
+
+static void testCacheRoundTrip() {
+    EnvironmentMap environment;
+    environment.compute(makeImage(128, 64, skyRadiance));
+    const char *path = "EnvironmentMapTest.env";
+    const uint8_t source[] = "source image";
+    const uint8_t edited[] = "source imagf";
+    uint64_t sourceHash = EnvironmentMap::hashSource(source, sizeof(source));
+    CHECK(sourceHash != EnvironmentMap::hashSource(edited, sizeof(edited)));
+    CHECK(environment.store(path, sourceHash));
+
+    // an edited image of the same size is stale
+    EnvironmentMap stale;
+    CHECK(!stale.load(path, EnvironmentMap::hashSource(edited, sizeof(edited))));
+    CHECK(!stale.isValid());
+
+    EnvironmentMap cached;
+    CHECK(cached.load(path, sourceHash));
+    CHECK(memcmp(cached.getIrradiance(), environment.getIrradiance(), sizeof(glm::vec3) * 9)
+          == 0);
+    int last = kEnvironmentMipCount - 1;
+    size_t texelBytes = (size_t) (environment.getTexels(last, 5) - environment.getTexels(0, 0)
+                                  + EnvironmentMap::mipSize(last) * EnvironmentMap::mipSize(last))
+                        * sizeof(uint32_t);
+    CHECK(memcmp(cached.getTexels(0, 0), environment.getTexels(0, 0), texelBytes) == 0);
+    remove(path);
+}
+
+int main() {
+    testConstantEnvironment();
+    testHalfSky();
+    testComputeIsDeterministic();
+    testPackR11G11B10();
+    testDecodeRle();
+    testDecodeFlat();
+    testCacheRoundTrip();
+    return checkResult();
+}
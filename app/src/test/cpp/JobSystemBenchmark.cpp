@@ -0,0 +1,60 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "core/JobSystem.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+static constexpr int kJobs = 4096;
+static constexpr int kFrames = 20;
+
+/*!
+ * About 20 us of arithmetic, roughly a small culling or skinning batch
+ */
+static float work(int seed) {
+    float value = (float) seed;
+    for (int i = 0; i < 4000; ++i) {
+        value = std::sin(value) * 0.5f + (float) i * 1e-4f;
+    }
+    return value;
+}
+
+/*!
+ * @return time per frame in ms of a frame of small jobs and a parallelFor over the same work
+ */
+static float measure() {
+    std::vector<float> results(kJobs);
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < kFrames; ++frame) {
+        JobCounter counter;
+        for (int job = 0; job < kJobs / 2; ++job) {
+            JobSystem::submit([&results, job]() { results[job] = work(job); }, &counter);
+        }
+        JobSystem::parallelFor(kJobs / 2, 16, [&results](size_t begin, size_t end) {
+            for (size_t job = begin; job < end; ++job) {
+                results[kJobs / 2 + job] = work((int) job);
+            }
+        });
+        JobSystem::wait(counter);
+    }
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / kFrames;
+}
+
+int main() {
+    float inlineMs = measure();
+    int cores = std::max(1, (int) std::thread::hardware_concurrency());
+    printf("%d jobs per frame on %d cores:\n", kJobs, cores);
+    printf("  inline      %8.3f ms per frame\n", inlineMs);
+    for (int workers = 1; workers <= std::max(cores * 2, 4); workers *= 2) {
+        JobSystem jobs(workers);
+        float ms = measure();
+        // the submitting thread runs jobs as well
+        int threads = std::min(workers + 1, cores);
+        printf("  %2d workers  %8.3f ms per frame, speedup %.2f, efficiency %3.0f%%\n", workers,
+               ms, inlineMs / ms, 100.0f * inlineMs / ms / (float) threads);
+    }
+    return 0;
+}
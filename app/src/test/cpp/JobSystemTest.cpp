@@ -0,0 +1,169 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "core/JobSystem.h"
+#include <vector>
+
+static void testRunsInlineWithoutWorkers() {
+    CHECK(JobSystem::get() == nullptr);
+    int value = 0;
+    JobCounter counter;
+    JobSystem::submit([&value]() { value = 1; }, &counter);
+    CHECK(value == 1);
+    CHECK(counter.isDone());
+    JobSystem::wait(counter);
+}
+
+static void testParallelForCoversEveryItemOnce() {
+    JobSystem jobs(4);
+    for (size_t count: {1, 7, 64, 1000, 100003}) {
+        std::vector<std::atomic<int>> visits(count);
+        JobSystem::parallelFor(count, 3, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                visits[i].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        bool once = true;
+        for (auto &visit: visits) {
+            once = once && visit.load() == 1;
+        }
+        CHECK(once);
+    }
+}
+
+/*!
+ * Every job spawns two children until @a depth runs out, the owner pops them while idle workers
+ * steal them from the other end of its deque
+ */
+static void spawnTree(int depth, JobCounter *counter, std::atomic<int> &leaves) {
+    if (depth == 0) {
+        leaves.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (int child = 0; child < 2; ++child) {
+        JobSystem::submit([depth, counter, &leaves]() {
+            spawnTree(depth - 1, counter, leaves);
+        }, counter);
+    }
+}
+
+static void testNestedJobsUnderStealing() {
+    JobSystem jobs(4);
+    for (int round = 0; round < 50; ++round) {
+        std::atomic<int> leaves{0};
+        JobCounter counter;
+        JobSystem::submit([&]() { spawnTree(10, &counter, leaves); }, &counter);
+        JobSystem::wait(counter);
+        CHECK(leaves.load() == 1 << 10);
+    }
+}
+
+static void testJobsWaitOnTheirChildren() {
+    // every worker blocks on children, only helping while waiting keeps the pool going
+    JobSystem jobs(2);
+    std::atomic<int> finished{0};
+    JobCounter outer;
+    for (int parent = 0; parent < 16; ++parent) {
+        JobSystem::submit([&finished]() {
+            JobCounter inner;
+            for (int child = 0; child < 16; ++child) {
+                JobSystem::submit([&finished]() {
+                    finished.fetch_add(1, std::memory_order_relaxed);
+                }, &inner);
+            }
+            JobSystem::wait(inner);
+            CHECK(inner.isDone());
+        }, &outer);
+    }
+    JobSystem::wait(outer);
+    CHECK(finished.load() == 16 * 16);
+}
+
+static void testParentCounters() {
+    JobSystem jobs(3);
+    std::atomic<int> finished{0};
+    JobCounter parent;
+    std::vector<std::unique_ptr<JobCounter>> children;
+    for (int i = 0; i < 8; ++i) {
+        children.push_back(std::make_unique<JobCounter>(&parent));
+        for (int job = 0; job < 100; ++job) {
+            JobSystem::submit([&finished]() {
+                finished.fetch_add(1, std::memory_order_relaxed);
+            }, children.back().get());
+        }
+    }
+    JobSystem::wait(parent);
+    CHECK(finished.load() == 800);
+    for (auto &child: children) {
+        CHECK(child->isDone());
+    }
+}
+
+static void testManySubmittingThreads() {
+    // threads outside the pool push onto the workers and help while the workers steal
+    JobSystem jobs(3);
+    std::atomic<int> finished{0};
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; ++thread) {
+        threads.emplace_back([&finished]() {
+            for (int round = 0; round < 200; ++round) {
+                JobCounter counter;
+                for (int job = 0; job < 20; ++job) {
+                    JobSystem::submit([&finished]() {
+                        finished.fetch_add(1, std::memory_order_relaxed);
+                    }, &counter, job % 3 == 0 ? JobAffinity::BIG : JobAffinity::ANY);
+                }
+                JobSystem::wait(counter);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    CHECK(finished.load() == 4 * 200 * 20);
+}
+
+static void testLittleJobsStayOffOtherThreads() {
+    JobSystem jobs(2);
+    std::thread::id caller = std::this_thread::get_id();
+    std::atomic<int> onCaller{0};
+    JobCounter counter;
+    for (int job = 0; job < 200; ++job) {
+        JobSystem::submit([&]() {
+            onCaller.fetch_add(std::this_thread::get_id() == caller, std::memory_order_relaxed);
+        }, &counter, JobAffinity::LITTLE);
+    }
+    JobSystem::wait(counter);
+    CHECK(onCaller.load() == 0);
+}
+
+static void testCoreClasses() {
+    std::vector<int> big;
+    std::vector<int> little;
+    CHECK(!JobSystem::splitCoreClasses({1800000, 1800000, 1800000, 1800000}, big, little));
+    CHECK(!JobSystem::splitCoreClasses({}, big, little));
+
+    CHECK(JobSystem::splitCoreClasses({1800000, 1800000, 2400000, 2400000}, big, little));
+    CHECK((big == std::vector<int>{2, 3}));
+    CHECK((little == std::vector<int>{0, 1}));
+
+    // four little, three big and one prime core, the prime core is big as well
+    CHECK(JobSystem::splitCoreClasses({1800000, 1800000, 1800000, 1800000, 2400000, 2400000,
+                                       2400000, 3000000}, big, little));
+    CHECK((big == std::vector<int>{4, 5, 6, 7}));
+    CHECK((little == std::vector<int>{0, 1, 2, 3}));
+}
+
+int main() {
+    testRunsInlineWithoutWorkers();
+    testParallelForCoversEveryItemOnce();
+    testNestedJobsUnderStealing();
+    testJobsWaitOnTheirChildren();
+    testParentCounters();
+    testManySubmittingThreads();
+    testLittleJobsStayOffOtherThreads();
+    testCoreClasses();
+    return checkResult();
+}
@@ -0,0 +1,91 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "math/mat4f.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+/*!
+ * Sizes of the batched kernels, about the joints of a few characters and the points of an occluder
+ */
+static constexpr size_t kMatrices = 1024;
+static constexpr size_t kPoints = 4096;
+static constexpr int kRepeats = 2000;
+
+#if defined(__ARM_NEON)
+static constexpr const char *kPath = "NEON";
+#elif defined(__SSE__)
+static constexpr const char *kPath = "SSE";
+#else
+static constexpr const char *kPath = "scalar";
+#endif
+
+/*!
+ * @return ns per call of @a fn, which processes @a count items
+ */
+template<typename Fn>
+static float measure(size_t count, Fn &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < kRepeats; ++repeat) {
+        fn();
+    }
+    std::chrono::duration<float, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ((float) kRepeats * (float) count);
+}
+
+int main() {
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+    std::vector<Mat4f> matrices(kMatrices);
+    for (auto &matrix: matrices) {
+        for (auto &row: matrix.m) {
+            for (float &value: row) {
+                value = values(random);
+            }
+        }
+    }
+    std::vector<Mat4f> products(kMatrices);
+    std::vector<glm::vec3> points(kPoints);
+    for (auto &point: points) {
+        point = glm::vec3(values(random), values(random), values(random));
+    }
+    std::vector<glm::vec3> transformed(kPoints);
+    std::vector<Quaternion> rotations;
+    for (size_t i = 0; i < kMatrices; ++i) {
+        rotations.emplace_back(values(random), values(random), values(random), 1.0f);
+        rotations.back().Normalize();
+    }
+    Mat4f a = matrices[0];
+    float sink = 0.0f;
+
+    float productNs = measure(kMatrices, [&]() {
+        for (size_t i = 0; i < kMatrices; ++i) {
+            products[i] = a * matrices[i];
+        }
+        sink += products[kMatrices - 1].m[0][0];
+    });
+    float transformNs = measure(kMatrices, [&]() {
+        for (size_t i = 0; i < kMatrices; ++i) {
+            products[i].initTransform(points[i], rotations[i], glm::vec3(1.5f));
+        }
+        sink += products[kMatrices - 1].m[1][1];
+    });
+    float arrayNs = measure(kMatrices, [&]() {
+        Mat4f::multiplyArray(a, matrices.data(), products.data(), kMatrices);
+        sink += products[kMatrices - 1].m[2][2];
+    });
+    float pointNs = measure(kPoints, [&]() {
+        Mat4f::transformPoints(a, points.data(), transformed.data(), kPoints);
+        sink += transformed[kPoints - 1].x;
+    });
+
+    printf("Mat4f, %s path (%g):\n", kPath, sink);
+    printf("  operator*        %7.2f ns per product\n", productNs);
+    printf("  initTransform    %7.2f ns per matrix\n", transformNs);
+    printf("  multiplyArray    %7.2f ns per matrix of %zu\n", arrayNs, kMatrices);
+    printf("  transformPoints  %7.2f ns per point of %zu\n", pointNs, kPoints);
+    return 0;
+}
@@ -0,0 +1,153 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "math/mat4f.h"
+#include "glm/glm.hpp"
+#include <cstring>
+#include <random>
+
+static std::mt19937 random_(3);
+
+static float randomFloat() {
+    return std::uniform_real_distribution<float>(-4.0f, 4.0f)(random_);
+}
+
+static Mat4f randomMatrix(bool affine) {
+    Mat4f matrix;
+    for (auto &row: matrix.m) {
+        for (float &value: row) {
+            value = randomFloat();
+        }
+    }
+    if (affine) {
+        matrix.m[3][0] = matrix.m[3][1] = matrix.m[3][2] = 0.0f;
+        matrix.m[3][3] = 1.0f;
+    }
+    return matrix;
+}
+
+/*!
+ * Mat4f is row major, glm keeps columns
+ */
+static glm::mat4 toGlm(const Mat4f &matrix) {
+    glm::mat4 result;
+    for (int row = 0; row < 4; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            result[column][row] = matrix.m[row][column];
+        }
+    }
+    return result;
+}
+
+static bool matches(const Mat4f &matrix, const glm::mat4 &expected, float tolerance = 1e-4f) {
+    for (int row = 0; row < 4; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            float value = expected[column][row];
+            if (std::abs(matrix.m[row][column] - value) > tolerance * std::max(1.0f,
+                                                                               std::abs(value))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void testProducts() {
+    for (int i = 0; i < 100; ++i) {
+        Mat4f a = randomMatrix(false);
+        Mat4f b = randomMatrix(false);
+        CHECK(matches(a * b, toGlm(a) * toGlm(b)));
+        glm::vec4 v(randomFloat(), randomFloat(), randomFloat(), randomFloat());
+        glm::vec4 product = a * v;
+        glm::vec4 expected = toGlm(a) * v;
+        CHECK(glm::length(product - expected) <= 1e-4f * std::max(1.0f, glm::length(expected)));
+    }
+}
+
+static void testMultiplyArray() {
+    // every count up to a few SIMD blocks, so the tails are covered
+    for (size_t count = 0; count < 20; ++count) {
+        Mat4f a = randomMatrix(false);
+        std::vector<Mat4f> in(count);
+        for (auto &matrix: in) {
+            matrix = randomMatrix(count % 2 == 0);
+        }
+        std::vector<Mat4f> out(count);
+        Mat4f::multiplyArray(a, in.data(), out.data(), count);
+        bool all = true;
+        for (size_t i = 0; i < count; ++i) {
+            all = all && matches(out[i], toGlm(a) * toGlm(in[i]));
+        }
+        CHECK(all);
+
+        // in place gives the same result
+        std::vector<Mat4f> inPlace = in;
+        Mat4f::multiplyArray(a, inPlace.data(), inPlace.data(), count);
+        CHECK(count == 0 || memcmp(inPlace.data(), out.data(), count * sizeof(Mat4f)) == 0);
+    }
+}
+
+static void testTransformPoints() {
+    for (size_t count = 0; count < 20; ++count) {
+        Mat4f a = randomMatrix(true);
+        std::vector<glm::vec3> in(count);
+        for (auto &point: in) {
+            point = glm::vec3(randomFloat(), randomFloat(), randomFloat());
+        }
+        std::vector<glm::vec3> out(count);
+        Mat4f::transformPoints(a, in.data(), out.data(), count);
+        bool all = true;
+        for (size_t i = 0; i < count; ++i) {
+            glm::vec3 expected = glm::vec3(toGlm(a) * glm::vec4(in[i], 1.0f));
+            all = all && glm::length(out[i] - expected)
+                         <= 1e-4f * std::max(1.0f, glm::length(expected));
+        }
+        CHECK(all);
+
+        std::vector<glm::vec3> inPlace = in;
+        Mat4f::transformPoints(a, inPlace.data(), inPlace.data(), count);
+        CHECK(inPlace == out);
+    }
+}
+
+static void testInverseAffine() {
+    for (int i = 0; i < 100; ++i) {
+        Mat4f a = randomMatrix(true);
+        CHECK(matches(a.inverseAffine(), glm::inverse(toGlm(a)), 1e-3f));
+    }
+}
+
+static void testTransform() {
+    // the quaternion overload matches translation * rotation * scale
+    glm::vec3 translation(1.0f, -2.0f, 3.0f);
+    glm::vec3 scale(2.0f, 0.5f, 1.5f);
+    glm::vec3 axis = glm::normalize(glm::vec3(1.0f, 2.0f, -0.5f));
+    float angle = 0.7f;
+    Quaternion rotation(axis.x * std::sin(angle * 0.5f), axis.y * std::sin(angle * 0.5f),
+                        axis.z * std::sin(angle * 0.5f), std::cos(angle * 0.5f));
+    Mat4f matrix;
+    matrix.initTransform(translation, rotation, scale);
+
+    float c = std::cos(angle);
+    float s = std::sin(angle);
+    glm::mat3 turn = glm::mat3(c) + s * glm::mat3(0.0f, axis.z, -axis.y,
+                                                  -axis.z, 0.0f, axis.x,
+                                                  axis.y, -axis.x, 0.0f)
+                     + (1.0f - c) * glm::outerProduct(axis, axis);
+    glm::mat4 expected(turn * glm::mat3(glm::vec3(scale.x, 0.0f, 0.0f),
+                                        glm::vec3(0.0f, scale.y, 0.0f),
+                                        glm::vec3(0.0f, 0.0f, scale.z)));
+    expected[3] = glm::vec4(translation, 1.0f);
+    CHECK(matches(matrix, expected));
+}
+
+int main() {
+    testProducts();
+    testMultiplyArray();
+    testTransformPoints();
+    testInverseAffine();
+    testTransform();
+    return checkResult();
+}
@@ -0,0 +1,113 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "animation/MorphTargets.h"
+#include <cstring>
+#include <random>
+
+static float fromHalf(uint16_t half) {
+    float sign = half & 0x8000 ? -1.0f : 1.0f;
+    int exponent = (half >> 10) & 31;
+    int mantissa = half & 1023;
+    if (exponent == 31) {
+        return mantissa == 0 ? sign * INFINITY : NAN;
+    }
+    if (exponent == 0) {
+        return sign * std::ldexp((float) mantissa, -24);
+    }
+    return sign * std::ldexp(1.0f + (float) mantissa / 1024.0f, exponent - 15);
+}
+
+static void testExactValues() {
+    CHECK(MorphTargets::toHalf(0.0f) == 0x0000);
+    CHECK(MorphTargets::toHalf(-0.0f) == 0x8000);
+    CHECK(MorphTargets::toHalf(1.0f) == 0x3c00);
+    CHECK(MorphTargets::toHalf(-2.0f) == 0xc000);
+    CHECK(MorphTargets::toHalf(0.5f) == 0x3800);
+    CHECK(MorphTargets::toHalf(65504.0f) == 0x7bff);
+    // smallest denormal, and what is too small even for it
+    CHECK(MorphTargets::toHalf(std::ldexp(1.0f, -24)) == 0x0001);
+    CHECK(MorphTargets::toHalf(std::ldexp(1.0f, -26)) == 0x0000);
+    // beyond the largest half the value rounds to infinity
+    CHECK(MorphTargets::toHalf(65520.0f) == 0x7c00);
+    CHECK(MorphTargets::toHalf(-1e6f) == 0xfc00);
+}
+
+static void testWeightIndicesAreExact() {
+    // the shaders read the weight index back from a half float
+    for (int weight = 0; weight <= 2048; ++weight) {
+        CHECK(fromHalf(MorphTargets::toHalf((float) weight)) == (float) weight);
+    }
+    CHECK(kMaxMorphWeights <= 2048);
+}
+
+static void testRoundsToNearest() {
+    // deltas are small offsets, the sweep covers them and the denormals below
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> exponents(-26.0f, 8.0f);
+    int failures = 0;
+    for (int i = 0; i < 1000000 && failures < 10; ++i) {
+        float value = std::exp2(exponents(random)) * (i & 1 ? -1.0f : 1.0f);
+        uint16_t half = MorphTargets::toHalf(value);
+        float error = std::abs(fromHalf(half) - value);
+        // neither neighbour of the result may be closer to the value
+        bool nearest = true;
+        if ((half & 0x7fff) != 0x7bff) {
+            nearest = nearest && std::abs(fromHalf(half + 1) - value) >= error;
+        }
+        if ((half & 0x7fff) != 0) {
+            nearest = nearest && std::abs(fromHalf(half - 1) - value) >= error;
+        }
+        // half a unit in the last place, 11 bits of precision for normal halves
+        float bound = std::max(std::abs(value) * std::ldexp(1.0f, -11), std::ldexp(1.0f, -25));
+        if (!nearest || error > bound) {
+            fprintf(stderr, "toHalf(%.9g) = %#06x is %g off\n", value, half, error);
+            failures++;
+        }
+    }
+    CHECK(failures == 0);
+}
+
+static std::vector<MorphDelta> makeDeltas(size_t count) {
+    std::vector<MorphDelta> deltas(count);
+    for (size_t i = 0; i < count; ++i) {
+        deltas[i] = {glm::vec3((float) i, 0.25f, -0.5f), glm::vec3(0.0f, 1.0f, 0.0f),
+                     (uint32_t) i};
+    }
+    return deltas;
+}
+
+static void testCapacity() {
+    // ES 3.0 only guarantees 2048 rows
+    CHECK(MorphTargets::maxDeltasFor(2048) == (size_t) 2048 * kMorphTextureWidth / 2);
+    CHECK(MorphTargets::maxDeltasFor(1 << 16) == kMaxMorphDeltas);
+    CHECK(MorphTargets::maxDeltasFor(0) == 0);
+
+    MorphTargets targets(5);
+    std::vector<Vertex> vertices(2);
+    vertices[0].morph = 0;
+    vertices[1].morph = (2u << kMorphStartBits) | 1;
+    CHECK(targets.addMesh(makeDeltas(3), vertices));
+    CHECK(targets.getDeltaCount() == 3);
+    CHECK(vertices[1].morph == ((2u << kMorphStartBits) | 1));
+
+    // the second mesh starts after the deltas of the first one
+    CHECK(targets.addMesh(makeDeltas(2), vertices));
+    CHECK(vertices[0].morph == 0);
+    CHECK(vertices[1].morph == ((2u << kMorphStartBits) | 4));
+
+    // a full texture drops the mesh and clears its vertices
+    CHECK(!targets.addMesh(makeDeltas(1), vertices));
+    CHECK(targets.getDeltaCount() == 5);
+    CHECK(vertices[1].morph == 0);
+}
+
+int main() {
+    testExactValues();
+    testWeightIndicesAreExact();
+    testRoundsToNearest();
+    testCapacity();
+    return checkResult();
+}
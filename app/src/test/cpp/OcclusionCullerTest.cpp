@@ -0,0 +1,186 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "culling/OcclusionCuller.h"
+#include <algorithm>
+#include <random>
+
+/*!
+ * Camera at the origin looking down +z, like Utility::buildPerspectiveMat
+ */
+static Mat4f makePerspective(float aspect, float near, float far) {
+    float a = (far + near) / (far - near);
+    float b = -2.0f * far * near / (far - near);
+    return Mat4f(1.0f / aspect, 0.0f, 0.0f, 0.0f,
+                 0.0f, 1.0f, 0.0f, 0.0f,
+                 0.0f, 0.0f, a, b,
+                 0.0f, 0.0f, 1.0f, 0.0f);
+}
+
+static void testWallAndFloor() {
+    OcclusionCuller culler;
+    Mat4f projection = makePerspective(2.0f, 0.01f, 100.0f);
+    OccluderGeometry wall;
+    wall.positions = {{-2.0f, -1.0f, 5.0f}, {2.0f, -1.0f, 5.0f}, {2.0f, 1.0f, 5.0f},
+                      {-2.0f, 1.0f, 5.0f}};
+    wall.indices = {0, 1, 2, 0, 2, 3};
+    // the floor starts behind the camera and is clipped at the near plane
+    OccluderGeometry floor;
+    floor.positions = {{-3.0f, -1.5f, -5.0f}, {3.0f, -1.5f, -5.0f}, {3.0f, -1.5f, 20.0f},
+                       {-3.0f, -1.5f, 20.0f}};
+    floor.indices = {0, 2, 1, 0, 3, 2};
+    culler.rasterize({{&wall, projection}, {&floor, projection}});
+
+    CHECK_NEAR(culler.getDepth(0, kOcclusionWidth / 2, kOcclusionHeight / 2), 0.2f, 1e-5f);
+    CHECK(culler.getDepth(0, kOcclusionWidth / 2, 0) > 0.0f);
+    auto visible = [&](glm::vec3 boundsMin, glm::vec3 boundsMax) {
+        return culler.isVisible(projection, boundsMin, boundsMax);
+    };
+    CHECK(!visible({-0.5f, -0.5f, 9.0f}, {0.5f, 0.5f, 10.0f}));
+    CHECK(visible({-0.5f, -0.5f, 3.0f}, {0.5f, 0.5f, 4.0f}));
+    // half behind the wall, half beside it
+    CHECK(visible({1.5f, -0.5f, 9.0f}, {3.5f, 0.5f, 10.0f}));
+    CHECK(visible({4.0f, -0.5f, 9.0f}, {5.0f, 0.5f, 10.0f}));
+    CHECK(!visible({-0.5f, -4.0f, 8.0f}, {0.5f, -3.0f, 9.0f}));
+    // the occluder itself is never hidden by its own depth
+    CHECK(visible({-2.0f, -1.0f, 5.0f}, {2.0f, 1.0f, 5.0f}));
+    CHECK(visible({-0.5f, -0.5f, -1.0f}, {0.5f, 0.5f, 1.0f}));
+    CHECK(!visible({-0.5f, -0.5f, -4.0f}, {0.5f, 0.5f, -3.0f}));
+    CHECK(!visible({50.0f, 0.0f, 5.0f}, {51.0f, 1.0f, 6.0f}));
+
+    const OcclusionStats &stats = culler.getStats();
+    CHECK(stats.frames == 1);
+    CHECK(stats.occluderTriangles == 4);
+    CHECK(stats.tested == 9);
+    CHECK(stats.culled == 2);
+    CHECK(stats.outside == 2);
+}
+
+static void testNothingHidesWithoutOccluders() {
+    OcclusionCuller culler;
+    Mat4f projection = makePerspective(2.0f, 0.01f, 100.0f);
+    culler.rasterize({});
+    CHECK(culler.isVisible(projection, {-0.5f, -0.5f, 9.0f}, {0.5f, 0.5f, 10.0f}));
+    CHECK(culler.getDepth(culler.getLevelCount() - 1, 0, 0) == 0.0f);
+}
+
+/*!
+ * Rasterizes like the culler in double precision, one pixel at a time. Pixels whose center lies
+ * on an edge are marked in @a ambiguous, float rounding may cover them or not.
+ */
+static void rasterizeReference(const std::vector<glm::dvec3> &screen, std::vector<double> &depth,
+                               std::vector<uint8_t> &ambiguous) {
+    for (size_t i = 0; i + 2 < screen.size(); i += 3) {
+        glm::dvec3 v0 = screen[i];
+        glm::dvec3 v1 = screen[i + 1];
+        glm::dvec3 v2 = screen[i + 2];
+        double area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::abs(area) < 1e-3) {
+            continue;
+        }
+        if (area < 0.0) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+        const glm::dvec3 *from[3] = {&v1, &v2, &v0};
+        const glm::dvec3 *to[3] = {&v2, &v0, &v1};
+        for (int y = 0; y < kOcclusionHeight; ++y) {
+            for (int x = 0; x < kOcclusionWidth; ++x) {
+                double px = x + 0.5;
+                double py = y + 0.5;
+                double weights[3];
+                bool inside = true;
+                bool nearEdge = false;
+                for (int e = 0; e < 3; ++e) {
+                    double ex = from[e]->y - to[e]->y;
+                    double ey = to[e]->x - from[e]->x;
+                    weights[e] = ex * (px - from[e]->x) + ey * (py - from[e]->y);
+                    inside = inside && weights[e] >= 0.0;
+                    nearEdge = nearEdge || std::abs(weights[e]) < 1e-3 * std::hypot(ex, ey);
+                }
+                size_t pixel = (size_t) y * kOcclusionWidth + x;
+                if (nearEdge) {
+                    ambiguous[pixel] = 1;
+                }
+                if (inside) {
+                    double z = (weights[0] * v0.z + weights[1] * v1.z + weights[2] * v2.z) / area;
+                    depth[pixel] = std::max(depth[pixel], z);
+                }
+            }
+        }
+    }
+}
+
+static void testMatchesReference() {
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> spread(-1.5f, 1.5f);
+    std::uniform_real_distribution<float> distance(1.0f, 40.0f);
+    Mat4f projection = makePerspective(2.0f, 0.1f, 100.0f);
+
+    OccluderGeometry geometry;
+    std::vector<glm::dvec3> screen;
+    for (int triangle = 0; triangle < 60; ++triangle) {
+        for (int corner = 0; corner < 3; ++corner) {
+            // every triangle in front of the near plane, some reach beyond the screen
+            float z = distance(random);
+            glm::vec3 position(spread(random) * z * 2.0f, spread(random) * z, z);
+            geometry.indices.push_back((uint16_t) geometry.positions.size());
+            geometry.positions.push_back(position);
+            glm::vec4 clip = projection * glm::vec4(position, 1.0f);
+            double inverseW = 1.0 / clip.w;
+            screen.emplace_back((clip.x * inverseW * 0.5 + 0.5) * kOcclusionWidth,
+                                (clip.y * inverseW * 0.5 + 0.5) * kOcclusionHeight, inverseW);
+        }
+    }
+    OcclusionCuller culler;
+    culler.rasterize({{&geometry, projection}});
+
+    std::vector<double> depth((size_t) kOcclusionWidth * kOcclusionHeight, 0.0);
+    std::vector<uint8_t> ambiguous(depth.size(), 0);
+    rasterizeReference(screen, depth, ambiguous);
+    int mismatches = 0;
+    int covered = 0;
+    for (int y = 0; y < kOcclusionHeight; ++y) {
+        for (int x = 0; x < kOcclusionWidth; ++x) {
+            size_t pixel = (size_t) y * kOcclusionWidth + x;
+            double expected = depth[pixel];
+            covered += expected > 0.0;
+            double actual = culler.getDepth(0, x, y);
+            if (!ambiguous[pixel] && std::abs(actual - expected) > 1e-5 * std::max(expected, 1.0)) {
+                if (mismatches++ < 10) {
+                    fprintf(stderr, "pixel %d, %d is %g instead of %g\n", x, y, actual, expected);
+                }
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+    // the triangles cover a good part of the screen, or the comparison proves little
+    CHECK(covered > kOcclusionWidth * kOcclusionHeight / 4);
+
+    // every pyramid texel holds the farthest depth of the texels below it
+    for (int level = 1; level < culler.getLevelCount(); ++level) {
+        int width = culler.getLevelWidth(level - 1);
+        int height = culler.getLevelHeight(level - 1);
+        for (int y = 0; y < culler.getLevelHeight(level); ++y) {
+            for (int x = 0; x < culler.getLevelWidth(level); ++x) {
+                float farthest = INFINITY;
+                for (int sy = y * 2; sy <= std::min(y * 2 + 1, height - 1); ++sy) {
+                    for (int sx = x * 2; sx <= std::min(x * 2 + 1, width - 1); ++sx) {
+                        farthest = std::min(farthest, culler.getDepth(level - 1, sx, sy));
+                    }
+                }
+                CHECK(culler.getDepth(level, x, y) == farthest);
+            }
+        }
+    }
+    CHECK(culler.getLevelWidth(culler.getLevelCount() - 1) == 1);
+}
+
+int main() {
+    testWallAndFloor();
+    testNothingHidesWithoutOccluders();
+    testMatchesReference();
+    return checkResult();
+}
@@ -0,0 +1,183 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "gpu/StreamingBuffer.h"
+#include <cstring>
+
+static constexpr size_t kFrameCapacity = 256;
+static constexpr size_t kAlignment = 64;
+
+struct Ring {
+    HostStreamingBufferBackend *backend;
+    StreamingBuffer buffer;
+
+    Ring() : Ring(std::make_unique<HostStreamingBufferBackend>()) {}
+
+    explicit Ring(std::unique_ptr<HostStreamingBufferBackend> host)
+            : backend(host.get()), buffer(std::move(host), kFrameCapacity, kAlignment) {}
+};
+
+static bool holds(const HostStreamingBufferBackend &backend, size_t offset, const void *data,
+                  size_t size) {
+    return offset + size <= backend.getStorage().size()
+           && memcmp(backend.getStorage().data() + offset, data, size) == 0;
+}
+
+static void testAlignedPushes() {
+    Ring ring;
+    CHECK(ring.backend->getStorage().size() == kFrameCapacity * kStreamingFrames);
+
+    ring.buffer.beginFrame();
+    size_t region = ring.buffer.getRegion();
+    const char first[] = "first";
+    const char second[] = "second";
+    size_t firstOffset = ring.buffer.push(first, sizeof(first));
+    size_t secondOffset = ring.buffer.push(second, sizeof(second));
+    CHECK(firstOffset == region * kFrameCapacity);
+    CHECK(secondOffset == region * kFrameCapacity + kAlignment);
+    CHECK(ring.buffer.getUsed() == kAlignment + sizeof(second));
+    CHECK(holds(*ring.backend, firstOffset, first, sizeof(first)));
+    CHECK(holds(*ring.backend, secondOffset, second, sizeof(second)));
+    ring.buffer.endFrame();
+
+    // an odd capacity is rounded up so every region starts aligned
+    StreamingBuffer odd(std::make_unique<HostStreamingBufferBackend>(), 100, kAlignment);
+    CHECK(odd.getFrameCapacity() == 128);
+}
+
+static void testWrapAround() {
+    Ring ring;
+    // the ring cycles through the regions, a region is waited for once it comes around again
+    int regions[2 * kStreamingFrames + 1];
+    for (int frame = 0; frame < 2 * kStreamingFrames + 1; ++frame) {
+        ring.buffer.beginFrame();
+        regions[frame] = ring.buffer.getRegion();
+        CHECK(ring.buffer.getUsed() == 0);
+        int waits = std::max(0, frame + 1 - kStreamingFrames);
+        CHECK(ring.backend->getFenceWaits() == waits);
+        uint32_t value = frame;
+        size_t offset = ring.buffer.push(&value, sizeof(value));
+        CHECK(offset == (size_t) regions[frame] * kFrameCapacity);
+        ring.buffer.endFrame();
+        CHECK(ring.backend->getFenceInserts() == frame + 1);
+    }
+    for (int frame = kStreamingFrames; frame < 2 * kStreamingFrames + 1; ++frame) {
+        CHECK(regions[frame] == regions[frame - kStreamingFrames]);
+        CHECK(regions[frame] != regions[frame - 1]);
+    }
+
+    // the data of the frames still in flight was not overwritten
+    for (int frame = kStreamingFrames + 1; frame < 2 * kStreamingFrames + 1; ++frame) {
+        uint32_t value = frame;
+        CHECK(holds(*ring.backend, regions[frame] * kFrameCapacity, &value, sizeof(value)));
+    }
+}
+
+static void testGrowth() {
+    Ring ring;
+    for (int frame = 0; frame < kStreamingFrames; ++frame) {
+        ring.buffer.beginFrame();
+        ring.buffer.endFrame();
+    }
+
+    // a frame that doesn't fit reallocates the ring and starts over in the new storage
+    ring.buffer.beginFrame();
+    int waits = ring.backend->getFenceWaits();
+    std::vector<uint8_t> big(kFrameCapacity + 1, 7);
+    size_t offset = ring.buffer.push(big.data(), big.size());
+    CHECK(ring.buffer.getFrameCapacity() == 2 * kFrameCapacity);
+    CHECK(ring.backend->getStorage().size() == 2 * kFrameCapacity * kStreamingFrames);
+    CHECK(offset == ring.buffer.getRegion() * ring.buffer.getFrameCapacity());
+    CHECK(holds(*ring.backend, offset, big.data(), big.size()));
+    ring.buffer.endFrame();
+
+    // the new storage was never read by the GPU, only the frame that grew it has to be waited for
+    for (int frame = 1; frame < kStreamingFrames; ++frame) {
+        ring.buffer.beginFrame();
+        ring.buffer.endFrame();
+    }
+    CHECK(ring.backend->getFenceWaits() == waits);
+    ring.buffer.beginFrame();
+    CHECK(ring.backend->getFenceWaits() == waits + 1);
+    ring.buffer.endFrame();
+
+    // reserving grows before the first push, so no range of the frame is lost
+    ring.buffer.beginFrame();
+    ring.buffer.reserve(5 * kFrameCapacity);
+    CHECK(ring.buffer.getFrameCapacity() == 8 * kFrameCapacity);
+    uint32_t value = 42;
+    offset = ring.buffer.push(&value, sizeof(value));
+    CHECK(offset == ring.buffer.getRegion() * ring.buffer.getFrameCapacity());
+    ring.buffer.endFrame();
+}
+
+static void testZeroCapacity() {
+    // an empty ring still has room for one aligned push and grows from there
+    auto host = std::make_unique<HostStreamingBufferBackend>();
+    HostStreamingBufferBackend *backend = host.get();
+    StreamingBuffer buffer(std::move(host), 0, kAlignment);
+    CHECK(buffer.getFrameCapacity() == kAlignment);
+    CHECK(backend->getStorage().size() == kAlignment * kStreamingFrames);
+
+    buffer.beginFrame();
+    std::vector<uint8_t> data(3 * kAlignment, 9);
+    size_t offset = buffer.push(data.data(), data.size());
+    CHECK(buffer.getFrameCapacity() == 4 * kAlignment);
+    CHECK(holds(*backend, offset, data.data(), data.size()));
+    buffer.endFrame();
+
+    // without an alignment the unit is a single byte
+    StreamingBuffer unaligned(std::make_unique<HostStreamingBufferBackend>(), 0, 0);
+    CHECK(unaligned.getFrameCapacity() == 1);
+    unaligned.beginFrame();
+    unaligned.reserve(5);
+    CHECK(unaligned.getFrameCapacity() == 8);
+    unaligned.endFrame();
+}
+
+static void testRestore() {
+    Ring ring;
+    for (int frame = 0; frame < kStreamingFrames; ++frame) {
+        ring.buffer.beginFrame();
+        ring.buffer.endFrame();
+    }
+    // the fences of a lost context are dropped, nothing is waited for afterwards
+    ring.buffer.restore();
+    int waits = ring.backend->getFenceWaits();
+    for (int frame = 0; frame < kStreamingFrames; ++frame) {
+        ring.buffer.beginFrame();
+        ring.buffer.endFrame();
+    }
+    CHECK(ring.backend->getFenceWaits() == waits);
+    CHECK(ring.backend->getStorage().size() == kFrameCapacity * kStreamingFrames);
+}
+
+static void testResourceBytes() {
+    // orphaning keeps the handle, only the recorded size changes. The names are made up, the
+    // context is dropped before the handle goes so nothing is deleted.
+    GpuResourceRegistry &registry = GpuResourceRegistry::instance();
+    {
+        GpuResource buffer(GpuResourceType::BUFFER, 7, 100);
+        CHECK(registry.getTotalBytes(GpuResourceType::BUFFER) == 100);
+        buffer.setBytes(300);
+        CHECK(registry.getTotalBytes(GpuResourceType::BUFFER) == 300);
+        CHECK(registry.getResourceCount() == 1);
+        registry.contextLost();
+        // a stale handle leaves the registry alone
+        buffer.setBytes(500);
+        CHECK(registry.getTotalBytes(GpuResourceType::BUFFER) == 0);
+    }
+    CHECK(registry.getResourceCount() == 0);
+}
+
+int main() {
+    testAlignedPushes();
+    testWrapAround();
+    testGrowth();
+    testZeroCapacity();
+    testRestore();
+    testResourceBytes();
+    return checkResult();
+}
@@ -0,0 +1,156 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "core/JobSystem.h"
+#include "transform/TransformHierarchy.h"
+#include "glm/glm.hpp"
+#include <cstring>
+#include <random>
+
+static std::mt19937 random_(5);
+
+static float randomFloat(float low, float high) {
+    return std::uniform_real_distribution<float>(low, high)(random_);
+}
+
+/*!
+ * @param scaled false keeps the scale at one, so long chains neither blow up nor vanish
+ */
+static Mat4f randomTransform(bool scaled = true) {
+    Quaternion rotation(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f),
+                        randomFloat(-1.0f, 1.0f), randomFloat(0.5f, 1.0f));
+    rotation.Normalize();
+    Mat4f matrix;
+    matrix.initTransform(glm::vec3(randomFloat(-2.0f, 2.0f), randomFloat(-2.0f, 2.0f),
+                                   randomFloat(-2.0f, 2.0f)), rotation,
+                         glm::vec3(scaled ? randomFloat(0.5f, 1.5f) : 1.0f));
+    return matrix;
+}
+
+static float distance(const glm::vec4 &a, const glm::vec4 &b) {
+    return glm::length(a - b);
+}
+
+static void testMovedNodesReachTheirPose() {
+    // root - arm - hand, and a leg next to the arm
+    TransformHierarchy hierarchy;
+    int root = hierarchy.addNode("root", TransformHierarchy::kNoParent, randomTransform());
+    int arm = hierarchy.addNode("arm", root, randomTransform());
+    int hand = hierarchy.addNode("hand", arm, randomTransform());
+    int leg = hierarchy.addNode("leg", root, randomTransform());
+    hierarchy.captureRestPose();
+    uint32_t version = hierarchy.getRestVersion();
+    for (int node = 0; node < (int) hierarchy.size(); ++node) {
+        CHECK(hierarchy.isAtRest(node));
+    }
+    CHECK(hierarchy.getSubtreeEnd(root) == 4);
+    CHECK(hierarchy.getSubtreeEnd(arm) == 3);
+    CHECK(hierarchy.find("hand") == hand);
+
+    // the vertices are baked with the rest world matrices
+    glm::vec4 local(0.3f, -0.7f, 1.1f, 1.0f);
+    glm::vec4 bakedHand = hierarchy.getWorldMatrix(hand) * local;
+    glm::vec4 bakedLeg = hierarchy.getWorldMatrix(leg) * local;
+
+    hierarchy.setLocalMatrix(arm, randomTransform());
+    CHECK(hierarchy.update());
+    CHECK(!hierarchy.update());
+    CHECK(hierarchy.isAtRest(root));
+    CHECK(!hierarchy.isAtRest(arm));
+    CHECK(!hierarchy.isAtRest(hand));
+    CHECK(hierarchy.isAtRest(leg));
+    CHECK(hierarchy.getRestVersion() == version + 2);
+
+    // the rest delta moves the baked vertex to where the node is now, in model and in clip space
+    glm::vec4 expected = hierarchy.getWorldMatrix(hand) * local;
+    CHECK(distance(hierarchy.getRestDelta(hand) * bakedHand, expected) < 1e-4f);
+    Mat4f projection = randomTransform();
+    CHECK(distance((projection * hierarchy.getRestDelta(hand)) * bakedHand,
+                   projection * expected) < 1e-4f);
+    CHECK(distance(hierarchy.getRestDelta(leg) * bakedLeg, bakedLeg) < 1e-5f);
+
+    // setting the same matrix again recomputes the subtree without changing its rest state
+    version = hierarchy.getRestVersion();
+    hierarchy.setLocalMatrix(root, hierarchy.getLocalMatrix(root));
+    CHECK(hierarchy.update());
+    CHECK(hierarchy.getRestVersion() == version);
+    CHECK(distance(hierarchy.getRestDelta(hand) * bakedHand, expected) < 1e-4f);
+}
+
+static void testReturnToRest() {
+    TransformHierarchy hierarchy;
+    Mat4f rest = randomTransform();
+    int root = hierarchy.addNode("root", TransformHierarchy::kNoParent, Mat4f());
+    int child = hierarchy.addNode("child", root, rest);
+    hierarchy.captureRestPose();
+    uint32_t version = hierarchy.getRestVersion();
+
+    hierarchy.setLocalMatrix(child, randomTransform());
+    hierarchy.update();
+    CHECK(!hierarchy.isAtRest(child));
+    hierarchy.setLocalMatrix(child, rest);
+    hierarchy.update();
+    CHECK(hierarchy.isAtRest(child));
+    CHECK(hierarchy.getRestVersion() == version + 2);
+}
+
+/*!
+ * Builds a wide, deep tree big enough to be split across the workers
+ */
+static void buildTree(TransformHierarchy &hierarchy, const std::vector<Mat4f> &locals) {
+    int root = hierarchy.addNode("root", TransformHierarchy::kNoParent, locals[0]);
+    size_t next = 1;
+    for (int branch = 0; branch < 8; ++branch) {
+        int parent = root;
+        for (int depth = 0; depth < 200; ++depth) {
+            parent = hierarchy.addNode("node", parent, locals[next++]);
+        }
+    }
+}
+
+static void testParallelUpdateMatchesSerial() {
+    std::vector<Mat4f> locals(1 + 8 * 200);
+    for (auto &local: locals) {
+        local = randomTransform(false);
+    }
+    TransformHierarchy serial;
+    TransformHierarchy parallel;
+    buildTree(serial, locals);
+    buildTree(parallel, locals);
+    serial.captureRestPose();
+    parallel.captureRestPose();
+
+    std::vector<std::pair<int, Mat4f>> moves;
+    for (int i = 0; i < 20; ++i) {
+        moves.emplace_back(1 + (int) (random_() % (locals.size() - 1)), randomTransform(false));
+    }
+    for (const auto &[node, local]: moves) {
+        serial.setLocalMatrix(node, local);
+        parallel.setLocalMatrix(node, local);
+    }
+    serial.update();
+    {
+        JobSystem jobs(4);
+        parallel.update();
+    }
+
+    bool same = true;
+    for (int node = 0; node < (int) serial.size(); ++node) {
+        same = same && memcmp(&serial.getWorldMatrix(node), &parallel.getWorldMatrix(node),
+                              sizeof(Mat4f)) == 0
+               && memcmp(&serial.getRestDelta(node), &parallel.getRestDelta(node),
+                         sizeof(Mat4f)) == 0
+               && serial.isAtRest(node) == parallel.isAtRest(node);
+    }
+    CHECK(same);
+    CHECK(serial.getRestVersion() == parallel.getRestVersion());
+}
+
+int main() {
+    testMovedNodesReachTheirPose();
+    testReturnToRest();
+    testParallelUpdateMatchesSerial();
+    return checkResult();
+}
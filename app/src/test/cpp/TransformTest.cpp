@@ -0,0 +1,136 @@
+//
+// Created by Dark Matter on 7/1/24.
+//
+
+#include "Check.h"
+#include "transform/Transform.h"
+#include "glm/glm.hpp"
+
+static float maxDifference(const Mat4f &a, const Mat4f &b) {
+    float difference = 0.0f;
+    for (int row = 0; row < 4; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            difference = std::max(difference, std::abs(a.m[row][column] - b.m[row][column]));
+        }
+    }
+    return difference;
+}
+
+static Mat4f eulerMatrix(float x, float y, float z) {
+    Mat4f rotation;
+    rotation.initRotationMatrix(x, y, z);
+    return rotation;
+}
+
+static void testEulerMatchesRotationMatrix() {
+    // the quaternion has to turn like the matrices Transform built before, with every axis order
+    // and sign mistake showing up somewhere in the sweep
+    float worst = 0.0f;
+    for (float x = -180.0f; x <= 180.0f; x += 22.5f) {
+        for (float y = -180.0f; y <= 180.0f; y += 22.5f) {
+            for (float z = -180.0f; z <= 180.0f; z += 22.5f) {
+                Mat4f rotation;
+                rotation.initTransform(glm::vec3(0.0f), Quaternion::fromEuler(x, y, z),
+                                       glm::vec3(1.0f));
+                worst = std::max(worst, maxDifference(rotation, eulerMatrix(x, y, z)));
+            }
+        }
+    }
+    CHECK(worst < 1e-5f);
+}
+
+/*!
+ * What Transform::matrix() should be, built from the plain matrices
+ */
+struct Expected {
+    glm::vec3 position{0.0f};
+    Mat4f rotation;
+    glm::vec3 scale{1.0f};
+
+    Mat4f matrix() const {
+        Mat4f translation;
+        translation.initTranslation(position.x, position.y, position.z);
+        Mat4f scaling;
+        scaling.initScaleMatrix(scale.x, scale.y, scale.z);
+        return translation * rotation * scaling;
+    }
+};
+
+/*!
+ * Asks for both cached matrices, then checks them against @a expected. Called after every setter,
+ * so a setter that doesn't mark the cache dirty leaves a stale matrix behind.
+ */
+static bool matches(const Transform &transform, const Expected &expected) {
+    Mat4f reference = expected.matrix();
+    const Mat4f &matrix = transform.matrix();
+    Mat4f product = transform.inverseMatrix() * matrix;
+    return maxDifference(matrix, reference) < 1e-4f && maxDifference(product, Mat4f()) < 1e-4f;
+}
+
+static void testSettersRebuildTheMatrices() {
+    Transform transform;
+    Expected expected;
+    CHECK(matches(transform, expected));
+
+    transform.setPosition(1.0f, -2.0f, 3.0f);
+    expected.position = glm::vec3(1.0f, -2.0f, 3.0f);
+    CHECK(matches(transform, expected));
+
+    transform.setPosition(glm::vec3(-4.0f, 0.5f, 2.0f));
+    expected.position = glm::vec3(-4.0f, 0.5f, 2.0f);
+    CHECK(matches(transform, expected));
+
+    transform.translate(glm::vec3(0.25f, 1.0f, -1.0f));
+    expected.position += glm::vec3(0.25f, 1.0f, -1.0f);
+    CHECK(matches(transform, expected));
+
+    transform.setYPosition(7.0f);
+    expected.position.y = 7.0f;
+    CHECK(matches(transform, expected));
+    CHECK(transform.getPositionY() == 7.0f);
+
+    transform.setRotation(30.0f, -45.0f, 60.0f);
+    expected.rotation = eulerMatrix(30.0f, -45.0f, 60.0f);
+    CHECK(matches(transform, expected));
+
+    // rotations add up around the local axes
+    for (int step = 0; step < 8; ++step) {
+        transform.rotate(5.0f, 10.0f, -15.0f);
+        expected.rotation = expected.rotation * eulerMatrix(5.0f, 10.0f, -15.0f);
+        CHECK(matches(transform, expected));
+    }
+
+    transform.setScale(2.0f, 0.5f, 1.5f);
+    expected.scale = glm::vec3(2.0f, 0.5f, 1.5f);
+    CHECK(matches(transform, expected));
+
+    // an unnormalized quaternion is normalized
+    transform.setRotation(Quaternion(0.0f, 2.0f, 0.0f, 2.0f));
+    expected.rotation = eulerMatrix(0.0f, -90.0f, 0.0f);
+    CHECK(matches(transform, expected));
+    CHECK(std::abs(transform.getRotation().w - std::sqrt(0.5f)) < 1e-6f);
+
+    // a copy keeps its own cache
+    Transform copy = transform;
+    copy.setPosition(0.0f, 0.0f, 0.0f);
+    CHECK(matches(transform, expected));
+}
+
+static void testWorldToLocalInvertsTheMatrix() {
+    Transform transform;
+    transform.setPosition(3.0f, -1.0f, 2.0f);
+    transform.setRotation(20.0f, 75.0f, -40.0f);
+    transform.setScale(1.5f, 2.0f, 0.5f);
+    for (int i = 0; i < 10; ++i) {
+        glm::vec3 local((float) i, 1.0f - (float) i * 0.5f, (float) (i * i) * 0.1f);
+        glm::vec3 world(transform.matrix() * glm::vec4(local, 1.0f));
+        CHECK(glm::length(transform.worldToLocal(world) - local) < 1e-4f);
+    }
+}
+
+int main() {
+    testEulerMatchesRotationMatrix();
+    testSettersRebuildTheMatrices();
+    testWorldToLocalInvertsTheMatrix();
+    return checkResult();
+}